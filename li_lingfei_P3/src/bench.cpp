@@ -0,0 +1,2183 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Micro benchmarks for BadgerDB components. Build with "make bench", which
+ * compiles everything with optimization, and run as
+ *     ./badgerdb_bench <benchmark>
+ * Run without arguments to list the available benchmarks.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "betree.h"
+#include "btree.h"
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "file.h"
+#include "filescan.h"
+#include "hashindex.h"
+#include "lsmtree.h"
+#include "btreeNode.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(const Clock::time_point& start)
+{
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+void removeIfExists(const std::string& name)
+{
+	try
+	{
+		File::remove(name);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// hashtbl: open addressing BufHashTbl vs. the original chained table
+// -----------------------------------------------------------------------------
+
+/**
+ * The chained hash table BufHashTbl used before it moved to open addressing,
+ * kept here only as the baseline for the hashtbl benchmark.
+ */
+class ChainedBufHashTbl
+{
+ private:
+	struct Bucket {
+		File* file;
+		PageId pageNo;
+		FrameId frameNo;
+		Bucket* next;
+	};
+
+	int HTSIZE;
+	Bucket** ht;
+
+	int hash(const File* file, const PageId pageNo)
+	{
+		int tmp, value;
+		tmp = (long)file;
+		value = (tmp + pageNo) % HTSIZE;
+		return value;
+	}
+
+ public:
+	ChainedBufHashTbl(const int htSize)
+		: HTSIZE(htSize)
+	{
+		ht = new Bucket* [htSize];
+		for(int i = 0; i < HTSIZE; i++)
+			ht[i] = NULL;
+	}
+
+	~ChainedBufHashTbl()
+	{
+		for(int i = 0; i < HTSIZE; i++) {
+			while (ht[i]) {
+				Bucket* tmpBuf = ht[i];
+				ht[i] = ht[i]->next;
+				delete tmpBuf;
+			}
+		}
+		delete [] ht;
+	}
+
+	void insert(const File* file, const PageId pageNo, const FrameId frameNo)
+	{
+		int index = hash(file, pageNo);
+		Bucket* tmpBuc = ht[index];
+		while (tmpBuc) {
+			if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+				throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
+			tmpBuc = tmpBuc->next;
+		}
+		tmpBuc = new Bucket;
+		tmpBuc->file = (File*) file;
+		tmpBuc->pageNo = pageNo;
+		tmpBuc->frameNo = frameNo;
+		tmpBuc->next = ht[index];
+		ht[index] = tmpBuc;
+	}
+
+	void lookup(const File* file, const PageId pageNo, FrameId &frameNo)
+	{
+		int index = hash(file, pageNo);
+		Bucket* tmpBuc = ht[index];
+		while (tmpBuc) {
+			if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
+				frameNo = tmpBuc->frameNo;
+				return;
+			}
+			tmpBuc = tmpBuc->next;
+		}
+		throw HashNotFoundException(file->filename(), pageNo);
+	}
+
+	// what BufMgr::readPage did with the chained table: catch the miss
+	bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo)
+	{
+		try
+		{
+			lookup(file, pageNo, frameNo);
+			return true;
+		}
+		catch(HashNotFoundException e)
+		{
+			return false;
+		}
+	}
+
+	void remove(const File* file, const PageId pageNo)
+	{
+		int index = hash(file, pageNo);
+		Bucket* tmpBuc = ht[index];
+		Bucket* prevBuc = NULL;
+		while (tmpBuc) {
+			if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
+				if(prevBuc)
+					prevBuc->next = tmpBuc->next;
+				else
+					ht[index] = tmpBuc->next;
+				delete tmpBuc;
+				return;
+			}
+			prevBuc = tmpBuc;
+			tmpBuc = tmpBuc->next;
+		}
+		throw HashNotFoundException(file->filename(), pageNo);
+	}
+};
+
+struct HashKey {
+	File* file;
+	PageId pageNo;
+};
+
+struct HashResult {
+	double hitNs;
+	double missNs;
+	double churnNs;
+};
+
+/**
+ * Runs the workload the buffer manager puts on its hash table against one
+ * table: fill it with one entry per frame, probe resident pages, probe cold
+ * pages, then replace entries as page replacement would.
+ */
+template<class Table>
+HashResult runHashWorkload(const std::vector<HashKey>& resident, const std::vector<HashKey>& cold,
+		const std::vector<std::uint32_t>& probes)
+{
+	const std::uint32_t frames = resident.size();
+	Table table(((((int) (frames * 1.2))*2)/2)+1);
+	for (std::uint32_t i = 0; i < frames; i++)
+		table.insert(resident[i].file, resident[i].pageNo, i);
+
+	HashResult result;
+	FrameId frameNo = 0;
+	std::uint64_t checksum = 0;
+
+	Clock::time_point start = Clock::now();
+	for (std::size_t i = 0; i < probes.size(); i++) {
+		const HashKey& key = resident[probes[i] % frames];
+		if (table.tryLookup(key.file, key.pageNo, frameNo))
+			checksum += frameNo;
+	}
+	result.hitNs = elapsedNs(start) / probes.size();
+
+	start = Clock::now();
+	for (std::size_t i = 0; i < probes.size(); i++) {
+		const HashKey& key = cold[probes[i] % cold.size()];
+		if (table.tryLookup(key.file, key.pageNo, frameNo))
+			checksum += frameNo;
+	}
+	result.missNs = elapsedNs(start) / probes.size();
+
+	// evict the page in a frame and load a cold page into it
+	start = Clock::now();
+	for (std::size_t i = 0; i < probes.size(); i++) {
+		const std::uint32_t frame = probes[i] % frames;
+		const HashKey& victim = resident[frame];
+		table.remove(victim.file, victim.pageNo);
+		const HashKey& incoming = cold[i % cold.size()];
+		table.insert(incoming.file, incoming.pageNo, frame);
+		table.remove(incoming.file, incoming.pageNo);
+		table.insert(victim.file, victim.pageNo, frame);
+	}
+	result.churnNs = elapsedNs(start) / (2 * probes.size());
+
+	if (checksum == 42)
+		std::cout << "";
+	return result;
+}
+
+void benchHashTable()
+{
+	const int numFiles = 4;
+	std::vector<BlobFile*> files;
+	for (int i = 0; i < numFiles; i++) {
+		std::ostringstream name;
+		name << "bench.hashtbl." << i;
+		removeIfExists(name.str());
+		files.push_back(new BlobFile(name.str(), true));
+	}
+
+	std::cout << "hashtbl: ns per operation, chained (old) vs open addressing (new)\n";
+	std::printf("%10s %12s %12s %12s %12s %12s %12s\n", "frames",
+			"hit old", "hit new", "miss old", "miss new", "churn old", "churn new");
+
+	std::mt19937 rng(564);
+	for (std::uint32_t frames = 1000; frames <= 1000000; frames *= 10) {
+		// pages of a few files, resident pages interleaved with cold ones the
+		// way a scan of several relations leaves them
+		std::vector<HashKey> resident(frames), cold(frames);
+		for (std::uint32_t i = 0; i < frames; i++) {
+			resident[i].file = files[i % numFiles];
+			resident[i].pageNo = 2 * (i / numFiles) + 1;
+			cold[i].file = files[i % numFiles];
+			cold[i].pageNo = 2 * (i / numFiles) + 2;
+		}
+		const std::size_t numProbes = std::max<std::size_t>(frames, 200000);
+		std::vector<std::uint32_t> probes(numProbes);
+		for (std::size_t i = 0; i < numProbes; i++)
+			probes[i] = rng();
+
+		// the miss path of the chained table throws; keep its probe count sane
+		std::vector<std::uint32_t> oldProbes(probes.begin(), probes.begin() + std::min<std::size_t>(numProbes, 200000));
+		HashResult oldResult = runHashWorkload<ChainedBufHashTbl>(resident, cold, oldProbes);
+		HashResult newResult = runHashWorkload<BufHashTbl>(resident, cold, probes);
+
+		std::printf("%10u %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", frames,
+				oldResult.hitNs, newResult.hitNs, oldResult.missNs, newResult.missNs,
+				oldResult.churnNs, newResult.churnNs);
+	}
+
+	for (int i = 0; i < numFiles; i++) {
+		std::string name = files[i]->filename();
+		delete files[i];
+		File::remove(name);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// bufmgr: BufMgr throughput from 1 to N threads
+// -----------------------------------------------------------------------------
+
+/**
+ * Runs numThreads workers against one buffer pool, each doing readPage and
+ * unPinPage on random pages out of pages, and returns operations per second.
+ */
+double runPoolWorkload(BufMgr* pool, const std::vector<BlobFile*>& files, std::uint32_t pagesPerFile,
+		int numThreads, std::uint32_t opsPerThread)
+{
+	std::vector<std::thread> workers;
+	Clock::time_point start = Clock::now();
+	for (int t = 0; t < numThreads; t++)
+	{
+		workers.push_back(std::thread([&, t]() {
+			std::mt19937 rng(564 + t);
+			for (std::uint32_t op = 0; op < opsPerThread; op++)
+			{
+				const std::uint32_t r = rng();
+				File* file = files[r % files.size()];
+				const PageId pageNo = (r / files.size()) % pagesPerFile + 1;
+				Page* page;
+				pool->readPage(file, pageNo, page);
+				pool->unPinPage(file, pageNo, false);
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+		workers[t].join();
+	return numThreads * (double) opsPerThread / (elapsedNs(start) / 1e9);
+}
+
+void benchBufMgr(int maxThreads)
+{
+	const int numFiles = 4;
+	const std::uint32_t numFrames = 4096;
+	const std::uint32_t opsPerThread = 200000;
+
+	std::vector<BlobFile*> files;
+	const std::uint32_t pagesPerFile = numFrames;	// 4x the pool in total
+	for (int i = 0; i < numFiles; i++)
+	{
+		std::ostringstream name;
+		name << "bench.bufmgr." << i;
+		removeIfExists(name.str());
+		files.push_back(new BlobFile(name.str(), true));
+		for (std::uint32_t p = 0; p < pagesPerFile; p++)
+		{
+			PageId pageNo;
+			files[i]->allocatePage(pageNo);
+		}
+	}
+
+	if (maxThreads <= 0)
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::cout << "bufmgr: readPage+unPinPage throughput, " << numFrames << " frames\n";
+	std::printf("%8s %16s %10s %16s %10s\n", "threads", "hits ops/s", "speedup", "misses ops/s", "speedup");
+
+	double baseHit = 0, baseMiss = 0;
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		// hits: a working set of half the pool, loaded before timing
+		BufMgr* hitPool = new BufMgr(numFrames);
+		runPoolWorkload(hitPool, files, numFrames / 2 / numFiles, 1, numFrames * 4);
+		const double hit = runPoolWorkload(hitPool, files, numFrames / 2 / numFiles, threads, opsPerThread);
+		delete hitPool;
+
+		// misses: uniform over four times the pool, most reads go to disk
+		BufMgr* missPool = new BufMgr(numFrames);
+		const double miss = runPoolWorkload(missPool, files, pagesPerFile, threads, opsPerThread / 10);
+		delete missPool;
+
+		if (threads == 1)
+		{
+			baseHit = hit;
+			baseMiss = miss;
+		}
+		std::printf("%8d %16.0f %9.2fx %16.0f %9.2fx\n", threads, hit, hit / baseHit, miss, miss / baseMiss);
+		if (threads < maxThreads && threads * 2 > maxThreads)
+			threads = maxThreads / 2;
+	}
+
+	for (int i = 0; i < numFiles; i++)
+	{
+		std::string name = files[i]->filename();
+		delete files[i];
+		File::remove(name);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// policy: replacement policy hit ratios on the test1/2/3 workloads
+// -----------------------------------------------------------------------------
+
+/**
+ * Tuple layout of the relations in main.cpp.
+ */
+struct BenchTuple {
+	int i;
+	double d;
+	char s[64];
+};
+
+const std::string benchRelationName = "bench.relA";
+
+/**
+ * Creates the relation of main.cpp's test1 (forward), test2 (backward) or
+ * test3 (random order) with keys 0 to size - 1.
+ */
+void createBenchRelation(const int test, const int size)
+{
+	removeIfExists(benchRelationName);
+	PageFile relation = PageFile::create(benchRelationName);
+
+	std::vector<int> keys(size);
+	for (int i = 0; i < size; i++)
+		keys[i] = (test == 2) ? size - 1 - i : i;
+	if (test == 3)
+	{
+		// the same shuffle as createRelationRandom, from random()'s default seed
+		std::vector<int> remaining(keys);
+		srandom(1);
+		for (int i = 0; i < size; i++)
+		{
+			const long pos = random() % (size - i);
+			keys[i] = remaining[pos];
+			std::swap(remaining[size - 1 - i], remaining[pos]);
+		}
+	}
+
+	BenchTuple tuple;
+	memset(tuple.s, ' ', sizeof(tuple.s));
+	PageId pageNo;
+	Page page = relation.allocatePage(pageNo);
+	for (int i = 0; i < size; i++)
+	{
+		sprintf(tuple.s, "%05d string record", keys[i]);
+		tuple.i = keys[i];
+		tuple.d = keys[i];
+		const std::string data(reinterpret_cast<char*>(&tuple), sizeof(tuple));
+		while (1)
+		{
+			try
+			{
+				page.insertRecord(data);
+				break;
+			}
+			catch(InsufficientSpaceException e)
+			{
+				relation.writePage(pageNo, page);
+				page = relation.allocatePage(pageNo);
+			}
+		}
+	}
+	relation.writePage(pageNo, page);
+}
+
+/**
+ * What intTests, doubleTests or stringTests do to the pool: build an index
+ * on one attribute from the relation, run the seven range scans and fetch
+ * every match from the relation, then delete every key.
+ */
+void runIndexWorkload(BufMgr* pool, PageFile* relation, const Datatype type, const int size)
+{
+	const int offsets[] = {offsetof(BenchTuple, i), offsetof(BenchTuple, d), offsetof(BenchTuple, s)};
+	std::string indexName;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsets[type], type);
+
+		const int lows[] = {25, 20, -3, 996, 0, 300, 3000};
+		const int highs[] = {40, 35, 3, 1001, 1, 400, 4000};
+		const Operator lowOps[] = {GT, GTE, GT, GT, GT, GT, GTE};
+		const Operator highOps[] = {LT, LTE, LT, LT, LT, LT, LT};
+		for (int q = 0; q < 7; q++)
+		{
+			int lowInt = lows[q], highInt = highs[q];
+			double lowDouble = lows[q], highDouble = highs[q];
+			char lowStr[32], highStr[32];
+			sprintf(lowStr, "%05d string record", lows[q]);
+			sprintf(highStr, "%05d string record", highs[q]);
+			const void* low = (type == INTEGER) ? (void*) &lowInt : (type == DOUBLE) ? (void*) &lowDouble : (void*) lowStr;
+			const void* high = (type == INTEGER) ? (void*) &highInt : (type == DOUBLE) ? (void*) &highDouble : (void*) highStr;
+			try
+			{
+				index.startScan(low, lowOps[q], high, highOps[q]);
+			}
+			catch(NoSuchKeyFoundException e)
+			{
+				continue;
+			}
+			try
+			{
+				while (1)
+				{
+					RecordId rid;
+					index.scanNext(rid);
+					Page* page;
+					pool->readPage(relation, rid.page_number, page);
+					pool->unPinPage(relation, rid.page_number, false);
+				}
+			}
+			catch(IndexScanCompletedException e)
+			{
+			}
+			index.endScan();
+		}
+
+		for (int i = 0; i < size; i++)
+		{
+			int keyInt = i;
+			double keyDouble = i;
+			char keyStr[32];
+			sprintf(keyStr, "%05d string record", i);
+			index.deleteEntry((type == INTEGER) ? (void*) &keyInt : (type == DOUBLE) ? (void*) &keyDouble : (void*) keyStr);
+		}
+	}
+	File::remove(indexName);
+}
+
+void benchPolicies()
+{
+	const int relationSize = 5000;
+	const ReplacementPolicyType policies[] = {CLOCK, LRU_K, TWO_Q, ARC};
+	const std::uint32_t poolSizes[] = {8, 16, 32, 64};
+
+	std::cout << "policy: buffer hit ratio on the test1/2/3 workloads (int, double and string index)\n";
+	std::printf("%6s %7s", "test", "frames");
+	for (int p = 0; p < 4; p++)
+	{
+		BufMgr probe(1, policies[p]);
+		std::printf(" %8s", probe.policyName());
+	}
+	std::printf("\n");
+
+	// BTreeIndex reports scans on std::cout; keep the table readable
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+
+	for (int test = 1; test <= 3; test++)
+	{
+		createBenchRelation(test, relationSize);
+		for (int s = 0; s < 4; s++)
+		{
+			std::printf("%6d %7u", test, poolSizes[s]);
+			for (int p = 0; p < 4; p++)
+			{
+				BufMgr* pool = new BufMgr(poolSizes[s], policies[p]);
+				PageFile* relation = new PageFile(benchRelationName, false);
+				runIndexWorkload(pool, relation, INTEGER, relationSize);
+				runIndexWorkload(pool, relation, DOUBLE, relationSize);
+				runIndexWorkload(pool, relation, STRING, relationSize);
+				const BufStats stats = pool->getBufStats();
+				std::printf(" %7.2f%%", 100.0 * (stats.accesses - stats.diskreads) / stats.accesses);
+				std::fflush(stdout);
+				pool->flushFile(relation);
+				delete relation;
+				delete pool;
+				discard.str("");
+			}
+			std::printf("\n");
+		}
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// scan: hot set hit ratio around sequential scans, with and without a ring
+// -----------------------------------------------------------------------------
+
+/**
+ * Interleaves reads of a hot set of pages with full FileScans of the bench
+ * relation and returns the percentage of hot set reads that hit the pool.
+ */
+double runScanWorkload(const std::uint32_t numFrames, const int numHot, const std::uint32_t ringSize)
+{
+	const std::string hotName = "bench.scan.hot";
+	removeIfExists(hotName);
+	BufMgr* pool = new BufMgr(numFrames);
+	BlobFile* hotFile = new BlobFile(hotName, true);
+	std::vector<PageId> hotPages(numHot);
+	for (int i = 0; i < numHot; i++)
+	{
+		Page* page;
+		pool->allocPage(hotFile, hotPages[i], page);
+		pool->unPinPage(hotFile, hotPages[i], true);
+	}
+
+	int hotAccesses = 0, hotMisses = 0;
+	for (int round = 0; round < 10; round++)
+	{
+		const int readsBefore = pool->getBufStats().diskreads;
+		for (int i = 0; i < numHot; i++)
+		{
+			Page* page;
+			pool->readPage(hotFile, hotPages[i], page);
+			pool->unPinPage(hotFile, hotPages[i], false);
+		}
+		hotAccesses += numHot;
+		hotMisses += pool->getBufStats().diskreads - readsBefore;
+
+		FileScan fscan(benchRelationName, pool, ringSize);
+		try
+		{
+			RecordId rid;
+			while (1)
+				fscan.scanNext(rid);
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+
+	pool->flushFile(hotFile);
+	delete pool;
+	delete hotFile;
+	File::remove(hotName);
+	return 100.0 * (hotAccesses - hotMisses) / hotAccesses;
+}
+
+void benchScan()
+{
+	const std::uint32_t numFrames = 64;
+	const int numHot = 32;
+	const int relationSizes[] = {1000, 5000, 20000};
+	const std::uint32_t ringSizes[] = {0, 4, BufAccessStrategy::DEFAULT_RING_SIZE};
+
+	std::cout << "scan: hit ratio of " << numHot << " hot pages read between full scans, "
+		<< numFrames << " frames\n";
+	std::printf("%8s %8s", "tuples", "pages");
+	for (int r = 0; r < 3; r++)
+	{
+		if (ringSizes[r] == 0)
+			std::printf(" %10s", "no ring");
+		else
+			std::printf("   ring %3u", ringSizes[r]);
+	}
+	std::printf("\n");
+
+	for (int s = 0; s < 3; s++)
+	{
+		createBenchRelation(1, relationSizes[s]);
+		std::uint32_t pages = 0;
+		{
+			PageFile relation(benchRelationName, false);
+			for (FileIterator it = relation.begin(); it != relation.end(); ++it)
+				pages++;
+		}
+		std::printf("%8d %8u", relationSizes[s], pages);
+		for (int r = 0; r < 3; r++)
+		{
+			std::printf(" %9.2f%%", runScanWorkload(numFrames, numHot, ringSizes[r]));
+			std::fflush(stdout);
+		}
+		std::printf("\n");
+	}
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// prefetch: sequential and leaf chain scans with asynchronous read-ahead
+// -----------------------------------------------------------------------------
+
+/**
+ * Prints the time per scan and the prefetch counters of a pool.
+ */
+void printPrefetchRow(const std::uint32_t depth, const double nsPerScan, const BufStats& stats)
+{
+	std::printf("%8u %12.0f %10d %10d %10d\n", depth, nsPerScan / 1000,
+		stats.prefetchIssued.load(), stats.prefetchUseful.load(), stats.prefetchWasted.load());
+	std::fflush(stdout);
+}
+
+void benchPrefetch()
+{
+	const int relationSize = 50000;
+	const int rounds = 5;
+	const std::uint32_t depths[] = {0, 2, 8, 16};
+
+	createBenchRelation(1, relationSize);
+
+	std::cout << "prefetch: FileScan of " << relationSize << " tuples, 256 frames, default ring\n";
+	std::printf("%8s %12s %10s %10s %10s\n", "depth", "us/scan", "issued", "useful", "wasted");
+	for (int d = 0; d < 4; d++)
+	{
+		BufMgr* pool = new BufMgr(256);
+		const Clock::time_point start = Clock::now();
+		for (int round = 0; round < rounds; round++)
+		{
+			FileScan fscan(benchRelationName, pool, BufAccessStrategy::DEFAULT_RING_SIZE, depths[d]);
+			try
+			{
+				RecordId rid;
+				while (1)
+					fscan.scanNext(rid);
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+		printPrefetchRow(depths[d], elapsedNs(start) / rounds, pool->getBufStats());
+		delete pool;
+	}
+
+	std::cout << "prefetch: full range scan of an int index on " << relationSize << " tuples, 32 frames\n";
+	std::printf("%8s %12s %10s %10s %10s\n", "depth", "us/scan", "issued", "useful", "wasted");
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	for (int d = 0; d < 4; d++)
+	{
+		BufMgr* pool = new BufMgr(32);
+		std::string indexName;
+		{
+			BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+			index.setPrefetchDepth(depths[d]);
+			pool->clearBufStats();
+			int low = -1, high = relationSize;
+			const Clock::time_point start = Clock::now();
+			for (int round = 0; round < rounds; round++)
+			{
+				index.startScan(&low, GT, &high, LT);
+				try
+				{
+					RecordId rid;
+					while (1)
+						index.scanNext(rid);
+				}
+				catch(IndexScanCompletedException e)
+				{
+				}
+				index.endScan();
+				discard.str("");
+			}
+			const double ns = elapsedNs(start) / rounds;
+			std::cout.rdbuf(out);
+			printPrefetchRow(depths[d], ns, pool->getBufStats());
+			std::cout.rdbuf(discard.rdbuf());
+		}
+		File::remove(indexName);
+		delete pool;
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// cleaner: allocBuf latency during index builds, background writer off and on
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns the upper bound, in ns, of the histogram bucket holding the given
+ * fraction of allocBuf calls.
+ */
+double latencyPercentile(const BufStats& stats, const double fraction)
+{
+	long total = 0;
+	for (int i = 0; i < BufStats::LATENCY_BUCKETS; i++)
+		total += stats.allocLatency[i];
+	long seen = 0;
+	for (int i = 0; i < BufStats::LATENCY_BUCKETS; i++)
+	{
+		seen += stats.allocLatency[i];
+		if (seen >= fraction * total)
+			return (double) (2ULL << i);
+	}
+	return 0;
+}
+
+void benchCleaner()
+{
+	const int relationSize = 50000;
+	const std::uint32_t numFrames = 64;
+
+	createBenchRelation(3, relationSize);
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+
+	BufStats results[2];
+	double ms[2];
+	for (int on = 0; on < 2; on++)
+	{
+		BufMgr* pool = new BufMgr(numFrames);
+		pool->setAllocTiming(true);
+		if (on)
+			pool->startCleaner();
+		std::string indexName;
+		const Clock::time_point start = Clock::now();
+		{
+			BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		}
+		ms[on] = elapsedNs(start) / 1e6;
+		results[on] = pool->getBufStats();
+		delete pool;
+		File::remove(indexName);
+	}
+	std::cout.rdbuf(out);
+
+	std::cout << "cleaner: allocBuf latency building an int index on " << relationSize
+		<< " random tuples, " << numFrames << " frames\n";
+	std::printf("%-14s %12s %12s\n", "", "cleaner off", "cleaner on");
+	std::printf("%-14s %12.1f %12.1f\n", "build ms", ms[0], ms[1]);
+	std::printf("%-14s %12d %12d\n", "disk writes", results[0].diskwrites.load(), results[1].diskwrites.load());
+	std::printf("%-14s %12d %12d\n", "by cleaner", results[0].cleanerWrites.load(), results[1].cleanerWrites.load());
+	std::printf("%-14s %12d %12d\n", "cleaner writes", results[0].cleanerBatches.load(), results[1].cleanerBatches.load());
+	const double fractions[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+	const char* labels[] = {"p50 ns <", "p90 ns <", "p99 ns <", "p99.9 ns <", "max ns <"};
+	for (int f = 0; f < 5; f++)
+		std::printf("%-14s %12.0f %12.0f\n", labels[f],
+			latencyPercentile(results[0], fractions[f]), latencyPercentile(results[1], fractions[f]));
+
+	std::printf("\nhistogram (calls per bucket)\n%-14s %12s %12s\n", "ns", "cleaner off", "cleaner on");
+	for (int i = 0; i < BufStats::LATENCY_BUCKETS; i++)
+	{
+		if (results[0].allocLatency[i] == 0 && results[1].allocLatency[i] == 0)
+			continue;
+		std::printf("%6llu-%-7llu %12d %12d\n", 1ULL << i, 2ULL << i,
+			results[0].allocLatency[i].load(), results[1].allocLatency[i].load());
+	}
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// pagefile: page allocation and deletion cost as a PageFile grows
+// -----------------------------------------------------------------------------
+
+void benchPageFile()
+{
+	const std::string fileName = "bench.pagefile";
+	const int sizes[] = {1000, 4000, 8000};
+	const int numOps = 500;
+	const File::Format formats[] = {File::LIST_FORMAT, File::DIRECTORY_FORMAT};
+
+	std::cout << "pagefile: us per allocatePage / deletePage+allocatePage after growing the file\n";
+	std::printf("%8s %12s %12s %12s %12s\n", "pages", "list alloc", "list reuse", "dir alloc", "dir reuse");
+	for (int s = 0; s < 3; s++)
+	{
+		std::printf("%8d", sizes[s]);
+		for (int f = 0; f < 2; f++)
+		{
+			removeIfExists(fileName);
+			PageFile* file = new PageFile(fileName, true, formats[f]);
+			Page page;
+			PageId pageNo;
+			for (int i = 0; i < sizes[s]; i++)
+				file->allocatePage(pageNo, page);
+
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < numOps; i++)
+				file->allocatePage(pageNo, page);
+			const double allocUs = elapsedNs(start) / numOps / 1000;
+
+			// pages in the middle of the file, so the used list has to be relinked
+			start = Clock::now();
+			for (int i = 0; i < numOps; i++)
+			{
+				file->deletePage(sizes[s] / 2 + i);
+				file->allocatePage(pageNo, page);
+			}
+			const double reuseUs = elapsedNs(start) / numOps / 1000;
+			std::printf(" %12.1f %12.1f", allocUs, reuseUs);
+			std::fflush(stdout);
+			delete file;
+		}
+		std::printf("\n");
+	}
+	File::remove(fileName);
+}
+
+// -----------------------------------------------------------------------------
+// fileio: random page reads and writes, pread/pwrite vs. the old fstream path
+// -----------------------------------------------------------------------------
+
+/**
+ * Page I/O the way File did it before positional reads and writes: one shared
+ * fstream per file, seek and transfer under a mutex, flush after every write.
+ * Kept here only as the baseline for the fileio benchmark.
+ */
+class StreamPageIo
+{
+ private:
+	std::fstream stream;
+	std::mutex lock;
+
+	static std::streampos pagePosition(const PageId pageNo)
+	{
+		return 4 * sizeof(PageId) + (pageNo - 1) * Page::SIZE;
+	}
+
+ public:
+	StreamPageIo(const std::string& name)
+		: stream(name, std::fstream::in | std::fstream::out | std::fstream::binary)
+	{
+	}
+
+	void readPage(const PageId pageNo, Page& page)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stream.seekg(pagePosition(pageNo), std::ios::beg);
+		stream.read(reinterpret_cast<char*>(&page), Page::SIZE);
+	}
+
+	void writePage(const PageId pageNo, const Page& page)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stream.seekp(pagePosition(pageNo), std::ios::beg);
+		stream.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+		stream.flush();
+	}
+};
+
+/**
+ * Runs random page reads or writes from several threads and returns pages
+ * per second.
+ */
+template <class PageIo>
+double runFileIoWorkload(PageIo* io, const PageId numPages, const int threads, const int opsPerThread, const bool write)
+{
+	std::vector<std::thread> workers;
+	const Clock::time_point start = Clock::now();
+	for (int t = 0; t < threads; t++)
+	{
+		workers.push_back(std::thread([=]() {
+			std::mt19937 rng(t + 1);
+			std::uniform_int_distribution<PageId> pick(1, numPages);
+			Page page;
+			for (int i = 0; i < opsPerThread; i++)
+			{
+				const PageId pageNo = pick(rng);
+				if (write)
+					io->writePage(pageNo, page);
+				else
+					io->readPage(pageNo, page);
+			}
+		}));
+	}
+	for (std::size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	return threads * opsPerThread / (elapsedNs(start) / 1e9);
+}
+
+void benchFileIo()
+{
+	const std::string fileName = "bench.fileio";
+	const PageId numPages = 8192;
+	const int opsPerThread = 20000;
+
+	removeIfExists(fileName);
+	BlobFile* file = new BlobFile(fileName, true);
+	{
+		Page page;
+		PageId pageNo;
+		for (PageId i = 0; i < numPages; i++)
+			file->allocatePage(pageNo, page);
+	}
+	StreamPageIo* stream = new StreamPageIo(fileName);
+
+	std::cout << "fileio: random " << Page::SIZE << " byte page transfers on a " << numPages
+		<< " page file (pages/s)\n";
+	std::printf("%8s %14s %14s %14s %14s\n", "threads", "fstream read", "pread", "fstream write", "pwrite");
+	for (int threads = 1; threads <= 4; threads *= 2)
+	{
+		std::printf("%8d", threads);
+		for (int write = 0; write < 2; write++)
+		{
+			std::printf(" %14.0f", runFileIoWorkload(stream, numPages, threads, opsPerThread, write != 0));
+			std::printf(" %14.0f", runFileIoWorkload(file, numPages, threads, opsPerThread, write != 0));
+			std::fflush(stdout);
+		}
+		std::printf("\n");
+	}
+
+	// what durability costs on the pread/pwrite path
+	file->setSyncPolicy(File::SYNC_ALWAYS);
+	std::printf("%8s %14s %14s %14s %14.0f  (SYNC_ALWAYS)\n", "1", "", "", "",
+		runFileIoWorkload(file, numPages, 1, opsPerThread / 20, true));
+
+	delete stream;
+	delete file;
+	File::remove(fileName);
+}
+
+// -----------------------------------------------------------------------------
+// bulkload
+// -----------------------------------------------------------------------------
+
+/**
+ * Builds an integer index on the shuffled relation through insertEntry or
+ * the bulk loader and returns the seconds taken, index flush included.
+ */
+double runBulkLoadWorkload(const std::uint32_t numFrames, const bool bulkLoad, BufStats& stats)
+{
+	BufMgr* pool = new BufMgr(numFrames);
+	std::string indexName;
+	const Clock::time_point start = Clock::now();
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, bulkLoad);
+	}
+	const double seconds = elapsedNs(start) / 1e9;
+	stats = pool->getBufStats();
+	delete pool;
+	File::remove(indexName);
+	return seconds;
+}
+
+void benchBulkLoad(const int maxRows)
+{
+	const std::uint32_t numFrames = 256;
+
+	std::cout << "bulkload: integer index build from a shuffled relation, " << numFrames << " frame pool\n";
+	std::printf("%10s %12s %12s %9s %14s %14s\n", "rows", "insert (s)", "bulk (s)", "speedup",
+		"insert writes", "bulk writes");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	for (int rows = 10000; rows <= maxRows; rows *= 10)
+	{
+		createBenchRelation(3, rows);
+		BufStats insertStats, bulkStats;
+		const double insertSeconds = runBulkLoadWorkload(numFrames, false, insertStats);
+		const double bulkSeconds = runBulkLoadWorkload(numFrames, true, bulkStats);
+		std::printf("%10d %12.3f %12.3f %8.1fx %14llu %14llu\n", rows, insertSeconds, bulkSeconds,
+			insertSeconds / bulkSeconds, (unsigned long long) insertStats.diskwrites,
+			(unsigned long long) bulkStats.diskwrites);
+		std::fflush(stdout);
+		discard.str("");
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// nodesearch
+// -----------------------------------------------------------------------------
+
+void setBenchKey(int& dst, const int value) { dst = value; }
+void setBenchKey(double& dst, const int value) { dst = value; }
+
+/**
+ * Nanoseconds per upperBound of Kernel on a node of usage entries with even
+ * keys, probed with random keys in and around its range. Each probe depends
+ * on the previous answer, as on the way down a tree.
+ */
+template <class Kernel, class Entry, class Key>
+double runNodeSearchWorkload(const Entry* entries, const int usage, const std::vector<Key>& probes)
+{
+	const int searches = 2000000;
+	const size_t mask = probes.size() - 1;
+	size_t next = 0;
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < searches; i++)
+		next = (next + 1 + Kernel::upperBound(entries, usage, probes[next])) & mask;
+	const double ns = elapsedNs(start) / searches;
+	if (next == probes.size())
+		std::cout << next;
+	return ns;
+}
+
+template <class Entry, class Key>
+void benchNodeSearchType(const char* name, const int capacity, std::vector<Key>& probeKeys, Key (*probeKey)(std::vector<Key>&, int))
+{
+	static char entryBuf[Page::SIZE];
+	Entry* entries = reinterpret_cast<Entry*>(entryBuf);
+	const int sizes[] = {16, 64, 256, capacity};
+	for (int s = 0; s < 4; s++)
+	{
+		const int usage = std::min(sizes[s], capacity);
+		for (int i = 0; i < usage; i++)
+			setBenchKey(entries[i].key, 2 * i);
+		std::vector<Key> probes;
+		std::mt19937 rng(usage);
+		for (int p = 0; p < 1024; p++)
+			probes.push_back(probeKey(probeKeys, std::uniform_int_distribution<int>(-1, 2 * usage)(rng)));
+		std::printf("%-16s %6d", name, usage);
+		std::printf(" %9.1f", runNodeSearchWorkload<LinearNodeSearch>(entries, usage, probes));
+		std::printf(" %9.1f", runNodeSearchWorkload<BinaryNodeSearch>(entries, usage, probes));
+		std::printf(" %9.1f\n", runNodeSearchWorkload<SimdNodeSearch>(entries, usage, probes));
+		std::fflush(stdout);
+	}
+}
+
+int intProbe(std::vector<int>&, int value) { return value; }
+double doubleProbe(std::vector<double>&, int value) { return value; }
+
+void benchNodeSearch()
+{
+	std::cout << "nodesearch: ns per upperBound on a node of N entries"
+#if defined(__AVX2__)
+		<< " (SIMD kernel: AVX2)\n";
+#elif defined(__SSE2__)
+		<< " (SIMD kernel: SSE2; rebuild with -mavx2 for AVX2)\n";
+#else
+		<< " (SIMD kernel: no vector unit, binary search)\n";
+#endif
+	std::printf("%-16s %6s %9s %9s %9s\n", "node", "N", "linear", "binary", "simd");
+	std::vector<int> intKeys;
+	std::vector<double> doubleKeys;
+	benchNodeSearchType<RIDKeyPair<int> >("int leaf", INTARRAYLEAFSIZE, intKeys, intProbe);
+	benchNodeSearchType<PageKeyPair<int> >("int non-leaf", INTARRAYNONLEAFSIZE, intKeys, intProbe);
+	benchNodeSearchType<RIDKeyPair<double> >("double leaf", DOUBLEARRAYLEAFSIZE, doubleKeys, doubleProbe);
+	benchNodeSearchType<PageKeyPair<double> >("double non-leaf", DOUBLEARRAYNONLEAFSIZE, doubleKeys, doubleProbe);
+}
+
+// -----------------------------------------------------------------------------
+// strkeys
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts that many shuffled string keys of length characters into an empty index
+ * and returns its shape. With sharedHead the keys share all but their last
+ * eight characters, otherwise all but their first eight.
+ */
+IndexShape runStringKeyWorkload(const int length, const bool sharedHead, const int keys, double& seconds)
+{
+	std::vector<int> order(keys);
+	for (int i = 0; i < keys; i++)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), std::mt19937(length));
+
+	BufMgr* pool = new BufMgr(4096);
+	std::string indexName;
+	IndexShape shape;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, s), STRING, true);
+		char key[STRINGSIZE + 1];
+		memset(key, 'x', length);
+		key[length] = '\0';
+		char* id = sharedHead ? key + length - 8 : key;
+		RecordId rid;
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < keys; i++)
+		{
+			char digits[9];
+			sprintf(digits, "%08d", order[i]);
+			memcpy(id, digits, 8);
+			index.insertEntry(key, rid);
+		}
+		seconds = elapsedNs(start) / 1e9;
+		shape = index.shape();
+	}
+	delete pool;
+	File::remove(indexName);
+	return shape;
+}
+
+void benchStringKeys()
+{
+	const int keys = 100000;
+
+	std::cout << "strkeys: index shape after inserting " << keys << " shuffled string keys\n";
+	std::cout << "(fixed fanout: children per page with a slot of the whole key and a page number)\n";
+	std::printf("%6s %-8s %7s %8s %11s %10s %8s %13s %10s\n", "length", "ids", "height", "leaves",
+		"keys/leaf", "nonleaves", "fanout", "fixed fanout", "insert (s)");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	const int lengths[] = {16, 64, 256};
+	for (int l = 0; l < 3; l++)
+	{
+		for (int shared = 0; shared < 2; shared++)
+		{
+			double seconds;
+			const IndexShape shape = runStringKeyWorkload(lengths[l], shared, keys, seconds);
+			std::printf("%6d %-8s %7d %8zu %11.1f %10zu %8.1f %13d %10.3f\n", lengths[l],
+				shared ? "last 8" : "first 8", shape.height, shape.leaves,
+				(double) shape.entries / shape.leaves, shape.nonLeaves,
+				shape.nonLeaves ? (double) shape.children / shape.nonLeaves : 0.0,
+				(int) ((Page::SIZE - sizeof(int) - sizeof(PageId)) / (lengths[l] + 1 + sizeof(PageId))),
+				seconds);
+			std::fflush(stdout);
+			discard.str("");
+		}
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// batchscan
+// -----------------------------------------------------------------------------
+
+/**
+ * Nanoseconds per record id of a full index range scan read one rid per
+ * scanNext call (batch 0) or batch rids per scanNextBatch call.
+ */
+double runIndexBatchWorkload(BTreeIndex& index, const int size, const std::size_t batch)
+{
+	const int rounds = 50;
+	std::vector<RecordId> rids(std::max<std::size_t>(batch, 1));
+	long found = 0;
+	int low = -1, high = size;
+	const Clock::time_point start = Clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		index.startScan(&low, GT, &high, LT);
+		if (batch == 0)
+		{
+			try
+			{
+				while (1)
+				{
+					index.scanNext(rids[0]);
+					found++;
+				}
+			}
+			catch(IndexScanCompletedException e)
+			{
+			}
+		}
+		else
+		{
+			std::size_t n;
+			while ((n = index.scanNextBatch(&rids[0], batch)) > 0)
+				found += n;
+		}
+		index.endScan();
+	}
+	return elapsedNs(start) / found;
+}
+
+/**
+ * Nanoseconds per record id of a FileScan over the relation, read as above.
+ * The scan flushes the relation out of the pool when it ends, so every round
+ * reads it back from the file.
+ */
+double runFileBatchWorkload(BufMgr* pool, const std::size_t batch)
+{
+	const int rounds = 5;
+	std::vector<RecordId> rids(std::max<std::size_t>(batch, 1));
+	long found = 0;
+	const Clock::time_point start = Clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		FileScan fscan(benchRelationName, pool);
+		if (batch == 0)
+		{
+			try
+			{
+				while (1)
+				{
+					fscan.scanNext(rids[0]);
+					found++;
+				}
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+		else
+		{
+			std::size_t n;
+			while ((n = fscan.scanNextBatch(&rids[0], batch)) > 0)
+				found += n;
+		}
+	}
+	return elapsedNs(start) / found;
+}
+
+void benchBatchScan()
+{
+	const int relationSize = 300000;
+	const std::size_t batches[] = {0, 1, 16, 256, 4096};
+
+	createBenchRelation(1, relationSize);
+	BufMgr* pool = new BufMgr(16384);
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	std::string indexName;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true);
+		std::cout.rdbuf(out);
+		std::cout << "batchscan: ns per rid of a full scan of " << relationSize
+			<< " tuples, index in the pool (batch 0: scanNext)\n";
+		std::printf("%8s %12s %12s\n", "batch", "index", "filescan");
+		for (int b = 0; b < 5; b++)
+		{
+			std::cout.rdbuf(discard.rdbuf());
+			const double indexNs = runIndexBatchWorkload(index, relationSize, batches[b]);
+			const double fileNs = runFileBatchWorkload(pool, batches[b]);
+			discard.str("");
+			std::cout.rdbuf(out);
+			std::printf("%8zu %12.2f %12.2f\n", batches[b], indexNs, fileNs);
+		}
+		std::cout.rdbuf(discard.rdbuf());
+	}
+	std::cout.rdbuf(out);
+	File::remove(indexName);
+	delete pool;
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// btreemt
+// -----------------------------------------------------------------------------
+
+/**
+ * Operations per second of threads sharing one integer index. Out of every
+ * ten operations a thread does five point lookups through a cursor, four
+ * inserts of new keys and one delete of a relation key; each thread has
+ * keys of its own to insert and delete.
+ */
+double runConcurrentIndexWorkload(BTreeIndex& index, const int size, const int numThreads,
+	const int opsPerThread, const int round)
+{
+	RecordId rid = {1, 1};
+	std::vector<std::thread> workers;
+	const Clock::time_point start = Clock::now();
+	for (int t = 0; t < numThreads; t++)
+	{
+		workers.push_back(std::thread([&, t]() {
+			std::mt19937 rng(t);
+			int nextInsert = size * (round + 1) + t;
+			int nextDelete = round * numThreads * opsPerThread / 10 + t;
+			for (int op = 0; op < opsPerThread; op++)
+			{
+				if (op % 10 < 5)
+				{
+					int key = std::uniform_int_distribution<int>(0, size - 1)(rng);
+					RecordId found[4];
+					ScanCursor* cursor = index.openScan(&key, GTE, &key, LTE);
+					cursor->scanNextBatch(found, 4);
+					delete cursor;
+				}
+				else if (op % 10 < 9)
+				{
+					index.insertEntry(&nextInsert, rid);
+					nextInsert += numThreads;
+				}
+				else
+				{
+					index.deleteEntry(&nextDelete);
+					nextDelete += numThreads;
+				}
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+		workers[t].join();
+	return numThreads * (double) opsPerThread / (elapsedNs(start) / 1e9);
+}
+
+void benchConcurrentIndex(int maxThreads)
+{
+	const int relationSize = 200000;
+	const int opsPerThread = 20000;
+
+	if (maxThreads <= 0)
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	createBenchRelation(3, relationSize);
+	BufMgr* pool = new BufMgr(16384);
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	std::string indexName;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true);
+		std::cout.rdbuf(out);
+		std::cout << "btreemt: lookup/insert/delete mix (5/4/1) on one index of " << relationSize
+			<< " keys, " << std::thread::hardware_concurrency() << " hardware threads\n";
+		std::printf("%8s %16s %10s\n", "threads", "ops/s", "speedup");
+		double base = 0;
+		int round = 0;
+		for (int threads = 1; threads <= maxThreads; threads *= 2, round++)
+		{
+			std::cout.rdbuf(discard.rdbuf());
+			const double ops = runConcurrentIndexWorkload(index, relationSize, threads, opsPerThread, round);
+			discard.str("");
+			std::cout.rdbuf(out);
+			if (threads == 1)
+				base = ops;
+			std::printf("%8d %16.0f %9.2fx\n", threads, ops, ops / base);
+			std::fflush(stdout);
+			if (threads < maxThreads && threads * 2 > maxThreads)
+				threads = maxThreads / 2;
+		}
+		std::cout.rdbuf(discard.rdbuf());
+		std::cout << index.validate(false);
+	}
+	std::cout.rdbuf(out);
+	File::remove(indexName);
+	delete pool;
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// postings
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts rows record ids, in record order, into an empty integer index under
+ * distinct keys (record i under key i % distinct), then scans the whole index
+ * with scanNextBatch. Returns its shape, and the insert seconds and scan
+ * nanoseconds per record id.
+ */
+IndexShape runPostingWorkload(const int rows, const int distinct, double& seconds, double& scanNs)
+{
+	BufMgr* pool = new BufMgr(4096);
+	std::string indexName;
+	IndexShape shape;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < rows; i++)
+		{
+			// a page of the relation holds about 100 records
+			RecordId rid;
+			rid.page_number = i / 100 + 1;
+			rid.slot_number = i % 100 + 1;
+			const int key = i % distinct;
+			index.insertEntry(&key, rid);
+		}
+		seconds = elapsedNs(start) / 1e9;
+		shape = index.shape();
+
+		const int rounds = 10;
+		std::vector<RecordId> rids(1024);
+		long found = 0;
+		int low = -1, high = distinct;
+		const Clock::time_point scanStart = Clock::now();
+		for (int round = 0; round < rounds; round++)
+		{
+			index.startScan(&low, GT, &high, LT);
+			std::size_t n;
+			while ((n = index.scanNextBatch(&rids[0], rids.size())) > 0)
+				found += n;
+			index.endScan();
+		}
+		scanNs = elapsedNs(scanStart) / found;
+	}
+	delete pool;
+	File::remove(indexName);
+	return shape;
+}
+
+void benchPostings()
+{
+	const int rows = 1000000;
+
+	std::cout << "postings: integer index of " << rows << " record ids over few to all distinct keys\n";
+	std::cout << "(rid leaves: leaves of " << INTARRAYLEAFSIZE << " <key, rid> pairs, one pair per record id, all full)\n";
+	std::printf("%9s %8s %9s %10s %8s %10s %9s %11s\n", "distinct", "leaves", "rid leaves",
+		"list pages", "height", "bytes/rid", "insert (s)", "scan ns/rid");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	const int distincts[] = {150, 1000, 10000, 100000, rows};
+	for (int d = 0; d < 5; d++)
+	{
+		double seconds, scanNs;
+		const IndexShape shape = runPostingWorkload(rows, distincts[d], seconds, scanNs);
+		std::printf("%9d %8zu %9zu %10zu %8d %10.2f %9.3f %11.1f\n", distincts[d], shape.leaves,
+			(shape.rids + INTARRAYLEAFSIZE - 1) / INTARRAYLEAFSIZE, shape.postingPages, shape.height,
+			(double) (shape.leaves + shape.postingPages) * Page::SIZE / shape.rids, seconds, scanNs);
+		std::fflush(stdout);
+		discard.str("");
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// lookup
+// -----------------------------------------------------------------------------
+
+/**
+ * Probes the index once for each key, through a scan of one key (startScan,
+ * scanNext to the end, endScan) or through lookup. Returns nanoseconds per
+ * probe, and adds the record ids found to found and the pool's page accesses
+ * to accesses.
+ */
+double runLookupWorkload(BufMgr* pool, BTreeIndex& index, const std::vector<int>& keys, const bool scan,
+	long& found, long& accesses)
+{
+	std::vector<RecordId> rids;
+	pool->clearBufStats();
+	const Clock::time_point start = Clock::now();
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		if (!scan)
+		{
+			rids.clear();
+			found += index.lookup(&keys[i], rids);
+			continue;
+		}
+		try
+		{
+			index.startScan(&keys[i], GTE, &keys[i], LTE);
+			RecordId rid;
+			while (1)
+			{
+				index.scanNext(rid);
+				found++;
+			}
+		}
+		catch (NoSuchKeyFoundException e)
+		{
+			continue;
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+	}
+	const double ns = elapsedNs(start) / keys.size();
+	accesses += pool->getBufStats().accesses;
+	return ns;
+}
+
+void benchLookup(const int rows)
+{
+	const int probes = 200000;
+	const int bitsPerKey = 10;
+
+	std::cout << "lookup: equality probes on an integer index of " << rows << " keys, "
+		<< probes << " keys present and " << probes << " absent\n";
+	std::printf("%-22s %12s %12s %14s %14s\n", "probe", "present ns", "absent ns", "present pages", "absent pages");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, rows);
+	std::mt19937 rng(7);
+	std::vector<int> present(probes), absent(probes);
+	for (int i = 0; i < probes; i++)
+	{
+		present[i] = std::uniform_int_distribution<int>(0, rows - 1)(rng);
+		absent[i] = std::uniform_int_distribution<int>(rows, 2 * rows - 1)(rng);
+	}
+
+	const char* names[] = {"startScan/scanNext", "lookup", "lookup + Bloom filter"};
+	for (int method = 0; method < 3; method++)
+	{
+		BufMgr* pool = new BufMgr(4096);
+		std::string indexName;
+		{
+			BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, method == 2 ? bitsPerKey : 0);
+			long found = 0, presentAccesses = 0, absentAccesses = 0;
+			const double presentNs = runLookupWorkload(pool, index, present, method == 0, found, presentAccesses);
+			const double absentNs = runLookupWorkload(pool, index, absent, method == 0, found, absentAccesses);
+			std::printf("%-22s %12.1f %12.1f %14.2f %14.2f\n", names[method], presentNs, absentNs,
+				(double) presentAccesses / probes, (double) absentAccesses / probes);
+			std::fflush(stdout);
+			discard.str("");
+		}
+		delete pool;
+		File::remove(indexName);
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// sequential
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts rows keys into an empty index of the given type in ascending (order 0),
+ * descending (1) or random (2) order, one record id each. Returns its shape, and
+ * the inserts per second.
+ */
+IndexShape runSequentialWorkload(const Datatype type, const int rows, const int order, double& perSecond)
+{
+	std::vector<int> keys(rows);
+	for (int i = 0; i < rows; i++)
+		keys[i] = (order == 1) ? rows - 1 - i : i;
+	if (order == 2)
+		std::shuffle(keys.begin(), keys.end(), std::mt19937(rows));
+
+	const int offsets[] = {offsetof(BenchTuple, i), offsetof(BenchTuple, d), offsetof(BenchTuple, s)};
+	BufMgr* pool = new BufMgr(4096);
+	std::string indexName;
+	IndexShape shape;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsets[type], type, true);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < rows; i++)
+		{
+			RecordId rid;
+			rid.page_number = i / 100 + 1;
+			rid.slot_number = i % 100 + 1;
+			const double d = keys[i];
+			char s[STRINGSIZE + 1];
+			if (type == STRING)
+				sprintf(s, "%08d string record", keys[i]);
+			const void* key = (type == INTEGER) ? (const void*) &keys[i] : (type == DOUBLE) ? (const void*) &d : (const void*) s;
+			index.insertEntry(key, rid);
+		}
+		perSecond = rows / (elapsedNs(start) / 1e9);
+		shape = index.shape();
+	}
+	delete pool;
+	File::remove(indexName);
+	return shape;
+}
+
+void benchSequential(const int rows)
+{
+	std::cout << "sequential: " << rows << " inserts into an empty index in ascending, descending and random key order\n";
+	std::printf("%-8s %-11s %8s %12s %10s %8s %12s\n", "type", "order", "leaves", "entries/leaf", "leaf fill", "height", "inserts/s");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	const char* types[] = {"integer", "double", "string"};
+	const char* orders[] = {"ascending", "descending", "random"};
+	for (int type = 0; type < 3; type++)
+	{
+		for (int order = 0; order < 3; order++)
+		{
+			double perSecond;
+			const IndexShape shape = runSequentialWorkload((Datatype) type, rows, order, perSecond);
+			std::printf("%-8s %-11s %8zu %12.1f %9.1f%% %8d %12.0f\n", types[type], orders[order], shape.leaves,
+				(double) shape.entries / shape.leaves, 100 * shape.leafFill, shape.height, perSecond);
+			std::fflush(stdout);
+			discard.str("");
+		}
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// churn
+// -----------------------------------------------------------------------------
+
+/**
+ * Keeps a window of rows integer keys in an index: each round deletes the oldest
+ * quarter of the window and inserts as many new keys past its end, in random order.
+ * Prints the file and free pages after each round, then compacts the index.
+ */
+void runChurnWorkload(const int rows, const int rounds)
+{
+	BufMgr* pool = new BufMgr(4096);
+	std::string indexName;
+	std::mt19937 rng(rows);
+	const int batch = rows / 4;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true);
+		std::vector<int> keys(rows);
+		for (int i = 0; i < rows; i++)
+			keys[i] = i;
+		std::shuffle(keys.begin(), keys.end(), rng);
+		for (int round = 0; round <= rounds; round++)
+		{
+			const Clock::time_point start = Clock::now();
+			if (round > 0)
+			{
+				for (int key = (round - 1) * batch; key < round * batch; key++)
+					index.deleteEntry(&key);
+				keys.resize(batch);
+				for (int i = 0; i < batch; i++)
+					keys[i] = rows + (round - 1) * batch + i;
+				std::shuffle(keys.begin(), keys.end(), rng);
+			}
+			for (std::size_t i = 0; i < keys.size(); i++)
+			{
+				RecordId rid;
+				rid.page_number = keys[i] / 100 + 1;
+				rid.slot_number = keys[i] % 100 + 1;
+				index.insertEntry(&keys[i], rid);
+			}
+			const double ms = elapsedNs(start) / 1e6;
+			const IndexShape shape = index.shape();
+			std::printf("%-10d %10zu %10zu %10zu %10.1f\n", round, shape.filePages, shape.freePages,
+				shape.filePages - shape.freePages, ms);
+			std::fflush(stdout);
+		}
+	}
+	std::size_t before;
+	{
+		BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true);
+		before = index.shape().filePages;
+	}
+	const Clock::time_point start = Clock::now();
+	const std::size_t saved = BTreeIndex::compact(indexName, pool);
+	const double ms = elapsedNs(start) / 1e6;
+	std::printf("%-10s %10zu %10s %10zu %10.1f\n", "compact", before - saved, "0", before - saved, ms);
+	delete pool;
+	File::remove(indexName);
+}
+
+void benchChurn(const int rows)
+{
+	std::cout << "churn: a window of " << rows << " integer keys, a quarter of it replaced each round\n";
+	std::printf("%-10s %10s %10s %10s %10s\n", "round", "file pages", "free", "live", "ms");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	std::cout.rdbuf(out);
+	runChurnWorkload(rows, 8);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// count
+// -----------------------------------------------------------------------------
+
+/**
+ * Counts the record ids of ranges of width keys at random starts, by scanning them
+ * (method 0) or with countRange (1, and 2 on an index with subtree counts).
+ * Returns nanoseconds per count, and adds the pool's page accesses to accesses.
+ */
+double runCountWorkload(BufMgr* pool, BTreeIndex& index, const int rows, const int width, const int method,
+	long& accesses)
+{
+	const int counts = std::max(10, std::min(10000, 100000000 / width));
+	std::mt19937 rng(width);
+	std::vector<RecordId> rids(4096);
+	long total = 0;
+	pool->clearBufStats();
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < counts; i++)
+	{
+		const int low = std::uniform_int_distribution<int>(0, rows - width)(rng);
+		const int high = low + width;
+		if (method > 0)
+		{
+			total += index.countRange(&low, GTE, &high, LT);
+			continue;
+		}
+		index.startScan(&low, GTE, &high, LT);
+		std::size_t n;
+		while ((n = index.scanNextBatch(&rids[0], rids.size())) > 0)
+			total += n;
+		index.endScan();
+	}
+	const double ns = elapsedNs(start) / counts;
+	accesses += pool->getBufStats().accesses / counts;
+	if (total != (long) counts * width)
+		std::printf("wrong count %ld\n", total);
+	return ns;
+}
+
+void benchCount(const int rows)
+{
+	std::cout << "count: record ids in a range of an integer index of " << rows << " keys,"
+		<< " scanned vs countRange, without and with subtree counts\n";
+	std::printf("%-24s %10s %12s %12s %12s\n", "count", "width", "ns", "pages", "inserts/s");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, rows);
+	const char* names[] = {"startScan/scanNextBatch", "countRange", "countRange + counts"};
+	for (int method = 0; method < 3; method++)
+	{
+		BufMgr* pool = new BufMgr(4096);
+		std::string indexName;
+		{
+			BTreeIndex index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 0, method == 2);
+
+			// what keeping the counts costs an insert: keys past the relation's, in random order
+			std::vector<int> keys(rows / 10);
+			for (std::size_t i = 0; i < keys.size(); i++)
+				keys[i] = rows + i;
+			std::shuffle(keys.begin(), keys.end(), std::mt19937(rows));
+			const Clock::time_point start = Clock::now();
+			for (std::size_t i = 0; i < keys.size(); i++)
+			{
+				RecordId rid;
+				rid.page_number = keys[i] / 100 + 1;
+				rid.slot_number = keys[i] % 100 + 1;
+				index.insertEntry(&keys[i], rid);
+			}
+			const double perSecond = keys.size() / (elapsedNs(start) / 1e9);
+
+			for (int width = 10; width <= rows; width *= 100)
+			{
+				long accesses = 0;
+				const double ns = runCountWorkload(pool, index, rows, width, method, accesses);
+				std::printf("%-24s %10d %12.0f %12ld %12.0f\n", names[method], width, ns, accesses, perSecond);
+				std::fflush(stdout);
+				discard.str("");
+			}
+		}
+		delete pool;
+		File::remove(indexName);
+	}
+	std::cout.rdbuf(out);
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// betree
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts rows integer keys in random order into an empty index, BTreeIndex or
+ * BEpsilonIndex, through a pool of frames pages, then scans them all. Returns the
+ * inserts per second, and sets the pool's disk reads and writes while inserting,
+ * the final flush of the index included, and the milliseconds of the scan.
+ */
+template <class Index>
+double runBEpsilonWorkload(const int rows, const int frames, long& reads, long& writes, double& scanMs)
+{
+	std::vector<int> keys(rows);
+	for (int i = 0; i < rows; i++)
+		keys[i] = i;
+	std::shuffle(keys.begin(), keys.end(), std::mt19937(rows));
+
+	BufMgr* pool = new BufMgr(frames);
+	std::string indexName;
+	double perSecond;
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		pool->clearBufStats();
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < rows; i++)
+		{
+			RecordId rid;
+			rid.page_number = keys[i] / 100 + 1;
+			rid.slot_number = keys[i] % 100 + 1;
+			index.insertEntry(&keys[i], rid);
+		}
+		perSecond = rows / (elapsedNs(start) / 1e9);
+	}
+	reads = pool->getBufStats().diskreads;
+	writes = pool->getBufStats().diskwrites;
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		const int low = 0;
+		const Clock::time_point start = Clock::now();
+		index.startScan(&low, GTE, &rows, LT);
+		long found = 0;
+		try
+		{
+			RecordId rid;
+			while (1)
+			{
+				index.scanNext(rid);
+				found++;
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+		scanMs = elapsedNs(start) / 1e6;
+		if (found != rows)
+			std::printf("wrong scan %ld\n", found);
+	}
+	delete pool;
+	File::remove(indexName);
+	return perSecond;
+}
+
+void benchBEpsilon(const int rows)
+{
+	std::cout << "betree: " << rows << " random integer inserts, B+ Tree vs B-epsilon tree, through pools of 64 to 4096 pages\n";
+	std::printf("%-8s %-10s %12s %12s %12s %10s\n", "frames", "index", "inserts/s", "disk reads", "disk writes", "scan ms");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	std::cout.rdbuf(out);
+	for (int frames = 64; frames <= 4096; frames *= 8)
+	{
+		long reads, writes;
+		double scanMs;
+		double perSecond = runBEpsilonWorkload<BTreeIndex>(rows, frames, reads, writes, scanMs);
+		std::printf("%-8d %-10s %12.0f %12ld %12ld %10.1f\n", frames, "B+ Tree", perSecond, reads, writes, scanMs);
+		perSecond = runBEpsilonWorkload<BEpsilonIndex>(rows, frames, reads, writes, scanMs);
+		std::printf("%-8d %-10s %12.0f %12ld %12ld %10.1f\n", frames, "B-epsilon", perSecond, reads, writes, scanMs);
+		std::fflush(stdout);
+	}
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// lsm
+// -----------------------------------------------------------------------------
+
+/**
+ * Lets an index finish the work its inserts left behind: an LSM index its merges.
+ */
+void settleIndex(BTreeIndex& index)
+{
+}
+
+void settleIndex(LSMIndex& index)
+{
+	index.waitForCompaction();
+}
+
+/**
+ * Removes an index's files: an LSM index has a file for each run besides its manifest.
+ */
+template <class Index>
+void removeIndex(const std::string& indexName, BufMgr* pool)
+{
+	File::remove(indexName);
+}
+
+template <>
+void removeIndex<LSMIndex>(const std::string& indexName, BufMgr* pool)
+{
+	LSMIndex::remove(indexName, pool);
+}
+
+/**
+ * Inserts rows integer keys in random order into an empty index, BTreeIndex or
+ * LSMIndex, through a pool of frames pages, then probes it for present and absent
+ * keys and scans it. Returns the inserts per second up to the last merge, and sets
+ * the disk writes of the inserts and the close, the nanoseconds and pages read per
+ * lookup of a present (hit) and an absent key (miss), and the milliseconds of a scan.
+ */
+template <class Index>
+double runLsmWorkload(const int rows, const int frames, long& writes, double& hitNs, double& hitPages,
+	double& missNs, double& missPages, double& scanMs)
+{
+	std::vector<int> keys(rows);
+	for (int i = 0; i < rows; i++)
+		keys[i] = i;
+	std::mt19937 rng(rows);
+	std::shuffle(keys.begin(), keys.end(), rng);
+
+	BufMgr* pool = new BufMgr(frames);
+	std::string indexName;
+	double perSecond;
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		pool->clearBufStats();
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < rows; i++)
+		{
+			RecordId rid;
+			rid.page_number = keys[i] / 100 + 1;
+			rid.slot_number = keys[i] % 100 + 1;
+			index.insertEntry(&keys[i], rid);
+		}
+		settleIndex(index);
+		perSecond = rows / (elapsedNs(start) / 1e9);
+	}
+	writes = pool->getBufStats().diskwrites;
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		settleIndex(index);
+		const int probes = 100000;
+		std::vector<RecordId> rids;
+		for (int miss = 0; miss < 2; miss++)
+		{
+			std::vector<int> probeKeys(probes);
+			for (int i = 0; i < probes; i++)
+				probeKeys[i] = std::uniform_int_distribution<int>(0, rows - 1)(rng) + miss * rows;
+			pool->clearBufStats();
+			const Clock::time_point start = Clock::now();
+			for (int i = 0; i < probes; i++)
+			{
+				rids.clear();
+				index.lookup(&probeKeys[i], rids);
+			}
+			(miss ? missNs : hitNs) = elapsedNs(start) / probes;
+			(miss ? missPages : hitPages) = (double) pool->getBufStats().accesses / probes;
+		}
+
+		const int low = 0;
+		const Clock::time_point start = Clock::now();
+		index.startScan(&low, GTE, &rows, LT);
+		long found = 0;
+		try
+		{
+			RecordId rid;
+			while (1)
+			{
+				index.scanNext(rid);
+				found++;
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+		scanMs = elapsedNs(start) / 1e6;
+		if (found != rows)
+			std::printf("wrong scan %ld\n", found);
+	}
+	removeIndex<Index>(indexName, pool);
+	delete pool;
+	return perSecond;
+}
+
+void benchLsm(const int rows)
+{
+	std::cout << "lsm: " << rows << " random integer inserts, then lookups and a scan, B+ Tree vs LSM tree"
+		<< " through a pool of 1024 pages\n";
+	std::printf("%-10s %12s %12s %9s %11s %9s %11s %10s\n", "index", "inserts/s", "disk writes",
+		"hit ns", "hit pages", "miss ns", "miss pages", "scan ms");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	std::cout.rdbuf(out);
+	for (int engine = 0; engine < 2; engine++)
+	{
+		long writes;
+		double hitNs, hitPages, missNs, missPages, scanMs;
+		const double perSecond = (engine == 0)
+			? runLsmWorkload<BTreeIndex>(rows, 1024, writes, hitNs, hitPages, missNs, missPages, scanMs)
+			: runLsmWorkload<LSMIndex>(rows, 1024, writes, hitNs, hitPages, missNs, missPages, scanMs);
+		std::printf("%-10s %12.0f %12ld %9.0f %11.2f %9.0f %11.2f %10.1f\n", engine == 0 ? "B+ Tree" : "LSM tree",
+			perSecond, writes, hitNs, hitPages, missNs, missPages, scanMs);
+		std::fflush(stdout);
+	}
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// hash
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts rows integer keys in random order into an empty index, BTreeIndex or
+ * HashIndex, through a pool of frames pages, then probes it for present and absent
+ * keys. Returns the inserts per second, and sets the nanoseconds, pages touched and
+ * disk reads per lookup of a present (hit) and an absent key (miss).
+ */
+template <class Index>
+double runHashWorkload(const int rows, const int frames, double& hitNs, double& hitPages, double& hitReads,
+	double& missNs, double& missPages, double& missReads)
+{
+	std::vector<int> keys(rows);
+	for (int i = 0; i < rows; i++)
+		keys[i] = i;
+	std::mt19937 rng(rows);
+	std::shuffle(keys.begin(), keys.end(), rng);
+
+	BufMgr* pool = new BufMgr(frames);
+	std::string indexName;
+	double perSecond;
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < rows; i++)
+		{
+			RecordId rid;
+			rid.page_number = keys[i] / 100 + 1;
+			rid.slot_number = keys[i] % 100 + 1;
+			index.insertEntry(&keys[i], rid);
+		}
+		perSecond = rows / (elapsedNs(start) / 1e9);
+	}
+	{
+		Index index(benchRelationName, indexName, pool, offsetof(BenchTuple, i), INTEGER);
+		const int probes = 100000;
+		std::vector<RecordId> rids;
+		for (int miss = 0; miss < 2; miss++)
+		{
+			std::vector<int> probeKeys(probes);
+			for (int i = 0; i < probes; i++)
+				probeKeys[i] = std::uniform_int_distribution<int>(0, rows - 1)(rng) + miss * rows;
+			pool->clearBufStats();
+			long found = 0;
+			const Clock::time_point start = Clock::now();
+			for (int i = 0; i < probes; i++)
+			{
+				rids.clear();
+				found += index.lookup(&probeKeys[i], rids);
+			}
+			(miss ? missNs : hitNs) = elapsedNs(start) / probes;
+			(miss ? missPages : hitPages) = (double) pool->getBufStats().accesses / probes;
+			(miss ? missReads : hitReads) = (double) pool->getBufStats().diskreads / probes;
+			if (found != (miss ? 0 : probes))
+				std::printf("wrong lookups %ld\n", found);
+		}
+	}
+	removeIndex<Index>(indexName, pool);
+	delete pool;
+	return perSecond;
+}
+
+void benchHash(const int rows)
+{
+	std::cout << "hash: " << rows << " random integer inserts, then 100K lookups, B+ Tree vs extendible hash"
+		<< " through a pool of 1024 pages\n";
+	std::printf("%-10s %12s %9s %11s %11s %9s %11s %11s\n", "index", "inserts/s",
+		"hit ns", "hit pages", "hit reads", "miss ns", "miss pages", "miss reads");
+
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+	createBenchRelation(3, 0);
+	std::cout.rdbuf(out);
+	for (int engine = 0; engine < 2; engine++)
+	{
+		double hitNs, hitPages, hitReads, missNs, missPages, missReads;
+		const double perSecond = (engine == 0)
+			? runHashWorkload<BTreeIndex>(rows, 1024, hitNs, hitPages, hitReads, missNs, missPages, missReads)
+			: runHashWorkload<HashIndex>(rows, 1024, hitNs, hitPages, hitReads, missNs, missPages, missReads);
+		std::printf("%-10s %12.0f %9.0f %11.2f %11.2f %9.0f %11.2f %11.2f\n", engine == 0 ? "B+ Tree" : "Hash",
+			perSecond, hitNs, hitPages, hitReads, missNs, missPages, missReads);
+		std::fflush(stdout);
+	}
+	File::remove(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// main
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	const std::string which = (argc > 1) ? argv[1] : "";
+
+	if (which == "hashtbl")
+		benchHashTable();
+	else if (which == "policy")
+		benchPolicies();
+	else if (which == "scan")
+		benchScan();
+	else if (which == "prefetch")
+		benchPrefetch();
+	else if (which == "cleaner")
+		benchCleaner();
+	else if (which == "pagefile")
+		benchPageFile();
+	else if (which == "fileio")
+		benchFileIo();
+	else if (which == "nodesearch")
+		benchNodeSearch();
+	else if (which == "btreemt")
+		benchConcurrentIndex(argc > 2 ? std::atoi(argv[2]) : 0);
+	else if (which == "batchscan")
+		benchBatchScan();
+	else if (which == "strkeys")
+		benchStringKeys();
+	else if (which == "postings")
+		benchPostings();
+	else if (which == "sequential")
+		benchSequential(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "churn")
+		benchChurn(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "count")
+		benchCount(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "betree")
+		benchBEpsilon(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "lsm")
+		benchLsm(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "hash")
+		benchHash(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "lookup")
+		benchLookup(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "bulkload")
+		benchBulkLoad(argc > 2 ? std::atoi(argv[2]) : 1000000);
+	else if (which == "bufmgr")
+		benchBufMgr(argc > 2 ? std::atoi(argv[2]) : 0);
+	else
+	{
+		std::cout << "Usage: ./badgerdb_bench <benchmark>\n";
+		std::cout << "  hashtbl    buffer hash table, chained vs open addressing, 1K-1M frames\n";
+		std::cout << "  bufmgr [N] buffer manager readPage/unPinPage throughput, 1 to N threads\n";
+		std::cout << "             (N defaults to the number of hardware threads)\n";
+		std::cout << "  policy     replacement policy hit ratios on the test1/2/3 workloads\n";
+		std::cout << "  scan       hot page hit ratio around full scans, with and without a ring\n";
+		std::cout << "  prefetch   file and index scans with 0 to 16 pages of read-ahead\n";
+		std::cout << "  cleaner    allocBuf latency histogram with the background writer off and on\n";
+		std::cout << "  pagefile   PageFile page allocation cost, linked list vs directory format\n";
+		std::cout << "  fileio     random page reads and writes, pread/pwrite vs fstream\n";
+		std::cout << "  nodesearch B+-tree node search, linear vs binary vs SIMD, per key type and size\n";
+		std::cout << "  strkeys    string index height and fanout at key lengths 16, 64 and 256\n";
+		std::cout << "  postings   integer index size and scan speed, 150 to 1M distinct keys over 1M rids\n";
+		std::cout << "  sequential [N] leaf fill and insert rate, ascending vs descending vs random keys\n";
+		std::cout << "             (N inserts, defaults to 1M)\n";
+		std::cout << "  lookup [N] equality probes, one-key scans vs lookup vs lookup with a Bloom filter\n";
+		std::cout << "             (N keys, defaults to 1M)\n";
+		std::cout << "  churn [N]  index file pages as a window of N integer keys is replaced, then compacted\n";
+		std::cout << "             (N defaults to 1M)\n";
+		std::cout << "  count [N]  range counts, scans vs countRange without and with subtree counts\n";
+		std::cout << "             (N keys, defaults to 1M)\n";
+		std::cout << "  betree [N] random inserts, B+ Tree vs B-epsilon tree: rate, disk reads and writes\n";
+		std::cout << "             (N keys, defaults to 1M)\n";
+		std::cout << "  lsm [N]    random inserts, lookups and a scan, B+ Tree vs LSM tree\n";
+		std::cout << "             (N keys, defaults to 1M)\n";
+		std::cout << "  hash [N]   random inserts and lookups, B+ Tree vs extendible hash: pages per probe\n";
+		std::cout << "             (N keys, defaults to 1M)\n";
+		std::cout << "  bulkload [N] integer index build, insertEntry vs bulk load, 10K to N rows\n";
+		std::cout << "             (N defaults to 1M)\n";
+		std::cout << "  batchscan  index and file scans, scanNext vs scanNextBatch of 1 to 4096 rids\n";
+		std::cout << "  btreemt [N] lookup/insert/delete throughput on one index, 1 to N threads\n";
+		std::cout << "             (N defaults to the number of hardware threads)\n";
+		return 1;
+	}
+	return 0;
+}
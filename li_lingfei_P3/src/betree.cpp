@@ -0,0 +1,687 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "betree.h"
+#include "filescan.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace badgerdb
+{
+
+static_assert(sizeof(BeNonLeafNode<int>) <= Page::SIZE, "an integer node fits a page");
+static_assert(sizeof(BeNonLeafNode<double>) <= Page::SIZE, "a double node fits a page");
+static_assert(sizeof(BeNonLeafNode<StringKeyValue>) <= Page::SIZE, "a string node fits a page");
+
+// -----------------------------------------------------------------------------
+// BEpsilonIndex::BEpsilonIndex -- Constructor
+// -----------------------------------------------------------------------------
+BEpsilonIndex::BEpsilonIndex(const std::string & relationName,
+		std::string & outIndexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset,
+		const Datatype attrType)
+{
+    std::ostringstream idxStr;
+    idxStr<<relationName<<"."<<attrByteOffset<<".be";
+    outIndexName = idxStr.str();
+
+    if(attrType == INTEGER) {
+        this->tree = new BEpsilonTree<IntKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    } else if(attrType == DOUBLE) {
+        this->tree = new BEpsilonTree<DoubleKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    } else {
+        this->tree = new BEpsilonTree<StringKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// BEpsilonTree::BEpsilonTree -- Constructor
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+BEpsilonTree<KeyTraits>::BEpsilonTree(const std::string & relationName,
+		const std::string & indexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset)
+{
+    this->bufMgr = bufMgrIn;
+    this->attrByteOffset = attrByteOffset;
+    this->scanExecuting = false;
+    this->headerPageNum = 1;
+
+    if(File::exists(indexName)) {
+        this->file = new BlobFile(indexName, false);
+
+        Page* metaInfoPage = NULL;
+        this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+        IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)metaInfoPage;
+        this->rootPageNum = indexMetaInfo->rootPageNo;
+        this->height = indexMetaInfo->height;
+        this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+        return;
+    }
+
+    this->file = new BlobFile(indexName, true);
+
+    //The meta page has the format of a B+ Tree's, without a Bloom filter or counts
+    Page* metaInfoPage = NULL;
+    this->bufMgr->allocPage(this->file, this->headerPageNum, metaInfoPage);
+    IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)metaInfoPage;
+    memset(indexMetaInfo, 0, sizeof(IndexMetaInfo));
+    strncpy(indexMetaInfo->relationName, indexName.c_str(), sizeof(indexMetaInfo->relationName) - 1);
+    indexMetaInfo->attrByteOffset = attrByteOffset;
+    indexMetaInfo->attrType = KeyTraits::TYPE;
+
+    //The tree starts as one empty leaf
+    Page* rootPage = NULL;
+    this->bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
+    ((Leaf*)rootPage)->usage = 0;
+    this->height = 0;
+    indexMetaInfo->rootPageNo = this->rootPageNum;
+    indexMetaInfo->height = 0;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+    this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
+
+    this->createIndexFromRelation(relationName);
+}
+
+//Reads the relation and inserts all <key, rid> pairs
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::createIndexFromRelation(const std::string& relationName)
+{
+    FileScan fscan(relationName, this->bufMgr, BufAccessStrategy::DEFAULT_RING_SIZE);
+    try {
+        RecordId scanRid;
+        while(1) {
+            fscan.scanNext(scanRid);
+            Value key;
+            KeyTraits::load(key, fscan.getRecordView().data + this->attrByteOffset);
+            this->insertEntry(KeyTraits::key(key), scanRid);
+        }
+    } catch(const EndOfFileException&) {
+    }
+}
+
+// -----------------------------------------------------------------------------
+// BEpsilonIndex::~BEpsilonIndex -- destructor
+// -----------------------------------------------------------------------------
+BEpsilonIndex::~BEpsilonIndex()
+{
+    delete this->tree;
+}
+
+template<class KeyTraits>
+BEpsilonTree<KeyTraits>::~BEpsilonTree()
+{
+    Page* metaInfoPage = NULL;
+    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+    IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)metaInfoPage;
+    indexMetaInfo->rootPageNo = this->rootPageNum;
+    indexMetaInfo->height = this->height;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+    this->bufMgr->flushFile(this->file);
+    delete this->file;
+}
+
+// -----------------------------------------------------------------------------
+// Entries and messages
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+bool BEpsilonTree<KeyTraits>::entryLess(const Entry& lhs, const Entry& rhs)
+{
+    if(KeyTraits::less(keyOf(lhs), keyOf(rhs))) {
+        return true;
+    }
+    if(KeyTraits::less(keyOf(rhs), keyOf(lhs))) {
+        return false;
+    }
+    if(lhs.rid.page_number != rhs.rid.page_number) {
+        return lhs.rid.page_number < rhs.rid.page_number;
+    }
+    return lhs.rid.slot_number < rhs.rid.slot_number;
+}
+
+template<class KeyTraits>
+int BEpsilonTree<KeyTraits>::route(const std::vector<Entry>& pivots, const Entry& entry)
+{
+    return std::upper_bound(pivots.begin(), pivots.end(), entry, entryLess) - pivots.begin();
+}
+
+template<class KeyTraits>
+void BEpsilonTree<KeyTraits>::apply(std::vector<Entry>& entries, const Message& message)
+{
+    if(message.op == BE_INSERT) {
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), message.entry, entryLess), message.entry);
+        return;
+    }
+    //A delete of an entry that is not there does nothing
+    typename std::vector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), message.entry, entryLess);
+    if(it != entries.end() && !entryLess(message.entry, *it)) {
+        entries.erase(it);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Insertion functions
+// -----------------------------------------------------------------------------
+const void BEpsilonIndex::insertEntry(const void *key, const RecordId rid)
+{
+    this->tree->insertEntry(key, rid);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::insertEntry(const void *key, const RecordId rid)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    this->insertEntry(KeyTraits::key(value), rid);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::insertEntry(Key key, const RecordId rid)
+{
+    Message message;
+    KeyTraits::assign(message.entry.key, key);
+    message.entry.rid = rid;
+    message.op = BE_INSERT;
+
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    this->pushRoot(message);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::pushRoot(const Message& message)
+{
+    std::vector<Message> messages(1, message);
+    std::vector<Split> splits;
+    this->push(this->rootPageNum, 0, messages, splits);
+
+    //The root split: a new root above it and its new siblings, which may split in turn
+    while(!splits.empty()) {
+        std::vector<Entry> pivots;
+        std::vector<PageId> children(1, this->rootPageNum);
+        for(size_t i = 0; i < splits.size(); i ++) {
+            pivots.push_back(splits[i].pivot);
+            children.push_back(splits[i].pageNo);
+        }
+        std::vector<Message> buffer;
+        PageId rootPageNo;
+        Page* rootPage;
+        this->bufMgr->allocPage(this->file, rootPageNo, rootPage);
+        this->bufMgr->unPinPage(this->file, rootPageNo, true);
+        splits.clear();
+        this->writeNonLeaf(rootPageNo, pivots, children, buffer, splits);
+        this->rootPageNum = rootPageNo;
+        this->height ++;
+    }
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::push(PageId pageNo, int level, std::vector<Message>& messages, std::vector<Split>& splits)
+{
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, pageNo, page);
+
+    if(level == this->height) {
+        //Leaf: take the messages in, and spread the entries over as many leaves as they need
+        Leaf* node = (Leaf*)page;
+        std::vector<Entry> entries(node->entries, node->entries + node->usage);
+        for(size_t i = 0; i < messages.size(); i ++) {
+            apply(entries, messages[i]);
+        }
+        const int pieces = std::max((size_t)1, (entries.size() + Leaf::MAX_USAGE - 1) / Leaf::MAX_USAGE);
+        size_t start = 0;
+        for(int p = 0; p < pieces; p ++) {
+            const size_t end = entries.size() * (p + 1) / pieces;
+            PageId piecePageNo = pageNo;
+            Leaf* piece = node;
+            if(p > 0) {
+                Page* piecePage;
+                this->bufMgr->allocPage(this->file, piecePageNo, piecePage);
+                piece = (Leaf*)piecePage;
+                Split split;
+                split.pivot = entries[start];
+                split.pageNo = piecePageNo;
+                splits.push_back(split);
+            }
+            piece->usage = end - start;
+            std::copy(entries.begin() + start, entries.begin() + end, piece->entries);
+            if(p > 0) {
+                this->bufMgr->unPinPage(this->file, piecePageNo, true);
+            }
+            start = end;
+        }
+        this->bufMgr->unPinPage(this->file, pageNo, true);
+        return;
+    }
+
+    NonLeaf* node = (NonLeaf*)page;
+    if(node->buffered + messages.size() <= (size_t)NonLeaf::BUFFER_SIZE) {
+        //Most of the time the messages just join the buffer
+        std::copy(messages.begin(), messages.end(), node->messages + node->buffered);
+        node->buffered += messages.size();
+        this->bufMgr->unPinPage(this->file, pageNo, true);
+        return;
+    }
+
+    std::vector<Entry> pivots;
+    std::vector<PageId> children;
+    node->read(pivots, children);
+    std::vector<Message> buffer(node->messages, node->messages + node->buffered);
+    buffer.insert(buffer.end(), messages.begin(), messages.end());
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+
+    //Flush the messages of the child with the most of them until the rest fit
+    while(buffer.size() > (size_t)NonLeaf::BUFFER_SIZE) {
+        std::vector<int> counts(children.size(), 0);
+        for(size_t i = 0; i < buffer.size(); i ++) {
+            counts[route(pivots, buffer[i].entry)] ++;
+        }
+        const int c = std::max_element(counts.begin(), counts.end()) - counts.begin();
+        std::vector<Message> down, kept;
+        for(size_t i = 0; i < buffer.size(); i ++) {
+            (route(pivots, buffer[i].entry) == c ? down : kept).push_back(buffer[i]);
+        }
+        buffer.swap(kept);
+
+        std::vector<Split> childSplits;
+        this->push(children[c], level + 1, down, childSplits);
+        for(size_t i = 0; i < childSplits.size(); i ++) {
+            pivots.insert(pivots.begin() + c + i, childSplits[i].pivot);
+            children.insert(children.begin() + c + 1 + i, childSplits[i].pageNo);
+        }
+    }
+    this->writeNonLeaf(pageNo, pivots, children, buffer, splits);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::writeNonLeaf(PageId pageNo, std::vector<Entry>& pivots, std::vector<PageId>& children,
+        std::vector<Message>& buffer, std::vector<Split>& splits)
+{
+    //Children are spread by bytes over about as few nodes as hold them: a node is cut
+    //before the pivot that would take it past its share, or past the index bytes. The
+    //pivot at a cut goes up, and each message goes with the child it is bound for
+    size_t bytes = sizeof(PageId);
+    for(size_t i = 0; i < pivots.size(); i ++) {
+        bytes += NonLeaf::pivotBytes(pivots[i]);
+    }
+    const size_t share = bytes / ((bytes + NonLeaf::INDEX_BYTES - 1) / NonLeaf::INDEX_BYTES);
+    std::vector<size_t> ends;
+    bytes = sizeof(PageId);
+    for(size_t i = 0; i < pivots.size(); i ++) {
+        const size_t pivotBytes = NonLeaf::pivotBytes(pivots[i]);
+        if(bytes >= share || bytes + pivotBytes > (size_t)NonLeaf::INDEX_BYTES) {
+            ends.push_back(i + 1);
+            bytes = sizeof(PageId);
+        } else {
+            bytes += pivotBytes;
+        }
+    }
+    ends.push_back(children.size());
+
+    const size_t pieces = ends.size();
+    size_t start = 0;
+    for(size_t p = 0; p < pieces; p ++) {
+        const size_t end = ends[p];
+        PageId piecePageNo = pageNo;
+        Page* piecePage;
+        if(p == 0) {
+            this->bufMgr->readPage(this->file, piecePageNo, piecePage);
+        } else {
+            this->bufMgr->allocPage(this->file, piecePageNo, piecePage);
+            Split split;
+            split.pivot = pivots[start - 1];
+            split.pageNo = piecePageNo;
+            splits.push_back(split);
+        }
+        NonLeaf* node = (NonLeaf*)piecePage;
+        node->write(pivots.data() + start, children.data() + start, end - start - 1);
+        node->buffered = 0;
+        for(size_t i = 0; i < buffer.size(); i ++) {
+            const bool above = (p == 0 || !entryLess(buffer[i].entry, pivots[start - 1]));
+            const bool below = (p == pieces - 1 || entryLess(buffer[i].entry, pivots[end - 1]));
+            if(above && below) {
+                node->messages[node->buffered ++] = buffer[i];
+            }
+        }
+        this->bufMgr->unPinPage(this->file, piecePageNo, true);
+        start = end;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Reading functions
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::readLeaf(const Entry& target, std::vector<Entry>& out, bool& hasHigh, Entry& high)
+{
+    //Messages on the way down bound for the child taken, root first: the newest ones
+    std::vector<std::vector<Message> > pending(this->height);
+    bool hasLow = false;
+    Entry low = Entry();
+    hasHigh = false;
+    std::vector<Entry> pivots;
+    std::vector<PageId> children;
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, page);
+        const NonLeaf* node = (const NonLeaf*)page;
+        node->read(pivots, children);
+        const int c = route(pivots, target);
+        if(c > 0) {
+            low = pivots[c - 1];
+            hasLow = true;
+        }
+        if(c < node->usage) {
+            high = pivots[c];
+            hasHigh = true;
+        }
+        for(int i = 0; i < node->buffered; i ++) {
+            if(route(pivots, node->messages[i].entry) == c) {
+                pending[level].push_back(node->messages[i]);
+            }
+        }
+        const PageId childPageNo = children[c];
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = childPageNo;
+    }
+
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, curPageNo, page);
+    const Leaf* node = (const Leaf*)page;
+    out.assign(node->entries, node->entries + node->usage);
+    this->bufMgr->unPinPage(this->file, curPageNo, false);
+
+    //Oldest first: the deepest buffers, each in the order it was filled. A message from
+    //high up may be bound for a sibling of the leaf, so the leaf's own range decides
+    for(int level = this->height - 1; level >= 0; level --) {
+        for(size_t i = 0; i < pending[level].size(); i ++) {
+            const Entry& entry = pending[level][i].entry;
+            if((!hasLow || !entryLess(entry, low)) && (!hasHigh || entryLess(entry, high))) {
+                apply(out, pending[level][i]);
+            }
+        }
+    }
+}
+
+template<class KeyTraits>
+const std::size_t BEpsilonTree<KeyTraits>::bufferedMessages()
+{
+    SharedLatchGuard shared(this->treeLatch);
+    std::size_t messages = 0;
+    this->validate_helper(this->rootPageNum, 0, NULL, NULL, messages);
+    return messages;
+}
+
+const std::size_t BEpsilonIndex::bufferedMessages()
+{
+    return this->tree->bufferedMessages();
+}
+
+// -----------------------------------------------------------------------------
+// Deletion functions
+// -----------------------------------------------------------------------------
+const bool BEpsilonIndex::deleteEntry(const void *key)
+{
+    return this->tree->deleteEntry(key);
+}
+
+template<class KeyTraits>
+const bool BEpsilonTree<KeyTraits>::deleteEntry(const void *key)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->deleteEntry(KeyTraits::key(value));
+}
+
+template<class KeyTraits>
+const bool BEpsilonTree<KeyTraits>::deleteEntry(Key key)
+{
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+
+    //The first entry of the key, from the least record id on, past any emptied leaves
+    Message message;
+    KeyTraits::assign(message.entry.key, key);
+    message.entry.rid.page_number = 0;
+    message.entry.rid.slot_number = 0;
+    message.op = BE_DELETE;
+    Entry target = message.entry;
+    std::vector<Entry> entries;
+    while(1) {
+        bool hasHigh;
+        Entry high;
+        this->readLeaf(target, entries, hasHigh, high);
+        typename std::vector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), message.entry, entryLess);
+        if(it != entries.end()) {
+            if(!KeyTraits::equals(keyOf(*it), key)) {
+                return false;
+            }
+            message.entry = *it;
+            this->pushRoot(message);
+            return true;
+        }
+        if(!hasHigh || KeyTraits::less(key, keyOf(high))) {
+            return false;
+        }
+        target = high;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Scan functions
+// -----------------------------------------------------------------------------
+const void BEpsilonIndex::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    this->tree->startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    Value low, high;
+    KeyTraits::load(low, lowValParm);
+    KeyTraits::load(high, highValParm);
+    this->startScan(KeyTraits::key(low), lowOpParm, KeyTraits::key(high), highOpParm);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::startScan(Key lowValParm,
+				   const Operator lowOpParm,
+				   Key highValParm,
+				   const Operator highOpParm)
+{
+    this->scanExecuting = false;
+    if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
+    }
+    if(KeyTraits::less(highValParm, lowValParm)) {
+        throw BadScanrangeException();
+    }
+    KeyTraits::assign(this->lowVal, lowValParm);
+    KeyTraits::assign(this->highVal, highValParm);
+    this->lowOp = lowOpParm;
+    this->highOp = highOpParm;
+
+    //Start at the least entry of the low key
+    KeyTraits::assign(this->scanTarget.key, lowValParm);
+    this->scanTarget.rid.page_number = 0;
+    this->scanTarget.rid.slot_number = 0;
+    this->scanMore = true;
+    this->loadScan();
+    if(this->scanRids.empty()) {
+        throw NoSuchKeyFoundException();
+    }
+    this->scanExecuting = true;
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::loadScan()
+{
+    const Key low = KeyTraits::key(this->lowVal);
+    const Key high = KeyTraits::key(this->highVal);
+    this->scanRids.clear();
+    this->scanPos = 0;
+    std::vector<Entry> entries;
+    while(this->scanRids.empty() && this->scanMore) {
+        bool hasHigh;
+        Entry next = Entry();
+        {
+            SharedLatchGuard shared(this->treeLatch);
+            this->readLeaf(this->scanTarget, entries, hasHigh, next);
+        }
+        for(size_t i = 0; i < entries.size(); i ++) {
+            const Key key = keyOf(entries[i]);
+            if(entryLess(entries[i], this->scanTarget)
+                    || (this->lowOp == GTE ? KeyTraits::less(key, low) : !KeyTraits::less(low, key))) {
+                continue;
+            }
+            if(this->highOp == LTE ? KeyTraits::less(high, key) : !KeyTraits::less(key, high)) {
+                this->scanMore = false;
+                break;
+            }
+            this->scanRids.push_back(entries[i].rid);
+        }
+        //The next leaf starts where this one's range ends
+        if(!hasHigh || KeyTraits::less(high, keyOf(next))) {
+            this->scanMore = false;
+        } else {
+            this->scanTarget = next;
+        }
+    }
+}
+
+const void BEpsilonIndex::scanNext(RecordId& outRid)
+{
+    this->tree->scanNext(outRid);
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::scanNext(RecordId& outRid)
+{
+    if(!this->scanExecuting) {
+        throw ScanNotInitializedException();
+    }
+    if(this->scanPos == this->scanRids.size()) {
+        this->loadScan();
+        if(this->scanRids.empty()) {
+            throw IndexScanCompletedException();
+        }
+    }
+    outRid = this->scanRids[this->scanPos ++];
+}
+
+const void BEpsilonIndex::endScan()
+{
+    this->tree->endScan();
+}
+
+template<class KeyTraits>
+const void BEpsilonTree<KeyTraits>::endScan()
+{
+    if(!this->scanExecuting) {
+        throw ScanNotInitializedException();
+    }
+    this->scanExecuting = false;
+    this->scanRids.clear();
+}
+
+// -----------------------------------------------------------------------------
+// Validation functions
+// -----------------------------------------------------------------------------
+const bool BEpsilonIndex::validate(bool showInfo)
+{
+    return this->tree->validate(showInfo);
+}
+
+template<class KeyTraits>
+const bool BEpsilonTree<KeyTraits>::validate(bool showInfo)
+{
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    std::size_t messages = 0;
+    const bool valid = this->validate_helper(this->rootPageNum, 0, NULL, NULL, messages);
+    if(showInfo) {
+        std::cout << "B-epsilon tree of height " << this->height << ", " << messages << " buffered messages: "
+            << (valid ? "valid" : "invalid") << "\n";
+    }
+    return valid;
+}
+
+template<class KeyTraits>
+const bool BEpsilonTree<KeyTraits>::validate_helper(PageId pageNo, int level, const Entry* low, const Entry* high, std::size_t& messages)
+{
+    //Everything in a node lies in [low, high)
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    bool valid = true;
+    if(level == this->height) {
+        const Leaf* node = (const Leaf*)page;
+        valid = node->usage >= 0 && node->usage <= Leaf::MAX_USAGE;
+        for(int i = 0; valid && i < node->usage; i ++) {
+            valid = (i == 0 || !entryLess(node->entries[i], node->entries[i - 1]))
+                && (low == NULL || !entryLess(node->entries[i], *low))
+                && (high == NULL || entryLess(node->entries[i], *high));
+        }
+        this->bufMgr->unPinPage(this->file, pageNo, false);
+        return valid;
+    }
+
+    const NonLeaf* node = (const NonLeaf*)page;
+    valid = node->usage >= (level == 0 ? 1 : 0) && node->usage <= NonLeaf::MAX_PIVOTS
+        && node->buffered >= 0 && node->buffered <= NonLeaf::BUFFER_SIZE;
+    std::vector<Entry> pivots;
+    std::vector<PageId> children;
+    if(valid) {
+        valid = node->read(pivots, children) <= NonLeaf::INDEX_BYTES;
+    }
+    for(size_t i = 0; valid && i < pivots.size(); i ++) {
+        valid = (i == 0 || entryLess(pivots[i - 1], pivots[i]))
+            && (low == NULL || !entryLess(pivots[i], *low))
+            && (high == NULL || entryLess(pivots[i], *high));
+    }
+    for(int i = 0; valid && i < node->buffered; i ++) {
+        valid = (node->messages[i].op == BE_INSERT || node->messages[i].op == BE_DELETE)
+            && (low == NULL || !entryLess(node->messages[i].entry, *low))
+            && (high == NULL || entryLess(node->messages[i].entry, *high));
+    }
+    messages += node->buffered;
+    if(!valid) {
+        children.clear();
+    }
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+
+    for(size_t c = 0; valid && c < children.size(); c ++) {
+        valid = this->validate_helper(children[c], level + 1,
+            c == 0 ? low : &pivots[c - 1], c == pivots.size() ? high : &pivots[c], messages);
+    }
+    return valid;
+}
+
+template class BEpsilonTree<IntKeyTraits>;
+template class BEpsilonTree<DoubleKeyTraits>;
+template class BEpsilonTree<StringKeyTraits>;
+
+}
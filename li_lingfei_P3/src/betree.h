@@ -0,0 +1,464 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "latch.h"
+#include "btree.h"
+
+/**
+ * B-epsilon tree: a write optimized index with the insert, delete and scan interface of
+ * BTreeIndex. Its non-leaves spend a small part of their page on pivots and the rest on
+ * a buffer of messages, each an insert or a delete of one <key, rid> pair. An insert or a
+ * delete only adds a message to the root's buffer; when a buffer fills, the messages
+ * bound for the child with the most of them move down together. A leaf is then written
+ * once for a whole batch of changes instead of once for each.
+ *
+ * Entries are ordered by key and then by record id, and pivots are entries too, so all
+ * the entries of one key may span leaves and every message goes to exactly one leaf.
+ */
+
+namespace badgerdb
+{
+
+/**
+ * @brief What a message does to the leaf it reaches.
+ */
+enum BeMessageOp
+{
+	BE_INSERT = 0,	/* Add the entry */
+	BE_DELETE = 1	/* Remove one copy of the entry */
+};
+
+/**
+ * @brief Entry of a leaf, and pivot of a non-leaf: a key with one record id.
+ */
+template<class Value>
+struct BeEntry {
+	Value key;
+	RecordId rid;
+};
+
+/**
+ * @brief Change to an entry, waiting in a non-leaf's buffer.
+ */
+template<class Value>
+struct BeMessage {
+	BeEntry<Value> entry;
+	int op;
+};
+
+/**
+ * @brief Leaf of a B-epsilon tree: entries in order.
+ */
+template<class Value>
+struct BeLeafNode {
+	static const int MAX_USAGE = (Page::SIZE - sizeof(int)) / sizeof(BeEntry<Value>);
+
+	int usage;
+
+	BeEntry<Value> entries[MAX_USAGE];
+};
+
+/**
+ * @brief How a pivot key is packed into a non-leaf: a fixed size key whole, a string
+ * key up to and with its terminating null.
+ */
+template<class Value>
+struct BePivotKey {
+	static const int MIN_BYTES = sizeof(Value);
+	static const int MAX_BYTES = sizeof(Value);
+
+	static int bytes(const Value&) { return sizeof(Value); }
+	static void store(char* dst, const Value& key) { memcpy(dst, &key, sizeof(Value)); }
+	static int load(Value& key, const char* src) { memcpy(&key, src, sizeof(Value)); return sizeof(Value); }
+};
+
+template<>
+struct BePivotKey<StringKeyValue> {
+	static const int MIN_BYTES = 1;
+	static const int MAX_BYTES = STRINGSIZE + 1;
+
+	static int bytes(const StringKeyValue& key) { return strnlen(key.chars, STRINGSIZE) + 1; }
+	static void store(char* dst, const StringKeyValue& key) {
+		const int length = bytes(key) - 1;
+		memcpy(dst, key.chars, length);
+		dst[length] = '\0';
+	}
+	static int load(StringKeyValue& key, const char* src) {
+		const int length = strnlen(src, STRINGSIZE);
+		memcpy(key.chars, src, length);
+		memset(key.chars + length, 0, sizeof(key.chars) - length);
+		return length + 1;
+	}
+};
+
+/**
+ * @brief Non-leaf of a B-epsilon tree. Child i holds the entries not below pivot i - 1
+ * and below pivot i. The children and pivots are packed into the index bytes, child 0
+ * first and then each pivot with the child to its right, so string pivots take only
+ * their key's length. The index bytes are a sixteenth of the page, and at least two
+ * pivots of the longest key: an integer node has 32 children and room for 479 messages;
+ * a string node of 20 byte keys has about 17 children and room for 28 messages.
+ * Messages are kept in the order they arrived, newest last.
+ */
+template<class Value>
+struct BeNonLeafNode {
+	typedef BePivotKey<Value> PivotKey;
+
+	//                                rid                  key                    child to its right
+	static const int MIN_PIVOT_BYTES = sizeof(RecordId) + PivotKey::MIN_BYTES + sizeof(PageId);
+	static const int MAX_PIVOT_BYTES = sizeof(RecordId) + PivotKey::MAX_BYTES + sizeof(PageId);
+
+	//                                                    child 0
+	static const int INDEX_BYTES = ((Page::SIZE / 16 > (int)sizeof(PageId) + 2 * MAX_PIVOT_BYTES
+		? Page::SIZE / 16 : (int)sizeof(PageId) + 2 * MAX_PIVOT_BYTES) + 7) / 8 * 8;
+
+	/**
+	 * Most pivots a node holds, all of the shortest key
+	 */
+	static const int MAX_PIVOTS = (INDEX_BYTES - sizeof(PageId)) / MIN_PIVOT_BYTES;
+
+	//                                       usage, buffered
+	static const int BUFFER_SIZE = (Page::SIZE - 2 * sizeof(int) - INDEX_BYTES) / sizeof(BeMessage<Value>);
+
+	int usage;
+	int buffered;
+
+	char index[INDEX_BYTES];
+
+	BeMessage<Value> messages[BUFFER_SIZE];
+
+	/**
+	 * Index bytes a pivot and the child to its right take
+	 */
+	static int pivotBytes(const BeEntry<Value>& pivot) {
+		return sizeof(RecordId) + PivotKey::bytes(pivot.key) + sizeof(PageId);
+	}
+
+	/**
+	 * Unpacks the pivots and children. Returns the index bytes they take
+	 */
+	int read(std::vector<BeEntry<Value> >& pivots, std::vector<PageId>& children) const {
+		pivots.resize(usage);
+		children.resize(usage + 1);
+		const char* p = index;
+		memcpy(&children[0], p, sizeof(PageId));
+		p += sizeof(PageId);
+		for(int i = 0; i < usage; i ++) {
+			memcpy(&pivots[i].rid, p, sizeof(RecordId));
+			p += sizeof(RecordId);
+			p += PivotKey::load(pivots[i].key, p);
+			memcpy(&children[i + 1], p, sizeof(PageId));
+			p += sizeof(PageId);
+		}
+		return p - index;
+	}
+
+	/**
+	 * Packs n pivots and the n + 1 children around them, which must fit in the index
+	 * bytes
+	 */
+	void write(const BeEntry<Value>* pivots, const PageId* children, const int n) {
+		usage = n;
+		char* p = index;
+		memcpy(p, &children[0], sizeof(PageId));
+		p += sizeof(PageId);
+		for(int i = 0; i < n; i ++) {
+			memcpy(p, &pivots[i].rid, sizeof(RecordId));
+			p += sizeof(RecordId);
+			PivotKey::store(p, pivots[i].key);
+			p += PivotKey::bytes(pivots[i].key);
+			memcpy(p, &children[i + 1], sizeof(PageId));
+			p += sizeof(PageId);
+		}
+	}
+};
+
+
+/**
+ * @brief Type erased interface of a B-epsilon tree, through which BEpsilonIndex reaches
+ * the tree instantiated for its key type. Keys are passed as pointers to an integer, a
+ * double or a char string.
+ */
+class BEpsilonCore {
+ public:
+	virtual ~BEpsilonCore() { }
+
+	virtual const void createIndexFromRelation(const std::string& relationName) = 0;
+	virtual const void insertEntry(const void* key, const RecordId rid) = 0;
+	virtual const bool deleteEntry(const void* key) = 0;
+	virtual const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp) = 0;
+	virtual const void scanNext(RecordId& outRid) = 0;
+	virtual const void endScan() = 0;
+	virtual const std::size_t bufferedMessages() = 0;
+	virtual const bool validate(bool showInfo) = 0;
+};
+
+
+/**
+ * @brief B-epsilon tree on one key type, with the keys and their order of the BTree of
+ * the same KeyTraits. Instantiated in betree.cpp for IntKeyTraits, DoubleKeyTraits and
+ * StringKeyTraits.
+ *
+ * Inserts and deletes change the tree one at a time, holding treeLatch exclusive. A scan
+ * holds it shared while it reads one leaf and the messages above it, and nothing between
+ * calls.
+ */
+template<class KeyTraits>
+class BEpsilonTree : public BEpsilonCore {
+
+ public:
+	typedef typename KeyTraits::Key Key;
+	typedef typename KeyTraits::Value Value;
+	typedef BeEntry<Value> Entry;
+	typedef BeMessage<Value> Message;
+	typedef BeLeafNode<Value> Leaf;
+	typedef BeNonLeafNode<Value> NonLeaf;
+
+ private:
+
+  /**
+   * A new right sibling of a node that split, and the least entry that goes to it.
+   */
+	struct Split {
+		Entry pivot;
+		PageId pageNo;
+	};
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * Page number of the root and number of non-leaf levels above the leaves.
+   */
+	PageId	rootPageNum;
+	int	height;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+	int	attrByteOffset;
+
+  /**
+   * Held exclusive by inserts and deletes, and shared by scans.
+   */
+	RWLatch	treeLatch;
+
+  /**
+   * State of the scan of startScan: its bounds, where the next leaf to read starts,
+   * and the record ids left from the last one.
+   */
+	bool	scanExecuting;
+	Value	lowVal;
+	Value	highVal;
+	Operator	lowOp;
+	Operator	highOp;
+	Entry	scanTarget;
+	bool	scanMore;
+	std::vector<RecordId>	scanRids;
+	std::size_t	scanPos;
+
+    /**
+     * Entry order: by key, then by page and slot number
+     * */
+    static bool entryLess(const Entry& lhs, const Entry& rhs);
+
+    static Key keyOf(const Entry& entry) {
+        return KeyTraits::key(const_cast<Value&>(entry.key));
+    }
+
+    /**
+     * Number of pivots not above entry: the child the entry goes to
+     * */
+    static int route(const std::vector<Entry>& pivots, const Entry& entry);
+
+    /**
+     * Applies a message to entries, which are in order
+     * */
+    static void apply(std::vector<Entry>& entries, const Message& message);
+
+    /**
+     * Adds messages, oldest first, to the node pageNo at depth level, all of which go
+     * to it. A leaf takes them in; a non-leaf buffers them, flushing the messages of its
+     * fullest child down while the buffer is over full. The new right siblings of the
+     * node, if it split, are added to splits in order. Called with treeLatch exclusive
+     * */
+    const void push(PageId pageNo, int level, std::vector<Message>& messages, std::vector<Split>& splits);
+
+    /**
+     * Writes a non-leaf to pageNo, and to new pages if its pivots and children do not
+     * fit in one node's index bytes
+     * */
+    const void writeNonLeaf(PageId pageNo, std::vector<Entry>& pivots, std::vector<PageId>& children,
+        std::vector<Message>& buffer, std::vector<Split>& splits);
+
+    /**
+     * Adds a message at the root, growing the tree while the root splits
+     * */
+    const void pushRoot(const Message& message);
+
+    /**
+     * Reads the leaf target goes to and applies the messages above it that go to it.
+     * Returns its entries in order in out, and sets hasHigh and high to the least entry
+     * of the leaves to its right, if any. Called with treeLatch held
+     * */
+    const void readLeaf(const Entry& target, std::vector<Entry>& out, bool& hasHigh, Entry& high);
+
+    /**
+     * Reads leaves from scanTarget on until some record ids in range are found or the
+     * range is past
+     * */
+    const void loadScan();
+
+    const bool validate_helper(PageId pageNo, int level, const Entry* low, const Entry* high, std::size_t& messages);
+
+ public:
+
+  /**
+   * Opens the index file of indexName, or creates it and inserts an entry for every
+   * record of relationName.
+   */
+	BEpsilonTree(const std::string& relationName, const std::string& indexName,
+						BufMgr* bufMgrIn, const int attrByteOffset);
+
+	~BEpsilonTree();
+
+	const void createIndexFromRelation(const std::string& relationName);
+
+	const void insertEntry(Key key, const RecordId rid);
+	const bool deleteEntry(Key key);
+	const void startScan(Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+
+	/* Type erased operations */
+	const void insertEntry(const void* key, const RecordId rid);
+	const bool deleteEntry(const void* key);
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const void scanNext(RecordId& outRid);
+	const void endScan();
+	const std::size_t bufferedMessages();
+	const bool validate(bool showInfo);
+};
+
+
+/**
+ * @brief Write optimized alternative to BTreeIndex, with the same constructor, inserts,
+ * deletes and scans. A random insert dirties the root's buffer rather than a leaf, and
+ * leaves are written once for a batch of changes, so inserts cost far fewer page writes.
+ * Deletes and scans read a path down the tree, as in a B+ Tree, and a delete adds a
+ * message like an insert. Leaves emptied by deletes are kept, not merged.
+ */
+class BEpsilonIndex {
+
+ private:
+
+  /**
+   * Tree on the attribute's key type.
+   */
+	BEpsilonCore	*tree;
+
+ public:
+
+	/**
+   * BEpsilonIndex Constructor.
+	 * Open the index file if it exists. If not, create it and insert an entry for every
+	 * tuple in the base relation, as BTreeIndex does without bulk loading.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file: that of the BTreeIndex on the attribute, with ".be" added.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built
+   */
+	BEpsilonIndex(const std::string& relationName, std::string& outIndexName,
+						BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType);
+
+	/**
+   * BEpsilonIndex Destructor.
+	 * End any initialized scan, save the root to the meta page and flush the index file,
+	 * messages still in buffers included.
+	 * */
+	~BEpsilonIndex();
+
+    /**
+	 * Insert a new entry using the pair <value,rid>. The entry is added to the root's
+	 * buffer, and reaches its leaf when the buffers above it fill.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	**/
+	const void insertEntry(const void* key, const RecordId rid);
+
+	/**
+	 * Delete the first record id of a key, in (page, slot) order, as BTreeIndex does.
+	 * Reads the leaves of the key and the messages above them to find it.
+   * @param key			Key to delete, pointer to integer/double/char string
+	 * @return False if the key has no record id.
+	**/
+	const bool deleteEntry(const void* key);
+
+	/**
+	 * Begin a filtered scan of the index, as BTreeIndex::startScan. Record ids come back
+	 * in key and then (page, slot) order, with the messages still in buffers applied.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the index that satisfies the scan criteria.
+	**/
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+	/**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	const void scanNext(RecordId& outRid);
+
+	/**
+	 * Terminate the current scan.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	const void endScan();
+
+	/**
+	 * Number of messages waiting in the buffers of the non-leaves.
+	**/
+	const std::size_t bufferedMessages();
+
+	/**
+	 * Check the order of the entries, pivots and messages, that every message lies in
+	 * the range of its node, and that no node is over full.
+   * @param showInfo	Print the result
+	 * @return True if the tree is valid.
+	**/
+	const bool validate(bool showInfo);
+};
+
+}
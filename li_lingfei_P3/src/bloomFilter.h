@@ -0,0 +1,207 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "types.h"
+#include "page.h"
+
+/**
+ * Bloom filter over the keys of an index. An equality probe for a key the filter has not
+ * seen is answered without reading a page of the tree. Its bits are kept in a chain of
+ * BloomPages after the index's meta page and in memory while the index is open.
+ */
+
+namespace badgerdb
+{
+
+/**
+ * @brief Page of the bits of a Bloom filter.
+ */
+struct BloomPage {
+    static const int WORDS = (Page::SIZE - 2 * sizeof(std::uint32_t)) / sizeof(std::uint64_t);
+
+    /**
+     * Next page of the filter, 0 on its last page
+     */
+    PageId nextPageNo;
+
+    std::uint32_t unused;
+
+    std::uint64_t words[WORDS];
+};
+
+static_assert(sizeof(BloomPage) == Page::SIZE, "a Bloom page fills a page");
+
+/**
+ * @brief Bits of a Bloom filter. Keys are added and probed as 64 bit hashes, from which
+ * the bit positions are derived by double hashing. Any number of threads can add and
+ * probe at once.
+ */
+class BloomFilter {
+ public:
+    BloomFilter(): words(NULL), pages(0), bits(0), hashes(0) { }
+
+    ~BloomFilter() {
+        delete[] words;
+    }
+
+    /**
+     * Clears the filter to the given number of pages of bits and hashes per key. 0 pages
+     * turns it off
+     */
+    void reset(const std::uint32_t pages, const int hashes) {
+        delete[] words;
+        this->pages = pages;
+        this->bits = (std::uint64_t)pages * BloomPage::WORDS * 64;
+        this->hashes = hashes;
+        this->words = (pages == 0) ? NULL : new std::atomic<std::uint64_t>[(std::size_t)pages * BloomPage::WORDS]();
+    }
+
+    bool enabled() const {
+        return bits != 0;
+    }
+
+    std::uint32_t pageCount() const {
+        return pages;
+    }
+
+    int hashCount() const {
+        return hashes;
+    }
+
+    /**
+     * Pages a filter of bitsPerKey bits for each of keys keys takes, at least one
+     */
+    static std::uint32_t pagesFor(const std::size_t keys, const int bitsPerKey) {
+        const std::uint64_t wanted = (std::uint64_t)keys * bitsPerKey;
+        const std::uint64_t perPage = (std::uint64_t)BloomPage::WORDS * 64;
+        return (std::uint32_t)std::max<std::uint64_t>(1, (wanted + perPage - 1) / perPage);
+    }
+
+    /**
+     * Hashes per key that give the fewest false positives at bitsPerKey bits per key
+     */
+    static int hashesFor(const int bitsPerKey) {
+        const int k = (int)(bitsPerKey * 0.69 + 0.5);
+        return std::min(16, std::max(1, k));
+    }
+
+    void add(const std::uint64_t hash) {
+        std::uint64_t h = hash;
+        const std::uint64_t delta = (hash >> 33) | (hash << 31) | 1;
+        for(int i = 0; i < hashes; i ++) {
+            const std::uint64_t bit = h % bits;
+            words[bit >> 6].fetch_or((std::uint64_t)1 << (bit & 63), std::memory_order_relaxed);
+            h += delta;
+        }
+    }
+
+    /**
+     * False only if no key of this hash has been added
+     */
+    bool mayContain(const std::uint64_t hash) const {
+        std::uint64_t h = hash;
+        const std::uint64_t delta = (hash >> 33) | (hash << 31) | 1;
+        for(int i = 0; i < hashes; i ++) {
+            const std::uint64_t bit = h % bits;
+            if(!(words[bit >> 6].load(std::memory_order_relaxed) & ((std::uint64_t)1 << (bit & 63)))) {
+                return false;
+            }
+            h += delta;
+        }
+        return true;
+    }
+
+    /**
+     * Copies the i-th page of bits from or to a page of the filter
+     */
+    void load(const std::uint32_t i, const BloomPage* page) {
+        for(int w = 0; w < BloomPage::WORDS; w ++) {
+            words[(std::size_t)i * BloomPage::WORDS + w].store(page->words[w], std::memory_order_relaxed);
+        }
+    }
+
+    void store(const std::uint32_t i, BloomPage* page) const {
+        for(int w = 0; w < BloomPage::WORDS; w ++) {
+            page->words[w] = words[(std::size_t)i * BloomPage::WORDS + w].load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Mixes the bits of x (the finalizer of MurmurHash3)
+     */
+    static std::uint64_t mix(std::uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb93fe1a85ec5ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    /**
+     * Hash of a key. A double is hashed by the interval of DOUBLEEPSILON it lies in,
+     * see hashNear, so that keys which compare equal can be found by one hash
+     */
+    static std::uint64_t hash(const int key) {
+        return mix((std::uint64_t)(std::uint32_t)key);
+    }
+
+    static std::uint64_t hash(const double key, const double epsilon) {
+        return mix((std::uint64_t)interval(key, epsilon));
+    }
+
+    static std::uint64_t hash(const char* key, const int length) {
+        //FNV-1a over the characters up to length or the terminator
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+        for(int i = 0; i < length && key[i] != '\0'; i ++) {
+            h = (h ^ (std::uint8_t)key[i]) * 0x100000001b3ULL;
+        }
+        return mix(h);
+    }
+
+    /**
+     * Hashes under which a double key is added: those of its interval and of the two
+     * next to it, as any key within epsilon of it lies in one of them. Returns how many
+     */
+    static int hashNear(const double key, const double epsilon, std::uint64_t* out) {
+        const std::int64_t i = interval(key, epsilon);
+        out[0] = mix((std::uint64_t)i);
+        out[1] = mix((std::uint64_t)(i - 1));
+        out[2] = mix((std::uint64_t)(i + 1));
+        return 3;
+    }
+
+ private:
+    /**
+     * Number of the interval of epsilon that key lies in. Doubles too large for it are
+     * at least epsilon apart from each other, and stand for themselves
+     */
+    static std::int64_t interval(const double key, const double epsilon) {
+        const double q = std::floor(key / epsilon);
+        if(std::fabs(q) < 4e18) {
+            return (std::int64_t)q;
+        }
+        std::int64_t bits;
+        memcpy(&bits, &key, sizeof(bits));
+        return bits;
+    }
+
+    std::atomic<std::uint64_t>* words;
+    std::uint32_t pages;
+    std::uint64_t bits;
+    int hashes;
+};
+
+}
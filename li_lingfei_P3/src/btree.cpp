@@ -6,6 +6,7 @@
  */
 
 #include "btree.h"
+#include "btreeNode.h"
 #include "filescan.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
@@ -16,11 +17,18 @@
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/file_io_exception.h"
 
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <map>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <cstdarg>
+#include <cstring>
 
 
 //#define DEBUG
@@ -28,6 +36,34 @@
 namespace badgerdb
 {
 
+const double BTreeIndex::DEFAULT_FILL_FACTOR = 0.9;
+
+//BadIndexInfoException keeps a reference to its reason
+static const std::string FORMAT_VERSION_MISMATCH = "index file format version does not match INDEX_FORMAT_VERSION";
+
+/*
+ * The tree of an index on KeyTraits, with the non-leaves that keep subtree counts if
+ * counted and the plain ones, of larger fanout, otherwise
+ */
+template<class KeyTraits>
+static BTreeCore* newTree(const bool counted, const std::string& relationName, const std::string& indexName,
+        BufMgr* bufMgrIn, const int attrByteOffset, const bool bulkLoad, const double fillFactor, const int bloomBitsPerKey)
+{
+    if(counted) {
+        return new BTree<CountedKeyTraits<KeyTraits> >(relationName, indexName, bufMgrIn, attrByteOffset, bulkLoad, fillFactor, bloomBitsPerKey);
+    }
+    return new BTree<KeyTraits>(relationName, indexName, bufMgrIn, attrByteOffset, bulkLoad, fillFactor, bloomBitsPerKey);
+}
+
+template<class KeyTraits>
+static const std::size_t compactTree(const bool counted, const std::string& indexName, BufMgr* bufMgrIn)
+{
+    if(counted) {
+        return BTree<CountedKeyTraits<KeyTraits> >::compact(indexName, bufMgrIn);
+    }
+    return BTree<KeyTraits>::compact(indexName, bufMgrIn);
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -35,15 +71,13 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		const bool bulkLoad,
+		const double fillFactor,
+		const int bloomBitsPerKey,
+		const bool subtreeCounts)
 {
-
-    dprintf("BTreeIndex: constructor invoked\n");
-
-    //Init buffer manager, attr type, attr offset
-    this->bufMgr = bufMgrIn;
     this->attributeType = attrType;
-    this->attrByteOffset = attrByteOffset;
 
     //Determine index filename
     std::ostringstream idxStr;
@@ -52,28 +86,56 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 
     outIndexName = indexName;
 
-    //Init non-leaf and leaf node occupancy
-    if(attrType == INTEGER) {
-        this->leafOccupancy = INTARRAYLEAFSIZE;
-        this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+    //An existing index keeps the non-leaf format it was created with
+    const bool counted = File::exists(indexName) ? readMetaInfo(indexName, bufMgrIn).subtreeCounts != 0 : subtreeCounts;
 
+    //Pick the tree for the key type and non-leaf format once; every later call goes straight to it
+    if(attrType == INTEGER) {
+        this->tree = newTree<IntKeyTraits>(counted, relationName, indexName, bufMgrIn, attrByteOffset, bulkLoad, fillFactor, bloomBitsPerKey);
     } else if(attrType == DOUBLE) {
-        this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
-        this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+        this->tree = newTree<DoubleKeyTraits>(counted, relationName, indexName, bufMgrIn, attrByteOffset, bulkLoad, fillFactor, bloomBitsPerKey);
+    } else {
+        this->tree = newTree<StringKeyTraits>(counted, relationName, indexName, bufMgrIn, attrByteOffset, bulkLoad, fillFactor, bloomBitsPerKey);
+    }
+}
 
-    } else if(attrType == STRING) {
-        this->leafOccupancy = STRINGARRAYLEAFSIZE;
-        this->nodeOccupancy = STRINGARRAYNONLEAFSIZE;
-        dprintf("sizeof pageno key pair: %d\n", sizeof(PageKeyPair<char*>));
-        dprintf("sizeof internal node: %d\n", sizeof(NonLeafNode<char*>));
+const IndexMetaInfo BTreeIndex::readMetaInfo(const std::string& indexName, BufMgr* bufMgrIn)
+{
+    BlobFile file(indexName, false);
+    Page* metaInfoPage = NULL;
+    bufMgrIn->readPage(&file, 1, metaInfoPage);
+    const IndexMetaInfo info = *(IndexMetaInfo*)metaInfoPage;
+    bufMgrIn->unPinPage(&file, 1, false);
+    bufMgrIn->flushFile(&file);
+    return info;
+}
 
-        dprintf("sizeof rid key pair: %d\n", sizeof(RIDKeyPair<char*>));
-        dprintf("sizeof leaf node: %d\n", sizeof(LeafNode<char*>));
-    }
+// -----------------------------------------------------------------------------
+// BTree::BTree -- Constructor
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+BTree<KeyTraits>::BTree(const std::string & relationName,
+		const std::string & indexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset,
+		const bool bulkLoad,
+		const double fillFactor,
+		const int bloomBitsPerKey)
+{
+
+    dprintf("BTreeIndex: constructor invoked\n");
 
-    dprintf("Node and leaf occupancy: %d, %d\n", this->nodeOccupancy, this->leafOccupancy);
+    //Init buffer manager, attr offset
+    this->bufMgr = bufMgrIn;
+    this->prefetchDepth = BufMgr::DEFAULT_PREFETCH_DEPTH;
+    this->scan = NULL;
+    this->structureVersion = 0;
+    this->edgePageNum = 0;
+    this->edgeHasLow = this->edgeHasHigh = false;
+    this->edgeVersion = 0;
+    this->attrByteOffset = attrByteOffset;
 
-    dprintf("offset of sibling %d\n", offsetof(LeafNode<char*>, rightSibPageNo));
+    dprintf("Non-leaf and leaf capacity: %d, %d\n", NonLeaf::MAX_USAGE, Leaf::MAX_USAGE);
 
     //Open or create the index file
     if(File::exists(indexName)) {
@@ -87,11 +149,26 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
         IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)(metaInfoPage);
         this->rootPageNum = indexMetaInfo->rootPageNo;
         this->height = indexMetaInfo->height;
+        const PageId bloomPageNo = indexMetaInfo->bloomPageNo;
+        const std::uint32_t bloomPages = indexMetaInfo->bloomPages;
+        const int bloomHashes = indexMetaInfo->bloomHashes;
+        this->counted = KeyTraits::COUNTED;
+        const int formatVersion = indexMetaInfo->formatVersion;
 
         dprintf("root: %d height: %d\n", this->rootPageNum, this->height);
 
         //Release meta info page
         this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+        if(formatVersion != INDEX_FORMAT_VERSION) {
+            this->bufMgr->flushFile(this->file);
+            delete this->file;
+            throw BadIndexInfoException(FORMAT_VERSION_MISMATCH);
+        }
+
+        if(bloomPageNo != 0) {
+            this->bloomLoad(bloomPageNo, bloomPages, bloomHashes);
+        }
     }
     else {
         dprintf("BTreeIndex: constructor: new index file created\n");
@@ -105,7 +182,7 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
         IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)metaInfoPage;
         strncpy(indexMetaInfo->relationName, indexName.c_str(), indexName.length());
         indexMetaInfo->attrByteOffset = attrByteOffset;
-        indexMetaInfo->attrType = attrType;
+        indexMetaInfo->attrType = KeyTraits::TYPE;
 
         //Allocate root page for the index file
         PageId rootPageNo = 0;
@@ -113,28 +190,31 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
         this->bufMgr->allocPage(this->file, rootPageNo, rootPage);
         this->rootPageNum = indexMetaInfo->rootPageNo = rootPageNo;
         this->height = indexMetaInfo->height = 0;
+        indexMetaInfo->bloomPageNo = 0;
+        indexMetaInfo->bloomPages = 0;
+        indexMetaInfo->bloomHashes = 0;
+        this->counted = KeyTraits::COUNTED;
+        indexMetaInfo->subtreeCounts = KeyTraits::COUNTED ? 1 : 0;
+        indexMetaInfo->formatVersion = INDEX_FORMAT_VERSION;
 
         //Build the root node as leaf to init the tree structure
-        if(attrType == INTEGER) {
-            LeafNode<int>* rootNode = (LeafNode<int>*)rootPage;
-            rootNode->rightSibPageNo = 0;
-            rootNode->usage = 0;
-
-        } else if(attrType == DOUBLE){
-            LeafNode<double>* rootNode = (LeafNode<double>*)rootPage;
-            rootNode->rightSibPageNo = 0;
-            rootNode->usage = 0;
-        } else {
-            LeafNode<char*>* rootNode = (LeafNode<char*>*)rootPage;
-            rootNode->rightSibPageNo = 0;
-            rootNode->usage = 0;
-        }
+        Leaf* rootNode = (Leaf*)rootPage;
+        rootNode->init();
+
         //Release meta info page
         this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
         //Release root node
         this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
 
-        this->createIndexFromRelation(relationName);
+        if(!bulkLoad) {
+            this->createIndexFromRelation(relationName);
+        } else {
+            this->bulkLoadFromRelation(relationName, fillFactor);
+        }
+
+        if(bloomBitsPerKey > 0) {
+            this->bloomBuild(bloomBitsPerKey);
+        }
 
     }
 //    printMeta();
@@ -145,37 +225,24 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 
 
 //Reads the relation and add all <key, rid> pairs to the index
-const void BTreeIndex::createIndexFromRelation(const std::string& relationName) {
+template<class KeyTraits>
+const void BTree<KeyTraits>::createIndexFromRelation(const std::string& relationName) {
     {
-		FileScan fscan(relationName, this->bufMgr);
+		//The scan recycles a small ring of frames, so the index pages being built stay in the pool
+		FileScan fscan(relationName, this->bufMgr, BufAccessStrategy::DEFAULT_RING_SIZE);
 		try {
 			RecordId scanRid;
 			while(1) {
 				fscan.scanNext(scanRid);
-				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
+				//Read the key straight out of the pinned page; no copy of the record is made
+				const char *record = fscan.getRecordView().data;
 
-                if(this->attributeType == INTEGER) {
-                    int key = *((int*)(record + this->attrByteOffset));
-                    this->insertEntry((void*)&key, scanRid);
-#ifdef DEBUG
-                    std::cout << "Extracted Key: " << key << std::endl;
-#endif
-                } else if(this->attributeType == DOUBLE){
-                    double key = *((double*)(record + this->attrByteOffset));
-                    this->insertEntry((void*)&key, scanRid);
-#ifdef DEBUG
-                    std::cout << "Extracted Key: " << key << std::endl;
-#endif
-                } else {
-                    char key[15];
-                    assignKey(key, (char*)(record + this->attrByteOffset));
-                    this->insertEntry((void*)&key, scanRid);
+                Value key;
+                KeyTraits::load(key, record + this->attrByteOffset);
+                this->insertEntry(KeyTraits::key(key), scanRid);
 #ifdef DEBUG
-                    std::cout << "Extracted Key: " << key << std::endl;
+                std::cout << "Extracted Key: " << KeyTraits::key(key) << std::endl;
 #endif
-                }
 			}
 		} catch(EndOfFileException e) {
 #ifdef DEBUG
@@ -185,430 +252,1983 @@ const void BTreeIndex::createIndexFromRelation(const std::string& relationName)
     }
 }
 
+const void BTreeIndex::createIndexFromRelation(const std::string& relationName) {
+    this->tree->createIndexFromRelation(relationName);
+}
+
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
+// Posting lists
 // -----------------------------------------------------------------------------
-BTreeIndex::~BTreeIndex()
-{ 
-    this->scanExecuting = false;
-
-    //Save meta info to header page
-    Page* metaInfoPage = NULL;
-    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
-    IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)(metaInfoPage);
-    indexMetaInfo->rootPageNo = this->rootPageNum;
-    indexMetaInfo->height = this->height;
-    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
-
-    this->bufMgr->flushFile(this->file);
 
-    delete this->file;
+/* Bytes of the value buffers of leaf entries: any inline list or overflow reference */
+static const int POSTING_VALUE_SIZE = PostingList::MAX_INLINE;
+
+/* Number of codes from codes[0] on that go on one overflow page. Equal codes, the same
+   record id added more than once, are kept on one page, so that a scan can go on from a
+   page after its last code */
+static size_t postingPageCodes(const std::uint64_t* codes, const size_t n) {
+    size_t k = 0;
+    int bytes = 0;
+    while(k < n) {
+        const int length = PostingList::varintLength(codes[k] - (k == 0 ? 0 : codes[k-1]));
+        if(bytes + length > PostingPage::DATA_SIZE) {
+            break;
+        }
+        bytes += length;
+        k ++;
+    }
+    while(k < n && k > 1 && codes[k] == codes[k-1]) {
+        k --;
+    }
+    return k;
 }
 
-// -----------------------------------------------------------------------------
-// Insertion functions
-// -----------------------------------------------------------------------------
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
-{
-    if(this->attributeType == INTEGER) {
-        PageKeyPair<int> ret = this->insertEntry_helper(*(int*)key, rid, this->rootPageNum, 0);
-        this->createNewRoot<int>(ret);
-    }
-    else if(this->attributeType == DOUBLE) {
-        PageKeyPair<double> ret = this->insertEntry_helper(*(double*)key, rid, this->rootPageNum, 0);
-        this->createNewRoot<double>(ret);
+/* Writes codes, which are in order, to a chain of new overflow pages, each filled before
+   the next. Writes the overflow value to out and returns its length */
+static int postingSpill(BufMgr* bufMgr, File* file, const std::uint64_t* codes, const size_t n, char* out) {
+    PostingList::Overflow overflow;
+    overflow.count = n;
+    overflow.headPageNo = overflow.tailPageNo = 0;
+    PostingPage* page = NULL;
+    for(size_t i = 0; i < n; ) {
+        const size_t k = postingPageCodes(codes + i, n - i);
+        PageId newPageNo;
+        Page* newPage;
+        bufMgr->allocPage(file, newPageNo, newPage);
+        PostingPage* next = (PostingPage*)newPage;
+        next->init();
+        next->put(codes + i, k);
+        if(page == NULL) {
+            overflow.headPageNo = newPageNo;
+        } else {
+            page->nextPageNo = newPageNo;
+            bufMgr->unPinPage(file, overflow.tailPageNo, true);
+        }
+        overflow.tailPageNo = newPageNo;
+        page = next;
+        i += k;
     }
-    else {
-        char truncatedKey[STRINGSIZE+1];
-        assignKey(truncatedKey, (char*)key);
-        PageKeyPair<char*> ret = this->insertEntry_helper((char*)truncatedKey, rid, this->rootPageNum, 0);
-        this->createNewRoot<char*>(ret);
+    bufMgr->unPinPage(file, overflow.tailPageNo, true);
+    return PostingList::putOverflow(out, overflow);
+}
+
+/* Writes the value of the list of codes, which are in order, to out: inline if it fits,
+   else spilled to overflow pages. Returns its length */
+static int postingPut(BufMgr* bufMgr, File* file, const std::uint64_t* codes, const size_t n, char* out) {
+    if(PostingList::inlineLength(codes, n) <= PostingList::MAX_INLINE) {
+        return PostingList::putInline(out, codes, n);
     }
-    this->dumpAllLevels();
+    return postingSpill(bufMgr, file, codes, n, out);
 }
 
-template<class T>
-const PageKeyPair<T> BTreeIndex::insertEntry_helper(T key, const RecordId rid, PageId curPageNo, int level) {
-    Page* curPage = NULL;
-    this->bufMgr->readPage(this->file, curPageNo, curPage);
+/* Adds code to the list of value and writes the new value to out, returning its length.
+   Only an inline list grows its value; overflow pages are written right away */
+static int postingAdd(BufMgr* bufMgr, File* file, const char* value, const std::uint64_t code, char* out) {
+    if(!PostingList::isOverflow(value)) {
+        std::vector<std::uint64_t> codes;
+        PostingList::getInline(value, codes);
+        codes.insert(std::upper_bound(codes.begin(), codes.end(), code), code);
+        return postingPut(bufMgr, file, codes.data(), codes.size(), out);
+    }
+
+    PostingList::Overflow overflow = PostingList::overflow(value);
+    Page* page = NULL;
+    bufMgr->readPage(file, overflow.tailPageNo, page);
+    PostingPage* tail = (PostingPage*)page;
+    if(code > tail->last) {
+        //Record ids mostly come in order: append to the tail, or to a new tail
+        if(!tail->append(code)) {
+            PageId newPageNo;
+            Page* newPage;
+            bufMgr->allocPage(file, newPageNo, newPage);
+            PostingPage* next = (PostingPage*)newPage;
+            next->init();
+            next->append(code);
+            tail->nextPageNo = newPageNo;
+            bufMgr->unPinPage(file, newPageNo, true);
+            bufMgr->unPinPage(file, overflow.tailPageNo, true);
+            overflow.tailPageNo = newPageNo;
+        } else {
+            bufMgr->unPinPage(file, overflow.tailPageNo, true);
+        }
+    } else {
+        bufMgr->unPinPage(file, overflow.tailPageNo, false);
+
+        //Insert into the first page whose last code is not less, splitting it if full
+        PageId pageNo = overflow.headPageNo;
+        bufMgr->readPage(file, pageNo, page);
+        while(((PostingPage*)page)->last < code) {
+            const PageId nextPageNo = ((PostingPage*)page)->nextPageNo;
+            bufMgr->unPinPage(file, pageNo, false);
+            pageNo = nextPageNo;
+            bufMgr->readPage(file, pageNo, page);
+        }
+        PostingPage* node = (PostingPage*)page;
+        std::vector<std::uint64_t> codes;
+        node->get(codes);
+        codes.insert(std::upper_bound(codes.begin(), codes.end(), code), code);
+        if(PostingPage::length(codes.data(), codes.size()) <= PostingPage::DATA_SIZE) {
+            node->put(codes.data(), codes.size());
+        } else {
+            int half = codes.size() / 2;
+            while(half > 1 && codes[half] == codes[half-1]) {
+                half --;
+            }
+            PageId newPageNo;
+            Page* newPage;
+            bufMgr->allocPage(file, newPageNo, newPage);
+            PostingPage* right = (PostingPage*)newPage;
+            right->init();
+            right->put(codes.data() + half, codes.size() - half);
+            right->nextPageNo = node->nextPageNo;
+            node->put(codes.data(), half);
+            node->nextPageNo = newPageNo;
+            bufMgr->unPinPage(file, newPageNo, true);
+            if(pageNo == overflow.tailPageNo) {
+                overflow.tailPageNo = newPageNo;
+            }
+        }
+        bufMgr->unPinPage(file, pageNo, true);
+    }
+    overflow.count ++;
+    return PostingList::putOverflow(out, overflow);
+}
 
-    PageKeyPair<T> ret;
+/* Removes the smallest code of the list of value and writes the new value to out.
+   Returns its length, 0 if the list is left empty. Overflow pages that empty are added to
+   dispose; with dispose NULL, returns -1, changing nothing, if a page would empty or if
+   the list is down to one page short enough to go back inline (see postingUnspill) */
+static int postingRemoveFirst(BufMgr* bufMgr, File* file, const char* value, char* out, std::vector<PageId>* dispose) {
+    if(!PostingList::isOverflow(value)) {
+        std::vector<std::uint64_t> codes;
+        PostingList::getInline(value, codes);
+        if(codes.size() == 1) {
+            return 0;
+        }
+        return PostingList::putInline(out, codes.data() + 1, codes.size() - 1);
+    }
+
+    PostingList::Overflow overflow = PostingList::overflow(value);
+    Page* page = NULL;
+    bufMgr->readPage(file, overflow.headPageNo, page);
+    PostingPage* head = (PostingPage*)page;
+    if(dispose == NULL && (head->count == 1 ||
+            (overflow.headPageNo == overflow.tailPageNo && (int)head->bytes <= PostingList::UNSPILL_BYTES))) {
+        bufMgr->unPinPage(file, overflow.headPageNo, false);
+        return -1;
+    }
+    if(head->count == 1) {
+        const PageId nextPageNo = head->nextPageNo;
+        bufMgr->unPinPage(file, overflow.headPageNo, false);
+        dispose->push_back(overflow.headPageNo);
+        if(nextPageNo == 0) {
+            return 0;
+        }
+        overflow.headPageNo = nextPageNo;
+    } else {
+        std::vector<std::uint64_t> codes;
+        head->get(codes);
+        head->put(codes.data() + 1, codes.size() - 1);
+        bufMgr->unPinPage(file, overflow.headPageNo, true);
+    }
+    overflow.count --;
+    return PostingList::putOverflow(out, overflow);
+}
 
-    if(level == this->height){
-        //Base case: Reached leaf
-        LeafNode<T>* node = (LeafNode<T>*)curPage;
+/* If the overflow list of value is down to one page of at most UNSPILL_BYTES, writes it
+   inline to out and returns its length; the page is then the caller's to dispose.
+   Returns 0 otherwise */
+static int postingUnspill(BufMgr* bufMgr, File* file, const char* value, char* out) {
+    if(!PostingList::isOverflow(value)) {
+        return 0;
+    }
+    PostingList::Overflow overflow = PostingList::overflow(value);
+    if(overflow.headPageNo != overflow.tailPageNo) {
+        return 0;
+    }
+    Page* page = NULL;
+    bufMgr->readPage(file, overflow.headPageNo, page);
+    std::vector<std::uint64_t> codes;
+    ((PostingPage*)page)->get(codes);
+    bufMgr->unPinPage(file, overflow.headPageNo, false);
+    if(PostingList::inlineLength(codes.data(), codes.size()) > PostingList::UNSPILL_BYTES) {
+        return 0;
+    }
+    return PostingList::putInline(out, codes.data(), codes.size());
+}
 
-        insertEntryInLeaf<T>(key, rid, node);
 
-        //Split
-        if(node->usage == this->leafOccupancy) {
-            dprintf("splitting...\n");
-            this->dumpAllLevels();
-            PageId newPageNo;
-            Page* newPage;
-            this->bufMgr->allocPage(this->file, newPageNo, newPage);
-            LeafNode<T>* newNode = (LeafNode<T>*)newPage;
-            dprintf("new leaf: %d\n", newPageNo);
+// -----------------------------------------------------------------------------
+// Bulk loading
+// -----------------------------------------------------------------------------
 
-            //redistribute with the full leaf node
-            int cnt = 0;
-            for(int i = this->leafOccupancy/2; i < this->leafOccupancy; i ++) {
-                //newNode is rhs, node is lhs
-                newNode->ridKeyPairArray[cnt].rid = node->ridKeyPairArray[i].rid;
-                assignKey(newNode->ridKeyPairArray[cnt].key, node->ridKeyPairArray[i].key);
-                cnt ++;
-            }
+/* Key order used to sort the entries: the tree's order, but a strict weak ordering
+   (doubles within the equality tolerance still sort by value) */
+inline bool bulkKeyLess(int lhs, int rhs) {
+    return lhs < rhs;
+}
+inline bool bulkKeyLess(double lhs, double rhs) {
+    return lhs < rhs;
+}
 
-            //set usage
-            newNode->usage = cnt;
-            node->usage = this->leafOccupancy - cnt;
+/* Copies the key of an entry out of its record */
+inline void bulkSetKey(RIDKeyPair<int>& pair, const char* field) {
+    memcpy(&pair.key, field, sizeof(int));
+}
+inline void bulkSetKey(RIDKeyPair<double>& pair, const char* field) {
+    memcpy(&pair.key, field, sizeof(double));
+}
 
-            //set sib pointers. note: order is important
-            newNode->rightSibPageNo = node->rightSibPageNo;
-            node->rightSibPageNo = newPageNo;
+/* Orders entries by key, then by record id */
+template<class T>
+struct BulkPairLess {
+    bool operator()(const RIDKeyPair<T>& lhs, const RIDKeyPair<T>& rhs) const {
+        if(bulkKeyLess(lhs.key, rhs.key)) return true;
+        if(bulkKeyLess(rhs.key, lhs.key)) return false;
+        if(lhs.rid.page_number != rhs.rid.page_number) {
+            return lhs.rid.page_number < rhs.rid.page_number;
+        }
+        return lhs.rid.slot_number < rhs.rid.slot_number;
+    }
+};
 
-            //copy up
-            ret.set(newPageNo, newNode->ridKeyPairArray[0].key);
+/*
+ * Writes a sorted run of entries to the sort file through the buffer manager. Run pages
+ * use the leaf layout, filled completely and chained by their sibling pointers.
+ */
+template<class T>
+class BulkRunWriter {
+public:
+    BulkRunWriter(BufMgr* bufMgr, File* file)
+        : bufMgr(bufMgr), file(file), firstPageNo(0), pageNo(0), node(NULL) { }
 
-            //Jobs with the new node is done. Release the new node
-            this->bufMgr->unPinPage(this->file, newPageNo, true);
-        }
+    ~BulkRunWriter() {
+        if(node != NULL) bufMgr->unPinPage(file, pageNo, true);
     }
-    else {
-        //Normal case: internal node
-        NonLeafNode<T>* node = (NonLeafNode<T>*)curPage;
 
-        //Find the position
-        int i;
-        for(i = 0; i < node->usage; i ++ ){
-            if(smallerThan(key, node->pageKeyPairArray[i].key)) {
-                break;
+    void add(const RIDKeyPair<T>& pair) {
+        if(node == NULL || node->usage == LeafNode<T>::ARRAYLEAFSIZE) {
+            PageId newPageNo;
+            Page* newPage;
+            bufMgr->allocPage(file, newPageNo, newPage);
+            if(node == NULL) {
+                firstPageNo = newPageNo;
+            } else {
+                node->rightSibPageNo = newPageNo;
+                bufMgr->unPinPage(file, pageNo, true);
             }
+            pageNo = newPageNo;
+            node = (LeafNode<T>*)newPage;
+            node->usage = 0;
+            node->rightSibPageNo = 0;
         }
+        node->ridKeyPairArray[node->usage ++] = pair;
+    }
 
-        //Recursive call to insert the entry in child
-        PageId childPageNo = node->pageKeyPairArray[i].pageNo;
-        PageKeyPair<T> pushUp = this->insertEntry_helper(key, rid, childPageNo, level + 1);
-
-        //Insert the copy-up entry
-        if(pushUp.pageNo != 0) {
-            insertEntryInNonLeaf(pushUp.key, pushUp.pageNo, node);
-
-            //Split
-            if(node->usage == this->nodeOccupancy) {
-                PageId newPageNo;
-                Page* newPage;
-                this->bufMgr->allocPage(this->file, newPageNo, newPage);
-                NonLeafNode<T>* newNode = (NonLeafNode<T>*)newPage;
-
-                //push up
-                ret.set(newPageNo, node->pageKeyPairArray[this->nodeOccupancy/2].key);
-                                                    
-                //redistribute
-                int cnt = 0;
-                for(int i = this->nodeOccupancy/2+1; i < this->nodeOccupancy; i ++) {
-                    newNode->pageKeyPairArray[cnt].pageNo = node->pageKeyPairArray[i].pageNo;
-                    assignKey(newNode->pageKeyPairArray[cnt].key, node->pageKeyPairArray[i].key);
-                    cnt ++;
-                }
-                newNode->pageKeyPairArray[cnt].pageNo = node->pageKeyPairArray[this->nodeOccupancy].pageNo;
-                assignKey(newNode->pageKeyPairArray[cnt].key, node->pageKeyPairArray[this->nodeOccupancy].key);
+    //Returns the first page of the run
+    PageId finish() {
+        if(node != NULL) {
+            bufMgr->unPinPage(file, pageNo, true);
+            node = NULL;
+        }
+        return firstPageNo;
+    }
 
-                //set usage
-                newNode->usage = cnt;
-                node->usage = this->nodeOccupancy - cnt - 1;
+private:
+    BufMgr* bufMgr;
+    File* file;
+    PageId firstPageNo;
+    PageId pageNo;
+    LeafNode<T>* node;
+};
 
-                //Jobs with the new node is done. Release the new node
-                this->bufMgr->unPinPage(this->file, newPageNo, true);
-            }
+/* Reads a run written by BulkRunWriter, keeping only its current page pinned */
+template<class T>
+class BulkRunReader {
+public:
+    BulkRunReader(BufMgr* bufMgr, File* file, PageId firstPageNo)
+        : bufMgr(bufMgr), file(file), pageNo(firstPageNo), node(NULL), pos(0) {
+        Page* page;
+        bufMgr->readPage(file, pageNo, page);
+        node = (LeafNode<T>*)page;
+    }
+
+    ~BulkRunReader() {
+        if(node != NULL) bufMgr->unPinPage(file, pageNo, false);
+    }
+
+    bool done() const { return node == NULL; }
+
+    const RIDKeyPair<T>& current() const { return node->ridKeyPairArray[pos]; }
+
+    void advance() {
+        if(++ pos < node->usage) return;
+        const PageId nextPageNo = node->rightSibPageNo;
+        bufMgr->unPinPage(file, pageNo, false);
+        node = NULL;
+        pos = 0;
+        if(nextPageNo != 0) {
+            Page* page;
+            pageNo = nextPageNo;
+            bufMgr->readPage(file, pageNo, page);
+            node = (LeafNode<T>*)page;
         }
     }
 
-    this->bufMgr->unPinPage(this->file, curPageNo, true);
-    return ret;
-}
+private:
+    BufMgr* bufMgr;
+    File* file;
+    PageId pageNo;
+    LeafNode<T>* node;
+    int pos;
+};
 
+/* Orders run readers by their current entry, smallest on top of a std heap */
 template<class T>
-const void BTreeIndex::createNewRoot(PageKeyPair<T>& ret) 
-{
-    if(ret.pageNo != 0) {
-        PageId rootPageNo;
-        Page* rootPage;
-        this->bufMgr->allocPage(this->file, rootPageNo, rootPage);
-        NonLeafNode<T>* rootNode = (NonLeafNode<T>*)rootPage;
-
-        dprintf("new root page no: %d\n", rootPageNo);
-        rootNode->pageKeyPairArray[0].pageNo = this->rootPageNum;
-        rootNode->usage = 0;
+struct BulkReaderGreater {
+    bool operator()(const BulkRunReader<T>* lhs, const BulkRunReader<T>* rhs) const {
+        return BulkPairLess<T>()(rhs->current(), lhs->current());
+    }
+};
 
-        this->rootPageNum = rootPageNo;
+/* Merges sorted runs into the sink (a BulkRunWriter or a BulkTreeBuilder) */
+template<class T, class Sink>
+void bulkMergeRuns(BufMgr* bufMgr, File* file, const std::vector<PageId>& runs, Sink& sink) {
+    std::vector<BulkRunReader<T>*> heap;
+    for(size_t i = 0; i < runs.size(); i ++) {
+        heap.push_back(new BulkRunReader<T>(bufMgr, file, runs[i]));
+    }
+    BulkReaderGreater<T> greater;
+    try {
+        std::make_heap(heap.begin(), heap.end(), greater);
+        while(!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            BulkRunReader<T>* reader = heap.back();
+            sink.add(reader->current());
+            reader->advance();
+            if(reader->done()) {
+                delete reader;
+                heap.pop_back();
+            } else {
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+        }
+    } catch(...) {
+        for(size_t i = 0; i < heap.size(); i ++) {
+            delete heap[i];
+        }
+        throw;
+    }
+}
 
-        this->insertEntryInNonLeaf<T>(ret.key, ret.pageNo, rootNode);
+/*
+ * Owns the temporary file runs are spilled to. The file is created on first use, and
+ * closed and removed when the bulk load ends, whether it finished or threw.
+ */
+class BulkSortFile {
+public:
+    BulkSortFile(BufMgr* bufMgr, const std::string& name)
+        : bufMgr(bufMgr), name(name), file(NULL) {
+        if(File::exists(name)) {
+            File::remove(name);
+        }
+    }
 
-        this->bufMgr->unPinPage(this->file, rootPageNo, true);
+    ~BulkSortFile() {
+        if(file == NULL) return;
+        try {
+            bufMgr->flushFile(file);
+        } catch(...) {
+        }
+        delete file;
+        File::remove(name);
+    }
 
-        this->height ++;
+    File* get() {
+        if(file == NULL) {
+            file = new BlobFile(name, true);
+        }
+        return file;
+    }
+
+private:
+    BufMgr* bufMgr;
+    const std::string name;
+    BlobFile* file;
+};
+
+/*
+ * Packs sorted entries into the tree bottom up. The entries of each key become one
+ * posting list, and leaves are filled by bytes up to the fill factor. Once the leaves are
+ * written, the number of nodes on every level above is planned from the number of leaves,
+ * and children are spread evenly over the nodes of a level, so every non-leaf but the
+ * root gets at least the occupancy validate() requires. One node per level is pinned at
+ * a time; a node's first child carries the separator that goes up to the level above.
+ * Subtree counts are summed as the children go up and kept by NonLeaf if it has them.
+ */
+template<class T, class NonLeaf>
+class BulkTreeBuilder {
+public:
+    BulkTreeBuilder(BufMgr* bufMgr, File* file, PageId firstLeafPageNo, int nodeOccupancy, double fillFactor)
+        : bufMgr(bufMgr), file(file), firstLeafPageNo(firstLeafPageNo), nodeOccupancy(nodeOccupancy),
+          fillFactor(fillFactor), leafPageNo(0), leaf(NULL) {
+        leafTarget = std::max(FixedLeafNode<T>::DATA_SIZE/2, (int)(fillFactor * FixedLeafNode<T>::DATA_SIZE));
+    }
+
+    void add(const RIDKeyPair<T>& pair) {
+        if(!codes.empty() && !keyEquals(pair.key, key)) {
+            addKey();
+        }
+        if(codes.empty()) {
+            key = pair.key;
+        }
+        codes.push_back(PostingList::code(pair.rid));
     }
-}
 
+    //Releases the last node of every level and returns the root and the height
+    void finish(PageId& rootPageNo, int& height) {
+        if(!codes.empty()) {
+            addKey();
+        }
+        if(leaf != NULL) {
+            bufMgr->unPinPage(file, leafPageNo, true);
+            leaf = NULL;
+        }
+        if(leaves.size() <= 1) {
+            //The first leaf is the root page of the new index
+            rootPageNo = firstLeafPageNo;
+            height = 0;
+            return;
+        }
 
-template<class T>
-const void BTreeIndex::insertEntryInLeaf(T key, const RecordId rid, LeafNode<T>* node) {
-#ifdef DEBUG
-    std::cout<<"inserting leaf key: "<<key<<std::endl;
-#endif
-    int i = 0;
-    for(i = 0; i < node->usage; i ++ ){
-        if(smallerThan(key, node->ridKeyPairArray[i].key)) {
-            break;
+        //Non-leaf levels count children, one more than keys
+        const int nodeMax = nodeOccupancy - 1;
+        const int nodeTarget = std::max(nodeOccupancy/2-1, (int)(fillFactor * nodeMax));
+        levels.push_back(plan(leaves.size(), nodeTarget + 1, nodeOccupancy/2));
+        while(levels.back().nodes > 1) {
+            levels.push_back(plan(levels.back().nodes, nodeTarget + 1, nodeOccupancy/2));
+        }
+        for(size_t i = 0; i < leaves.size(); i ++) {
+            addChild(0, leaves[i]);
+        }
+        for(size_t l = 0; l < levels.size(); l ++) {
+            if(levels[l].page != NULL) {
+                bufMgr->unPinPage(file, levels[l].pageNo, true);
+                levels[l].page = NULL;
+            }
         }
+        rootPageNo = levels.back().pageNo;
+        height = levels.size();
+    }
+
+private:
+    struct Level {
+        size_t nodes;   //nodes on the level
+        size_t base;    //children per node
+        size_t extra;   //the first extra nodes get one more
+        size_t index;   //node being filled
+        int filled;     //children in it so far
+        PageId pageNo;
+        Page* page;
+    };
+
+    //Puts the posting list of key into the leaf, or into a new one if the leaf is full
+    void addKey() {
+        //Doubles within the equality tolerance are one key, their codes out of order
+        if(!std::is_sorted(codes.begin(), codes.end())) {
+            std::sort(codes.begin(), codes.end());
+        }
+        char value[POSTING_VALUE_SIZE];
+        const int length = postingPut(bufMgr, file, codes.data(), codes.size(), value);
+        const std::uint32_t count = codes.size();
+        codes.clear();
+
+        if(leaf == NULL || leaf->usedBytes() + (int)sizeof(typename FixedLeafNode<T>::Slot) + length > leafTarget) {
+            const PageId previousPageNo = leafPageNo;
+            if(leaf == NULL) {
+                //The empty root leaf of the new index becomes the first leaf
+                leafPageNo = firstLeafPageNo;
+                Page* page;
+                bufMgr->readPage(file, leafPageNo, page);
+                leaf = (FixedLeafNode<T>*)page;
+            } else {
+                Page* page;
+                bufMgr->allocPage(file, leafPageNo, page);
+                leaf->rightSibPageNo = leafPageNo;
+                bufMgr->unPinPage(file, previousPageNo, true);
+                leaf = (FixedLeafNode<T>*)page;
+            }
+            leaf->init();
+            CountedPageKeyPair<T> child;
+            child.set(leafPageNo, key);
+            leaves.push_back(child);
+        }
+        leaf->put(key, value, length);
+        leaves.back().count += count;
     }
 
-    //Shift all elements after this position
-    for(int j = node->usage; j > i; j -- ){
-        node->ridKeyPairArray[j].rid = node->ridKeyPairArray[j-1].rid;
-        assignKey(node->ridKeyPairArray[j].key, node->ridKeyPairArray[j-1].key);
+    static Level plan(size_t entries, size_t target, size_t minimum) {
+        Level level;
+        level.nodes = std::max((size_t)1, (entries + target - 1) / target);
+        while(level.nodes > 1 && entries / level.nodes < minimum) {
+            level.nodes --;
+        }
+        level.base = entries / level.nodes;
+        level.extra = entries % level.nodes;
+        level.index = 0;
+        level.filled = 0;
+        level.pageNo = 0;
+        level.page = NULL;
+        return level;
     }
 
-    node->ridKeyPairArray[i].rid = rid;
-    assignKey(node->ridKeyPairArray[i].key, key);
+    static int quota(const Level& level) {
+        return level.base + (level.index < level.extra ? 1 : 0);
+    }
 
-    dprintf("right sib: %d\n", node->rightSibPageNo);
+    void addChild(size_t l, CountedPageKeyPair<T> child) {
+        Level& level = levels[l];
+        if(level.page == NULL || level.filled == quota(level)) {
+            if(level.page != NULL) {
+                bufMgr->unPinPage(file, level.pageNo, true);
+                level.index ++;
+            }
+            bufMgr->allocPage(file, level.pageNo, level.page);
+            NonLeaf* node = (NonLeaf*)level.page;
+            node->init(child.pageNo);
+            node->setCount(0, child.count);
+            level.filled = 1;
+
+            //push up: the first child's separator separates this node from its left sibling,
+            //and its count is all the node has under it so far
+            if(l + 1 < levels.size()) {
+                CountedPageKeyPair<T> up = child;
+                up.pageNo = level.pageNo;
+                addChild(l + 1, up);
+            }
+            return;
+        }
+        NonLeaf* node = (NonLeaf*)level.page;
+        node->setKey(level.filled - 1, child.key);
+        node->setChild(level.filled, child.pageNo);
+        node->setCount(level.filled, child.count);
+        node->usage = level.filled ++;
+
+        //The nodes being filled above are the ones this node is under, as their last child
+        for(size_t m = l + 1; m < levels.size(); m ++) {
+            NonLeaf* above = (NonLeaf*)levels[m].page;
+            above->addCount(levels[m].filled - 1, child.count);
+        }
+    }
 
-    node->usage ++;
+    BufMgr* bufMgr;
+    File* file;
+    PageId firstLeafPageNo;
+    int nodeOccupancy;
+    double fillFactor;
+    int leafTarget;     //bytes a leaf is filled to
+
+    T key;                              //key being collected, and its codes
+    std::vector<std::uint64_t> codes;
+    PageId leafPageNo;                  //leaf being filled
+    FixedLeafNode<T>* leaf;
+    std::vector<CountedPageKeyPair<T> > leaves;    //first key, page and record ids of every leaf
+    std::vector<Level> levels;          //non-leaf levels, lowest first
+};
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::bulkLoadFromRelation(const std::string& relationName, const double fillFactor) {
+    this->bulkLoad(relationName, fillFactor, (Leaf*)NULL);
 }
 
+template<class KeyTraits>
+const void BTree<KeyTraits>::bulkLoad(const std::string& relationName, const double fillFactor, StringLeafNode*) {
+    this->createIndexFromRelation(relationName);
+}
 
+template<class KeyTraits>
 template<class T>
-const void BTreeIndex::insertEntryInNonLeaf(T key, const PageId pageNo, NonLeafNode<T>* node) {
-#ifdef DEBUG
-    std::cout<<"inserting internal key: "<<key<<" pageNo "<<pageNo<<std::endl;
-#endif
-    int i = 0;
-    for(i = 0; i < node->usage; i ++ ){
-        if(smallerThan(key, node->pageKeyPairArray[i].key)) {
-            break;
+const void BTree<KeyTraits>::bulkLoad(const std::string& relationName, const double fillFactor, FixedLeafNode<T>*) {
+    //Runs are sorted in memory the size of a quarter of the pool and merged through it,
+    //up to a quarter of the pool's frames at a time
+    const size_t runPages = std::max((std::uint32_t)2, this->bufMgr->numFrames() / 4);
+    const size_t runEntries = runPages * LeafNode<Key>::ARRAYLEAFSIZE;
+    const size_t fanIn = runPages;
+
+    BulkSortFile sortFile(this->bufMgr, this->file->filename() + ".sort");
+    std::vector<PageId> runs;
+    std::vector<RIDKeyPair<Key> > entries;
+    size_t numEntries = 0;
+    BulkPairLess<Key> less;
+
+    //Extract the <key, rid> pairs, spilling a sorted run whenever the memory is full
+    {
+        FileScan fscan(relationName, this->bufMgr, BufAccessStrategy::DEFAULT_RING_SIZE);
+        try {
+            RecordId scanRid;
+            while(1) {
+                fscan.scanNext(scanRid);
+                RIDKeyPair<Key> pair;
+                pair.rid = scanRid;
+                bulkSetKey(pair, fscan.getRecordView().data + this->attrByteOffset);
+                entries.push_back(pair);
+                numEntries ++;
+
+                if(entries.size() == runEntries) {
+                    std::sort(entries.begin(), entries.end(), less);
+                    BulkRunWriter<Key> writer(this->bufMgr, sortFile.get());
+                    for(size_t i = 0; i < entries.size(); i ++) {
+                        writer.add(entries[i]);
+                    }
+                    runs.push_back(writer.finish());
+                    entries.clear();
+                }
+            }
+        } catch(EndOfFileException e) {
         }
     }
-
-    //Shift all elements after this position
-    for(int j = node->usage; j > i; j -- ){
-        node->pageKeyPairArray[j+1].pageNo = node->pageKeyPairArray[j+1-1].pageNo;
-        assignKey(node->pageKeyPairArray[j].key, node->pageKeyPairArray[j-1].key);
+    std::sort(entries.begin(), entries.end(), less);
+    if(numEntries == 0) {
+        return;
     }
-    node->pageKeyPairArray[i+1].pageNo = pageNo;
-    assignKey(node->pageKeyPairArray[i].key, key);
 
-    node->usage ++;
+    const double fill = std::min(1.0, std::max(0.5, fillFactor));
+    BulkTreeBuilder<Key, NonLeaf> builder(this->bufMgr, this->file, this->rootPageNum, NonLeaf::MAX_USAGE, fill);
+    if(runs.empty()) {
+        //Everything fit in memory
+        for(size_t i = 0; i < entries.size(); i ++) {
+            builder.add(entries[i]);
+        }
+    } else {
+        if(!entries.empty()) {
+            BulkRunWriter<Key> writer(this->bufMgr, sortFile.get());
+            for(size_t i = 0; i < entries.size(); i ++) {
+                writer.add(entries[i]);
+            }
+            runs.push_back(writer.finish());
+        }
+        std::vector<RIDKeyPair<Key> >().swap(entries);
+
+        //Merge passes until the last one can feed the builder
+        while(runs.size() > fanIn) {
+            std::vector<PageId> merged;
+            for(size_t i = 0; i < runs.size(); i += fanIn) {
+                std::vector<PageId> group(runs.begin() + i, runs.begin() + std::min(i + fanIn, runs.size()));
+                if(group.size() == 1) {
+                    merged.push_back(group[0]);
+                    continue;
+                }
+                BulkRunWriter<Key> writer(this->bufMgr, sortFile.get());
+                bulkMergeRuns<Key>(this->bufMgr, sortFile.get(), group, writer);
+                merged.push_back(writer.finish());
+            }
+            runs.swap(merged);
+        }
+        bulkMergeRuns<Key>(this->bufMgr, sortFile.get(), runs, builder);
+    }
+    builder.finish(this->rootPageNum, this->height);
 }
 
 
 // -----------------------------------------------------------------------------
-// Scan functions
+// Bloom filter
 // -----------------------------------------------------------------------------
-const void BTreeIndex::startScan(const void* lowValParm,
-				   const Operator lowOpParm,
-				   const void* highValParm,
-				   const Operator highOpParm)
+template<class KeyTraits>
+const void BTree<KeyTraits>::bloomBuild(const int bitsPerKey)
 {
-    //Set scan parameters and check scan condition
-    if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
-        throw BadOpcodesException();
+    //Hash every key, walking the leaves from the leftmost
+    std::vector<std::uint64_t> keyHashes;
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        const PageId childPageNo = ((NonLeaf*)curPage)->child(0);
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = childPageNo;
     }
-	this->scanExecuting = true;
-	this->lowOp = lowOpParm;
-	this->highOp = highOpParm;
-
-    if(this->attributeType == INTEGER) {
-        this->lowValInt = *(int*)lowValParm;
-        this->highValInt = *(int*)highValParm;
-        if(smallerThan(this->highValInt, this->lowValInt)) {
-            throw BadScanrangeException();
+    std::size_t keys = 0;
+    while(curPageNo != 0) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        Leaf* node = (Leaf*)curPage;
+        Value key;
+        for(int i = 0; i < node->usage; i ++) {
+            std::uint64_t hashes[3];
+            const int n = KeyTraits::hashes(node->key(i, key), hashes);
+            keyHashes.insert(keyHashes.end(), hashes, hashes + n);
         }
-    }
-    else if(this->attributeType == DOUBLE) {
-        this->lowValDouble = *(double*)lowValParm;
-        this->highValDouble = *(double*)highValParm;
-        if(smallerThan(this->highValDouble, this->lowValDouble)) {
-            throw BadScanrangeException();
+        keys += node->usage;
+        const PageId nextPageNo = node->rightSibPageNo;
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = nextPageNo;
+    }
+
+    this->filter.reset(BloomFilter::pagesFor(keys, bitsPerKey), BloomFilter::hashesFor(bitsPerKey));
+    for(std::size_t i = 0; i < keyHashes.size(); i ++) {
+        this->filter.add(keyHashes[i]);
+    }
+
+    //Chain its pages; they need not be consecutive in the file
+    PageId firstPageNo = 0;
+    PageId lastPageNo = 0;
+    for(std::uint32_t i = 0; i < this->filter.pageCount(); i ++) {
+        PageId pageNo;
+        Page* page = NULL;
+        this->bufMgr->allocPage(this->file, pageNo, page);
+        ((BloomPage*)page)->nextPageNo = 0;
+        ((BloomPage*)page)->unused = 0;
+        this->bufMgr->unPinPage(this->file, pageNo, true);
+        if(lastPageNo == 0) {
+            firstPageNo = pageNo;
+        } else {
+            this->bufMgr->readPage(this->file, lastPageNo, page);
+            ((BloomPage*)page)->nextPageNo = pageNo;
+            this->bufMgr->unPinPage(this->file, lastPageNo, true);
         }
+        lastPageNo = pageNo;
     }
-    else {
-        assignKey(this->lowValString, (char*)lowValParm);
-        assignKey(this->highValString, (char*)highValParm);
-        if(smallerThan(this->highValString, this->lowValString)) {
-            throw BadScanrangeException();
-        }
+    this->bloomStore(firstPageNo);
+
+    Page* metaInfoPage = NULL;
+    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+    IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)metaInfoPage;
+    indexMetaInfo->bloomPageNo = firstPageNo;
+    indexMetaInfo->bloomPages = this->filter.pageCount();
+    indexMetaInfo->bloomHashes = this->filter.hashCount();
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::bloomLoad(const PageId firstPageNo, const std::uint32_t pages, const int hashes)
+{
+    this->filter.reset(pages, hashes);
+    PageId pageNo = firstPageNo;
+    for(std::uint32_t i = 0; i < pages; i ++) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, pageNo, page);
+        this->filter.load(i, (BloomPage*)page);
+        const PageId nextPageNo = ((BloomPage*)page)->nextPageNo;
+        this->bufMgr->unPinPage(this->file, pageNo, false);
+        pageNo = nextPageNo;
     }
+}
 
-    //Locate scan starting position
-    if(this->attributeType == INTEGER) {
-        this->startScan_helper<int>(*(int*)lowValParm, lowOpParm, *(int*)highValParm, highOpParm);
+template<class KeyTraits>
+const void BTree<KeyTraits>::bloomStore(const PageId firstPageNo)
+{
+    PageId pageNo = firstPageNo;
+    for(std::uint32_t i = 0; i < this->filter.pageCount(); i ++) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, pageNo, page);
+        this->filter.store(i, (BloomPage*)page);
+        const PageId nextPageNo = ((BloomPage*)page)->nextPageNo;
+        this->bufMgr->unPinPage(this->file, pageNo, true);
+        pageNo = nextPageNo;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Compaction
+// -----------------------------------------------------------------------------
+const std::size_t BTreeIndex::compact(const std::string& indexName, BufMgr* bufMgrIn)
+{
+    if(File::isOpen(indexName)) {
+        throw FileOpenException(indexName);
     }
-    else if(this->attributeType == DOUBLE) {
-        this->startScan_helper<double>(*(double*)lowValParm, lowOpParm, *(double*)highValParm, highOpParm);
+
+    //The meta page tells the key type and the non-leaf format
+    const IndexMetaInfo info = readMetaInfo(indexName, bufMgrIn);
+    if(info.formatVersion != INDEX_FORMAT_VERSION) {
+        throw BadIndexInfoException(FORMAT_VERSION_MISMATCH);
     }
-    else {
-        this->startScan_helper<char*>((char*)lowValParm, lowOpParm, (char*)highValParm, highOpParm);
+
+    if(info.attrType == INTEGER) {
+        return compactTree<IntKeyTraits>(info.subtreeCounts != 0, indexName, bufMgrIn);
+    } else if(info.attrType == DOUBLE) {
+        return compactTree<DoubleKeyTraits>(info.subtreeCounts != 0, indexName, bufMgrIn);
     }
+    return compactTree<StringKeyTraits>(info.subtreeCounts != 0, indexName, bufMgrIn);
 }
 
-template<class T>
-const void BTreeIndex::startScan_helper(T lowKeyVal,
-				   const Operator lowOpParm,
-				   T highKeyVal,
-				   const Operator highOpParm)
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::compact(const std::string& indexName, BufMgr* bufMgrIn)
 {
-    int level = 0;
-    PageId curPageNo = this->rootPageNum;
-    Page* curPage = NULL;
-    while(level++ < this->height) {
-        this->bufMgr->readPage(this->file, curPageNo, curPage);
+    enum { META, NON_LEAF, LEAF, POSTING, BLOOM };
 
-        NonLeafNode<T>* curNode = (NonLeafNode<T>*)curPage;
+    const std::string compactName = indexName + ".compact";
+    if(File::exists(compactName)) {
+        File::remove(compactName);
+    }
 
-        //Note: we must scan from rhs until some key less than the or equal to lowVal. 
-        int i = curNode->usage - 1;
-        for(i = curNode->usage - 1; i >= 0; i -- ){
-            if(smallerThanOrEquals<T>(curNode->pageKeyPairArray[i].key, lowKeyVal)) {
-                break;
+    std::size_t oldPages, newPages;
+    {
+        BlobFile in(indexName, false);
+        BlobFile out(compactName, true);
+
+        Page* page = NULL;
+        bufMgrIn->readPage(&in, 1, page);
+        const IndexMetaInfo meta = *(IndexMetaInfo*)page;
+        bufMgrIn->unPinPage(&in, 1, false);
+
+        //List the pages in use in the order they are written, with what each holds
+        std::vector<PageId> pages(1, 1);
+        std::vector<int> kinds(1, META);
+        std::vector<PageId> postingPages;
+        std::vector<PageId> level(1, meta.rootPageNo);
+        for(int depth = 0; depth <= meta.height; depth ++) {
+            std::vector<PageId> below;
+            for(size_t i = 0; i < level.size(); i ++) {
+                bufMgrIn->readPage(&in, level[i], page);
+                if(depth < meta.height) {
+                    NonLeaf* node = (NonLeaf*)page;
+                    for(int c = 0; c <= node->usage; c ++) {
+                        below.push_back(node->child(c));
+                    }
+                } else {
+                    Leaf* node = (Leaf*)page;
+                    for(int e = 0; e < node->usage; e ++) {
+                        if(!PostingList::isOverflow(node->value(e))) {
+                            continue;
+                        }
+                        PageId pageNo = PostingList::overflow(node->value(e)).headPageNo;
+                        while(pageNo != 0) {
+                            Page* postingPage = NULL;
+                            bufMgrIn->readPage(&in, pageNo, postingPage);
+                            postingPages.push_back(pageNo);
+                            const PageId nextPageNo = ((PostingPage*)postingPage)->nextPageNo;
+                            bufMgrIn->unPinPage(&in, pageNo, false);
+                            pageNo = nextPageNo;
+                        }
+                    }
+                }
+                bufMgrIn->unPinPage(&in, level[i], false);
+                pages.push_back(level[i]);
+                kinds.push_back(depth < meta.height ? NON_LEAF : LEAF);
             }
+            level.swap(below);
+        }
+        pages.insert(pages.end(), postingPages.begin(), postingPages.end());
+        kinds.insert(kinds.end(), postingPages.size(), POSTING);
+        PageId bloomPageNo = meta.bloomPageNo;
+        for(std::uint32_t i = 0; bloomPageNo != 0 && i < meta.bloomPages; i ++) {
+            bufMgrIn->readPage(&in, bloomPageNo, page);
+            pages.push_back(bloomPageNo);
+            kinds.push_back(BLOOM);
+            const PageId nextPageNo = ((BloomPage*)page)->nextPageNo;
+            bufMgrIn->unPinPage(&in, bloomPageNo, false);
+            bloomPageNo = nextPageNo;
         }
 
-        PageId tmpPageNo = curNode->pageKeyPairArray[i + 1].pageNo; //Use the page ptr to the found key's right
+        //A new file hands out its pages in order, so the i-th page listed becomes page i + 1
+        std::map<PageId, PageId> renumbered;
+        renumbered[0] = 0;
+        for(size_t i = 0; i < pages.size(); i ++) {
+            renumbered[pages[i]] = i + 1;
+        }
 
-        dprintf("searching internal node... next page: %d\n", tmpPageNo);
+        //Copy each page, pointing its page numbers at the new pages
+        for(size_t i = 0; i < pages.size(); i ++) {
+            Page* newPage = NULL;
+            PageId newPageNo;
+            bufMgrIn->readPage(&in, pages[i], page);
+            bufMgrIn->allocPage(&out, newPageNo, newPage);
+            assert(newPageNo == renumbered[pages[i]]);
+            memcpy(newPage, page, Page::SIZE);
+            bufMgrIn->unPinPage(&in, pages[i], false);
+
+            if(kinds[i] == META) {
+                IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)newPage;
+                indexMetaInfo->rootPageNo = renumbered[indexMetaInfo->rootPageNo];
+                indexMetaInfo->bloomPageNo = renumbered[indexMetaInfo->bloomPageNo];
+            } else if(kinds[i] == NON_LEAF) {
+                NonLeaf* node = (NonLeaf*)newPage;
+                for(int c = 0; c <= node->usage; c ++) {
+                    node->setChild(c, renumbered[node->child(c)]);
+                }
+            } else if(kinds[i] == LEAF) {
+                Leaf* node = (Leaf*)newPage;
+                node->rightSibPageNo = renumbered[node->rightSibPageNo];
+                for(int e = 0; e < node->usage; e ++) {
+                    if(!PostingList::isOverflow(node->value(e))) {
+                        continue;
+                    }
+                    PostingList::Overflow overflow = PostingList::overflow(node->value(e));
+                    overflow.headPageNo = renumbered[overflow.headPageNo];
+                    overflow.tailPageNo = renumbered[overflow.tailPageNo];
+                    char value[PostingList::OVERFLOW_BYTES];
+                    PostingList::putOverflow(value, overflow);
+                    Value key;
+                    node->put(node->key(e, key), value, PostingList::OVERFLOW_BYTES);
+                }
+            } else if(kinds[i] == POSTING) {
+                PostingPage* postingPage = (PostingPage*)newPage;
+                postingPage->nextPageNo = renumbered[postingPage->nextPageNo];
+            } else {
+                BloomPage* bloomPage = (BloomPage*)newPage;
+                bloomPage->nextPageNo = renumbered[bloomPage->nextPageNo];
+            }
+            bufMgrIn->unPinPage(&out, newPageNo, true);
+        }
+
+        oldPages = in.pageCount();
+        newPages = out.pageCount();
+        bufMgrIn->flushFile(&out);
+        bufMgrIn->flushFile(&in);
+    }
+
+    //rename replaces the old file in one step, so a crash leaves one whole index file
+    if(std::rename(compactName.c_str(), indexName.c_str()) != 0) {
+        throw FileIOException(indexName, errno);
+    }
+    return oldPages - newPages;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+BTreeIndex::~BTreeIndex()
+{
+    delete this->tree;
+}
+
+template<class KeyTraits>
+BTree<KeyTraits>::~BTree()
+{ 
+    //End the scan of startScan; cursors from openScan must be deleted before the tree
+    delete this->scan;
+    this->scan = NULL;
+
+    //Save meta info to header page
+    Page* metaInfoPage = NULL;
+    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+    IndexMetaInfo* indexMetaInfo = (IndexMetaInfo*)(metaInfoPage);
+    indexMetaInfo->rootPageNo = this->rootPageNum;
+    indexMetaInfo->height = this->height;
+    const PageId bloomPageNo = indexMetaInfo->bloomPageNo;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+    //Keys inserted since the filter was read have set more of its bits
+    if(this->filter.enabled()) {
+        this->bloomStore(bloomPageNo);
+    }
+
+    this->bufMgr->flushFile(this->file);
+
+    delete this->file;
+}
+
+// -----------------------------------------------------------------------------
+// Insertion functions
+// -----------------------------------------------------------------------------
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+{
+    this->tree->insertEntry(key, rid);
+}
 
+template<class KeyTraits>
+const void BTree<KeyTraits>::insertEntry(const void *key, const RecordId rid)
+{
+    //String keys are cut to STRINGSIZE characters here
+    Value value;
+    KeyTraits::load(value, key);
+    this->insertEntry(KeyTraits::key(value), rid);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::insertEntry(Key key, const RecordId rid)
+{
+    if(this->filter.enabled()) {
+        std::uint64_t hashes[3];
+        const int n = KeyTraits::hashes(key, hashes);
+        for(int i = 0; i < n; i ++) {
+            this->filter.add(hashes[i]);
+        }
+    }
+
+    //Most inserts only add to one leaf, which other threads can do alongside
+    {
+        SharedLatchGuard shared(this->treeLatch);
+        if(this->insertEntryInPlace(key, rid)) {
+            return;
+        }
+    }
+
+    //The leaf splits: insert again with the tree to ourselves
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    this->structureVersion ++;
+    PageKeyPair<Value> ret = this->insertEntry_helper(key, rid, this->rootPageNum, 0, LEFT_EDGE | RIGHT_EDGE);
+    this->createNewRoot(ret);
+    this->dumpAllLevels();
+}
+
+template<class KeyTraits>
+const PageId BTree<KeyTraits>::findLeaf(Key key, Path* path)
+{
+    //No node has split or merged since the edge leaf was set, so its range still holds
+    if(path == NULL && this->edgePageNum != 0 && this->edgeVersion == this->structureVersion
+            && (!this->edgeHasLow || !smallerThan(key, KeyTraits::key(this->edgeLow)))
+            && (!this->edgeHasHigh || smallerThan(key, KeyTraits::key(this->edgeHigh)))) {
+        return this->edgePageNum;
+    }
+
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        NonLeaf* node = (NonLeaf*)curPage;
+        const int c = node->upperBound(key);
+        PageId childPageNo = node->child(c);
         this->bufMgr->unPinPage(this->file, curPageNo, false);
+        if(path != NULL) {
+            path->pageNo[level] = curPageNo;
+            path->child[level] = c;
+        }
+        curPageNo = childPageNo;
+    }
+    if(path != NULL) {
+        path->length = this->height;
+    }
+    return curPageNo;
+}
 
-        curPageNo = tmpPageNo;
+template<class KeyTraits>
+const void BTree<KeyTraits>::addToPath(const Path& path, const int delta)
+{
+    //The counts are added to atomically, so the pages are only read latched
+    for(int level = 0; level < path.length; level ++) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, path.pageNo[level], page);
+        ((NonLeaf*)page)->addCount(path.child[level], delta);
+        this->bufMgr->unPinPage(this->file, path.pageNo[level], true);
     }
+}
 
-    dprintf("leaf page no: %d\n", curPageNo);
+template<class KeyTraits>
+const std::uint64_t BTree<KeyTraits>::subtreeCount(const PageId pageNo, const bool leaf)
+{
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    std::uint64_t count = 0;
+    if(leaf) {
+        const Leaf* node = (const Leaf*)page;
+        for(int i = 0; i < node->usage; i ++) {
+            count += PostingList::count(node->value(i));
+        }
+    } else {
+        const NonLeaf* node = (const NonLeaf*)page;
+        for(int i = 0; i <= node->usage; i ++) {
+            count += node->count(i);
+        }
+    }
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    return count;
+}
 
-    PageId leafPageNo = curPageNo;
+template<class KeyTraits>
+const bool BTree<KeyTraits>::insertEntryInPlace(Key key, const RecordId rid)
+{
+    Path path;
+    PageId leafPageNo = this->findLeaf(key, this->counted ? &path : NULL);
+    std::lock_guard<RWLatch> leaf(this->leafLatch(leafPageNo));
     Page* leafPage = NULL;
     this->bufMgr->readPage(this->file, leafPageNo, leafPage);
+    Leaf* node = (Leaf*)leafPage;
+
+    //A new key gets a list of one; an overflow list is added to on its pages and keeps
+    //the length of its value, so only an inline list that grows can fail to fit
+    char value[POSTING_VALUE_SIZE];
+    const std::uint64_t code = PostingList::code(rid);
+    const int i = node->find(key);
+    const int length = (i < 0)
+        ? PostingList::putInline(value, &code, 1)
+        : postingAdd(this->bufMgr, this->file, node->value(i), code, value);
+
+    //insertEntry_helper splits a leaf the entry does not fit in
+    if(!node->put(key, value, length)) {
+        this->bufMgr->unPinPage(this->file, leafPageNo, false);
+        return false;
+    }
+    this->bufMgr->unPinPage(this->file, leafPageNo, true);
+    if(this->counted) {
+        this->addToPath(path, 1);
+    }
+    return true;
+}
+
+/* Sets the count of the child pageNo of node, if it is one of its children */
+template<class NonLeaf>
+static void setChildCount(NonLeaf* node, const PageId pageNo, const std::uint64_t count) {
+    for(int i = 0; i <= node->usage; i ++) {
+        if(node->child(i) == pageNo) {
+            node->setCount(i, (std::uint32_t)count);
+            return;
+        }
+    }
+}
+
+template<class KeyTraits>
+const PageKeyPair<typename KeyTraits::Value> BTree<KeyTraits>::insertEntry_helper(Key key, const RecordId rid, PageId curPageNo, int level, const int edge) {
+    Page* curPage = NULL;
+    this->bufMgr->readPage(this->file, curPageNo, curPage);
+
+    PageKeyPair<Value> ret;
+
+    if(level == this->height){
+        //Base case: Reached leaf
+        Leaf* node = (Leaf*)curPage;
+        char value[POSTING_VALUE_SIZE];
+        const std::uint64_t code = PostingList::code(rid);
+        const int i = node->find(key);
+        const int length = (i < 0)
+            ? PostingList::putInline(value, &code, 1)
+            : postingAdd(this->bufMgr, this->file, node->value(i), code, value);
+
+        //Split
+        if(!node->put(key, value, length)) {
+            dprintf("splitting...\n");
+            this->dumpAllLevels();
+            PageId newPageNo;
+            Page* newPage;
+            this->bufMgr->allocPage(this->file, newPageNo, newPage);
+            Leaf* newNode = (Leaf*)newPage;
+            dprintf("new leaf: %d\n", newPageNo);
+
+            //newNode is rhs, node is lhs; the separator is copied up. A key past the end of
+            //the last leaf leaves it nearly full, and the same for the first leaf
+            const double fill = splitFill(edge, node->lowerBound(key) == 0, node->upperBound(key) == node->usage);
+            node->splitPut(key, value, length, newNode, ret.key, fill);
+            ret.pageNo = newPageNo;
+
+            //set sib pointers. note: order is important
+            newNode->rightSibPageNo = node->rightSibPageNo;
+            node->rightSibPageNo = newPageNo;
+
+            //The next keys in the same order go to the leaf this one went to
+            if((edge & RIGHT_EDGE) && !smallerThan(key, KeyTraits::key(ret.key))) {
+                this->edgePageNum = newPageNo;
+                KeyTraits::assign(this->edgeLow, KeyTraits::key(ret.key));
+                this->edgeHasLow = true;
+                this->edgeHasHigh = false;
+                this->edgeVersion = this->structureVersion;
+            } else if((edge & LEFT_EDGE) && smallerThan(key, KeyTraits::key(ret.key))) {
+                this->edgePageNum = curPageNo;
+                KeyTraits::assign(this->edgeHigh, KeyTraits::key(ret.key));
+                this->edgeHasLow = false;
+                this->edgeHasHigh = true;
+                this->edgeVersion = this->structureVersion;
+            }
+
+            //Jobs with the new node is done. Release the new node
+            this->bufMgr->unPinPage(this->file, newPageNo, true);
+        }
+    }
+    else {
+        //Normal case: internal node
+        NonLeaf* node = (NonLeaf*)curPage;
+
+        //Recursive call to insert the entry in child, which is at an edge if it is the
+        //first or last child of a node there
+        const int c = node->upperBound(key);
+        PageId childPageNo = node->child(c);
+        const int childEdge = ((edge & LEFT_EDGE) && c == 0 ? LEFT_EDGE : 0)
+            | ((edge & RIGHT_EDGE) && c == node->usage ? RIGHT_EDGE : 0);
+        PageKeyPair<Value> pushUp = this->insertEntry_helper(key, rid, childPageNo, level + 1, childEdge);
+
+        //A child that did not split has one more record id. One that did is counted
+        //again with its new sibling once they are placed
+        if(this->counted && pushUp.pageNo == 0) {
+            node->addCount(c, 1);
+        }
+        std::uint64_t counts[2] = {0, 0};
+        if(this->counted && pushUp.pageNo != 0) {
+            counts[0] = this->subtreeCount(childPageNo, level + 1 == this->height);
+            counts[1] = this->subtreeCount(pushUp.pageNo, level + 1 == this->height);
+        }
+
+        //Insert the copy-up entry, splitting the node if it does not fit
+        if(pushUp.pageNo != 0 && !node->insert(KeyTraits::key(pushUp.key), pushUp.pageNo)) {
+            PageId newPageNo;
+            Page* newPage;
+            this->bufMgr->allocPage(this->file, newPageNo, newPage);
+            NonLeaf* newNode = (NonLeaf*)newPage;
+
+            //the middle key is pushed up, or one near the end the new child is at
+            const int i = node->upperBound(KeyTraits::key(pushUp.key));
+            node->splitInsert(KeyTraits::key(pushUp.key), pushUp.pageNo, newNode, ret.key,
+                splitFill(edge, i == 0, i == node->usage));
+            ret.pageNo = newPageNo;
+
+            if(this->counted) {
+                setChildCount(newNode, childPageNo, counts[0]);
+                setChildCount(newNode, pushUp.pageNo, counts[1]);
+            }
+
+            //Jobs with the new node is done. Release the new node
+            this->bufMgr->unPinPage(this->file, newPageNo, true);
+        }
+        if(this->counted && pushUp.pageNo != 0) {
+            setChildCount(node, childPageNo, counts[0]);
+            setChildCount(node, pushUp.pageNo, counts[1]);
+        }
+    }
+
+    this->bufMgr->unPinPage(this->file, curPageNo, true);
+    return ret;
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::createNewRoot(PageKeyPair<Value>& ret) 
+{
+    if(ret.pageNo != 0) {
+        PageId rootPageNo;
+        Page* rootPage;
+        this->bufMgr->allocPage(this->file, rootPageNo, rootPage);
+        NonLeaf* rootNode = (NonLeaf*)rootPage;
+
+        dprintf("new root page no: %d\n", rootPageNo);
+        rootNode->init(this->rootPageNum);
+
+        this->rootPageNum = rootPageNo;
+
+        rootNode->insert(KeyTraits::key(ret.key), ret.pageNo);
+        if(this->counted) {
+            rootNode->setCount(0, this->subtreeCount(rootNode->child(0), this->height == 0));
+            rootNode->setCount(1, this->subtreeCount(ret.pageNo, this->height == 0));
+        }
+
+        this->bufMgr->unPinPage(this->file, rootPageNo, true);
+
+        this->height ++;
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+// Scan functions
+// -----------------------------------------------------------------------------
+ScanCursor* BTreeIndex::openScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    return this->tree->openScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+ScanCursor* BTree<KeyTraits>::openScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    Value low, high;
+    KeyTraits::load(low, lowValParm);
+    KeyTraits::load(high, highValParm);
+    return this->openScan(KeyTraits::key(low), lowOpParm, KeyTraits::key(high), highOpParm);
+}
+
+template<class KeyTraits>
+typename BTree<KeyTraits>::Cursor* BTree<KeyTraits>::openScan(Key lowValParm,
+				   const Operator lowOpParm,
+				   Key highValParm,
+				   const Operator highOpParm)
+{
+    return new Cursor(this, lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+const void BTreeIndex::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    this->tree->startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    Value low, high;
+    KeyTraits::load(low, lowValParm);
+    KeyTraits::load(high, highValParm);
+    this->startScan(KeyTraits::key(low), lowOpParm, KeyTraits::key(high), highOpParm);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::startScan(Key lowValParm,
+				   const Operator lowOpParm,
+				   Key highValParm,
+				   const Operator highOpParm)
+{
+    //End the running scan, if any, before the new one pins its leaf
+    delete this->scan;
+    this->scan = NULL;
+    this->scan = new Cursor(this, lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+BTree<KeyTraits>::Cursor::Cursor(BTree* tree,
+				   Key lowValParm,
+				   const Operator lowOpParm,
+				   Key highValParm,
+				   const Operator highOpParm)
+{
+    //Set scan parameters and check scan condition
+    if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
+    }
+    this->tree = tree;
+    this->lowOp = lowOpParm;
+    this->highOp = highOpParm;
+
+    KeyTraits::assign(this->lowVal, lowValParm);
+    KeyTraits::assign(this->highVal, highValParm);
+    if(smallerThan(KeyTraits::key(this->highVal), KeyTraits::key(this->lowVal))) {
+        throw BadScanrangeException();
+    }
+
+    //Locate scan starting position
+    this->rids.reserve(Leaf::MAX_USAGE);
+    this->ridCount = this->ridPos = 0;
+    this->hasLastKey = false;
+    this->nextCode = 0;
+    this->postingPageNum = 0;
+    this->seek();
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::Cursor::seek()
+{
+    this->scanLeaves.clear();
+    this->scanLeafPos = 0;
+    this->scanLeafIssued = 0;
+    SharedLatchGuard shared(this->tree->treeLatch);
+    const PageId curPageNo = this->collectLeaves(KeyTraits::key(this->lowVal), false);
+
+    dprintf("leaf page no: %d\n", curPageNo);
+
+    this->readAhead();
+    this->readLeaf(curPageNo, true);
+}
+
+template<class KeyTraits>
+const PageId BTree<KeyTraits>::Cursor::collectLeaves(Key key, const bool withLeaf)
+{
+    const Key highKeyVal = KeyTraits::key(this->highVal);
+    File* file = this->tree->file;
+    BufMgr* bufMgr = this->tree->bufMgr;
+    int level = 0;
+    PageId curPageNo = this->tree->rootPageNum;
+    Page* curPage = NULL;
+    this->hasFence = false;
+    while(level++ < this->tree->height) {
+        bufMgr->readPage(file, curPageNo, curPage);
+
+        NonLeaf* curNode = (NonLeaf*)curPage;
+
+        //Note: we must find the last key less than or equal to key, and take the page ptr to its right.
+        int i = curNode->upperBound(key);
+
+        PageId tmpPageNo = curNode->child(i);
+
+        dprintf("searching internal node... next page: %d\n", tmpPageNo);
+
+        //The least separator to the right of the path bounds the leaves of the last parent
+        if(i < curNode->usage) {
+            Value separator;
+            const Key separatorKey = curNode->key(i, separator);
+            if(!this->hasFence || smallerThan(separatorKey, KeyTraits::key(this->fence))) {
+                KeyTraits::assign(this->fence, separatorKey);
+                this->hasFence = true;
+            }
+        }
 
-    LeafNode<T>* leafNode = (LeafNode<T>*)leafPage;
+        //Remember the leaves to the right that may hold keys in range, to read them ahead:
+        //those whose lhs key is not greater than highVal
+        if(level == this->tree->height) {
+            const int last = curNode->upperBound(highKeyVal);
+            for(int j = withLeaf ? i : i + 1; j <= last; j ++ ) {
+                this->scanLeaves.push_back(curNode->child(j));
+            }
+        }
+
+        bufMgr->unPinPage(file, curPageNo, false);
+
+        curPageNo = tmpPageNo;
+    }
+
+    //No leaf right of the fence holds a key in range
+    if(this->hasFence && smallerThan(highKeyVal, KeyTraits::key(this->fence))) {
+        this->hasFence = false;
+    }
+    return curPageNo;
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::Cursor::readLeaf(PageId pageNo, const bool seeking)
+{
+    const Key highKeyVal = KeyTraits::key(this->highVal);
+    BufMgr* bufMgr = this->tree->bufMgr;
+    File* file = this->tree->file;
+    SharedLatchGuard leaf(this->tree->leafLatch(pageNo));
+    Page* page = NULL;
+    bufMgr->readPage(file, pageNo, page);
+    Leaf* node = (Leaf*)page;
+
+    //First entry to return, and the one whose list is only partly returned
+    int start = 0;
+    int resume = -1;
+    if(this->hasLastKey) {
+        start = node->lowerBound(KeyTraits::key(this->lastKey));
+        resume = node->find(KeyTraits::key(this->lastKey));
+    } else if(seeking) {
+        //First key greater than (GT) or not less than (GTE) lowVal
+        start = (this->lowOp == GT)
+            ? node->upperBound(KeyTraits::key(this->lowVal))
+            : node->lowerBound(KeyTraits::key(this->lowVal));
+    }
+
+    //One past the last entry not greater than (LTE) or less than (LT) highVal
+    const int end = std::max(start, (this->highOp == LT)
+        ? node->lowerBound(highKeyVal)
+        : node->upperBound(highKeyVal));
+
+    this->rids.clear();
+    this->ridPos = 0;
+    this->postingPageNum = 0;
+    int j = start;
+    while(j < end) {
+        const std::uint64_t from = (j == resume) ? this->nextCode : 0;
+        const char* value = node->value(j);
+        this->hasLastKey = true;
+        node->key(j ++, this->lastKey);
+        this->nextCode = from;
+        if(!PostingList::isOverflow(value)) {
+            this->codes.clear();
+            PostingList::getInline(value, this->codes);
+            for(size_t k = 0; k < this->codes.size(); k ++) {
+                if(this->codes[k] >= from) {
+                    this->rids.push_back(PostingList::rid(this->codes[k]));
+                }
+            }
+            this->nextCode = std::max(from, this->codes.back() + 1);
+            continue;
+        }
 
-    int i;
-    for(i = 0; i < leafNode->usage; i ++ ){
-        if((lowOpParm == GT && smallerThan(lowKeyVal, leafNode->ridKeyPairArray[i].key)) || 
-           (lowOpParm == GTE && smallerThanOrEquals<T>(lowKeyVal, leafNode->ridKeyPairArray[i].key))) {
-            this->nextEntry = i;
-            dprintf("starting scan at page %d index %d keyVal ", curPageNo, i);
-            std::cout<<leafNode->ridKeyPairArray[i].key<<std::endl;
+        //A list resumed past its tail is done without walking its pages
+        const PostingList::Overflow overflow = PostingList::overflow(value);
+        if(from > 0) {
+            Page* tailPage = NULL;
+            bufMgr->readPage(file, overflow.tailPageNo, tailPage);
+            const bool done = ((PostingPage*)tailPage)->last < from;
+            bufMgr->unPinPage(file, overflow.tailPageNo, false);
+            if(done) {
+                continue;
+            }
+        }
+        this->postingPageNum = this->readPosting(overflow.headPageNo, from);
+        if(this->postingPageNum != 0) {
             break;
         }
     }
 
-    if(i == leafNode->usage) {
-        //No matching entry in this leaf. Move to the sibling
-        PageId tmpLeafPageNo = leafNode->rightSibPageNo;
-        this->bufMgr->unPinPage(this->file, leafPageNo, false);
-        leafPageNo = tmpLeafPageNo;
-        if(leafPageNo != 0) {
-            this->bufMgr->readPage(this->file, leafPageNo, leafPage);
-            this->nextEntry = 0;
-            dprintf("starting scan at page %d index %d keyVal ", curPageNo, i);
-            std::cout<<leafNode->ridKeyPairArray[i].key<<std::endl;
+    this->ridCount = this->rids.size();
+    this->leafPageNum = pageNo;
+    this->leafDone = j >= end;
+    this->reachedHigh = end < node->usage;
+    this->nextPageNum = node->rightSibPageNo;
+    this->version = this->tree->structureVersion;
+
+    bufMgr->unPinPage(file, pageNo, false);
+}
+
+template<class KeyTraits>
+const PageId BTree<KeyTraits>::Cursor::readPosting(PageId pageNo, const std::uint64_t from)
+{
+    BufMgr* bufMgr = this->tree->bufMgr;
+    File* file = this->tree->file;
+    while(pageNo != 0) {
+        Page* page = NULL;
+        bufMgr->readPage(file, pageNo, page);
+        PostingPage* node = (PostingPage*)page;
+        const PageId nextPageNo = node->nextPageNo;
+        if(node->last >= from) {
+            this->codes.clear();
+            node->get(this->codes);
+            for(size_t k = 0; k < this->codes.size(); k ++) {
+                if(this->codes[k] >= from) {
+                    this->rids.push_back(PostingList::rid(this->codes[k]));
+                }
+            }
+            this->nextCode = node->last + 1;
+            bufMgr->unPinPage(file, pageNo, false);
+            return nextPageNo;
         }
+        bufMgr->unPinPage(file, pageNo, false);
+        pageNo = nextPageNo;
     }
+    return 0;
+}
 
-    this->currentPageNum = leafPageNo;
-    if(leafPageNo != 0) {
-        this->currentPageData = leafPage;
+template<class KeyTraits>
+const bool BTree<KeyTraits>::Cursor::nextLeaf()
+{
+    while(this->ridPos == this->ridCount) {
+        if(this->postingPageNum == 0 && this->leafDone && (this->reachedHigh || this->nextPageNum == 0)) {
+            return false;
+        }
+
+        SharedLatchGuard shared(this->tree->treeLatch);
+        if(this->version == this->tree->structureVersion && this->postingPageNum != 0) {
+            //Go on along the posting list of the last key
+            SharedLatchGuard leaf(this->tree->leafLatch(this->leafPageNum));
+            this->rids.clear();
+            this->ridPos = 0;
+            this->postingPageNum = this->readPosting(this->postingPageNum, this->nextCode);
+            this->ridCount = this->rids.size();
+        }
+        else if(this->version == this->tree->structureVersion && !this->leafDone) {
+            //Entries of the leaf are left after the list just finished
+            this->readLeaf(this->leafPageNum, false);
+        }
+        else if(this->version == this->tree->structureVersion) {
+            //The leaf chain is as we left it: go on to the sibling
+            if(this->scanLeafPos < this->scanLeaves.size() && this->scanLeaves[this->scanLeafPos] == this->nextPageNum) {
+                this->scanLeafPos ++;
+                this->readAhead();
+            }
+            this->readLeaf(this->nextPageNum, false);
+        }
+        else {
+            //Nodes were split or merged since: find our place from the root
+            this->scanLeaves.clear();
+            this->hasFence = false;
+            const PageId pageNo = this->hasLastKey
+                ? this->tree->findLeaf(KeyTraits::key(this->lastKey))
+                : this->tree->findLeaf(KeyTraits::key(this->lowVal));
+            this->readLeaf(pageNo, true);
+        }
     }
+    return true;
 }
 
 const void BTreeIndex::scanNext(RecordId& outRid) 
 {
-    if(this->scanExecuting == false) {
+    this->tree->scanNext(outRid);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::scanNext(RecordId& outRid) 
+{
+    if(this->scan == NULL) {
         throw ScanNotInitializedException();
     }
-    if(this->attributeType == INTEGER) {
-        this->scanNext_helper<int>(outRid, this->lowValInt, this->highValInt);
+    this->scan->scanNext(outRid);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::Cursor::scanNext(RecordId& outRid) 
+{
+    if(this->ridPos == this->ridCount && !this->nextLeaf()) {
+        throw IndexScanCompletedException();
     }
-    else if(this->attributeType == DOUBLE) {
-        this->scanNext_helper<double>(outRid, this->lowValDouble, this->highValDouble);
+    outRid = this->rids[this->ridPos ++];
+}
+
+const std::size_t BTreeIndex::scanNextBatch(RecordId* outRids, const std::size_t maxRids) 
+{
+    return this->tree->scanNextBatch(outRids, maxRids);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::scanNextBatch(RecordId* outRids, const std::size_t maxRids) 
+{
+    if(this->scan == NULL) {
+        throw ScanNotInitializedException();
     }
-    else {
-        this->scanNext_helper<char*>(outRid, this->lowValString, this->highValString);
+    return this->scan->scanNextBatch(outRids, maxRids);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::Cursor::scanNextBatch(RecordId* outRids, const std::size_t maxRids) 
+{
+    std::size_t count = 0;
+    while(count < maxRids && (this->ridPos < this->ridCount || this->nextLeaf())) {
+        const std::size_t run = std::min(maxRids - count, this->ridCount - this->ridPos);
+        std::copy(this->rids.begin() + this->ridPos, this->rids.begin() + this->ridPos + run, outRids + count);
+        this->ridPos += run;
+        count += run;
+    }
+    return count;
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::Cursor::readAhead()
+{
+    //Leaves the scan already reached need no prefetch
+    this->scanLeafIssued = std::max(this->scanLeafIssued, this->scanLeafPos);
+
+    //Past the leaves of one parent, go on with those of the next
+    while(this->hasFence && this->scanLeaves.size() < this->scanLeafPos + this->tree->prefetchDepth) {
+        Value fence;
+        KeyTraits::assign(fence, KeyTraits::key(this->fence));
+        this->collectLeaves(KeyTraits::key(fence), true);
+    }
+    std::vector<PageId> pageNos;
+    while(this->scanLeafIssued < this->scanLeaves.size() && this->scanLeafIssued < this->scanLeafPos + this->tree->prefetchDepth) {
+        pageNos.push_back(this->scanLeaves[this->scanLeafIssued ++]);
+    }
+    if(!pageNos.empty()) {
+        this->tree->bufMgr->prefetch(this->tree->file, pageNos);
     }
 }
 
-template<class T>
-const void BTreeIndex::scanNext_helper(RecordId& outRid, T lowVal, T highVal) 
+const void BTreeIndex::setPrefetchDepth(const std::uint32_t depth)
+{
+    this->tree->setPrefetchDepth(depth);
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::setPrefetchDepth(const std::uint32_t depth)
 {
-    LeafNode<T>* curNode = (LeafNode<T>*)this->currentPageData;
+    this->prefetchDepth = depth;
+}
 
-    //Note that char* also works here since we don't modify anyting
-    //For insertion and deletion, must use assignKey() function instead
-    T nextKeyVal = curNode->ridKeyPairArray[this->nextEntry].key;
+const void BTreeIndex::endScan() 
+{
+    this->tree->endScan();
+}
 
-    if(this->currentPageNum == 0 || this->nextEntry == curNode->usage) {
-        throw IndexScanCompletedException();
+template<class KeyTraits>
+const void BTree<KeyTraits>::endScan() 
+{
+    if(this->scan == NULL) {
+        throw ScanNotInitializedException();
     }
+    delete this->scan;
+    this->scan = NULL;
+}
 
-    if((this->highOp == LT && !smallerThan(nextKeyVal, highVal)) || 
-       (this->highOp == LTE && !smallerThanOrEquals<T>(nextKeyVal, highVal))) {
-        throw IndexScanCompletedException();
+
+// -----------------------------------------------------------------------------
+// Lookup functions
+// -----------------------------------------------------------------------------
+const std::size_t BTreeIndex::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    return this->tree->lookup(key, outRids);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->lookup(KeyTraits::key(value), outRids);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::lookup(Key key, std::vector<RecordId>& outRids)
+{
+    //A key the filter has never seen is not in the tree
+    if(this->filter.enabled() && !this->filter.mayContain(KeyTraits::hash(key))) {
+        return 0;
+    }
+
+    //Each key is in one leaf, with all its record ids
+    SharedLatchGuard shared(this->treeLatch);
+    const PageId leafPageNo = this->findLeaf(key);
+    SharedLatchGuard leaf(this->leafLatch(leafPageNo));
+    Page* leafPage = NULL;
+    this->bufMgr->readPage(this->file, leafPageNo, leafPage);
+    Leaf* node = (Leaf*)leafPage;
+    const std::size_t before = outRids.size();
+    const int i = node->find(key);
+    if(i >= 0 && !PostingList::isOverflow(node->value(i))) {
+        const char* value = node->value(i);
+        const std::uint64_t n = PostingList::getVarint(value) >> 1;
+        std::uint64_t code = 0;
+        for(std::uint64_t k = 0; k < n; k ++) {
+            code += PostingList::getVarint(value);
+            outRids.push_back(PostingList::rid(code));
+        }
+    } else if(i >= 0) {
+        const PostingList::Overflow overflow = PostingList::overflow(node->value(i));
+        outRids.reserve(before + overflow.count);
+        std::vector<std::uint64_t> codes;
+        PageId pageNo = overflow.headPageNo;
+        while(pageNo != 0) {
+            Page* page = NULL;
+            this->bufMgr->readPage(this->file, pageNo, page);
+            codes.clear();
+            ((PostingPage*)page)->get(codes);
+            const PageId nextPageNo = ((PostingPage*)page)->nextPageNo;
+            this->bufMgr->unPinPage(this->file, pageNo, false);
+            for(std::size_t k = 0; k < codes.size(); k ++) {
+                outRids.push_back(PostingList::rid(codes[k]));
+            }
+            pageNo = nextPageNo;
+        }
     }
+    this->bufMgr->unPinPage(this->file, leafPageNo, false);
+    return outRids.size() - before;
+}
+
+// -----------------------------------------------------------------------------
+// Order statistic functions
+// -----------------------------------------------------------------------------
+const std::size_t BTreeIndex::countRange(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+    return this->tree->countRange(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::countRange(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+    Value low, high;
+    KeyTraits::load(low, lowValParm);
+    KeyTraits::load(high, highValParm);
+    return this->countRange(KeyTraits::key(low), lowOpParm, KeyTraits::key(high), highOpParm);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::countRange(Key low, const Operator lowOpParm, Key high, const Operator highOpParm)
+{
+    if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
+    }
+    if(smallerThan(high, low)) {
+        throw BadScanrangeException();
+    }
+
+    SharedLatchGuard shared(this->treeLatch);
+    if(!this->counted) {
+        return this->countLeaves(this->findLeaf(low), &low, lowOpParm == GTE, high, highOpParm == LTE);
+    }
+    //Everything below the high bound less everything below the low one; a range that
+    //holds no key can come out negative when low and high are the same
+    const std::uint64_t belowHigh = this->countBelow(high, highOpParm == LTE);
+    const std::uint64_t belowLow = this->countBelow(low, lowOpParm == GT);
+    return belowHigh > belowLow ? belowHigh - belowLow : 0;
+}
+
+const std::size_t BTreeIndex::rank(const void* key)
+{
+    return this->tree->rank(key);
+}
+
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::rank(const void* key)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->rank(KeyTraits::key(value));
+}
 
-    outRid = curNode->ridKeyPairArray[this->nextEntry].rid;
+template<class KeyTraits>
+const std::size_t BTree<KeyTraits>::rank(Key key)
+{
+    SharedLatchGuard shared(this->treeLatch);
+    return this->countBelow(key, false);
+}
 
-    this->nextEntry ++;
+template<class KeyTraits>
+const std::uint64_t BTree<KeyTraits>::countBelow(Key key, const bool inclusive)
+{
+    if(!this->counted) {
+        return this->countLeaves(this->firstLeaf(), NULL, false, key, inclusive);
+    }
 
-    //Reached the end of current leaf node
-    if(this->nextEntry == curNode->usage) {
-        //Release current page
-        PageId tmpCurrentPageNum = this->currentPageNum;
+    //The children left of the path down to key's leaf hold only smaller keys
+    std::uint64_t below = 0;
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        NonLeaf* node = (NonLeaf*)curPage;
+        const int c = node->upperBound(key);
+        for(int i = 0; i < c; i ++) {
+            below += node->count(i);
+        }
+        const PageId childPageNo = node->child(c);
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = childPageNo;
+    }
 
-        this->currentPageNum = curNode->rightSibPageNo;
+    SharedLatchGuard leaf(this->leafLatch(curPageNo));
+    Page* leafPage = NULL;
+    this->bufMgr->readPage(this->file, curPageNo, leafPage);
+    Leaf* node = (Leaf*)leafPage;
+    const int end = inclusive ? node->upperBound(key) : node->lowerBound(key);
+    for(int i = 0; i < end; i ++) {
+        below += PostingList::count(node->value(i));
+    }
+    this->bufMgr->unPinPage(this->file, curPageNo, false);
+    return below;
+}
 
-        this->bufMgr->unPinPage(this->file, tmpCurrentPageNum, false);
+template<class KeyTraits>
+const PageId BTree<KeyTraits>::firstLeaf()
+{
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        const PageId childPageNo = ((NonLeaf*)curPage)->child(0);
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = childPageNo;
+    }
+    return curPageNo;
+}
 
-        if(this->currentPageNum != 0) {
-            this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-            this->nextEntry = 0;
+template<class KeyTraits>
+const std::uint64_t BTree<KeyTraits>::countLeaves(PageId pageNo, const Key* low, const bool lowInclusive, Key high, const bool highInclusive)
+{
+    std::uint64_t count = 0;
+    while(pageNo != 0) {
+        SharedLatchGuard leaf(this->leafLatch(pageNo));
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, pageNo, page);
+        Leaf* node = (Leaf*)page;
+        int i = 0;
+        if(low != NULL) {
+            i = lowInclusive ? node->lowerBound(*low) : node->upperBound(*low);
+            low = NULL;
+        }
+        const int end = highInclusive ? node->upperBound(high) : node->lowerBound(high);
+        for(; i < end; i ++) {
+            count += PostingList::count(node->value(i));
         }
+        //The range ends in this leaf unless it ran to its last key
+        const PageId nextPageNo = (end < node->usage) ? 0 : node->rightSibPageNo;
+        this->bufMgr->unPinPage(this->file, pageNo, false);
+        pageNo = nextPageNo;
     }
+    return count;
 }
 
-const void BTreeIndex::endScan() 
+const bool BTreeIndex::select(const std::size_t k, void* outKey, RecordId& outRid)
 {
-    if(this->scanExecuting == false) {
-        throw ScanNotInitializedException();
+    return this->tree->select(k, outKey, outRid);
+}
+
+template<class KeyTraits>
+const bool BTree<KeyTraits>::select(const std::size_t k, void* outKey, RecordId& outRid)
+{
+    Value value;
+    if(!this->select(k, value, outRid)) {
+        return false;
     }
-    this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-	this->scanExecuting = false;
+    KeyTraits::store(outKey, KeyTraits::key(value));
+    return true;
 }
 
+template<class KeyTraits>
+const bool BTree<KeyTraits>::select(const std::size_t k, Value& outKey, RecordId& outRid)
+{
+    SharedLatchGuard shared(this->treeLatch);
+
+    //Walk down past the children with fewer record ids than are left to skip; without
+    //counts, skip along the leaves from the first
+    std::uint64_t skip = k;
+    PageId curPageNo = this->rootPageNum;
+    for(int level = 0; level < this->height; level ++) {
+        Page* curPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        NonLeaf* node = (NonLeaf*)curPage;
+        int c = 0;
+        while(this->counted && c < node->usage && skip >= node->count(c)) {
+            skip -= node->count(c ++);
+        }
+        const PageId childPageNo = node->child(c);
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = childPageNo;
+    }
+
+    while(curPageNo != 0) {
+        SharedLatchGuard leaf(this->leafLatch(curPageNo));
+        Page* leafPage = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, leafPage);
+        Leaf* node = (Leaf*)leafPage;
+        for(int i = 0; i < node->usage; i ++) {
+            const char* value = node->value(i);
+            const std::uint32_t n = PostingList::count(value);
+            if(skip >= n) {
+                skip -= n;
+                continue;
+            }
+
+            //The entry has the record id: read its list, skipping whole overflow pages
+            std::vector<std::uint64_t> codes;
+            if(!PostingList::isOverflow(value)) {
+                PostingList::getInline(value, codes);
+            } else {
+                PageId pageNo = PostingList::overflow(value).headPageNo;
+                while(codes.empty()) {
+                    Page* page = NULL;
+                    this->bufMgr->readPage(this->file, pageNo, page);
+                    PostingPage* posting = (PostingPage*)page;
+                    const PageId nextPageNo = posting->nextPageNo;
+                    if(skip < posting->count) {
+                        posting->get(codes);
+                    } else {
+                        skip -= posting->count;
+                    }
+                    this->bufMgr->unPinPage(this->file, pageNo, false);
+                    pageNo = nextPageNo;
+                }
+            }
+            node->key(i, outKey);
+            outRid = PostingList::rid(codes[skip]);
+            this->bufMgr->unPinPage(this->file, curPageNo, false);
+            return true;
+        }
+        const PageId nextPageNo = node->rightSibPageNo;
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = nextPageNo;
+    }
+    return false;
+}
 
 // -----------------------------------------------------------------------------
 // Deletion functions
 // -----------------------------------------------------------------------------
 const bool BTreeIndex::deleteEntry(const void *key)
 {
+    return this->tree->deleteEntry(key);
+}
+
+template<class KeyTraits>
+const bool BTree<KeyTraits>::deleteEntry(const void *key)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->deleteEntry(KeyTraits::key(value));
+}
+
+template<class KeyTraits>
+const bool BTree<KeyTraits>::deleteEntry(Key key)
+{
+    //Most deletes only take from one leaf, which other threads can do alongside
+    {
+        SharedLatchGuard shared(this->treeLatch);
+        const int deleted = this->deleteEntryInPlace(key);
+        if(deleted >= 0) {
+            return deleted == 1;
+        }
+    }
+
+    //The leaf underflows: delete again with the tree to ourselves
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    this->structureVersion ++;
     std::set<PageId> pinnedPage;
     std::vector<PageId> disposePageNo;
     bool result = true;
 
 
     try {
-        if(this->attributeType == INTEGER) {
-            this->deleteEntry_helper<int>(*(int*)key, this->rootPageNum, NULL, -2, 0, disposePageNo, pinnedPage);
-        }
-        else if(this->attributeType == DOUBLE) {
-            this->deleteEntry_helper<double>(*(double*)key, this->rootPageNum, NULL, -2, 0, disposePageNo, pinnedPage);
-        }
-        else {
-            char truncatedKey[11];
-            assignKey(truncatedKey, (char*)key);
-            this->deleteEntry_helper<char*>(truncatedKey, this->rootPageNum, NULL, -2, 0, disposePageNo, pinnedPage);
-        }
+        this->deleteEntry_helper(key, this->rootPageNum, NULL, -2, 0, disposePageNo, pinnedPage);
     }
     catch(DeletionKeyNotFoundException e) {
         std::set<PageId>::iterator it;
@@ -621,25 +2241,59 @@ const bool BTreeIndex::deleteEntry(const void *key)
         result = false;
     }
 
+    //Posting pages the delete emptied are disposed with the nodes
+    //and go on the file's free list for later allocations
     for(size_t i = 0; i < disposePageNo.size(); i ++) {
-        try{
-            this->bufMgr->disposePage(this->file, disposePageNo[i]);
-        }catch(InvalidPageException e) {
-            //The provided BlobFile class doesn't support dispose operation.
-        }
+        this->bufMgr->disposePage(this->file, disposePageNo[i]);
     }
 
     return result;
 }
 
 
-template<class T>
-const void BTreeIndex::deleteEntry_helper(T key, PageId curPageNo, NonLeafNode<T>* parentNode, 
+template<class KeyTraits>
+const int BTree<KeyTraits>::deleteEntryInPlace(Key key)
+{
+    Path path;
+    PageId leafPageNo = this->findLeaf(key, this->counted ? &path : NULL);
+    std::lock_guard<RWLatch> leaf(this->leafLatch(leafPageNo));
+    Page* leafPage = NULL;
+    this->bufMgr->readPage(this->file, leafPageNo, leafPage);
+    Leaf* node = (Leaf*)leafPage;
+
+    int i = node->find(key);
+    if(i < 0) {
+        this->bufMgr->unPinPage(this->file, leafPageNo, false);
+        return 0;
+    }
+    //A list shrinks in place; deleteEntry_helper_leaf disposes of posting pages that
+    //empty, and rebalances a leaf left underfull, unless it is the root
+    char value[POSTING_VALUE_SIZE];
+    const int length = postingRemoveFirst(this->bufMgr, this->file, node->value(i), value, NULL);
+    if(length < 0 || (length == 0 && this->height != 0 && node->underfullWithout(i))) {
+        this->bufMgr->unPinPage(this->file, leafPageNo, false);
+        return -1;
+    }
+    if(length == 0) {
+        node->removeAt(i);
+    } else {
+        node->put(key, value, length);
+    }
+    this->bufMgr->unPinPage(this->file, leafPageNo, true);
+    if(this->counted) {
+        this->addToPath(path, -1);
+    }
+    return 1;
+}
+
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::deleteEntry_helper(Key key, PageId curPageNo, NonLeaf* parentNode, 
         int keyIndexAtParent, int level, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage) {
 
     if(level == this->height){
         //Leaf
-        deleteEntry_helper_leaf<T>(key, curPageNo, parentNode, keyIndexAtParent, disposePageNo, pinnedPage);
+        deleteEntry_helper_leaf(key, curPageNo, parentNode, keyIndexAtParent, disposePageNo, pinnedPage);
     }
     else {
         //Internal node
@@ -647,189 +2301,80 @@ const void BTreeIndex::deleteEntry_helper(T key, PageId curPageNo, NonLeafNode<T
         Page* curPage = NULL;
         this->bufMgr->readPage(this->file, curPageNo, curPage);
         pinnedPage.insert(curPageNo);
-        NonLeafNode<T>* node = (NonLeafNode<T>*)curPage;
-        //Search page pointer for key. -1 because the last pair doesn't have a key. it only has a pageNo
-        int i;
-        for(i = 0; i < node->usage; i ++ ){
-            if(smallerThan(key, node->pageKeyPairArray[i].key)) {
-                break;
-            }
-        }
+        NonLeaf* node = (NonLeaf*)curPage;
+        //Search page pointer for key
+        int i = node->upperBound(key);
         //i-1 because the key to be deleted is between keyArray[i-1] and keyArray[i]
         //when deletion propagates, keyArray[i-1] is the one to be deleted (deleted by children)
         //Example: [10] 500 [20] 600, key = 550
         //Index:   i-1  i-1  i   i 
         //After redistribtute: [10] 400 [20] 600, key = 550
         //Index:                i-1 i-1  i    i 
-        deleteEntry_helper<T>(key, node->pageKeyPairArray[i].pageNo, node, i-1, level+1, disposePageNo, pinnedPage);
+        deleteEntry_helper(key, node->child(i), node, i-1, level+1, disposePageNo, pinnedPage);
+
+        //The child lost a record id, and may have merged with or moved entries to or from
+        //a sibling: count the children around it again
+        if(this->counted) {
+            for(int j = std::max(0, i - 1); j <= std::min(node->usage, i + 1); j ++) {
+                node->setCount(j, this->subtreeCount(node->child(j), level + 1 == this->height));
+            }
+        }
 
         if(level == 0 && node->usage == 0) {
             //Root is empty: assign its only child as the new root
             disposePageNo.push_back(this->rootPageNum);
-            this->rootPageNum = node->pageKeyPairArray[0].pageNo;
+            this->rootPageNum = node->child(0);
             this->height --;
         }
-        else if(level != 0 && node->usage < this->nodeOccupancy/2 - 1) {
-            if(keyIndexAtParent != -1) {
-                //Normal case: redistribute/merge with left sibling
-
-                //current node's keyIndex is the same as left sibling's pageNoIndex
-                PageId sibPageNo = parentNode->pageKeyPairArray[keyIndexAtParent].pageNo;  
-                Page* sibPage = NULL;
-                this->bufMgr->readPage(this->file, sibPageNo, sibPage);
-                pinnedPage.insert(sibPageNo);
-                NonLeafNode<T>* sibNode = (NonLeafNode<T>*)sibPage;
-
-                if(sibNode->usage >= this->nodeOccupancy/2) {
-                    //pull the key value at keyIndex from parent
-                    //insert the key to first position of curNode
-                    //get the last pageNo from sib. insert it to the first position of curNode
-                    //get the last key from sib. update parent with it
-                    dprintf("internal node redistribute with left sib\n");
-
-                    PageId insertionPageNo = sibNode->pageKeyPairArray[sibNode->usage].pageNo;
-                    PageKeyPair<T> pageKeyPair;
-                    pageKeyPair.set( insertionPageNo, parentNode->pageKeyPairArray[keyIndexAtParent].key);
-
-                    //Shift all elements to right in curNode
-                    node->usage ++;
-                    for(int j = node->usage; j > 0; j -- ){
-                        node->pageKeyPairArray[j].pageNo = node->pageKeyPairArray[j-1].pageNo;
-                        assignKey(node->pageKeyPairArray[j].key, node->pageKeyPairArray[j-1].key);
-                    }
-
-                    node->pageKeyPairArray[0].pageNo = pageKeyPair.pageNo;
-                    assignKey(node->pageKeyPairArray[0].key, pageKeyPair.key);
-
-                    //update parent with the last key from sib. 
-                    assignKey(parentNode->pageKeyPairArray[keyIndexAtParent].key, 
-                            sibNode->pageKeyPairArray[sibNode->usage-1].key);
-
-                    //shrink sib page
-                    sibNode->usage --;
-
-                    //Return. parent will handle its own process
-                }
-                else {
-                    //merge with sibling
-                    //pull the key value at keyIndex from parent
-                    //delete the page ptr at keyIndex+1
-
-                    dprintf("internal node merge with left sib\n");
-
-                    //insert the keyFromParent (k_) to the last pos
-                    //      k1      k2      k_
-                    //  p1      p2      p3
-                    assignKey(sibNode->pageKeyPairArray[sibNode->usage].key, parentNode->pageKeyPairArray[keyIndexAtParent].key);
-                    sibNode->usage ++;
-                    deleteEntryFromNonLeaf(keyIndexAtParent, parentNode);       //delete the key and rhs page ptr
-
-                    //insert the pageKeyPair from current node to sib
-                    //      k1      k2      k_      k'1     k'2
-                    //  p1      p2      p4      p'1     p'2     p'3
-                    for(int i = 0; i < node->usage; i ++) {
-                        sibNode->pageKeyPairArray[sibNode->usage].pageNo = node->pageKeyPairArray[i].pageNo;
-                        assignKey(sibNode->pageKeyPairArray[sibNode->usage].key, node->pageKeyPairArray[i].key);
-                        sibNode->usage ++;
-                    }
-                    sibNode->pageKeyPairArray[sibNode->usage].pageNo = node->pageKeyPairArray[node->usage].pageNo;
-
-                    disposePageNo.push_back(curPageNo);
-
-                    //return. parent will handle its own process
+        else if(level != 0 && parentNode->usage > 0 && node->underfull()) {
+            //Redistribute/merge with the left sibling, or with the right sibling if this is
+            //the leftmost child. The right node of the pair is the one merged away
+            //Illustration (parent node):
+            //      k1      k2      k3
+            //  p1      p2      p3      p4
+            //  keyIndexAtParent: 1, curPageNo: p3, left: p2, right: p3, separator: k2
+            //  keyIndexAtParent: -1, curPageNo: p1, left: p1, right: p2, separator: k1
+            //A string separator moved up by a redistribution may not fit in the parent. The
+            //right sibling is tried next then, and failing that too the node is left underfull
+            const int curIndex = keyIndexAtParent + 1;
+            const int sibIndexes[2] = {(curIndex > 0) ? curIndex - 1 : curIndex + 1, (curIndex > 0) ? curIndex + 1 : -1};
+            for(int s = 0; s < 2; s ++) {
+                const int sibIndex = sibIndexes[s];
+                if(sibIndex < 0 || sibIndex > parentNode->usage) {
+                    continue;
                 }
-                this->bufMgr->unPinPage(this->file, sibPageNo, true);
-                pinnedPage.erase(sibPageNo);
-            }
-            else {
-                //Special case: leftmost page ptr in the parent node
-                //Use right sibling 
-                
-                //currentNode's pageNoIndex = keyIndexAtParent + 1
-                //right sibling's pageNoIndex = keyIndexAtParent + 2
-                
-                //Illustration (parent node):
-                //      k1      k2      k3
-                //  p1      p2      p3      p4
-                //  keyIndexAtParent: 1
-                //  curPageNo: p2 (keyIndexAtParent + 1)
-                //  sibPageNo: p3 (keyIndexAtParent + 2)
-                
-                PageId sibPageNo = parentNode->pageKeyPairArray[keyIndexAtParent+2].pageNo;  
+                const int sepIndex = std::min(curIndex, sibIndex);
+                const PageId sibPageNo = parentNode->child(sibIndex);
                 Page* sibPage = NULL;
                 this->bufMgr->readPage(this->file, sibPageNo, sibPage);
                 pinnedPage.insert(sibPageNo);
-                NonLeafNode<T>* sibNode = (NonLeafNode<T>*)sibPage;
-
-                if(sibNode->usage >= this->nodeOccupancy/2) {
-                    //append parent's pageKeyArray[keyIndex+1].key to curNode
-                    //get the first pageNo from sib, append it to curNode
-                    //get the first key from sib, update parent's pageKeyArray[keyIndex+1].key
-
-                    dprintf("internal node redistribute with right sib\n");
-
-                    PageId insertionPageNo = sibNode->pageKeyPairArray[0].pageNo;
-
-                    //Append insertion key and pageNo
-                    assignKey(node->pageKeyPairArray[node->usage].key, parentNode->pageKeyPairArray[keyIndexAtParent+1].key);
-
-                    node->pageKeyPairArray[node->usage+1].pageNo = insertionPageNo;
-                    node->usage ++;
-
-                    //update parent with the first key from sib. 
-                    assignKey(parentNode->pageKeyPairArray[keyIndexAtParent+1].key, 
-                            sibNode->pageKeyPairArray[0].key);
-
-                    //shift all elements in sib to left
-                    for(int i = 0; i < sibNode->usage; i ++) {
-                        sibNode->pageKeyPairArray[i].pageNo = sibNode->pageKeyPairArray[i+1].pageNo;
-                        assignKey(sibNode->pageKeyPairArray[i].key, sibNode->pageKeyPairArray[i+1].key);
-                    }
-                    //shrink sib page
-                    sibNode->usage --;
-
-                    //Return. parent will handle its own process
-                }
-                else {
-                    //sibling merges into curNode
-                    //pull the key value at keyIndex from parent (sibling's key)
-                    //delete the page ptr at keyIndex+2 (sibling's page pointer)
-                    
-                    //Status of parent node:
-                    //      k1      k2      k3
-                    //  p1      p2      p3      p4
-                    //  keyIndexAtParent: 1
-                    //  curPageNo: p2
-                    //  sibPageNo (to be deleted): p3
-                    //  key to be deleted: k2
-
-                    dprintf("internal node merge with right sib\n");
-
-                    //Status of curNode:
-                    //insert the key from parent to cur node
-                    //      k1      k2      k_ 
-                    //  p1      p2      p3    
-                    assignKey(node->pageKeyPairArray[node->usage].key, parentNode->pageKeyPairArray[keyIndexAtParent+1].key);
-                    node->usage ++;
-                    deleteEntryFromNonLeaf(keyIndexAtParent+1, parentNode);       //delete the key and rhs page ptr
-
-                    //Status of curNode:
-                    //insert the pageKeyPair from sib to cur node
+                NonLeaf* sibNode = (NonLeaf*)sibPage;
+                NonLeaf* left = (sibIndex < curIndex) ? sibNode : node;
+                NonLeaf* right = (sibIndex < curIndex) ? node : sibNode;
+
+                //pull the separator from parent
+                Value parentKey;
+                parentNode->key(sepIndex, parentKey);
+                bool rebalanced = true;
+                if(NonLeaf::mergeable(left, KeyTraits::key(parentKey), right)) {
+                    dprintf("internal node merge\n");
                     //      k1      k2      k_      k'1     k'2
                     //  p1      p2      p3      p'1     p'2     p'3
-                    for(int i = 0; i < sibNode->usage; i ++) {
-                        node->pageKeyPairArray[node->usage].pageNo = sibNode->pageKeyPairArray[i].pageNo;
-                        assignKey(node->pageKeyPairArray[node->usage].key, sibNode->pageKeyPairArray[i].key);
-                        node->usage ++;
-                    }
-                    node->pageKeyPairArray[node->usage].pageNo = sibNode->pageKeyPairArray[sibNode->usage].pageNo;
-
-                    disposePageNo.push_back(sibPageNo);
-
-                    //return. parent will handle its own process
+                    left->mergeFrom(KeyTraits::key(parentKey), right);
+                    parentNode->removeKey(sepIndex);       //delete the key and rhs page ptr
+                    disposePageNo.push_back((sibIndex < curIndex) ? curPageNo : sibPageNo);
+                }
+                else {
+                    dprintf("internal node redistribute\n");
+                    rebalanced = NonLeaf::redistribute(left, right, parentNode, sepIndex);
                 }
-                this->bufMgr->unPinPage(this->file, sibPageNo, true);
+
+                //Return. parent will handle its own process
+                this->bufMgr->unPinPage(this->file, sibPageNo, rebalanced);
                 pinnedPage.erase(sibPageNo);
+                if(rebalanced) {
+                    break;
+                }
             }
         }
         else {
@@ -840,188 +2385,100 @@ const void BTreeIndex::deleteEntry_helper(T key, PageId curPageNo, NonLeafNode<T
     }
 }
     
-template<class T>
-const void BTreeIndex::deleteEntry_helper_leaf(T key, PageId curPageNo, NonLeafNode<T>* parentNode, 
+template<class KeyTraits>
+const void BTree<KeyTraits>::deleteEntry_helper_leaf(Key key, PageId curPageNo, NonLeaf* parentNode, 
         int keyIndexAtParent, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage) {
 
     Page* curPage = NULL;
     this->bufMgr->readPage(this->file, curPageNo, curPage);
     pinnedPage.insert(curPageNo);
-    LeafNode<T>* node = (LeafNode<T>*)curPage;
+    Leaf* node = (Leaf*)curPage;
 
-    //delete the entry from node
-    if(deleteEntryFromLeaf(key, node) == false) {
+    //delete the first record id of the key, and the key with its last one
+    int i = node->find(key);
+    if(i < 0) {
         throw DeletionKeyNotFoundException();
     }
-    else {
-        if(this->height != 0 && node->usage < this->leafOccupancy/2) {
-            if(keyIndexAtParent != -1) {
-                //Redistribute/Merge with left sibling except leftmost node
-            
-                Page* sibPage = NULL;
-                PageId sibPageNo = parentNode->pageKeyPairArray[keyIndexAtParent].pageNo;  
-                this->bufMgr->readPage(this->file, sibPageNo, sibPage);
-                pinnedPage.insert(sibPageNo);
-                LeafNode<T>* sibNode = (LeafNode<T>*)sibPage;
-
-                if(sibNode->usage > this->leafOccupancy/2) {
-                    //Redistribute
-                    dprintf("leaf redistribute with left sib\n");
-                    int redistFromPos = sibNode->usage - 1;
-                    RIDKeyPair<T> ridKeyPair = sibNode->ridKeyPairArray[redistFromPos];
-                    sibNode->usage --;  //delete the redistributed entry
-
-                    insertEntryInLeaf<T>(ridKeyPair.key, ridKeyPair.rid, node);
-
-                    //Update the key of parent
-                    assignKey(parentNode->pageKeyPairArray[keyIndexAtParent].key, ridKeyPair.key);
-
-                    //All Done
-                }
-                else {
-                    //Merge into left sibling
-                    dprintf("leaf merge with left sib\n");
-                    for(int i = 0; i < node->usage; i ++) {
-                        sibNode->ridKeyPairArray[sibNode->usage].rid = node->ridKeyPairArray[i].rid;
-                        assignKey(sibNode->ridKeyPairArray[sibNode->usage].key, node->ridKeyPairArray[i].key);
-                        sibNode->usage ++;
-                    }
-
-                    dprintf("keyIndexAtParent: %d\n", keyIndexAtParent);
-                    //Delete key from parent
-                    deleteEntryFromNonLeaf(keyIndexAtParent, parentNode);
-
-                    //Set left and right sib pointers
-                    sibNode->rightSibPageNo = node->rightSibPageNo;
-
-                    //Dispose curPage
-                    disposePageNo.push_back(curPageNo);
+    char value[POSTING_VALUE_SIZE];
+    const int length = postingRemoveFirst(this->bufMgr, this->file, node->value(i), value, &disposePageNo);
+    if(length == 0) {
+        node->removeAt(i);
+    } else {
+        //A list down to one short page goes back inline if the leaf has room for it
+        char inlineValue[POSTING_VALUE_SIZE];
+        const int inlineLength = postingUnspill(this->bufMgr, this->file, value, inlineValue);
+        if(inlineLength > 0 && node->put(key, inlineValue, inlineLength)) {
+            disposePageNo.push_back(PostingList::overflow(value).headPageNo);
+        } else {
+            node->put(key, value, length);
+        }
+    }
 
-                    //Return. Parent will handle its own redistribution/merging
-                }
-                this->bufMgr->unPinPage(this->file, sibPageNo, true);
-                pinnedPage.erase(sibPageNo);
+    if(this->height != 0 && parentNode->usage > 0 && node->underfull()) {
+        //Redistribute/Merge with left sibling except leftmost node, which uses its right sibling.
+        //A leaf's right sibling under the same parent is the parent's next page ptr. When the
+        //separator a redistribution picks does not fit in the parent, the right sibling is
+        //tried next, and failing that too the leaf is left underfull
+        const int curIndex = keyIndexAtParent + 1;
+        const int sibIndexes[2] = {(curIndex > 0) ? curIndex - 1 : curIndex + 1, (curIndex > 0) ? curIndex + 1 : -1};
+        for(int s = 0; s < 2; s ++) {
+            const int sibIndex = sibIndexes[s];
+            if(sibIndex < 0 || sibIndex > parentNode->usage) {
+                continue;
+            }
+            const int sepIndex = std::min(curIndex, sibIndex);
+            const PageId sibPageNo = parentNode->child(sibIndex);
+            Page* sibPage = NULL;
+            this->bufMgr->readPage(this->file, sibPageNo, sibPage);
+            pinnedPage.insert(sibPageNo);
+            Leaf* sibNode = (Leaf*)sibPage;
+            Leaf* left = (sibIndex < curIndex) ? sibNode : node;
+            Leaf* right = (sibIndex < curIndex) ? node : sibNode;
+
+            bool rebalanced = true;
+            if(Leaf::mergeable(left, right)) {
+                //Merge the right leaf into the left one and delete its key from parent
+                dprintf("leaf merge, keyIndexAtParent: %d\n", keyIndexAtParent);
+                left->mergeFrom(right);
+                parentNode->removeKey(sepIndex);
+                disposePageNo.push_back((sibIndex < curIndex) ? curPageNo : sibPageNo);
+
+                //Return. Parent will handle its own redistribution/merging
             }
             else {
-                //Special case: leftmost node must redistribute/merge with right sibling
-                Page* sibPage = NULL;
-                PageId sibPageNo = node->rightSibPageNo;
-                this->bufMgr->readPage(this->file, sibPageNo, sibPage);
-                pinnedPage.insert(sibPageNo);
-                LeafNode<T>* sibNode = (LeafNode<T>*)sibPage;
-                if(sibNode->usage > this->leafOccupancy/2) {
-                    //Redistribute
-                    dprintf("special: leaf redistribute with right sib\n");
-                    int redistFromPos = 0;
-                    RIDKeyPair<T> ridKeyPair;
-                    ridKeyPair.rid = sibNode->ridKeyPairArray[redistFromPos].rid;
-                    assignKey(ridKeyPair.key, sibNode->ridKeyPairArray[redistFromPos].key);
-
-                    deleteEntryFromLeaf<T>(ridKeyPair.key, sibNode);
-
-                    node->ridKeyPairArray[node->usage].rid = ridKeyPair.rid;
-                    assignKey(node->ridKeyPairArray[node->usage].key, ridKeyPair.key);
-
-                    node->usage ++;
-
-                    //Update the key of parent
-                    //Since curNode is the leftmost, its right sibling must have the same parent
-                    //The position of key to be updated is the index of the key of curNode + 1
-                    assignKey(parentNode->pageKeyPairArray[keyIndexAtParent+1].key, 
-                            sibNode->ridKeyPairArray[0].key);
-
-                    //All Done
-                }
-                else {
-                    //Sibling merges into curNode
-                    dprintf("special: leaf merge with right sib\n");
-                    for(int i = 0; i < sibNode->usage; i ++) {
-                        node->ridKeyPairArray[node->usage].rid = sibNode->ridKeyPairArray[i].rid;
-                        assignKey(node->ridKeyPairArray[node->usage].key, sibNode->ridKeyPairArray[i].key);
-                        node->usage ++;
-                    }
-                    //Delete sibling's key from parent
-                    //Note that sibling's key index must be at current key index + 1
-                    deleteEntryFromNonLeaf<T>(keyIndexAtParent+1, parentNode);
-                    
-                    //Set left and right sib pointers
-                    node->rightSibPageNo = sibNode->rightSibPageNo;
-
-                    //Dispose right sibling
-                    disposePageNo.push_back(sibPageNo);
-
-                    //Done with curNode. Parent will handle its own redistribution/merging
-                }
-                this->bufMgr->unPinPage(this->file, sibPageNo, true);
-                pinnedPage.erase(sibPageNo);
+                //Redistribute and update the key of parent
+                dprintf("leaf redistribute\n");
+                rebalanced = Leaf::redistribute(left, right, parentNode, sepIndex);
+            }
+            this->bufMgr->unPinPage(this->file, sibPageNo, rebalanced);
+            pinnedPage.erase(sibPageNo);
+            if(rebalanced) {
+                break;
             }
         }
-        else {
-            //Leaf usage > occupancy/2. Do nothing
-        }
+    }
+    else {
+        //Leaf usage > occupancy/2. Do nothing
     }
     this->bufMgr->unPinPage(this->file, curPageNo, true);
     pinnedPage.erase(curPageNo);
 }
 
-template<class T>
-const bool BTreeIndex::deleteEntryFromLeaf(T key, LeafNode<T>*  node) {
-    int i = 0;
-    for(i = 0; i < node->usage; i ++ ){
-        if(equals(key, node->ridKeyPairArray[i].key)) {
-            break;
-        }
-    }
-
-    //Key Not found
-    if(i == node->usage) { return false; }
-
-    //Shift all elements after this position
-    for(int j = i; j < node->usage - 1; j ++){
-        node->ridKeyPairArray[j].rid = node->ridKeyPairArray[j+1].rid;
-        assignKey(node->ridKeyPairArray[j].key, node->ridKeyPairArray[j+1].key);
-    }
-
-    node->usage --;
-    return true;
-}
-
-template<class T>
-const void BTreeIndex::deleteEntryFromNonLeaf(const int keyIndex, NonLeafNode<T>* node) {
-    //Simply shift all elements after this position to left
-
-    //Note the skew between key and pageNo index
-    //Example: keyIndex is 1, k1 and p2 will be deleted
-    //      k0      [k1]      k2
-    //  p0      p1      [p2]       p3
-
-    for(int j = keyIndex; j < node->usage - 1; j ++){
-        //Sometimes the child is the leftmost of the parent. keyIndex can be -1
-        if(j >= 0) {
-            assignKey(node->pageKeyPairArray[j].key, node->pageKeyPairArray[j+1].key);
-        }
-        node->pageKeyPairArray[j+1].pageNo = node->pageKeyPairArray[j+2].pageNo;
-    }
-    node->usage --;
-}
-
 // -----------------------------------------------------------------------------
 // Validation functions
 // -----------------------------------------------------------------------------
 const bool BTreeIndex::validate(bool showInfo) {
+    return this->tree->validate(showInfo);
+}
+
+template<class KeyTraits>
+const bool BTree<KeyTraits>::validate(bool showInfo) {
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
     if(showInfo) std::cout<<"\n========= Validation Result ==========\n";
 
     std::set<PageId> pinnedPage;
     try {
-        if(this->attributeType == INTEGER) {
-            this->validate_helper<int>(this->rootPageNum, 0, pinnedPage);
-        }
-        else if(this->attributeType == DOUBLE) {
-            this->validate_helper<double>(this->rootPageNum, 0, pinnedPage);
-        }
-        else {
-            this->validate_helper<char*>(this->rootPageNum, 0, pinnedPage);
-        }
+        this->validate_helper(this->rootPageNum, 0, pinnedPage);
         if(this->bufMgr->pinnedCnt() != 0) {
             dprintf("Buffer manager is not clean:\n");
             this->bufMgr->printSelfPinned();
@@ -1048,26 +2505,34 @@ const bool BTreeIndex::validate(bool showInfo) {
     return true;
 }
 
-template<class T>
-const void BTreeIndex::validate_helper(PageId curPageNo, int level, std::set<PageId>& pinnedPage) {
+template<class KeyTraits>
+const std::uint64_t BTree<KeyTraits>::validate_helper(PageId curPageNo, int level, std::set<PageId>& pinnedPage,
+        const bool leftEdge, const bool rightEdge) {
+    std::uint64_t count = 0;
     if(level == this->height) {
-        validate_helper_leaf<T>(curPageNo, pinnedPage);
+        count = validate_helper_leaf(curPageNo, pinnedPage);
     }
     else {
         Page* curPage = NULL;
         this->bufMgr->readPage(this->file, curPageNo, curPage);
         pinnedPage.insert(curPageNo);
-        NonLeafNode<T>* node = (NonLeafNode<T>*)curPage;
+        NonLeaf* node = (NonLeaf*)curPage;
 
-        if((level != 0) && (node->usage < this->nodeOccupancy/2-1 || node->usage > this->nodeOccupancy)) {
+        if((level != 0) && !node->validUsage()) {
             dprintf("Internal Page #%d usage invalid\n", curPageNo);
-            dprintf("Usage: %d, nodeOccupancy: %d\n", node->usage, this->nodeOccupancy);
+            dprintf("Usage: %d, capacity: %d\n", node->usage, NonLeaf::MAX_USAGE);
+            throw ValidationFailedException();
+        }
+        if((level != 0) && !leftEdge && !rightEdge && !node->halfFull()) {
+            dprintf("Internal Page #%d less than half full\n", curPageNo);
+            dprintf("Usage: %d, capacity: %d\n", node->usage, NonLeaf::MAX_USAGE);
             throw ValidationFailedException();
         }
 
         //Validation
+        Value lowKey, highKey, parentKey;
         for(int i = 0; i <= node->usage; i ++) {
-            PageId childPageNo = node->pageKeyPairArray[i].pageNo;
+            PageId childPageNo = node->child(i);
             if(childPageNo == 0) {
                 dprintf("Page #%d pageNo index #%d pageNo is 0\n", curPageNo, i);
                 throw ValidationFailedException();
@@ -1077,45 +2542,49 @@ const void BTreeIndex::validate_helper(PageId curPageNo, int level, std::set<Pag
             this->bufMgr->readPage(this->file, childPageNo, childPage);
             pinnedPage.insert(childPageNo);
 
-            T lowKey, highKey;
+            //A non-leaf may be left with one child and no key to check
+            bool hasKeys = false;
             if(level == this->height - 1) {
-                LeafNode<T>* childNode = (LeafNode<T>*)childPage;
+                Leaf* childNode = (Leaf*)childPage;
 
-                if(childNode->usage < this->leafOccupancy/2 || childNode->usage > this->leafOccupancy) {
+                if(!childNode->validUsage()) {
                     dprintf("Leaf Page #%d usage invalid\n", childPageNo);
-                    dprintf("Usage: %d, leafOccupancy: %d\n", node->usage, this->leafOccupancy);
+                    dprintf("Usage: %d, capacity: %d\n", childNode->usage, Leaf::MAX_USAGE);
                     throw ValidationFailedException();
                 }
 
-                lowKey = childNode->ridKeyPairArray[0].key;
-                highKey = childNode->ridKeyPairArray[childNode->usage-1].key;
+                hasKeys = true;
+                childNode->key(0, lowKey);
+                childNode->key(childNode->usage-1, highKey);
             }
             else {
-                NonLeafNode<T>* childNode = (NonLeafNode<T>*)childPage;
+                NonLeaf* childNode = (NonLeaf*)childPage;
             
-                //if occupancy is 6, then the resulting two nodes will both have usage of 2. Hence -1 is needed
-                if(childNode->usage < this->nodeOccupancy/2-1 || childNode->usage > this->nodeOccupancy) {
+                if(!childNode->validUsage()) {
                     dprintf("Internal Page #%d usage invalid\n", childPageNo);
-                    dprintf("Usage: %d, nodeOccupancy: %d\n", childNode->usage, this->nodeOccupancy);
+                    dprintf("Usage: %d, capacity: %d\n", childNode->usage, NonLeaf::MAX_USAGE);
                     throw ValidationFailedException();
                 }
 
-                lowKey = childNode->pageKeyPairArray[0].key;
-                highKey = childNode->pageKeyPairArray[childNode->usage-1].key;
-                if(lowKey > highKey) {
-                    dprintf("Page #%d lowKey > highKey\n", childPageNo);
-                    throw ValidationFailedException();
+                hasKeys = childNode->usage > 0;
+                if(hasKeys) {
+                    childNode->key(0, lowKey);
+                    childNode->key(childNode->usage-1, highKey);
+                    if(smallerThan(KeyTraits::key(highKey), KeyTraits::key(lowKey))) {
+                        dprintf("Page #%d lowKey > highKey\n", childPageNo);
+                        throw ValidationFailedException();
+                    }
                 }
             }
 
-            if(i != node->usage && !smallerThan(highKey, node->pageKeyPairArray[i].key)) {
+            if(hasKeys && i != node->usage && !smallerThan(KeyTraits::key(highKey), node->key(i, parentKey))) {
                 dprintf("Child Page #%d highKey >= parent rhs key\n", childPageNo);
-                std::cout<<"highKey: "<<highKey<<", parent rhs key: "<<node->pageKeyPairArray[i].key<<"\n";
+                std::cout<<"highKey: "<<KeyTraits::key(highKey)<<", parent rhs key: "<<KeyTraits::key(parentKey)<<"\n";
                 throw ValidationFailedException();
             }
-            if(i != 0 && smallerThan(lowKey, node->pageKeyPairArray[i-1].key)) {
+            if(hasKeys && i != 0 && smallerThan(KeyTraits::key(lowKey), node->key(i-1, parentKey))) {
                 dprintf("Child Page #%d lowKey < parent lhs key\n", childPageNo);
-                std::cout<<"lowKey: "<<lowKey<<", parent lhs key: "<<node->pageKeyPairArray[i-1].key<<"\n";
+                std::cout<<"lowKey: "<<KeyTraits::key(lowKey)<<", parent lhs key: "<<KeyTraits::key(parentKey)<<"\n";
                 throw ValidationFailedException();
             }
             this->bufMgr->unPinPage(this->file, childPageNo, false);
@@ -1123,67 +2592,183 @@ const void BTreeIndex::validate_helper(PageId curPageNo, int level, std::set<Pag
 
 
             //Recursively validate child node
-            validate_helper<T>(childPageNo, level+1, pinnedPage);
+            const std::uint64_t childCount = validate_helper(childPageNo, level+1, pinnedPage,
+                    leftEdge && i == 0, rightEdge && i == node->usage);
+            if(this->counted && node->count(i) != childCount) {
+                dprintf("Page #%d count of child #%d is %u, not %llu\n", curPageNo, i,
+                    node->count(i), (unsigned long long)childCount);
+                throw ValidationFailedException();
+            }
+            count += childCount;
         }
 
         //Validation for this node completed
         this->bufMgr->unPinPage(this->file, curPageNo, false);
         pinnedPage.erase(curPageNo);
     }
+    return count;
 }
 
-template<class T>
-const void BTreeIndex::validate_helper_leaf(PageId curPageNo, std::set<PageId>& pinnedPage) {
+template<class KeyTraits>
+const std::uint64_t BTree<KeyTraits>::validate_helper_leaf(PageId curPageNo, std::set<PageId>& pinnedPage) {
     Page* curPage = NULL;
     this->bufMgr->readPage(this->file, curPageNo, curPage);
     pinnedPage.insert(curPageNo);
-    LeafNode<T>* node = (LeafNode<T>*)curPage;
+    Leaf* node = (Leaf*)curPage;
 
-    if((this->height != 0) && (node->usage < this->leafOccupancy/2 || node->usage > this->leafOccupancy)) {
+    if((this->height != 0) && !node->validUsage()) {
         dprintf("Leaf Page #%d usage invalid\n", curPageNo);
-        dprintf("Usage: %d, leafOccupancy: %d\n", node->usage, this->leafOccupancy);
+        dprintf("Usage: %d, capacity: %d\n", node->usage, Leaf::MAX_USAGE);
         throw ValidationFailedException();
     }
 
+    Value key, previousKey;
     for(int i = 1; i < node->usage; i ++) {
-        if(smallerThan(node->ridKeyPairArray[i].key, node->ridKeyPairArray[i-1].key)) {
+        if(!smallerThan(node->key(i-1, previousKey), node->key(i, key))) {
             dprintf("Leaf Page #%d invalid key order\n", curPageNo);
             throw ValidationFailedException();
         }
     }
+    std::uint64_t count = 0;
+    for(int i = 0; i < node->usage; i ++) {
+        this->validate_helper_posting(curPageNo, node->value(i), pinnedPage);
+        count += PostingList::count(node->value(i));
+    }
 
     this->bufMgr->unPinPage(this->file, curPageNo, false);
     pinnedPage.erase(curPageNo);
+    return count;
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::validate_helper_posting(PageId leafPageNo, const char* value, std::set<PageId>& pinnedPage) {
+    std::vector<std::uint64_t> codes;
+    if(!PostingList::isOverflow(value)) {
+        PostingList::getInline(value, codes);
+        if(codes.empty() || !std::is_sorted(codes.begin(), codes.end())) {
+            dprintf("Leaf Page #%d invalid posting list\n", leafPageNo);
+            throw ValidationFailedException();
+        }
+        return;
+    }
+
+    const PostingList::Overflow overflow = PostingList::overflow(value);
+    std::uint32_t count = 0;
+    std::uint64_t previous = 0;
+    PageId pageNo = overflow.headPageNo;
+    PageId lastPageNo = 0;
+    while(pageNo != 0) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, pageNo, page);
+        pinnedPage.insert(pageNo);
+        PostingPage* node = (PostingPage*)page;
+        codes.clear();
+        node->get(codes);
+        if(node->count == 0 || codes.front() != node->first || codes.back() != node->last
+                || (count > 0 && codes.front() <= previous) || !std::is_sorted(codes.begin(), codes.end())) {
+            dprintf("Posting Page #%d of leaf page #%d invalid\n", pageNo, leafPageNo);
+            throw ValidationFailedException();
+        }
+        count += node->count;
+        previous = node->last;
+        lastPageNo = pageNo;
+        const PageId nextPageNo = node->nextPageNo;
+        this->bufMgr->unPinPage(this->file, pageNo, false);
+        pinnedPage.erase(pageNo);
+        pageNo = nextPageNo;
+    }
+    if(count != overflow.count || lastPageNo != overflow.tailPageNo) {
+        dprintf("Leaf Page #%d posting list count or tail invalid\n", leafPageNo);
+        throw ValidationFailedException();
+    }
 }
 
 const bool BTreeIndex::isEmpty() {
+    return this->tree->isEmpty();
+}
+
+template<class KeyTraits>
+const bool BTree<KeyTraits>::isEmpty() {
+    SharedLatchGuard shared(this->treeLatch);
     if(this->height != 0) return false;
     bool empty = false;
 
     Page* rootPage;
     this->bufMgr->readPage(this->file, this->rootPageNum, rootPage);
-    if(this->attributeType == INTEGER) {
-        LeafNode<int>* rootPageInt = (LeafNode<int>*)rootPage;
-        empty = (rootPageInt->usage == 0);
-    }
-    else if(this->attributeType == DOUBLE) {
-        LeafNode<double>* rootPageInt = (LeafNode<double>*)rootPage;
-        empty = (rootPageInt->usage == 0);
-    }
-    else {
-        LeafNode<char*>* rootPageInt = (LeafNode<char*>*)rootPage;
-        empty = (rootPageInt->usage == 0);
-    }
+    Leaf* rootNode = (Leaf*)rootPage;
+    empty = (rootNode->usage == 0);
     this->bufMgr->unPinPage(this->file, this->rootPageNum, false);
     return empty;
 }
 
+const IndexShape BTreeIndex::shape() {
+    return this->tree->shape();
+}
+
+template<class KeyTraits>
+const IndexShape BTree<KeyTraits>::shape() {
+    SharedLatchGuard shared(this->treeLatch);
+    IndexShape shape;
+    shape.height = this->height;
+    shape.leaves = shape.entries = shape.rids = shape.postingPages = shape.nonLeaves = shape.children = 0;
+    shape.leafFill = 0;
+    this->shape_helper(this->rootPageNum, 0, shape);
+    shape.leafFill /= shape.leaves;
+    shape.filePages = static_cast<BlobFile*>(this->file)->pageCount();
+    shape.freePages = static_cast<BlobFile*>(this->file)->freePageCount();
+    return shape;
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::shape_helper(PageId curPageNo, int level, IndexShape& shape) {
+    Page* curPage = NULL;
+    if(level == this->height) {
+        SharedLatchGuard leaf(this->leafLatch(curPageNo));
+        this->bufMgr->readPage(this->file, curPageNo, curPage);
+        Leaf* node = (Leaf*)curPage;
+        shape.leaves ++;
+        shape.entries += node->usage;
+        shape.leafFill += (double)node->usedBytes() / Leaf::DATA_SIZE;
+        for(int i = 0; i < node->usage; i ++) {
+            shape.rids += PostingList::count(node->value(i));
+            if(!PostingList::isOverflow(node->value(i))) {
+                continue;
+            }
+            PageId pageNo = PostingList::overflow(node->value(i)).headPageNo;
+            while(pageNo != 0) {
+                Page* page = NULL;
+                this->bufMgr->readPage(this->file, pageNo, page);
+                const PageId nextPageNo = ((PostingPage*)page)->nextPageNo;
+                this->bufMgr->unPinPage(this->file, pageNo, false);
+                shape.postingPages ++;
+                pageNo = nextPageNo;
+            }
+        }
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        return;
+    }
+    this->bufMgr->readPage(this->file, curPageNo, curPage);
+    NonLeaf* node = (NonLeaf*)curPage;
+    shape.nonLeaves ++;
+    shape.children += node->usage + 1;
+    for(int i = 0; i <= node->usage; i ++) {
+        this->shape_helper(node->child(i), level + 1, shape);
+    }
+    this->bufMgr->unPinPage(this->file, curPageNo, false);
+}
+
 
 // -----------------------------------------------------------------------------
 // Debugging functions
 // -----------------------------------------------------------------------------
 
 const void BTreeIndex::printMeta() 
+{
+    this->tree->printMeta();
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::printMeta() 
 {
     this->bufMgr->printSelfNonNull();
     Page* metaInfoPage = NULL;
@@ -1215,8 +2800,26 @@ const int BTreeIndex::dprintf(const char *format, ...)
     return done;
 }
 
+const int BTreeCore::dprintf(const char *format, ...)
+{
+    int done = 0;
+#ifdef DEBUG
+    va_list arg;
+    va_start (arg, format);
+    done = vfprintf(stdout, format, arg);
+    va_end (arg);
+#endif
+    return done;
+}
+
 
 const void BTreeIndex::dumpAllLevels()  
+{
+    this->tree->dumpAllLevels();
+}
+
+template<class KeyTraits>
+const void BTree<KeyTraits>::dumpAllLevels()  
 {
 #ifdef DEBUG
     for(int i = 0; i <= this->height; i ++) {
@@ -1226,37 +2829,22 @@ const void BTreeIndex::dumpAllLevels()
 #endif
 }
 
-const void BTreeIndex::dumpLevel(int dumpLevel)  
+template<class KeyTraits>
+const void BTree<KeyTraits>::dumpLevel(int dumpLevel)  
 {
 #ifdef DEBUG
     if(dumpLevel == this->height) {
-        if(this->attributeType == INTEGER) {
-            dumpLeaf<int>();
-        }
-        else if(this->attributeType == DOUBLE) {
-            dumpLeaf<double>();
-        }
-        else {
-            dumpLeaf<char*>();
-        }
+        dumpLeaf();
     }
     else {
-        if(this->attributeType == INTEGER) {
-            dumpLevel1<int>(this->rootPageNum, 0, dumpLevel);
-        }
-        else if(this->attributeType == DOUBLE) {
-            dumpLevel1<double>(this->rootPageNum, 0, dumpLevel);
-        }
-        else {
-            dumpLevel1<char*>(this->rootPageNum, 0, dumpLevel);
-        }
+        dumpLevel1(this->rootPageNum, 0, dumpLevel);
     }
 #endif
 }
 
 
-template<class T>
-const void BTreeIndex::dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel) 
+template<class KeyTraits>
+const void BTree<KeyTraits>::dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel) 
 {
 #ifdef DEBUG
     if(curLevel > dumpLevel) {
@@ -1266,55 +2854,24 @@ const void BTreeIndex::dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel)
 
     if(curPageNo != 0) {
         this->bufMgr->readPage(this->file, curPageNo, curPage);
-        NonLeafNode<T>* curNode = (NonLeafNode<T>*)curPage;
+        NonLeaf* curNode = (NonLeaf*)curPage;
         if(curLevel == dumpLevel) {
             std::cout<<"\t"<<curPageNo<<": ";
 
-            if(curNode->usage > this->nodeOccupancy) {
+            if(curNode->usage > NonLeaf::MAX_USAGE) {
                 return;
             }
 
+            Value key;
             for(int i = 0; i < curNode->usage; i ++) {
-                std::cout<<"["<<curNode->pageKeyPairArray[i].pageNo<<"] "<<curNode->pageKeyPairArray[i].key<<" ";
+                std::cout<<"["<<curNode->child(i)<<"] "<<curNode->key(i, key)<<" ";
             }
-            std::cout<<"["<<curNode->pageKeyPairArray[curNode->usage].pageNo<<"]";
+            std::cout<<"["<<curNode->child(curNode->usage)<<"]";
             std::cout<<" u: "<<curNode->usage<<"\n";
         }
         else {
             for(int i = 0; i < curNode->usage + 1; i ++) {
-                dumpLevel1<T>(curNode->pageKeyPairArray[i].pageNo, curLevel + 1, dumpLevel);
-            }
-        }
-        this->bufMgr->unPinPage(this->file, curPageNo, false);
-    }
-#endif
-}
-
-template<char*>
-const void BTreeIndex::dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel) 
-{
-#ifdef DEBUG
-    if(curLevel > dumpLevel) {
-        return;
-    }
-    Page* curPage = NULL;
-
-    if(curPageNo != 0) {
-        this->bufMgr->readPage(this->file, curPageNo, curPage);
-        NonLeafNode<char*>* curNode = (NonLeafNode<char*>*)curPage;
-        if(curLevel == dumpLevel) {
-            std::cout<<"\t"<<curPageNo<<" usage "<<curNode->usage<<": ";
-
-            if(curNode->usage > this->nodeOccupancy) return;
-
-            for(int i = 0; i < curNode->usage; i ++) {
-                dprintf("[%d] %s ", curNode->pageKeyPairArray[i].pageNo, curNode->pageKeyPairArray[i].key);
-            }
-            std::cout<<"["<<curNode->pageKeyPairArray[curNode->usage].pageNo<<"]\n";
-        }
-        else {
-            for(int i = 0; i < curNode->usage + 1; i ++) {
-                dumpLevel1<char*>(curNode->pageKeyPairArray[i].pageNo, curLevel + 1, dumpLevel);
+                dumpLevel1(curNode->child(i), curLevel + 1, dumpLevel);
             }
         }
         this->bufMgr->unPinPage(this->file, curPageNo, false);
@@ -1322,17 +2879,17 @@ const void BTreeIndex::dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel)
 #endif
 }
 
-template<class T>
-const void BTreeIndex::dumpLeaf() 
+template<class KeyTraits>
+const void BTree<KeyTraits>::dumpLeaf() 
 {
 #ifdef DEBUG
     PageId curPageNo = this->rootPageNum;
     Page* curPage = NULL;
     for(int i = 0; i < this->height; i ++) {
         this->bufMgr->readPage(this->file, curPageNo, curPage);
-        NonLeafNode<T>* curNode = (NonLeafNode<T>*)curPage;
+        NonLeaf* curNode = (NonLeaf*)curPage;
         PageId tmp = curPageNo;
-        curPageNo = curNode->pageKeyPairArray[0].pageNo;
+        curPageNo = curNode->child(0);
         this->bufMgr->unPinPage(this->file, tmp, false);
     }
 
@@ -1342,10 +2899,11 @@ const void BTreeIndex::dumpLeaf()
             return;
         }
         this->bufMgr->readPage(this->file, curPageNo, curPage);
-        LeafNode<T>* curNode = (LeafNode<T>*)curPage;
+        Leaf* curNode = (Leaf*)curPage;
         std::cout<<"\t"<<curPageNo<<": ";
+        Value key;
         for(int i = 0; i < curNode->usage; i ++) {
-            std::cout<<curNode->ridKeyPairArray[i].key<<" ";
+            std::cout<<curNode->key(i, key)<<" ";
         }
         std::cout<<" u:"<<curNode->usage<<"";
         std::cout<<"\t"<<"-> "<<curNode->rightSibPageNo<<"\n";
@@ -1356,36 +2914,19 @@ const void BTreeIndex::dumpLeaf()
 #endif
 }
 
-template<char*>
-const void BTreeIndex::dumpLeaf() 
-{
-#ifdef DEBUG
-    PageId curPageNo = this->rootPageNum;
-    Page* curPage = NULL;
-    for(int i = 0; i < this->height; i ++) {
-        this->bufMgr->readPage(this->file, curPageNo, curPage);
-        NonLeafNode<char*>* curNode = (NonLeafNode<char*>*)curPage;
-        PageId tmp = curPageNo;
-        curPageNo = curNode->pageKeyPairArray[0].pageNo;
-        this->bufMgr->unPinPage(this->file, tmp, false);
-    }
 
-    while(curPageNo != 0) {
-        this->bufMgr->readPage(this->file, curPageNo, curPage);
-        LeafNode<char*>* curNode = (LeafNode<char*>*)curPage;
-        std::cout<<curPageNo<<"->"<<curNode->rightSibPageNo<<": ";
-        for(int i = 0; i < curNode->usage; i ++) {
-            dprintf("%s ", curNode->ridKeyPairArray[i].key);
-        }
-        std::cout<<" u:"<<curNode->usage<<"";
-        std::cout<<"\n";
-        PageId tmp = curPageNo;
-        curPageNo = curNode->rightSibPageNo;
-        this->bufMgr->unPinPage(this->file, tmp, false);
-    }
-#endif
-}
+constexpr Datatype IntKeyTraits::TYPE;
+constexpr Datatype DoubleKeyTraits::TYPE;
+constexpr Datatype StringKeyTraits::TYPE;
 
+template<class KeyTraits>
+constexpr double BTree<KeyTraits>::SEQUENTIAL_SPLIT_FILL;
 
+template class BTree<IntKeyTraits>;
+template class BTree<DoubleKeyTraits>;
+template class BTree<StringKeyTraits>;
+template class BTree<CountedKeyTraits<IntKeyTraits> >;
+template class BTree<CountedKeyTraits<DoubleKeyTraits> >;
+template class BTree<CountedKeyTraits<StringKeyTraits> >;
 
 }
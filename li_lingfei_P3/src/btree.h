@@ -14,11 +14,14 @@
 #include <vector>
 #include <set>
 #include <algorithm>
+#include <cmath>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "latch.h"
+#include "bloomFilter.h"
 
 namespace badgerdb
 {
@@ -45,9 +48,14 @@ enum Operator
 };
 
 /**
- * @brief Size of String key.
+ * @brief Longest String key. Longer keys are cut to this many characters.
  */
-const  int STRINGSIZE = 10;
+const  int STRINGSIZE = 256;
+
+/**
+ * @brief DOUBLE keys closer than this compare equal.
+ */
+const  double DOUBLEEPSILON = 0.00001;
 
 
 /* Assignment for structures*/
@@ -58,8 +66,30 @@ inline void assignKey( double& dst, double src) {
     dst = src;
 }
 inline void assignKey( char dst[STRINGSIZE+1], char* src) {
-    strncpy(dst, src, STRINGSIZE);
-    dst[STRINGSIZE] = '\0';
+    const size_t length = strnlen(src, STRINGSIZE);
+    memcpy(dst, src, length);
+    memset(dst + length, 0, STRINGSIZE + 1 - length);
+}
+
+/* Key order of the tree: doubles closer than DOUBLEEPSILON are equal */
+inline bool keyLess(int lhs, int rhs) {
+    return lhs < rhs;
+}
+inline bool keyLess(double lhs, double rhs) {
+    return !(fabs(lhs - rhs) < DOUBLEEPSILON) && lhs < rhs;
+}
+inline bool keyLess(const char* lhs, const char* rhs) {
+    return strncmp(lhs, rhs, STRINGSIZE) < 0;
+}
+
+inline bool keyEquals(int lhs, int rhs) {
+    return lhs == rhs;
+}
+inline bool keyEquals(double lhs, double rhs) {
+    return fabs(lhs - rhs) < DOUBLEEPSILON;
+}
+inline bool keyEquals(const char* lhs, const char* rhs) {
+    return strncmp(lhs, rhs, STRINGSIZE) == 0;
 }
 
 
@@ -80,19 +110,6 @@ public:
 	}
 };
 
-template <>
-class RIDKeyPair<char*>{
-public:
-	RecordId rid;
-	char key[STRINGSIZE+1];     //Extra space for null terminator
-
-	void set( RecordId r, char* k)
-	{
-		rid = r;
-        assignKey(key, k);
-	}
-};
-
 /**
  * @brief Structure to store a key page pair which is used to pass the key and page to functions that make 
  * any modifications to the non leaf pages of the tree.
@@ -110,22 +127,38 @@ public:
 		pageNo = p;
         assignKey(key, k);
 	}
+
+  /**
+   * The non-leaves of an index without subtree counts keep none; see CountedPageKeyPair
+   */
+	std::uint32_t childCount() const { return 0; }
+	void setChildCount(const std::uint32_t) { }
+	void addChildCount(const int) { }
 };
 
-//Specialized template for string datatype
-template <>
-class PageKeyPair<char*>{
+/**
+ * @brief Key page pair of the non-leaves of an index with subtree counts, which also keeps
+ * the number of record ids in the subtree of pageNo. Counts are read and added to
+ * atomically, as threads holding the tree latch shared add to them at once.
+*/
+template <class T>
+class CountedPageKeyPair{
 public:
 	PageId pageNo;
-	char key[STRINGSIZE+1];
+	std::uint32_t count;
+	T key;
 
-    PageKeyPair(): pageNo(0) { }
+    CountedPageKeyPair(): pageNo(0), count(0) { }
 
-	void set( int p, char* k)
+	void set( int p, T k)
 	{
 		pageNo = p;
         assignKey(key, k);
 	}
+
+	std::uint32_t childCount() const { return __atomic_load_n(&count, __ATOMIC_RELAXED); }
+	void setChildCount(const std::uint32_t c) { __atomic_store_n(&count, c, __ATOMIC_RELAXED); }
+	void addChildCount(const int delta) { __atomic_add_fetch(&count, delta, __ATOMIC_RELAXED); }
 };
 
 
@@ -134,15 +167,17 @@ public:
 /**
  * @brief Overloaded operator to compare the key values of two rid-key pairs
  * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
+ * a smaller rid, by page number and then slot number.
 */
 template <class T>
 bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
 {
 	if( r1.key != r2.key )
 		return r1.key < r2.key;
-	else
+	else if( r1.rid.page_number != r2.rid.page_number )
 		return r1.rid.page_number < r2.rid.page_number;
+	else
+		return r1.rid.slot_number < r2.rid.slot_number;
 }
 
 
@@ -158,12 +193,6 @@ const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof(int) ) /
 //                                                 sibling ptr      usage              RIDKeyPair
 const  int DOUBLEARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof(int) ) / ( sizeof(RIDKeyPair<double>) );
 
-/**
- * @brief Number of key slots in B+Tree leaf for STRING key.
- */
-//                                                 sibling ptr        usage                  RIDKeyPair
-const  int STRINGARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof(int) ) / ( sizeof(RIDKeyPair<char*>) );
-
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
@@ -177,12 +206,20 @@ const  int INTARRAYNONLEAFSIZE = ( Page::SIZE -  sizeof(int)) / ( sizeof(PageKey
 const  int DOUBLEARRAYNONLEAFSIZE = ( Page::SIZE - sizeof(int)) / ( sizeof(PageKeyPair<double> ) ) - 2;
 
 /**
- * @brief Number of key slots in B+Tree leaf for STRING key.
+ * @brief Number of key slots in the non-leaves of an index with subtree counts. A double
+ * pair has room for the count in its padding, so only integer non-leaves hold fewer.
  */
-//                                                   usage            PageKeyPair                          -1 for the extra page ptr
-const  int STRINGARRAYNONLEAFSIZE = ( Page::SIZE - sizeof(int)) / ( sizeof(PageKeyPair<char*>)) - 1;
+const  int INTCOUNTEDNONLEAFSIZE = ( Page::SIZE -  sizeof(int)) / ( sizeof(CountedPageKeyPair<int>) ) - 1;
+const  int DOUBLECOUNTEDNONLEAFSIZE = ( Page::SIZE - sizeof(int)) / ( sizeof(CountedPageKeyPair<double> ) ) - 2;
 
 
+/**
+ * @brief Version of the index file layout. An index file written with another version,
+ * such as one from before string keys were prefix-compressed, is not opened. Version 2
+ * keeps subtree counts only in the non-leaves of an index created with them.
+ */
+const int INDEX_FORMAT_VERSION = 2;
+
 /**
  * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
  * to the following structure to store or retrieve information from it.
@@ -216,6 +253,24 @@ struct IndexMetaInfo{
    * Height of the B+-tree
    */
 	int height;
+
+  /**
+   * First page of the Bloom filter over the keys, 0 if the index has none, and its
+   * number of pages and of hashes per key.
+   */
+	PageId bloomPageNo;
+	std::uint32_t bloomPages;
+	int bloomHashes;
+
+  /**
+   * Non-zero if the non-leaf nodes keep the number of record ids under each child.
+   */
+	int subtreeCounts;
+
+  /**
+   * INDEX_FORMAT_VERSION of the code that created the file.
+   */
+	int formatVersion;
 };
 
 /*
@@ -228,20 +283,22 @@ at this level are just above the leaf nodes. Otherwise set to 0.
 /**
  * @brief Structure for all non-leaf nodes
 */
-template<typename T>
+template<typename T, class Pair = PageKeyPair<T> >
 struct NonLeafNode {
     //                                                   usage                  PageKeyPair 
-    const static int ARRAYNONLEAFSIZE = ( Page::SIZE - sizeof(int)) / ( sizeof( PageKeyPair<T>) );
+    const static int ARRAYNONLEAFSIZE = ( Page::SIZE - sizeof(int)) / ( sizeof( Pair) );
     //Note: this is one pair larger than this->nodeOccupancy to incoporate the extra page ptr
 
     int usage = 0;
 
-    PageKeyPair<T> pageKeyPairArray[ARRAYNONLEAFSIZE];
+    Pair pageKeyPairArray[ARRAYNONLEAFSIZE];
 
 };
 
 /**
- * @brief Structure for all leaf nodes
+ * @brief Array of <key, rid> pairs with a sibling pointer, one per page. The tree's
+ * leaves keep posting lists instead (btreeNode.h); the bulk loader writes its sorted
+ * runs in this format.
  */
 template<typename T>
 struct LeafNode {
@@ -255,12 +312,265 @@ struct LeafNode {
     PageId rightSibPageNo;
 };
 
+/**
+ * @brief A string key of up to STRINGSIZE characters, null terminated.
+ */
+struct StringKeyValue {
+	char chars[STRINGSIZE+1];
+};
+
+/*
+ * Node formats, defined in btreeNode.h. Leaves hold each key once with the posting list
+ * of its record ids; integer and double non-leaves are the arrays of NonLeafNode, and
+ * string nodes hold variable length keys in a key heap. A non-leaf is given the type of
+ * its children's entries: with a subtree count (CountedPageKeyPair, ChildRef) in an index
+ * with subtree counts, without one (PageKeyPair, PageRef) otherwise.
+ */
+template<class T> struct FixedLeafNode;
+template<class T, int OCCUPANCY, class Pair> struct FixedNonLeafNode;
+struct StringLeafNode;
+template<class Child> struct StringNonLeafNode;
+struct PageRef;
+struct ChildRef;
+
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
+ * @brief Key traits. Everything the tree needs to know about a key type: how keys are
+ * passed and held, how they compare and the format of its nodes, all fixed at compile
+ * time. BTree is instantiated with one of these.
+ */
+struct IntKeyTraits {
+  /**
+   * Type of keys in the node structures and in the tree's functions.
+   */
+	typedef int Key;
+
+  /**
+   * Copy of a key that the tree keeps, e.g. a scan bound.
+   */
+	typedef int Value;
+
+  /**
+   * Leaf and non-leaf node formats, and the non-leaf format of an index with subtree
+   * counts, which CountedKeyTraits picks.
+   */
+	typedef FixedLeafNode<int> Leaf;
+	typedef FixedNonLeafNode<int, INTARRAYNONLEAFSIZE, PageKeyPair<int> > NonLeaf;
+	typedef FixedNonLeafNode<int, INTCOUNTEDNONLEAFSIZE, CountedPageKeyPair<int> > CountedNonLeaf;
+
+  /**
+   * True if the non-leaves keep subtree counts.
+   */
+	static const bool COUNTED = false;
+
+	static constexpr Datatype TYPE = INTEGER;
+
+	static void load(Value& dst, const void* src) { memcpy(&dst, src, sizeof(int)); }
+
+  /**
+   * Copies a key out to the caller, the reverse of load.
+   */
+	static void store(void* dst, Key src) { memcpy(dst, &src, sizeof(int)); }
+	static void assign(Value& dst, Key src) { dst = src; }
+	static Key key(Value& value) { return value; }
+	static bool less(Key lhs, Key rhs) { return keyLess(lhs, rhs); }
+	static bool equals(Key lhs, Key rhs) { return keyEquals(lhs, rhs); }
+
+  /**
+   * Hash a key is probed in the index's Bloom filter by, and the hashes it is added
+   * under, which take in every key that equals it. Returns how many.
+   */
+	static std::uint64_t hash(Key key) { return BloomFilter::hash(key); }
+	static int hashes(Key key, std::uint64_t* out) { out[0] = hash(key); return 1; }
+};
+
+struct DoubleKeyTraits {
+	typedef double Key;
+	typedef double Value;
+	typedef FixedLeafNode<double> Leaf;
+	typedef FixedNonLeafNode<double, DOUBLEARRAYNONLEAFSIZE, PageKeyPair<double> > NonLeaf;
+	typedef FixedNonLeafNode<double, DOUBLECOUNTEDNONLEAFSIZE, CountedPageKeyPair<double> > CountedNonLeaf;
+	static const bool COUNTED = false;
+
+	static constexpr Datatype TYPE = DOUBLE;
+
+	static void load(Value& dst, const void* src) { memcpy(&dst, src, sizeof(double)); }
+	static void store(void* dst, Key src) { memcpy(dst, &src, sizeof(double)); }
+	static void assign(Value& dst, Key src) { dst = src; }
+	static Key key(Value& value) { return value; }
+	static bool less(Key lhs, Key rhs) { return keyLess(lhs, rhs); }
+	static bool equals(Key lhs, Key rhs) { return keyEquals(lhs, rhs); }
+	static std::uint64_t hash(Key key) { return BloomFilter::hash(key, DOUBLEEPSILON); }
+	static int hashes(Key key, std::uint64_t* out) { return BloomFilter::hashNear(key, DOUBLEEPSILON, out); }
+};
+
+struct StringKeyTraits {
+	typedef char* Key;
+	typedef StringKeyValue Value;
+	typedef StringLeafNode Leaf;
+	typedef StringNonLeafNode<PageRef> NonLeaf;
+	typedef StringNonLeafNode<ChildRef> CountedNonLeaf;
+	static const bool COUNTED = false;
+
+	static constexpr Datatype TYPE = STRING;
+
+	static void load(Value& dst, const void* src) { assignKey(dst.chars, (char*)src); }
+	static void store(void* dst, const char* src) { assignKey((char*)dst, (char*)src); }
+	static void assign(Value& dst, Key src) { assignKey(dst.chars, src); }
+	static Key key(Value& value) { return value.chars; }
+	static bool less(const char* lhs, const char* rhs) { return keyLess(lhs, rhs); }
+	static bool equals(const char* lhs, const char* rhs) { return keyEquals(lhs, rhs); }
+	static std::uint64_t hash(const char* key) { return BloomFilter::hash(key, STRINGSIZE); }
+	static int hashes(const char* key, std::uint64_t* out) { out[0] = hash(key); return 1; }
+};
+
+/**
+ * @brief Key traits of an index with subtree counts: those of Base, with the non-leaves
+ * that keep the number of record ids under each child. Indexes without counts keep the
+ * non-leaf format, and fanout, of Base.
+ */
+template<class Base>
+struct CountedKeyTraits : public Base {
+	typedef typename Base::CountedNonLeaf NonLeaf;
+	static const bool COUNTED = true;
+};
+
+
+/**
+ * @brief A range scan over a B+ Tree index, opened with BTreeIndex::openScan. Each cursor
+ * keeps its own bounds and copies out the matching entries of one leaf at a time, holding
+ * no pin or latch between calls. Any number of cursors can be open on one index at once,
+ * interleaved or each in its own thread, alongside inserts and deletes. An entry inserted
+ * or deleted while the scan is open may or may not be returned. Deleting the cursor ends
+ * the scan.
 */
-class BTreeIndex {
+class ScanCursor {
+ public:
+	virtual ~ScanCursor() { }
+
+	/**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	virtual const void scanNext(RecordId& outRid) = 0;
+
+	/**
+	 * Fetch the record ids of the next index entries that match the scan, moving to the
+	 * right sibling whenever a leaf runs out.
+   * @param outRids	Array the record ids are written to
+   * @param maxRids	Size of outRids
+	 * @return Number of record ids written. Less than maxRids only once the scan is complete.
+	**/
+	virtual const std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids) = 0;
+};
+
+
+/**
+ * @brief Shape of a B+ Tree index: its height and how full its nodes are.
+*/
+struct IndexShape {
+  /**
+   * Number of non-leaf levels above the leaves.
+   */
+	int height;
+
+  /**
+   * Number of leaves, of the entries (distinct keys) in them and of the record ids in
+   * their posting lists.
+   */
+	std::size_t leaves;
+	std::size_t entries;
+	std::size_t rids;
+
+  /**
+   * Number of overflow pages of posting lists.
+   */
+	std::size_t postingPages;
+
+  /**
+   * Fraction of the bytes of the leaves in use, averaged over the leaves.
+   */
+	double leafFill;
+
+  /**
+   * Number of non-leaf nodes and of the child pointers in them.
+   */
+	std::size_t nonLeaves;
+	std::size_t children;
+
+  /**
+   * Number of pages of the index file, free ones included, and of its free pages.
+   */
+	std::size_t filePages;
+	std::size_t freePages;
+};
+
+
+/**
+ * @brief Type erased interface of a B+ Tree index, through which BTreeIndex reaches
+ * the BTree instantiated for its key type. Keys are passed as pointers to an
+ * integer, a double or a char string.
+*/
+class BTreeCore {
+ public:
+	virtual ~BTreeCore() { }
+
+	virtual const void createIndexFromRelation(const std::string& relationName) = 0;
+	virtual const void insertEntry(const void* key, const RecordId rid) = 0;
+	virtual ScanCursor* openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp) = 0;
+	virtual const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp) = 0;
+	virtual const void scanNext(RecordId& outRid) = 0;
+	virtual const std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids) = 0;
+	virtual const void endScan() = 0;
+	virtual const std::size_t lookup(const void* key, std::vector<RecordId>& outRids) = 0;
+	virtual const std::size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp) = 0;
+	virtual const std::size_t rank(const void* key) = 0;
+	virtual const bool select(const std::size_t k, void* outKey, RecordId& outRid) = 0;
+	virtual const void setPrefetchDepth(const std::uint32_t depth) = 0;
+	virtual const bool deleteEntry(const void* key) = 0;
+	virtual const bool validate(bool showInfo) = 0;
+	virtual const bool isEmpty() = 0;
+	virtual const IndexShape shape() = 0;
+	virtual const void printMeta() = 0;
+	virtual const void dumpAllLevels() = 0;
+
+	/**
+	 * Indicates that the key is not found in the index. Deletion is terminated
+	**/
+    class DeletionKeyNotFoundException{ };
+
+	/**
+	 * Indicates that the tree sturcture is not valid for B+-tree. Validation process is terminated
+	**/
+    class ValidationFailedException{ };
+
+	/**
+	 * Print the given string only when DEBUG is set
+	**/
+    static const int dprintf (const char *format, ...);
+};
+
+
+/**
+ * @brief B+ Tree on one key type. The key layout, comparisons and node formats
+ * come from KeyTraits, so the node searches and comparisons compile down to the
+ * key type's own instructions. Nodes are only read and changed through the
+ * functions of KeyTraits::Leaf and KeyTraits::NonLeaf (btreeNode.h). Instantiated
+ * in btree.cpp for IntKeyTraits, DoubleKeyTraits and StringKeyTraits.
+ *
+ * Any number of threads can insert, delete and scan at once. Operations that change
+ * at most one leaf hold treeLatch shared and latch that leaf; the few inserts and
+ * deletes that split or merge nodes are redone holding treeLatch exclusive.
+*/
+template<class KeyTraits>
+class BTree : public BTreeCore {
+
+ public:
+	typedef typename KeyTraits::Key Key;
+	typedef typename KeyTraits::Value Value;
+	typedef typename KeyTraits::Leaf Leaf;
+	typedef typename KeyTraits::NonLeaf NonLeaf;
 
  private:
 
@@ -285,221 +595,535 @@ class BTreeIndex {
 	PageId	rootPageNum;
 
   /**
-   * Datatype of attribute over which index is built.
+   * Offset of attribute, over which index is built, inside records.
    */
-	Datatype	attributeType;
+	int 		attrByteOffset;
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Height of the B+-tree
    */
-	int 		attrByteOffset;
+	int height;
+
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Number of leaves a range scan asks the buffer manager to read ahead.
    */
-	int		leafOccupancy;
+	std::uint32_t	prefetchDepth;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Held shared to read non-leaf nodes, rootPageNum and height, which only change with
+   * it held exclusive. Leaves are written with it shared only under their leaf latch.
    */
-	int		nodeOccupancy;
+	RWLatch	treeLatch;
 
   /**
-   * Height of the B+-tree
+   * Leaf latch with padding, so that neighbouring latches do not share a cache line.
    */
-	int height;
-
-
-	// MEMBERS SPECIFIC TO SCANNING
+	struct LeafLatch {
+		RWLatch	latch;
+		char	pad[64 - sizeof(RWLatch)];
+	};
 
   /**
-   * True if an index scan has been started.
+   * Number of leaf latches. Leaves share them by page number.
    */
-	bool		scanExecuting;
+	static const int LEAF_LATCHES = 256;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Latches of the leaves. Taken only with treeLatch held shared, one at a time.
    */
-	int		nextEntry;
+	LeafLatch	leafLatches[LEAF_LATCHES];
 
   /**
-   * Page number of current page being scanned.
+   * Counts the operations that held treeLatch exclusive. A cursor that finds it changed
+   * since it left a leaf looks its place up again rather than follow the leaf's sibling.
    */
-	PageId	currentPageNum;
+	std::uint64_t	structureVersion;
 
   /**
-   * Current Page being scanned.
+   * Bloom filter over the keys, kept on the pages from bloomPageNo of the meta page.
+   * Off if the index was built without one.
    */
-	Page		*currentPageData;
+	BloomFilter	filter;
 
   /**
-   * Low INTEGER value for scan.
+   * Leaf the last split at either end of the leaf level left its key in, 0 if none, and
+   * the keys it holds: from edgeLow on, or below edgeHigh. Inserts in key order find their
+   * leaf here without walking down the tree. Only set with treeLatch held exclusive, and
+   * good while structureVersion is edgeVersion.
    */
-	int		lowValInt;
+	PageId	edgePageNum;
+	Value	edgeLow;
+	Value	edgeHigh;
+	bool	edgeHasLow;
+	bool	edgeHasHigh;
+	std::uint64_t	edgeVersion;
 
   /**
-   * Low DOUBLE value for scan.
+   * Bits of the edge argument of insertEntry_helper: the node is the first or the last
+   * of its level
    */
-	double	lowValDouble;
+	static const int LEFT_EDGE = 1;
+	static const int RIGHT_EDGE = 2;
 
   /**
-   * Low STRING value for scan.
+   * Fraction of the bytes or keys a node keeps when it splits for a key past its last
+   * one at the right end of its level. A node split for a key before its first at the
+   * left end keeps the rest.
    */
-	char lowValString[15];
+	static constexpr double SEQUENTIAL_SPLIT_FILL = 0.9;
 
   /**
-   * High INTEGER value for scan.
+   * True if every non-leaf keeps the number of record ids under each of its children.
+   * Inserts and deletes then add to the counts on their way down, and countRange, rank
+   * and select walk down by them; otherwise they walk the leaves.
    */
-	int		highValInt;
+	bool	counted;
 
   /**
-   * High DOUBLE value for scan.
+   * Most levels of non-leaves a walk down records.
    */
-	double	highValDouble;
+	static const int MAX_PATH = 32;
 
   /**
-   * High STRING value for scan.
+   * Non-leaves a walk down went through, from the root, and the child it took in each.
    */
-	char highValString[15];
-	
+	struct Path {
+		int	length;
+		PageId	pageNo[MAX_PATH];
+		int	child[MAX_PATH];
+	};
+
+ public:
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * @brief Range scan over this tree. Holds all scan state; the tree is only read.
    */
-	Operator	lowOp;
+	class Cursor : public ScanCursor {
+	 public:
+		/**
+		 * Finds the first entry in range and copies the matches of its leaf.
+		 * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+		 * @throws  BadScanrangeException If lowVal > highval
+		**/
+		Cursor(BTree* tree, Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+
+		const void scanNext(RecordId& outRid);
+
+		const std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids);
+
+	 private:
+		/**
+		 * Tree being scanned.
+		 */
+		BTree	*tree;
+
+		/**
+		 * Record ids copied from the last leaf or posting page read.
+		 */
+		std::vector<RecordId>	rids;
+
+		/**
+		 * Number of entries in rids, and the next one to return.
+		 */
+		std::size_t	ridCount;
+		std::size_t	ridPos;
+
+		/**
+		 * Last leaf read, and its right sibling, 0 if it was the last leaf.
+		 */
+		PageId	leafPageNum;
+		PageId	nextPageNum;
+
+		/**
+		 * False while entries in range of the last leaf are left to read.
+		 */
+		bool	leafDone;
+
+		/**
+		 * Next overflow page of the posting list of lastKey to read, 0 if none.
+		 */
+		PageId	postingPageNum;
+
+		/**
+		 * True once a leaf ended with a key past the high value.
+		 */
+		bool	reachedHigh;
+
+		/**
+		 * structureVersion of the tree when the last leaf was read.
+		 */
+		std::uint64_t	version;
+
+		/**
+		 * Leaves after the first leaf of the scan, taken from the parent of that
+		 * leaf and of the parents after it as the scan reaches them, and cut off
+		 * at the high key.  The leaf chain is read ahead from these.
+		 */
+		std::vector<PageId>	scanLeaves;
+
+		/**
+		 * Least key of the leaves right of those in scanLeaves, if any may hold
+		 * keys in range.
+		 */
+		bool	hasFence;
+		Value	fence;
+
+		/**
+		 * Number of entries of scanLeaves the scan has moved on to.
+		 */
+		std::size_t	scanLeafPos;
+
+		/**
+		 * Number of entries of scanLeaves prefetched so far.
+		 */
+		std::size_t	scanLeafIssued;
+
+		/**
+		 * Greatest key returned so far. Its record ids below the code nextCode (see
+		 * postingList.h) have been returned; a scan resumes at this key and code.
+		 */
+		bool	hasLastKey;
+		Value	lastKey;
+		std::uint64_t	nextCode;
+
+		/**
+		 * Codes decoded from a posting list.
+		 */
+		std::vector<std::uint64_t>	codes;
+
+		/**
+		 * Low value for scan.
+		 */
+		Value	lowVal;
+
+		/**
+		 * High value for scan.
+		 */
+		Value	highVal;
+
+		/**
+		 * Low Operator. Can only be GT(>) or GTE(>=).
+		 */
+		Operator	lowOp;
+
+		/**
+		 * High Operator. Can only be LT(<) or LTE(<=).
+		 */
+		Operator	highOp;
+
+		/**
+		 * Walks down to the leaf holding the first entry in range and reads it
+		 * */
+		const void seek();
+
+		/**
+		 * Walks down to the leaf that would hold key, appends the leaves after it
+		 * in its parent to scanLeaves, and it too if withLeaf, and sets the fence.
+		 * Returns the leaf. Called with treeLatch held shared
+		 * */
+		const PageId collectLeaves(Key key, const bool withLeaf);
+
+		/**
+		 * Prefetches leaves of scanLeaves until prefetchDepth are ahead of the scan,
+		 * collecting those of the next parent when the ones known run short
+		 * */
+		const void readAhead();
+
+		/**
+		 * Reads leaves until some entries are copied or the scan is complete.
+		 * Returns false if the scan is complete
+		 * */
+		const bool nextLeaf();
+
+		/**
+		 * Copies the record ids of the matching entries of a leaf into rids: from
+		 * lastKey and nextCode if the scan has a last key, else from the low value if
+		 * seeking, else from the first entry. Stops after the first overflow page
+		 * read, leaving the rest of the list and of the leaf for the next call.
+		 * Called with treeLatch held shared
+		 * */
+		const void readLeaf(PageId pageNo, const bool seeking);
+
+		/**
+		 * Copies the record ids from code from on of the first page of an overflow
+		 * list, from pageNo on, that has any into rids. Returns the page after it, 0
+		 * at the end of the list. Called with the latch of the list's leaf held
+		 * */
+		const PageId readPosting(PageId pageNo, const std::uint64_t from);
+	};
+
+ private:
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Scan of startScan, NULL if none has been started.
    */
-	Operator	highOp;
-	
+	Cursor	*scan;
+
 	// -----------------------------------------------------------------------------
     // Private functions
     // -----------------------------------------------------------------------------
 
     /* Relativity comparisons */
-    const bool smallerThan(int lhs, int rhs) { 
-        return lhs < rhs; 
-    }
-    const bool smallerThan(double lhs, double rhs) { 
-        return !equals(lhs, rhs) && (lhs < rhs);
-    }
-    const bool smallerThan(char* lhs, char* rhs) { 
-        return strncmp(lhs, rhs, STRINGSIZE) < 0; 
+    static bool smallerThan(Key lhs, Key rhs) {
+        return KeyTraits::less(lhs, rhs);
     }
 
     /* Equality comparisons */
-    const bool equals(int lhs, int rhs) { 
-        return lhs == rhs; 
-    }
-    const bool equals(double lhs, double rhs) { 
-        return fabs(lhs-rhs) < 0.00001; 
-    }
-    const bool equals(char* lhs, char* rhs) { 
-        return strncmp(lhs, rhs, STRINGSIZE) == 0; 
+    static bool equals(Key lhs, Key rhs) {
+        return KeyTraits::equals(lhs, rhs);
     }
 
-    template<class T>
-    const bool smallerThanOrEquals(T lhs, T rhs) { 
-        return smallerThan(lhs, rhs) || equals(lhs, rhs); 
+    static bool smallerThanOrEquals(Key lhs, Key rhs) {
+        return !KeyTraits::less(rhs, lhs);
     }
 
     /**
      * Create a new root with the copy-up entry if appropriate
      * */
-    template<class T>
-	const void createNewRoot(PageKeyPair<T>& ret);
+	const void createNewRoot(PageKeyPair<Value>& ret);
 
     /**
-     * Helper function for insertion. 
+     * Helper function for insertion. edge tells if the node is the first (LEFT_EDGE)
+     * and or the last (RIGHT_EDGE) of its level: a node there that splits for a key
+     * beyond its keys is split unevenly, expecting more keys in the same order.
      * Returns the copy-up (or push-up) key.
      * */
-    template<class T>
-	const PageKeyPair<T> insertEntry_helper(T key, const RecordId rid, PageId curPageNo, int level);
+	const PageKeyPair<Value> insertEntry_helper(Key key, const RecordId rid, PageId curPageNo, int level, const int edge);
 
     /**
-     * Inserts the key and rid to the correct position in the given leaf node
+     * Fraction of a node at edge to keep when it splits for a key that goes before all its
+     * keys (first) or after them (last)
      * */
-    template<class T>
-    const void insertEntryInLeaf(T key, const RecordId rid, LeafNode<T>* node);
+    static double splitFill(const int edge, const bool first, const bool last) {
+        if((edge & RIGHT_EDGE) && last) {
+            return SEQUENTIAL_SPLIT_FILL;
+        }
+        if((edge & LEFT_EDGE) && first) {
+            return 1 - SEQUENTIAL_SPLIT_FILL;
+        }
+        return 0.5;
+    }
 
     /**
-     * Inserts the key and pageNo to the correct position in the given internal node
+     * Walks down from the root to the leaf where key belongs, unless it is in the range of
+     * the edge leaf. If path is given, the walk always starts at the root and is recorded
+     * in it. Called with treeLatch held
      * */
-    template<class T>
-    const void insertEntryInNonLeaf(T key, const PageId pageNo, NonLeafNode<T>* node);
+    const PageId findLeaf(Key key, Path* path = NULL);
 
     /**
-     * Helper function for startScan
+     * Adds delta to the counts of the children a walk down took. Called with treeLatch
+     * held shared
      * */
-    template<class T>
-	const void startScan_helper(T lowVal, const Operator lowOp, T highVal, const Operator highOp);
+    const void addToPath(const Path& path, const int delta);
 
     /**
-     * Helper function for scanNext
+     * Number of record ids under a node: the sum of its counts, or of the lengths of its
+     * posting lists if it is a leaf
      * */
-    template<class T>
-    const void scanNext_helper(RecordId& outRid, T lowVal, T highVal);
+    const std::uint64_t subtreeCount(const PageId pageNo, const bool leaf);
 
     /**
-     * Helper function for deletion.
+     * Number of record ids of keys below key, or not above it if inclusive. Called with
+     * treeLatch held shared
      * */
-    template<class T>
-    const void deleteEntry_helper(T key, PageId curPageNo, NonLeafNode<T>* parentNode, 
-            int keyIndexAtParent, int level, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage);
+    const std::uint64_t countBelow(Key key, const bool inclusive);
 
     /**
-     * Helper function for deletion for leaf nodes. Separated from deleteEntry_helper to make the codes cleaner
+     * First leaf of the tree. Called with treeLatch held
      * */
-    template<class T>
-    const void deleteEntry_helper_leaf(T key, PageId curPageNo, NonLeafNode<T>* parentNode, 
-            int keyIndexAtParent, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage);
+    const PageId firstLeaf();
 
     /**
-     * Delete the entry from an leaf node
+     * Number of record ids of keys in the leaves from pageNo on, from the first not below
+     * *low (or above it unless lowInclusive), or from the start if low is NULL, to the
+     * last below high (or not above it if highInclusive). Called with treeLatch held shared
      * */
-    template<class T>
-    const bool deleteEntryFromLeaf(T key, LeafNode<T>* node);
+    const std::uint64_t countLeaves(PageId pageNo, const Key* low, const bool lowInclusive, Key high, const bool highInclusive);
 
     /**
-     * Delete the entry from an internal node
+     * Latch of the given leaf
      * */
-    template<class T>
-    const void deleteEntryFromNonLeaf(const int keyIndex, NonLeafNode<T>* node);
+    RWLatch& leafLatch(const PageId pageNo) {
+        return leafLatches[pageNo % LEAF_LATCHES].latch;
+    }
+
+    /**
+     * Inserts the entry if its leaf has room for it without splitting, under treeLatch
+     * held shared. Returns false, changing nothing, if the leaf would split
+     * */
+    const bool insertEntryInPlace(Key key, const RecordId rid);
+
+    /**
+     * Deletes the entry if its leaf stays at least half full, under treeLatch held shared.
+     * Returns 1 if deleted, 0 if the key is not in the index, -1, changing nothing, if
+     * the leaf would have to be merged or redistributed
+     * */
+    const int deleteEntryInPlace(Key key);
+
+    /**
+     * Helper function for deletion.
+     * */
+    const void deleteEntry_helper(Key key, PageId curPageNo, NonLeaf* parentNode,
+            int keyIndexAtParent, int level, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage);
+
+    /**
+     * Helper function for deletion for leaf nodes. Separated from deleteEntry_helper to make the codes cleaner
+     * */
+    const void deleteEntry_helper_leaf(Key key, PageId curPageNo, NonLeaf* parentNode,
+            int keyIndexAtParent, std::vector<PageId>& disposePageNo, std::set<PageId>& pinnedPage);
 
     /*
      * Tree structure validator helpers
      * */
-    template<class T>
-    const void validate_helper(PageId curPageNo, int level, std::set<PageId>& pinnedPage);
+    /*
+     * Return the number of record ids under the node, which its parent's count of it
+     * must match in an index with subtree counts. leftEdge and rightEdge tell whether the
+     * node is the first or the last of its level
+     * */
+    const std::uint64_t validate_helper(PageId curPageNo, int level, std::set<PageId>& pinnedPage,
+            const bool leftEdge = true, const bool rightEdge = true);
 
-    template<class T>
-    const void validate_helper_leaf(PageId curPageNo, std::set<PageId>& pinnedPage);
+    const std::uint64_t validate_helper_leaf(PageId curPageNo, std::set<PageId>& pinnedPage);
+
+    /*
+     * Checks the order and counts of a posting list, and the chain of its overflow pages
+     * */
+    const void validate_helper_posting(PageId leafPageNo, const char* value, std::set<PageId>& pinnedPage);
+
+    /*
+     * Adds the nodes below curPageNo to shape
+     * */
+    const void shape_helper(PageId curPageNo, int level, IndexShape& shape);
 
-    /* 
+    /*
      * Debugging functions
      * */
-    template<class T>
     const void dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel);
 
-    template<char*>
-    const void dumpLevel1(PageId curPageNo, int curLevel, int dumpLevel);
+	const void dumpLeaf();
 
+    const void dumpLevel(int dumpLevel);
+
+    /*
+     * Builds the index from the base relation bottom up: sorts the <key, rid> pairs
+     * with an external merge sort and packs leaves and non-leaf nodes in order.
+     */
+    const void bulkLoadFromRelation(const std::string& relationName, const double fillFactor);
+
+    /*
+     * bulkLoadFromRelation for the leaf format of KeyTraits. Leaves of fixed size keys are
+     * packed by bytes; a string index is built by insertion.
+     */
     template<class T>
-	const void dumpLeaf();
+    const void bulkLoad(const std::string& relationName, const double fillFactor, FixedLeafNode<T>*);
 
-    template<char*>
-	const void dumpLeaf();
+    const void bulkLoad(const std::string& relationName, const double fillFactor, StringLeafNode*);
 
-    const void dumpLevel(int dumpLevel);
+    /*
+     * Builds the Bloom filter over the keys in the leaves, with bitsPerKey bits for each,
+     * and writes it to new pages after the tree's
+     */
+    const void bloomBuild(const int bitsPerKey);
+
+    /*
+     * Reads the Bloom filter from, or writes it to, its pages
+     */
+    const void bloomLoad(const PageId firstPageNo, const std::uint32_t pages, const int hashes);
+
+    const void bloomStore(const PageId firstPageNo);
+
+
+ public:
+
+	/**
+   * Opens the index file of the given name, or creates it and builds the index from the
+   * relation, with subtree counts if KeyTraits::COUNTED. See BTreeIndex::BTreeIndex.
+   */
+	BTree(const std::string& relationName, const std::string& indexName,
+						BufMgr* bufMgrIn, const int attrByteOffset,
+						const bool bulkLoad, const double fillFactor, const int bloomBitsPerKey = 0);
+
+	~BTree();
+
+	/**
+   * Rewrites the index file of the given name densely. See BTreeIndex::compact.
+   */
+	static const std::size_t compact(const std::string& indexName, BufMgr* bufMgrIn);
+
+    const void createIndexFromRelation(const std::string& relationName);
+
+	/* Typed operations: see the BTreeIndex functions of the same name */
+	const void insertEntry(Key key, const RecordId rid);
+	Cursor* openScan(Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+	const void startScan(Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+	const bool deleteEntry(Key key);
+	const std::size_t lookup(Key key, std::vector<RecordId>& outRids);
+	const std::size_t countRange(Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+	const std::size_t rank(Key key);
+	const bool select(const std::size_t k, Value& outKey, RecordId& outRid);
+
+	/* Type erased operations */
+	const void insertEntry(const void* key, const RecordId rid);
+	ScanCursor* openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const bool deleteEntry(const void* key);
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+	const std::size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const std::size_t rank(const void* key);
+	const bool select(const std::size_t k, void* outKey, RecordId& outRid);
+
+	const void scanNext(RecordId& outRid);
+	const std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids);
+	const void endScan();
+	const void setPrefetchDepth(const std::uint32_t depth);
+    const bool validate(bool showInfo);
+    const bool isEmpty();
+	const IndexShape shape();
+	const void printMeta();
+    const void dumpAllLevels();
+};
+
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. Any number of scans can be open at once through openScan; startScan runs
+ * one scan kept inside the index. The tree itself is a
+ * BTree on the attribute's key type, picked once when the index is opened.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * Tree on the attribute's key type.
+   */
+	BTreeCore	*tree;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Reads the meta page of an index file that is not open through a file of its own,
+   * which it flushes before closing.
+   */
+	static const IndexMetaInfo readMetaInfo(const std::string& indexName, BufMgr* bufMgrIn);
 
-	
  public:
 
+    /**
+     * Fraction of each node filled by bulk loading, unless another is asked for.
+     */
+    static const double DEFAULT_FILL_FACTOR;
+
     // -----------------------------------------------------------------------------
     // Constructor / Destructor and helpers
     // -----------------------------------------------------------------------------
 	/**
-   * BTreeIndex Constructor. 
+   * BTreeIndex Constructor.
 	 * Check to see if the corresponding index file exists. If so, open the file.
 	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
    *
@@ -508,24 +1132,30 @@ class BTreeIndex {
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
-   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @param bulkLoad						Build a new index bottom up from the sorted entries instead of inserting them one at a time
+   * @param fillFactor					Fraction of each node filled by bulk loading, clamped to [0.5, 1]
+   * @param bloomBitsPerKey			Bits per key of a Bloom filter over the keys, for lookup to skip the tree for keys not in it. 0 builds none. Ignored when the index file exists
+   * @param subtreeCounts				Keep the number of record ids under each child in the non-leaves, for countRange, rank and select to walk down the tree instead of along the leaves. Every insert and delete then writes the non-leaves on its path, and integer non-leaves hold 681 keys instead of 1022. Ignored when the index file exists
+   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters, or it was written in another INDEX_FORMAT_VERSION.
    */
 	BTreeIndex(const std::string& relationName, std::string& outIndexName,
-						BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType);
+						BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType,
+						const bool bulkLoad = false, const double fillFactor = DEFAULT_FILL_FACTOR,
+						const int bloomBitsPerKey = 0, const bool subtreeCounts = false);
 
     const void createIndexFromRelation(const std::string& relationName);
 
 	/**
-   * BTreeIndex Destructor. 
+   * BTreeIndex Destructor.
 	 * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
 	 * and delete file instance thereby closing the index file.
-	 * Destructor should not throw any exceptions. All exceptions should be caught in here itself. 
+	 * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
 	 * */
 	~BTreeIndex();
 
 
     /**
-	 * Insert a new entry using the pair <value,rid>. 
+	 * Insert a new entry using the pair <value,rid>.
 	 * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting of leaf node.
 	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
 	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
@@ -535,10 +1165,18 @@ class BTreeIndex {
 	**/
 	const void insertEntry(const void* key, const RecordId rid);
 
-	
+
 	/**
-	 * Begin a filtered scan of the index.  For instance, if the method is called 
-	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
+	 * Open a filtered scan of the index, independent of startScan and of any other open
+	 * cursor. Takes the same arguments as startScan. The caller deletes the cursor.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	ScanCursor* openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+	/**
+	 * Begin a filtered scan of the index.  For instance, if the method is called
+	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
 	 * greater than "a" and less than or equal to "d".
 	 * If another scan is already executing, that needs to be ended here.
 	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
@@ -547,7 +1185,7 @@ class BTreeIndex {
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
    * @param highOp	High operator (LT/LTE)
-   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
 	**/
@@ -562,43 +1200,119 @@ class BTreeIndex {
 	**/
 	const void scanNext(RecordId& outRid);
 
-	
+	/**
+	 * Fetch the record ids of the next index entries that match the scan. Whole runs of
+	 * entries are copied out of each leaf, and the end of the scan is a short count
+	 * rather than an exception.
+   * @param outRids	Array the record ids are written to
+   * @param maxRids	Size of outRids
+	 * @return Number of record ids written. Less than maxRids only once the scan is complete.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	const std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids);
+
+
 	/**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	const void endScan();
 
+	/**
+	 * Find every entry of the given key. Walks down the tree once and copies the key's
+	 * posting list, with no scan set up. If the index has a Bloom filter, a key it rules
+	 * out is answered without reading a page.
+   * @param key			Key to look up, pointer to integer/double/char string
+   * @param outRids	The record ids of the key are appended to this, in (page, slot) order
+	 * @return Number of record ids appended, 0 if the key is not in the index.
+	**/
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+
+	/**
+	 * Count the record ids in a key range, without reading them. Takes the same arguments
+	 * as startScan. With subtree counts this reads one path down the tree for each bound;
+	 * otherwise it reads the leaves up to the high bound.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+	 * @return Number of record ids of keys in the range.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	const std::size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+	/**
+	 * Count the record ids of keys less than the given key.
+   * @param key			Key, pointer to integer/double/char string
+	 * @return Number of record ids before the first of key in key order.
+	**/
+	const std::size_t rank(const void* key);
+
+	/**
+	 * Find the k-th record id of the index, counting from 0 in key and then (page, slot)
+	 * order: the one a full scan returns after k others.
+   * @param k				Position of the record id
+   * @param outKey	Its key is copied to this: an integer, a double or a char array of STRINGSIZE + 1
+   * @param outRid	The record id is returned in this
+	 * @return False, setting neither, if the index has k record ids or fewer.
+	**/
+	const bool select(const std::size_t k, void* outKey, RecordId& outRid);
+
+	/**
+	 * Set how many leaves range scans read ahead of the leaf they are on. 0 turns read-ahead off.
+   * @param depth	Number of leaves to prefetch
+	**/
+	const void setPrefetchDepth(const std::uint32_t depth);
+
 	/**
 	 * Indicates that the key is not found in the index. Deletion is terminated
 	**/
-    class DeletionKeyNotFoundException{ };
+    typedef BTreeCore::DeletionKeyNotFoundException DeletionKeyNotFoundException;
 
 	/**
-	 * Delete the given key from the index.
+	 * Delete an entry of the given key from the index: the smallest record id, by page
+	 * and slot, of the key's posting list.
 	 * @param key the key to be deleted
 	 * @throws DeletionKeyNotFoundException If the key is not present in the index
 	**/
     const bool deleteEntry(const void *key);
 
-    
+
 	/**
 	 * Indicates that the tree sturcture is not valid for B+-tree. Validation process is terminated
 	**/
-    class ValidationFailedException{ };
-	
+    typedef BTreeCore::ValidationFailedException ValidationFailedException;
+
 	/**
-	 * Validate the tree structure. 
+	 * Validate the tree structure.
 	 * @param showInfo If true, then the information about the tree will be printed during validation. If false, the validation will execute silently until it sees invalid structure.
 	 * @throws ValidationFailedException If the tree structure is invalid
 	**/
     const bool validate(bool showInfo);
-	
+
 	/**
 	 * Return a boolean indicating if the tree has no entry in it
 	**/
     const bool isEmpty();
 
+	/**
+	 * Count the nodes and entries on every level of the tree
+	**/
+	const IndexShape shape();
+
+	/**
+	 * Rewrite an index file with only the pages the index uses and no free ones: the
+	 * meta page, the tree level by level from the root, then the overflow pages of the
+	 * posting lists and the Bloom filter. The index must not be open.
+   * @param indexName	Name of the index file, as returned by the constructor
+   * @param bufMgrIn	Buffer Manager Instance
+	 * @return Number of pages the file shrank by.
+	 * @throws FileOpenException If the index file is open
+	 * @throws BadIndexInfoException If the file was written in another INDEX_FORMAT_VERSION
+	**/
+	static const std::size_t compact(const std::string& indexName, BufMgr* bufMgrIn);
+
     // -----------------------------------------------------------------------------
     // Debugging functions
     // -----------------------------------------------------------------------------
@@ -620,5 +1334,3 @@ class BTreeIndex {
 };
 
 }
-
-
@@ -0,0 +1,1295 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+
+#include "btree.h"
+#include "nodeSearch.h"
+#include "postingList.h"
+
+/**
+ * Node formats of the B+-tree. BTree reaches its nodes only through the functions
+ * below, so each key type lays its nodes out as suits it:
+ *     FixedLeafNode                        slotted page of fixed size keys, for INTEGER
+ *                                          and DOUBLE keys
+ *     FixedNonLeafNode                     sorted array of fixed size keys
+ *     StringLeafNode, StringNonLeafNode    slotted pages whose keys are kept in a key
+ *                                          heap, less the prefix all keys of the node
+ *                                          share, for STRING keys
+ *
+ * Every node has a usage, its number of entries (leaves) or keys (non-leaves). Key i of
+ * a non-leaf separates child i from child i + 1. A leaf holds each key once, with the
+ * posting list of its record ids (postingList.h) as the entry's value.
+ */
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// Fixed size keys
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Leaf of fixed size keys, each with the posting list of its record ids. The
+ * slots, in key order, fill data from the start and hold a key and where its list lies
+ * in the heap, which grows down from the end of data. A list rewritten longer moves
+ * and leaves a hole in the heap until the leaf is compacted.
+ */
+template<class T>
+struct FixedLeafNode {
+    struct Slot {
+        T key;
+        std::uint16_t offset;
+        std::uint16_t length;
+    };
+
+    /**
+     * Bytes of slots and heap
+     */
+    static const int DATA_SIZE = Page::SIZE - sizeof(int) - sizeof(PageId) - 4 * sizeof(std::uint16_t);
+
+    /**
+     * Most entries a leaf holds: every list takes at least a byte
+     */
+    static const int MAX_USAGE = DATA_SIZE / (sizeof(Slot) + 1);
+
+    int usage;
+
+    PageId rightSibPageNo;
+
+    /**
+     * Start of the heap, which ends at the end of data
+     */
+    std::uint16_t heapStart;
+
+    /**
+     * Bytes of the heap left by removed or moved lists
+     */
+    std::uint16_t holeBytes;
+
+    std::uint16_t unused[2];
+
+    char data[DATA_SIZE];
+
+    /**
+     * @brief An entry being put into a leaf. Points into the leaf it is taken from, or
+     * into a copy of it.
+     */
+    struct EntryRef {
+        T key;
+        const char* value;
+        int length;
+    };
+
+    void init() {
+        clear();
+        this->rightSibPageNo = 0;
+    }
+
+    Slot* slots() { return (Slot*)data; }
+    const Slot* slots() const { return (const Slot*)data; }
+
+    int freeBytes() const {
+        return heapStart - usage * (int)sizeof(Slot);
+    }
+
+    /**
+     * Bytes taken by slots and lists
+     */
+    int usedBytes() const {
+        return DATA_SIZE - freeBytes() - holeBytes;
+    }
+
+    /**
+     * Position of the first entry whose key is not less than key
+     */
+    int lowerBound(T key) const {
+        return NodeSearch::lowerBound(slots(), this->usage, key);
+    }
+
+    /**
+     * Position of the first entry whose key is greater than key
+     */
+    int upperBound(T key) const {
+        return NodeSearch::upperBound(slots(), this->usage, key);
+    }
+
+    /**
+     * Copies the key of entry i to buf and returns it
+     */
+    T key(int i, T& buf) const {
+        buf = slots()[i].key;
+        return buf;
+    }
+
+    /**
+     * Posting list of entry i
+     */
+    const char* value(int i) const {
+        return data + slots()[i].offset;
+    }
+
+    /**
+     * Position of the entry with key, -1 if there is none
+     */
+    int find(T key) const {
+        const int i = lowerBound(key);
+        return (i < this->usage && keyEquals(key, slots()[i].key)) ? i : -1;
+    }
+
+    /**
+     * Sets the posting list of key to value, adding an entry for key if it has none.
+     * Returns false, changing nothing, if the leaf has to split for it. A list no longer
+     * than the one it replaces is always written in place.
+     */
+    bool put(T key, const char* value, const int length) {
+        int i = find(key);
+        if(i >= 0 && length <= slots()[i].length) {
+            memcpy(data + slots()[i].offset, value, length);
+            holeBytes += slots()[i].length - length;
+            slots()[i].length = length;
+            return true;
+        }
+        const int needed = (i >= 0) ? length - slots()[i].length : (int)sizeof(Slot) + length;
+        if(freeBytes() + holeBytes < needed) {
+            return false;
+        }
+        const bool added = i < 0;
+        if(!added) {
+            //the old list becomes a hole; compact() keeps no bytes of a slot of length 0
+            holeBytes += slots()[i].length;
+            slots()[i].length = 0;
+        }
+        if(freeBytes() < (added ? (int)sizeof(Slot) : 0) + length) {
+            compact();
+        }
+        if(added) {
+            i = upperBound(key);
+            memmove(&slots()[i+1], &slots()[i], (this->usage - i) * sizeof(Slot));
+            slots()[i].key = key;
+            slots()[i].length = 0;
+            this->usage ++;
+        }
+        heapStart -= length;
+        memcpy(data + heapStart, value, length);
+        slots()[i].offset = heapStart;
+        slots()[i].length = length;
+        return true;
+    }
+
+    /**
+     * Puts the entry into this full leaf and moves the entries above the cut to right, a
+     * new page. The cut leaves this leaf the fraction leftFill of the bytes, half unless
+     * the inserts come in key order. separator is set to the key copied up to the parent
+     */
+    void splitPut(T key, const char* value, const int length, FixedLeafNode* right, T& separator, const double leftFill = 0.5) {
+        const FixedLeafNode copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs, key, value, length);
+        const int k = splitPoint(refs, leftFill);
+        separator = refs[k].key;
+        build(refs.data(), k);
+        right->build(refs.data() + k, refs.size() - k);
+    }
+
+    void removeAt(int i) {
+        holeBytes += slots()[i].length;
+        memmove(&slots()[i], &slots()[i+1], (this->usage - i - 1) * sizeof(Slot));
+        this->usage --;
+        if(this->usage == 0) {
+            clear();
+        }
+    }
+
+    /**
+     * Below a quarter full a leaf other than the root is merged or redistributed
+     */
+    bool underfull() const {
+        return usedBytes() < DATA_SIZE/4;
+    }
+
+    bool underfullWithout(int i) const {
+        return this->usage == 1 || usedBytes() - (int)sizeof(Slot) - slots()[i].length < DATA_SIZE/4;
+    }
+
+    bool validUsage() const {
+        return this->usage >= 1 && this->usage <= MAX_USAGE;
+    }
+
+    /**
+     * True if left and its right sibling are to be merged rather than redistributed
+     */
+    static bool mergeable(const FixedLeafNode* left, const FixedLeafNode* right) {
+        return left->usedBytes() + right->usedBytes() <= DATA_SIZE;
+    }
+
+    /**
+     * Appends the entries of the right sibling, whose page is then disposed
+     */
+    void mergeFrom(const FixedLeafNode* right) {
+        const FixedLeafNode copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs);
+        right->collect(refs);
+        build(refs.data(), refs.size());
+        this->rightSibPageNo = right->rightSibPageNo;
+    }
+
+    /**
+     * Splits the entries of two siblings evenly by bytes between them and sets their
+     * separator, key keyIndex of parent. Returns false if the parent takes no new key
+     */
+    template<class Parent>
+    static bool redistribute(FixedLeafNode* left, FixedLeafNode* right, Parent* parent, int keyIndex) {
+        const FixedLeafNode leftCopy = *left;
+        const FixedLeafNode rightCopy = *right;
+        std::vector<EntryRef> refs;
+        leftCopy.collect(refs);
+        rightCopy.collect(refs);
+        const int k = splitPoint(refs, 0.5);
+        if(!parent->setKey(keyIndex, refs[k].key)) {
+            return false;
+        }
+        left->build(refs.data(), k);
+        right->build(refs.data() + k, refs.size() - k);
+        return true;
+    }
+
+private:
+    void clear() {
+        this->usage = 0;
+        heapStart = DATA_SIZE;
+        holeBytes = 0;
+        unused[0] = unused[1] = 0;
+    }
+
+    EntryRef ref(int i) const {
+        EntryRef r = {slots()[i].key, value(i), slots()[i].length};
+        return r;
+    }
+
+    void collect(std::vector<EntryRef>& refs) const {
+        for(int j = 0; j < this->usage; j ++) refs.push_back(ref(j));
+    }
+
+    /**
+     * Refs to the entries of the leaf, with the list of key set to value
+     */
+    void collect(std::vector<EntryRef>& refs, T key, const char* value, const int length) const {
+        EntryRef entry = {key, value, length};
+        const int i = find(key);
+        collect(refs);
+        if(i >= 0) {
+            refs[i] = entry;
+        } else {
+            refs.insert(refs.begin() + upperBound(key), entry);
+        }
+    }
+
+    /**
+     * Where to cut refs into two leaves, the left one taking refs[0, k): the last cut
+     * that gives the left one at most the fraction leftFill of their bytes, moved right
+     * if the right one would not fit
+     */
+    static int splitPoint(const std::vector<EntryRef>& refs, const double leftFill) {
+        const int n = refs.size();
+        int total = 0;
+        for(int i = 0; i < n; i ++) {
+            total += sizeof(Slot) + refs[i].length;
+        }
+        const double target = std::min<double>(DATA_SIZE, leftFill * total);
+        int k = 1;
+        int left = sizeof(Slot) + refs[0].length;
+        while(k < n - 1 && (left + (int)sizeof(Slot) + refs[k].length <= target || total - left > DATA_SIZE)) {
+            left += sizeof(Slot) + refs[k].length;
+            k ++;
+        }
+        return k;
+    }
+
+    /**
+     * Refills the leaf with refs[0, n), which must fit and must not point into the leaf
+     */
+    void build(const EntryRef* refs, const int n) {
+        clear();
+        for(int i = 0; i < n; i ++) {
+            heapStart -= refs[i].length;
+            memcpy(data + heapStart, refs[i].value, refs[i].length);
+            slots()[i].key = refs[i].key;
+            slots()[i].offset = heapStart;
+            slots()[i].length = refs[i].length;
+        }
+        this->usage = n;
+    }
+
+    /**
+     * Packs the heap
+     */
+    void compact() {
+        const FixedLeafNode copy = *this;
+        heapStart = DATA_SIZE;
+        for(int i = 0; i < this->usage; i ++) {
+            heapStart -= slots()[i].length;
+            memcpy(data + heapStart, copy.data + copy.slots()[i].offset, slots()[i].length);
+            slots()[i].offset = heapStart;
+        }
+        holeBytes = 0;
+    }
+};
+
+/**
+ * @brief Non-leaf of up to OCCUPANCY keys and one more child. Full at OCCUPANCY - 1 keys.
+ * Pair is CountedPageKeyPair in an index with subtree counts, PageKeyPair otherwise.
+ */
+template<class T, int OCCUPANCY, class Pair>
+struct FixedNonLeafNode : public NonLeafNode<T, Pair> {
+    /**
+     * Most keys a non-leaf holds
+     */
+    static const int MAX_USAGE = OCCUPANCY;
+
+    void init(const PageId firstPageNo) {
+        this->usage = 0;
+        this->pageKeyPairArray[0].pageNo = firstPageNo;
+        this->pageKeyPairArray[0].setChildCount(0);
+    }
+
+    /**
+     * Index of the child whose subtree holds key
+     */
+    int upperBound(T key) const {
+        return NodeSearch::upperBound(this->pageKeyPairArray, this->usage, key);
+    }
+
+    PageId child(int i) const {
+        return this->pageKeyPairArray[i].pageNo;
+    }
+
+    void setChild(int i, const PageId pageNo) {
+        this->pageKeyPairArray[i].pageNo = pageNo;
+    }
+
+    /**
+     * Number of record ids under child i; always 0 without subtree counts
+     */
+    std::uint32_t count(int i) const {
+        return this->pageKeyPairArray[i].childCount();
+    }
+
+    void setCount(int i, const std::uint32_t count) {
+        this->pageKeyPairArray[i].setChildCount(count);
+    }
+
+    void addCount(int i, const int delta) {
+        this->pageKeyPairArray[i].addChildCount(delta);
+    }
+
+    T key(int i, T& buf) const {
+        buf = this->pageKeyPairArray[i].key;
+        return buf;
+    }
+
+    /**
+     * Inserts key with pageNo as the child to its right, with a count of 0. Returns false,
+     * changing nothing, if the node has to split for it
+     */
+    bool insert(T key, const PageId pageNo) {
+        if(this->usage + 1 >= OCCUPANCY) {
+            return false;
+        }
+        insertEntry(key, pageNo);
+        return true;
+    }
+
+    /**
+     * Inserts key and pageNo into this full node and moves the keys and children above
+     * the cut key to right, a new page. The cut key, the middle one unless leftFill asks
+     * for another fraction of the keys to stay, is pushed up to the parent as separator
+     */
+    void splitInsert(T key, const PageId pageNo, FixedNonLeafNode* right, T& separator, const double leftFill = 0.5) {
+        insertEntry(key, pageNo);
+        const int cut = std::min(OCCUPANCY - 2, std::max(1, (int)(leftFill * OCCUPANCY)));
+
+        //push up
+        separator = this->pageKeyPairArray[cut].key;
+
+        //redistribute
+        int cnt = 0;
+        for(int i = cut+1; i < OCCUPANCY; i ++) {
+            right->pageKeyPairArray[cnt ++] = this->pageKeyPairArray[i];
+        }
+        right->pageKeyPairArray[cnt] = this->pageKeyPairArray[OCCUPANCY];
+
+        //set usage
+        right->usage = cnt;
+        this->usage = OCCUPANCY - cnt - 1;
+    }
+
+    /**
+     * Deletes key keyIndex and child keyIndex + 1
+     */
+    void removeKey(int keyIndex) {
+        //Note the skew between key and pageNo index
+        //Example: keyIndex is 1, k1 and p2 will be deleted
+        //      k0      [k1]      k2
+        //  p0      p1      [p2]       p3
+        for(int j = keyIndex; j < this->usage - 1; j ++) {
+            assignKey(this->pageKeyPairArray[j].key, this->pageKeyPairArray[j+1].key);
+            this->pageKeyPairArray[j+1].pageNo = this->pageKeyPairArray[j+2].pageNo;
+            this->pageKeyPairArray[j+1].setChildCount(this->pageKeyPairArray[j+2].childCount());
+        }
+        this->usage --;
+    }
+
+    bool setKey(int i, T key) {
+        assignKey(this->pageKeyPairArray[i].key, key);
+        return true;
+    }
+
+    //if occupancy is 6, then the resulting two nodes will both have usage of 2. Hence -1 is needed
+    bool underfull() const {
+        return this->usage < OCCUPANCY/2-1;
+    }
+
+    bool validUsage() const {
+        return this->usage >= 1 && this->usage <= OCCUPANCY;
+    }
+
+    /**
+     * Half full, as every non-leaf but the root must be except on the first and last
+     * node of a level: a split at either end leaves the node there short of half full,
+     * and it fills as the inserts go on in key order
+     */
+    bool halfFull() const {
+        return this->usage >= OCCUPANCY/2-1;
+    }
+
+    static bool mergeable(const FixedNonLeafNode* left, T parentKey, const FixedNonLeafNode* right) {
+        return std::max(left->usage, right->usage) < OCCUPANCY/2;
+    }
+
+    /**
+     * Appends parentKey, the separator pulled down from the parent, and the keys and
+     * children of the right sibling
+     */
+    void mergeFrom(T parentKey, const FixedNonLeafNode* right) {
+        //      k1      k2      k_      k'1     k'2
+        //  p1      p2      p3      p'1     p'2     p'3
+        assignKey(this->pageKeyPairArray[this->usage].key, parentKey);
+        this->usage ++;
+        for(int i = 0; i < right->usage; i ++) {
+            this->pageKeyPairArray[this->usage ++] = right->pageKeyPairArray[i];
+        }
+        this->pageKeyPairArray[this->usage].pageNo = right->pageKeyPairArray[right->usage].pageNo;
+        this->pageKeyPairArray[this->usage].setChildCount(right->pageKeyPairArray[right->usage].childCount());
+    }
+
+    /**
+     * Rotates one child from the larger of two siblings to the smaller through their
+     * separator, key keyIndex of parent
+     */
+    static bool redistribute(FixedNonLeafNode* left, FixedNonLeafNode* right, FixedNonLeafNode* parent, int keyIndex) {
+        if(left->usage > right->usage) {
+            //the separator and left's last child go to the front of right
+            right->usage ++;
+            for(int j = right->usage; j > 0; j --) {
+                right->pageKeyPairArray[j] = right->pageKeyPairArray[j-1];
+            }
+            right->pageKeyPairArray[0].pageNo = left->pageKeyPairArray[left->usage].pageNo;
+            right->pageKeyPairArray[0].setChildCount(left->pageKeyPairArray[left->usage].childCount());
+            assignKey(right->pageKeyPairArray[0].key, parent->pageKeyPairArray[keyIndex].key);
+
+            //left's last key replaces the separator
+            assignKey(parent->pageKeyPairArray[keyIndex].key, left->pageKeyPairArray[left->usage-1].key);
+            left->usage --;
+        } else {
+            //the separator and right's first child go to the end of left
+            assignKey(left->pageKeyPairArray[left->usage].key, parent->pageKeyPairArray[keyIndex].key);
+            left->pageKeyPairArray[left->usage+1].pageNo = right->pageKeyPairArray[0].pageNo;
+            left->pageKeyPairArray[left->usage+1].setChildCount(right->pageKeyPairArray[0].childCount());
+            left->usage ++;
+
+            //right's first key replaces the separator
+            assignKey(parent->pageKeyPairArray[keyIndex].key, right->pageKeyPairArray[0].key);
+            for(int i = 0; i < right->usage; i ++) {
+                right->pageKeyPairArray[i] = right->pageKeyPairArray[i+1];
+            }
+            right->usage --;
+        }
+        return true;
+    }
+
+private:
+    void insertEntry(T key, const PageId pageNo) {
+        const int i = upperBound(key);
+
+        //Shift all elements after this position
+        for(int j = this->usage; j > i; j --) {
+            this->pageKeyPairArray[j+1].pageNo = this->pageKeyPairArray[j].pageNo;
+            this->pageKeyPairArray[j+1].setChildCount(this->pageKeyPairArray[j].childCount());
+            assignKey(this->pageKeyPairArray[j].key, this->pageKeyPairArray[j-1].key);
+        }
+        this->pageKeyPairArray[i+1].pageNo = pageNo;
+        this->pageKeyPairArray[i+1].setChildCount(0);
+        assignKey(this->pageKeyPairArray[i].key, key);
+        this->usage ++;
+    }
+};
+
+
+// -----------------------------------------------------------------------------
+// String keys
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Slot of a string node: where the rest of key, after the node's prefix, lies in
+ * the key heap, and the length of its posting list (leaf) or the child page (non-leaf)
+ * of the entry.
+ */
+template<class Payload>
+struct StringSlot {
+    std::uint16_t offset;
+    std::uint16_t length;
+    Payload payload;
+};
+
+/**
+ * @brief Payload of a string leaf slot. The posting list follows the rest of the key in
+ * the heap.
+ */
+struct ValueLength {
+    std::uint16_t length;
+};
+
+/**
+ * @brief Payload of a string non-leaf slot: the child to the right of the key.
+ */
+struct PageRef {
+    PageId pageNo;
+
+    std::uint32_t childCount() const { return 0; }
+    void setChildCount(const std::uint32_t) { }
+    void addChildCount(const int) { }
+};
+
+/**
+ * @brief Payload of a string non-leaf slot in an index with subtree counts: the child to
+ * the right of the key and the number of record ids under it, read and added to
+ * atomically as in CountedPageKeyPair.
+ */
+struct ChildRef {
+    PageId pageNo;
+    std::uint32_t count;
+
+    std::uint32_t childCount() const { return __atomic_load_n(&count, __ATOMIC_RELAXED); }
+    void setChildCount(const std::uint32_t c) { __atomic_store_n(&count, c, __ATOMIC_RELAXED); }
+    void addChildCount(const int delta) { __atomic_add_fetch(&count, delta, __ATOMIC_RELAXED); }
+};
+
+/* Bytes an entry keeps in the heap after the rest of its key */
+inline int heapValueBytes(const PageRef&) {
+    return 0;
+}
+inline int heapValueBytes(const ChildRef&) {
+    return 0;
+}
+inline int heapValueBytes(const ValueLength& value) {
+    return value.length;
+}
+
+/**
+ * @brief Slotted node of string keys. The slots, in key order, fill data from the
+ * start; the prefix shared by all keys of the node sits at the end, and the rest of
+ * each key is put in the key heap that grows down from the prefix. Keys are compared
+ * with the prefix once and only their remainders are searched. A leaf entry's posting
+ * list is kept right after the rest of its key. A key removed leaves a hole in the heap
+ * until the node is compacted.
+ */
+template<class Payload>
+struct StringNode {
+    typedef StringSlot<Payload> Slot;
+
+    /**
+     * Bytes of slots, heap and prefix. The node is followed by the right sibling (leaf)
+     * or by the payload of the first child (non-leaf).
+     */
+    static const int DATA_SIZE = Page::SIZE - sizeof(int) - 4 * sizeof(std::uint16_t)
+            - (std::is_same<Payload, ValueLength>::value ? sizeof(PageId) : sizeof(Payload));
+
+    /**
+     * Most entries a node holds: empty keys take only their slot
+     */
+    static const int MAX_USAGE = DATA_SIZE / sizeof(Slot);
+
+    int usage;
+
+    /**
+     * Length of the prefix every key of the node starts with
+     */
+    std::uint16_t prefixLength;
+
+    /**
+     * Start of the key heap, which ends where the prefix begins
+     */
+    std::uint16_t heapStart;
+
+    /**
+     * Bytes of the heap left by removed keys
+     */
+    std::uint16_t holeBytes;
+
+    std::uint16_t unused;
+
+    char data[DATA_SIZE];
+
+    /**
+     * @brief An entry being put into a node: a key, made of head followed by tail, and
+     * its payload. Points into the node it is taken from, or into a copy of it.
+     */
+    struct EntryRef {
+        const char* head;
+        int headLength;
+        const char* tail;
+        int tailLength;
+        Payload payload;
+        const char* value;
+
+        int length() const { return headLength + tailLength; }
+        int valueLength() const { return heapValueBytes(payload); }
+
+        void copyValue(char* dst) const {
+            if(valueLength() > 0) {
+                memcpy(dst, value, valueLength());
+            }
+        }
+        char at(int j) const { return j < headLength ? head[j] : tail[j - headLength]; }
+
+        /* Copies characters [from, to) of the key */
+        void copy(int from, int to, char* dst) const {
+            if(from < headLength) {
+                const int n = std::min(to, headLength) - from;
+                memcpy(dst, head + from, n);
+                dst += n;
+                from += n;
+            }
+            if(from < to) {
+                memcpy(dst, tail + from - headLength, to - from);
+            }
+        }
+    };
+
+    Slot* slots() { return (Slot*)data; }
+    const Slot* slots() const { return (const Slot*)data; }
+    const char* prefix() const { return data + DATA_SIZE - prefixLength; }
+
+    void clear() {
+        usage = 0;
+        prefixLength = 0;
+        heapStart = DATA_SIZE;
+        holeBytes = 0;
+        unused = 0;
+    }
+
+    int freeBytes() const {
+        return heapStart - usage * (int)sizeof(Slot);
+    }
+
+    /**
+     * Bytes taken by slots, keys, values and prefix
+     */
+    int usedBytes() const {
+        return DATA_SIZE - freeBytes() - holeBytes;
+    }
+
+    /**
+     * Bytes of the rest of key i and its value in the heap
+     */
+    int heapBytes(int i) const {
+        return slots()[i].length + heapValueBytes(slots()[i].payload);
+    }
+
+    /**
+     * Below a quarter full a node other than the root is merged or redistributed
+     */
+    bool underfull() const {
+        return usedBytes() < DATA_SIZE/4;
+    }
+
+    /**
+     * Copies key i to buf and returns it
+     */
+    char* key(int i, StringKeyValue& buf) const {
+        memcpy(buf.chars, prefix(), prefixLength);
+        memcpy(buf.chars + prefixLength, data + slots()[i].offset, slots()[i].length);
+        buf.chars[prefixLength + slots()[i].length] = '\0';
+        return buf.chars;
+    }
+
+    int lowerBound(const char* key) const { return bound(key, false); }
+    int upperBound(const char* key) const { return bound(key, true); }
+
+    /**
+     * Number of keys less than (lowerBound) or not greater than (upperBound) key, which
+     * is compared up to STRINGSIZE characters
+     */
+    int bound(const char* key, const bool upper) const {
+        const size_t keyLength = strnlen(key, STRINGSIZE);
+        const int length = (int)keyLength;
+        const int c = memcmp(key, prefix(), std::min(keyLength, (size_t)prefixLength));
+        if(c < 0 || (c == 0 && length < prefixLength)) {
+            return 0;
+        }
+        if(c > 0) {
+            return usage;
+        }
+        const char* rest = key + prefixLength;
+        const int restLength = length - prefixLength;
+        int base = 0;
+        int len = usage;
+        while(len > 0) {
+            const int half = len / 2;
+            const int r = compareRest(base + half, rest, restLength);
+            if(r < 0 || (upper && r == 0)) {
+                base += half + 1;
+                len -= half + 1;
+            } else {
+                len = half;
+            }
+        }
+        return base;
+    }
+
+    /**
+     * Position of the first key equal to key, -1 if there is none
+     */
+    int find(const char* key) const {
+        const int i = lowerBound(key);
+        if(i == usage) {
+            return -1;
+        }
+        const int length = strnlen(key, STRINGSIZE);
+        if(length < prefixLength || memcmp(key, prefix(), prefixLength) != 0) {
+            return -1;
+        }
+        return compareRest(i, key + prefixLength, length - prefixLength) == 0 ? i : -1;
+    }
+
+    EntryRef ref(int i) const {
+        const char* rest = data + slots()[i].offset;
+        EntryRef r = {prefix(), prefixLength, rest, slots()[i].length, slots()[i].payload, rest + slots()[i].length};
+        return r;
+    }
+
+    static EntryRef ref(const char* key, const Payload payload, const char* value = NULL) {
+        EntryRef r = {key, (int)strnlen(key, STRINGSIZE), NULL, 0, payload, value};
+        return r;
+    }
+
+    /**
+     * Refs to the entries of the node, with entry inserted at position i
+     */
+    void collect(std::vector<EntryRef>& refs, int i, const EntryRef& entry) const {
+        refs.reserve(usage + 1);
+        for(int j = 0; j < i; j ++) refs.push_back(ref(j));
+        refs.push_back(entry);
+        for(int j = i; j < usage; j ++) refs.push_back(ref(j));
+    }
+
+    void collect(std::vector<EntryRef>& refs) const {
+        for(int j = 0; j < usage; j ++) refs.push_back(ref(j));
+    }
+
+    static int commonPrefix(const EntryRef& a, const EntryRef& b) {
+        const int n = std::min(a.length(), b.length());
+        int j = 0;
+        while(j < n && a.at(j) == b.at(j)) {
+            j ++;
+        }
+        return j;
+    }
+
+    /**
+     * Bytes a node holding refs[lo, hi) takes: the prefix of its first and last key, and
+     * a slot, the rest of the key and the value for each entry. sums[i] is the total
+     * length of the keys and values before refs[i]
+     */
+    static int rangeBytes(const EntryRef* refs, const std::vector<int>& sums, int lo, int hi) {
+        if(lo >= hi) {
+            return 0;
+        }
+        const int count = hi - lo;
+        const int common = commonPrefix(refs[lo], refs[hi-1]);
+        return common + count * (int)sizeof(Slot) + sums[hi] - sums[lo] - count * common;
+    }
+
+    static void lengthSums(const std::vector<EntryRef>& refs, std::vector<int>& sums) {
+        sums.assign(refs.size() + 1, 0);
+        for(size_t i = 0; i < refs.size(); i ++) {
+            sums[i+1] = sums[i] + refs[i].length() + refs[i].valueLength();
+        }
+    }
+
+    static bool fits(const std::vector<EntryRef>& refs) {
+        std::vector<int> sums;
+        lengthSums(refs, sums);
+        return rangeBytes(refs.data(), sums, 0, refs.size()) <= DATA_SIZE;
+    }
+
+    /**
+     * Refills the node with refs[0, n), which must fit and must not point into the node
+     */
+    void build(const EntryRef* refs, const int n) {
+        clear();
+        if(n == 0) {
+            return;
+        }
+        const int common = commonPrefix(refs[0], refs[n-1]);
+        prefixLength = common;
+        heapStart = DATA_SIZE - common;
+        refs[0].copy(0, common, data + heapStart);
+        for(int i = 0; i < n; i ++) {
+            const int length = refs[i].length() - common;
+            heapStart -= length + refs[i].valueLength();
+            refs[i].copy(common, refs[i].length(), data + heapStart);
+            refs[i].copyValue(data + heapStart + length);
+            slots()[i].offset = heapStart;
+            slots()[i].length = length;
+            slots()[i].payload = refs[i].payload;
+        }
+        usage = n;
+    }
+
+    /**
+     * Puts key, followed by value in a leaf, at position i, the node's prefix kept if key
+     * starts with it and shortened otherwise. Returns false, changing nothing, if the
+     * entry does not fit
+     */
+    bool insertAt(const int i, const char* key, const Payload payload, const char* value = NULL) {
+        const int length = strnlen(key, STRINGSIZE);
+        if(usage > 0 && length >= prefixLength && memcmp(key, prefix(), prefixLength) == 0) {
+            const int restLength = length - prefixLength;
+            const int needed = sizeof(Slot) + restLength + heapValueBytes(payload);
+            if(freeBytes() < needed) {
+                if(freeBytes() + holeBytes < needed) {
+                    return false;
+                }
+                compact();
+            }
+            heapStart -= restLength + heapValueBytes(payload);
+            memcpy(data + heapStart, key + prefixLength, restLength);
+            ref(key, payload, value).copyValue(data + heapStart + restLength);
+            memmove(&slots()[i+1], &slots()[i], (usage - i) * sizeof(Slot));
+            slots()[i].offset = heapStart;
+            slots()[i].length = restLength;
+            slots()[i].payload = payload;
+            usage ++;
+            return true;
+        }
+
+        //Rebuild the node around the shorter prefix
+        const StringNode copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs, i, ref(key, payload, value));
+        if(!fits(refs)) {
+            return false;
+        }
+        build(refs.data(), refs.size());
+        return true;
+    }
+
+    /**
+     * Removes entry i, leaving its key and value in the heap as a hole
+     */
+    void removeAt(const int i) {
+        holeBytes += heapBytes(i);
+        memmove(&slots()[i], &slots()[i+1], (usage - i - 1) * sizeof(Slot));
+        usage --;
+        if(usage == 0) {
+            clear();
+        }
+    }
+
+    /**
+     * Replaces key i, keeping its payload. Returns false, changing nothing, if the new key
+     * does not fit
+     */
+    bool replaceKey(const int i, const char* key) {
+        const StringNode copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs);
+        refs[i] = ref(key, refs[i].payload);
+        if(!fits(refs)) {
+            return false;
+        }
+        build(refs.data(), refs.size());
+        return true;
+    }
+
+    /**
+     * Where to cut refs into two nodes: the left one takes refs[0, k) and the right one
+     * refs[k, n), or refs[k + 1, n) when refs[k] is pushed up to the parent. The cut
+     * that best gives the left node the fraction leftFill of the bytes is found; within a
+     * tenth of the entries of that cut, the one making the shortest separator is taken.
+     */
+    static int splitPoint(const std::vector<EntryRef>& refs, const bool pushUp, const double leftFill = 0.5) {
+        const int n = refs.size();
+        std::vector<int> sums;
+        lengthSums(refs, sums);
+        const int first = pushUp ? 0 : 1;
+        const int skip = pushUp ? 1 : 0;
+        std::vector<bool> fit(n, false);
+        int best = first;
+        double bestGap = -1;
+        for(int k = first; k < n; k ++) {
+            const int left = rangeBytes(refs.data(), sums, 0, k);
+            const int right = rangeBytes(refs.data(), sums, k + skip, n);
+            fit[k] = left <= DATA_SIZE && right <= DATA_SIZE;
+            const double gap = std::fabs((1 - leftFill) * left - leftFill * right);
+            if(fit[k] && (bestGap < 0 || gap < bestGap)) {
+                best = k;
+                bestGap = gap;
+            }
+        }
+
+        int cut = best;
+        int cutLength = separatorLength(refs, best, pushUp);
+        const int window = n / 10;
+        for(int k = std::max(first, best - window); k <= std::min(n - 1, best + window); k ++) {
+            const int length = separatorLength(refs, k, pushUp);
+            if(fit[k] && (length < cutLength || (length == cutLength && std::abs(k - best) < std::abs(cut - best)))) {
+                cut = k;
+                cutLength = length;
+            }
+        }
+        return cut;
+    }
+
+    /**
+     * Length of the separator of a cut at k: the key pushed up, or the shortest prefix of
+     * refs[k] greater than refs[k - 1]
+     */
+    static int separatorLength(const std::vector<EntryRef>& refs, const int k, const bool pushUp) {
+        if(pushUp) {
+            return refs[k].length();
+        }
+        const int common = commonPrefix(refs[k-1], refs[k]);
+        //equal keys on both sides would put the separator's key on its left
+        return (common == refs[k].length()) ? STRINGSIZE + 1 : common + 1;
+    }
+
+    static void separator(const EntryRef& lhs, const EntryRef& rhs, StringKeyValue& out) {
+        const int length = std::min(commonPrefix(lhs, rhs) + 1, rhs.length());
+        rhs.copy(0, length, out.chars);
+        out.chars[length] = '\0';
+    }
+
+    static void keyOf(const EntryRef& entry, StringKeyValue& out) {
+        entry.copy(0, entry.length(), out.chars);
+        out.chars[entry.length()] = '\0';
+    }
+
+private:
+    /**
+     * Sign of the rest of key i less the key rest, both past the prefix
+     */
+    int compareRest(const int i, const char* rest, const int restLength) const {
+        const int length = slots()[i].length;
+        const int c = memcmp(data + slots()[i].offset, rest, std::min(length, restLength));
+        return c != 0 ? c : length - restLength;
+    }
+
+    /**
+     * Packs the heap, keeping the prefix
+     */
+    void compact() {
+        const StringNode copy = *this;
+        heapStart = DATA_SIZE - prefixLength;
+        for(int i = 0; i < usage; i ++) {
+            heapStart -= heapBytes(i);
+            memcpy(data + heapStart, copy.data + copy.slots()[i].offset, heapBytes(i));
+            slots()[i].offset = heapStart;
+        }
+        holeBytes = 0;
+    }
+};
+
+/**
+ * @brief Leaf of string keys, holding as many entries as their keys and posting lists
+ * leave room for. Splits at the byte midpoint, or the fraction asked for, and copies up
+ * the shortest separator near it.
+ */
+struct StringLeafNode : public StringNode<ValueLength> {
+    PageId rightSibPageNo;
+
+    void init() {
+        clear();
+        rightSibPageNo = 0;
+    }
+
+    /**
+     * Posting list of entry i
+     */
+    const char* value(int i) const {
+        return data + slots()[i].offset + slots()[i].length;
+    }
+
+    /**
+     * Sets the posting list of key to value, adding an entry for key if it has none.
+     * Returns false, changing nothing, if the leaf has to split for it. A list no longer
+     * than the one it replaces is always written in place.
+     */
+    bool put(const char* key, const char* value, const int length) {
+        const int i = find(key);
+        const ValueLength valueLength = {(std::uint16_t)length};
+        if(i < 0) {
+            return insertAt(upperBound(key), key, valueLength, value);
+        }
+        const int oldLength = slots()[i].payload.length;
+        if(length <= oldLength) {
+            memmove(data + slots()[i].offset + slots()[i].length, value, length);
+            holeBytes += oldLength - length;
+            slots()[i].payload = valueLength;
+            return true;
+        }
+        if(freeBytes() + holeBytes < length - oldLength) {
+            return false;
+        }
+        //key starts with the prefix, so it goes back without a rebuild unless it was alone
+        removeAt(i);
+        return insertAt(i, key, valueLength, value);
+    }
+
+    void splitPut(const char* key, const char* value, const int length, StringLeafNode* right, StringKeyValue& separator,
+            const double leftFill = 0.5) {
+        const StringNode<ValueLength> copy = *this;
+        const ValueLength valueLength = {(std::uint16_t)length};
+        std::vector<EntryRef> refs;
+        const int i = find(key);
+        if(i >= 0) {
+            copy.collect(refs);
+            refs[i].payload = valueLength;
+            refs[i].value = value;
+        } else {
+            copy.collect(refs, upperBound(key), ref(key, valueLength, value));
+        }
+        const int k = splitPoint(refs, false, leftFill);
+        StringNode<ValueLength>::separator(refs[k-1], refs[k], separator);
+        build(refs.data(), k);
+        right->build(refs.data() + k, refs.size() - k);
+    }
+
+    bool underfullWithout(int i) const {
+        return usage == 1 || usedBytes() - (int)sizeof(Slot) - heapBytes(i) < DATA_SIZE/4;
+    }
+
+    bool validUsage() const {
+        return usage >= 1 && usage <= MAX_USAGE;
+    }
+
+    static bool mergeable(const StringLeafNode* left, const StringLeafNode* right) {
+        std::vector<EntryRef> refs;
+        left->collect(refs);
+        right->collect(refs);
+        return fits(refs);
+    }
+
+    void mergeFrom(const StringLeafNode* right) {
+        const StringNode<ValueLength> copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs);
+        right->collect(refs);
+        build(refs.data(), refs.size());
+        rightSibPageNo = right->rightSibPageNo;
+    }
+
+    /**
+     * Splits the entries of two siblings evenly between them and sets their separator,
+     * key keyIndex of parent. Returns false, changing nothing, if the new separator does
+     * not fit in the parent
+     */
+    template<class Parent>
+    static bool redistribute(StringLeafNode* left, StringLeafNode* right, Parent* parent, int keyIndex) {
+        const StringNode<ValueLength> leftCopy = *left;
+        const StringNode<ValueLength> rightCopy = *right;
+        std::vector<EntryRef> refs;
+        leftCopy.collect(refs);
+        rightCopy.collect(refs);
+        const int k = splitPoint(refs, false);
+        StringKeyValue separator;
+        StringNode<ValueLength>::separator(refs[k-1], refs[k], separator);
+        if(!parent->setKey(keyIndex, separator.chars)) {
+            return false;
+        }
+        left->build(refs.data(), k);
+        right->build(refs.data() + k, refs.size() - k);
+        return true;
+    }
+};
+
+/**
+ * @brief Non-leaf of string keys. Child 0 is first; child i + 1 is the payload of key i.
+ * A non-leaf may be left with no key, and so one child, when the separator a
+ * redistribution would give it does not fit. Child is ChildRef in an index with subtree
+ * counts, PageRef otherwise.
+ */
+template<class Child>
+struct StringNonLeafNode : public StringNode<Child> {
+    typedef StringNode<Child> Node;
+    typedef typename Node::EntryRef EntryRef;
+    using Node::usage;
+    using Node::MAX_USAGE;
+    using Node::clear;
+    using Node::slots;
+    using Node::upperBound;
+    using Node::insertAt;
+    using Node::collect;
+    using Node::ref;
+    using Node::splitPoint;
+    using Node::keyOf;
+    using Node::build;
+    using Node::removeAt;
+    using Node::replaceKey;
+    using Node::fits;
+    using Node::key;
+
+    Child first;
+
+    void init(const PageId firstPageNo) {
+        clear();
+        first.pageNo = firstPageNo;
+        first.setChildCount(0);
+    }
+
+    PageId child(int i) const {
+        return childRef(i).pageNo;
+    }
+
+    void setChild(int i, const PageId pageNo) {
+        childRef(i).pageNo = pageNo;
+    }
+
+    /**
+     * Number of record ids under child i; always 0 without subtree counts
+     */
+    std::uint32_t count(int i) const {
+        return childRef(i).childCount();
+    }
+
+    void setCount(int i, const std::uint32_t count) {
+        childRef(i).setChildCount(count);
+    }
+
+    void addCount(int i, const int delta) {
+        childRef(i).addChildCount(delta);
+    }
+
+    /**
+     * Inserts key with pageNo as the child to its right, with a count of 0
+     */
+    bool insert(const char* key, const PageId pageNo) {
+        Child child = Child();
+        child.pageNo = pageNo;
+        return insertAt(upperBound(key), key, child);
+    }
+
+    void splitInsert(const char* key, const PageId pageNo, StringNonLeafNode* right, StringKeyValue& separator,
+            const double leftFill = 0.5) {
+        const Node copy = *this;
+        Child child = Child();
+        child.pageNo = pageNo;
+        std::vector<EntryRef> refs;
+        copy.collect(refs, upperBound(key), ref(key, child));
+        const int k = splitPoint(refs, true, leftFill);
+        keyOf(refs[k], separator);
+        build(refs.data(), k);
+        right->clear();
+        right->first = refs[k].payload;
+        right->build(refs.data() + k + 1, refs.size() - k - 1);
+    }
+
+    void removeKey(int keyIndex) {
+        removeAt(keyIndex);
+    }
+
+    bool setKey(int i, const char* key) {
+        return replaceKey(i, key);
+    }
+
+    bool validUsage() const {
+        return usage >= 0 && usage <= MAX_USAGE;
+    }
+
+    /**
+     * String non-leaves have no occupancy floor: a redistribution whose separator does
+     * not fit in the parent leaves a node underfull
+     */
+    bool halfFull() const {
+        return true;
+    }
+
+    static bool mergeable(const StringNonLeafNode* left, const char* parentKey, const StringNonLeafNode* right) {
+        std::vector<EntryRef> refs;
+        left->collect(refs);
+        refs.push_back(ref(parentKey, right->first));
+        right->collect(refs);
+        return fits(refs);
+    }
+
+    void mergeFrom(const char* parentKey, const StringNonLeafNode* right) {
+        const Node copy = *this;
+        std::vector<EntryRef> refs;
+        copy.collect(refs);
+        refs.push_back(ref(parentKey, right->first));
+        right->collect(refs);
+        build(refs.data(), refs.size());
+    }
+
+    /**
+     * Splits the keys and children of two siblings and their separator, key keyIndex of
+     * parent, evenly between them. Returns false, changing nothing, if the new separator
+     * does not fit in the parent
+     */
+    static bool redistribute(StringNonLeafNode* left, StringNonLeafNode* right, StringNonLeafNode* parent, int keyIndex) {
+        const Node leftCopy = *left;
+        const Node rightCopy = *right;
+        StringKeyValue parentKey;
+        parent->key(keyIndex, parentKey);
+        std::vector<EntryRef> refs;
+        leftCopy.collect(refs);
+        refs.push_back(ref(parentKey.chars, right->first));
+        rightCopy.collect(refs);
+        const int k = splitPoint(refs, true);
+        StringKeyValue separator;
+        keyOf(refs[k], separator);
+        if(!parent->setKey(keyIndex, separator.chars)) {
+            return false;
+        }
+        left->build(refs.data(), k);
+        right->first = refs[k].payload;
+        right->build(refs.data() + k + 1, refs.size() - k - 1);
+        return true;
+    }
+
+private:
+    Child& childRef(int i) {
+        return i == 0 ? first : slots()[i-1].payload;
+    }
+
+    const Child& childRef(int i) const {
+        return i == 0 ? first : slots()[i-1].payload;
+    }
+};
+
+static_assert(sizeof(StringLeafNode) <= Page::SIZE && sizeof(StringNonLeafNode<PageRef>) <= Page::SIZE
+        && sizeof(StringNonLeafNode<ChildRef>) <= Page::SIZE, "string nodes must fit in a page");
+
+}
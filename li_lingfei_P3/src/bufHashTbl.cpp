@@ -11,104 +11,134 @@
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hashKey(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // Combine the full pointer and the page number, then run the 64-bit
+  // finalizer from MurmurHash3 so that neighbouring pages of one file and the
+  // same page of neighbouring files land in unrelated buckets.
+  std::uint64_t key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(file));
+  key ^= static_cast<std::uint64_t>(pageNo) * 0x9E3779B97F4A7C15ULL;
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+std::uint32_t BufHashTbl::hash(const File* file, const PageId pageNo) const
+{
+  return static_cast<std::uint32_t>(hashKey(file, pageNo)) & mask;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(1), numEntries(0)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // keep the load factor at or below one half so probe runs stay short
+  while (HTSIZE < 2 * static_cast<std::uint32_t>(htSize))
+    HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+
+  ht = new hashBucket[HTSIZE];
+  for(std::uint32_t i = 0; i < HTSIZE; i++)
+    ht[i].file = NULL;
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
   delete [] ht;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+std::uint32_t BufHashTbl::find(const File* file, const PageId pageNo) const
+{
+  std::uint32_t index = hash(file, pageNo);
+  while (ht[index].file != NULL) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+      return index;
+    index = (index + 1) & mask;
+  }
+  return HTSIZE;
+}
+
+void BufHashTbl::grow()
 {
-  int index = hash(file, pageNo);
+  hashBucket* old = ht;
+  const std::uint32_t oldSize = HTSIZE;
+
+  HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+  ht = new hashBucket[HTSIZE];
+  for(std::uint32_t i = 0; i < HTSIZE; i++)
+    ht[i].file = NULL;
+
+  for(std::uint32_t i = 0; i < oldSize; i++) {
+    if (old[i].file == NULL)
+      continue;
+    std::uint32_t index = hash(old[i].file, old[i].pageNo);
+    while (ht[index].file != NULL)
+      index = (index + 1) & mask;
+    ht[index] = old[i];
+  }
+  delete [] old;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  if (2 * (numEntries + 1) > HTSIZE)
+    grow();
+
+  std::uint32_t index = hash(file, pageNo);
+  while (ht[index].file != NULL) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+  		throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+    index = (index + 1) & mask;
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+  ht[index].file = (File*) file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
+}
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
+{
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  const std::uint32_t index = find(file, pageNo);
+  if (index == HTSIZE)
+    return false;
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  std::uint32_t hole = find(file, pageNo);
+  if (hole == HTSIZE)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  // Backward-shift deletion: walk the rest of the probe run and move back any
+  // entry whose home bucket does not lie between the hole and its position,
+  // so lookups never need tombstones.
+  std::uint32_t index = (hole + 1) & mask;
+  while (ht[index].file != NULL) {
+    const std::uint32_t home = hash(ht[index].file, ht[index].pageNo);
+    if (((index - home) & mask) >= ((index - hole) & mask)) {
+      ht[hole] = ht[index];
+      hole = index;
     }
+    index = (index + 1) & mask;
   }
-
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].file = NULL;
+  numEntries--;
 }
 
 }
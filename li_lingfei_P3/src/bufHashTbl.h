@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +17,7 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below). NULL marks an empty bucket
 	 */
 	File *file;
 
@@ -29,30 +30,43 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The table is a flat array of buckets using open addressing with linear
+* probing, so inserts only allocate when the table doubles to keep its load
+* factor at or below one half.  Removal shifts later entries of the
+* probe run back instead of leaving tombstones, which keeps probe sequences
+* short under the constant insert/remove churn of page replacement.
+*
+* @warning This class is not threadsafe.  BufMgr partitions the pool's
+* mapping over several tables and guards each one with its own mutex.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Number of buckets in the hash table. Always a power of two
 	 */
-  int HTSIZE;
+  std::uint32_t HTSIZE;
+
+	/**
+	 *	HTSIZE - 1, used to wrap bucket indexes
+	 */
+  std::uint32_t mask;
+
+	/**
+	 *	Number of entries currently in the table
+	 */
+  std::uint32_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
 
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
@@ -61,11 +75,38 @@ class BufHashTbl
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Returns the bucket index holding (file, pageNo), or HTSIZE if absent.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Bucket index or HTSIZE.
+	 */
+  std::uint32_t find(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Doubles the number of buckets and reinserts every entry.
+	 */
+  void grow();
 
  public:
 	/**
+	 * Mixes file and pageNo into a 64-bit hash.  The low 32 bits pick the
+	 * bucket; callers that shard pages over several tables use the high bits.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			64-bit hash value.
+	 */
+  static std::uint64_t hashKey(const File* file, const PageId pageNo);
+
+	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param htSize	Expected number of entries. The table starts at the next
+	 *								power of two of at least twice this number and grows past it.
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -73,7 +114,7 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
-	
+
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
 	 *
@@ -81,7 +122,6 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -92,18 +132,29 @@ class BufHashTbl
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
 	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Non-throwing variant of lookup() for hot paths where a miss is expected,
+   * such as the buffer manager checking for a cold page.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the page is found
+	 * @return				True if the page entry is in the hash table.
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  void remove(const File* file, const PageId pageNo);
 };
 
 }
@@ -0,0 +1,479 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "bufPolicy.h"
+
+namespace badgerdb {
+
+std::size_t PageKeyHash::operator()(const PageKey& key) const
+{
+	return static_cast<std::size_t>(BufHashTbl::hashKey(key.file, key.pageNo));
+}
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyType type, BufDesc* descs,
+		const std::uint32_t numBufs)
+{
+	switch(type)
+	{
+		case LRU_K:
+			return new LRUKPolicy(numBufs);
+		case TWO_Q:
+			return new TwoQPolicy(numBufs);
+		case ARC:
+			return new ARCPolicy(numBufs);
+		case CLOCK:
+		default:
+			return new ClockPolicy(descs, numBufs);
+	}
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(BufDesc* descs, const std::uint32_t numBufs)
+	: descs(descs), numBufs(numBufs), clockHand(numBufs - 1)
+{
+}
+
+void ClockPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+	// BufDesc::Set() already set the reference bit
+}
+
+void ClockPolicy::frameAccessed(const FrameId frame)
+{
+	descs[frame].refbit = true;
+}
+
+void ClockPolicy::frameFreed(const FrameId frame)
+{
+}
+
+void ClockPolicy::evictionCancelled(const FrameId frame)
+{
+	// the clock remembers nothing about its victims
+}
+
+bool ClockPolicy::selectVictim(FrameId& frame, const ClaimFunction& claim)
+{
+	std::uint32_t numScanned = 0;
+
+	while (numScanned < 2*numBufs)	//Need to scn twice
+	{
+		// advance the clock
+		const FrameId hand = (clockHand.fetch_add(1) + 1) % numBufs;
+		BufDesc* tmpbuf = &descs[hand];
+		numScanned++;
+
+		// cheap checks before asking BufMgr for the frame
+		if (tmpbuf->pinCnt > 0)
+			continue;
+		if (tmpbuf->valid && tmpbuf->refbit.exchange(false))
+			continue;	// has been referenced, clear the bit
+
+		if (claim(hand))
+		{
+			frame = hand;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ClockPolicy::upcomingVictims(std::vector<FrameId>& frames, const std::size_t count)
+{
+	// the frames the hand would take next: unreferenced frames on this
+	// revolution, then the referenced ones, which lose their bit on the way
+	const std::uint32_t hand = clockHand.load();
+	std::vector<FrameId> referenced;
+	for (std::uint32_t i = 1; i <= numBufs && frames.size() < count; i++)
+	{
+		const FrameId frame = (hand + i) % numBufs;
+		if (descs[frame].pinCnt > 0)
+			continue;
+		if (descs[frame].valid && descs[frame].refbit)
+			referenced.push_back(frame);
+		else
+			frames.push_back(frame);
+	}
+	for (std::size_t i = 0; i < referenced.size() && frames.size() < count; i++)
+		frames.push_back(referenced[i]);
+}
+
+//----------------------------------------
+// GhostList
+//----------------------------------------
+
+void GhostList::push(const PageKey& key)
+{
+	erase(key);
+	index[key] = order.insert(order.end(), key);
+}
+
+bool GhostList::erase(const PageKey& key)
+{
+	std::unordered_map<PageKey, std::list<PageKey>::iterator, PageKeyHash>::iterator it = index.find(key);
+	if (it == index.end())
+		return false;
+	order.erase(it->second);
+	index.erase(it);
+	return true;
+}
+
+bool GhostList::pop(PageKey& key)
+{
+	if (order.empty())
+		return false;
+	key = order.front();
+	index.erase(key);
+	order.pop_front();
+	return true;
+}
+
+//----------------------------------------
+// QueuePolicy
+//----------------------------------------
+
+QueuePolicy::QueuePolicy(const std::uint32_t numBufs, const int numQueues)
+	: numBufs(numBufs), queues(numQueues + 1), queueOf(numBufs, FREE), position(numBufs), pageOf(numBufs),
+	  claimedFrom(numBufs, FREE)
+{
+	for (FrameId i = 0; i < numBufs; i++)
+	{
+		position[i] = queues[FREE].insert(queues[FREE].end(), i);
+		pageOf[i].file = NULL;
+		pageOf[i].pageNo = Page::INVALID_NUMBER;
+	}
+}
+
+void QueuePolicy::moveTo(const FrameId frame, const int queue)
+{
+	std::list<FrameId>& to = queues[queue];
+	to.splice(to.end(), queues[queueOf[frame]], position[frame]);
+	queueOf[frame] = queue;
+}
+
+bool QueuePolicy::claimFrom(const int queue, FrameId& frame, const ClaimFunction& claim)
+{
+	std::list<FrameId>& q = queues[queue];
+	for (std::list<FrameId>::iterator it = q.begin(); it != q.end(); ++it)
+	{
+		if (claim(*it))
+		{
+			frame = *it;
+			claimedFrom[frame] = queue;
+			moveTo(frame, FREE);
+			return true;
+		}
+	}
+	return false;
+}
+
+void QueuePolicy::frameFreed(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	moveTo(frame, FREE);
+}
+
+bool QueuePolicy::selectVictim(FrameId& frame, const ClaimFunction& claim)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (claimFrom(FREE, frame, claim))
+		return true;
+	return evict(frame, claim);
+}
+
+void QueuePolicy::evictionCancelled(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const int queue = claimedFrom[frame];
+	if (queueOf[frame] != FREE || queue == FREE)
+		return;
+
+	// the frame was the oldest one its queue could give up, and still is
+	forgetEvicted(frame, queue);
+	std::list<FrameId>& to = queues[queue];
+	to.splice(to.begin(), queues[FREE], position[frame]);
+	queueOf[frame] = queue;
+}
+
+void QueuePolicy::upcomingVictims(std::vector<FrameId>& frames, const std::size_t count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	for (std::size_t q = FREE + 1; q < queues.size(); q++)
+	{
+		for (std::list<FrameId>::iterator it = queues[q].begin(); it != queues[q].end(); ++it)
+		{
+			if (frames.size() >= count)
+				return;
+			frames.push_back(*it);
+		}
+	}
+}
+
+//----------------------------------------
+// LRUKPolicy
+//----------------------------------------
+
+LRUKPolicy::LRUKPolicy(const std::uint32_t numBufs)
+	: QueuePolicy(numBufs, 1), tick(0), history(numBufs)
+{
+}
+
+std::uint64_t LRUKPolicy::priority(const FrameId frame) const
+{
+	// frames with fewer than K accesses have infinite backward K-distance and
+	// go first, least recently used first; then by oldest K-th access
+	const History& h = history[frame];
+	if (h.time[K - 1] == 0)
+		return h.time[0];
+	return (1ULL << 63) | h.time[K - 1];
+}
+
+void LRUKPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const PageKey key = {file, pageNo};
+	pageOf[frame] = key;
+
+	History& h = history[frame];
+	std::unordered_map<PageKey, History, PageKeyHash>::iterator it = retained.find(key);
+	if (it != retained.end())
+	{
+		h = it->second;
+		retained.erase(it);
+		retainedOrder.erase(key);
+	}
+	else
+	{
+		for (int i = 0; i < K; i++)
+			h.time[i] = 0;
+	}
+	for (int i = K - 1; i > 0; i--)
+		h.time[i] = h.time[i - 1];
+	h.time[0] = ++tick;
+
+	moveTo(frame, RESIDENT);
+	byPriority.insert(std::make_pair(priority(frame), frame));
+}
+
+void LRUKPolicy::frameAccessed(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (queueOf[frame] != RESIDENT)
+		return;
+
+	byPriority.erase(std::make_pair(priority(frame), frame));
+	History& h = history[frame];
+	for (int i = K - 1; i > 0; i--)
+		h.time[i] = h.time[i - 1];
+	h.time[0] = ++tick;
+	byPriority.insert(std::make_pair(priority(frame), frame));
+}
+
+void LRUKPolicy::frameFreed(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (queueOf[frame] == RESIDENT)
+		byPriority.erase(std::make_pair(priority(frame), frame));
+	moveTo(frame, FREE);
+}
+
+bool LRUKPolicy::evict(FrameId& frame, const ClaimFunction& claim)
+{
+	std::set<std::pair<std::uint64_t, FrameId> >::iterator it;
+	for (it = byPriority.begin(); it != byPriority.end(); ++it)
+	{
+		if (!claim(it->second))
+			continue;
+
+		frame = it->second;
+		byPriority.erase(it);
+		claimedFrom[frame] = RESIDENT;
+		moveTo(frame, FREE);
+
+		// retain the history of the evicted page
+		retained[pageOf[frame]] = history[frame];
+		retainedOrder.push(pageOf[frame]);
+		PageKey oldest;
+		if (retainedOrder.size() > numBufs && retainedOrder.pop(oldest))
+			retained.erase(oldest);
+		return true;
+	}
+	return false;
+}
+
+void LRUKPolicy::forgetEvicted(const FrameId frame, const int queue)
+{
+	// the history was copied, not moved, so the frame still has it
+	retained.erase(pageOf[frame]);
+	retainedOrder.erase(pageOf[frame]);
+	byPriority.insert(std::make_pair(priority(frame), frame));
+}
+
+void LRUKPolicy::upcomingVictims(std::vector<FrameId>& frames, const std::size_t count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::set<std::pair<std::uint64_t, FrameId> >::iterator it;
+	for (it = byPriority.begin(); it != byPriority.end() && frames.size() < count; ++it)
+		frames.push_back(it->second);
+}
+
+//----------------------------------------
+// TwoQPolicy
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t numBufs)
+	: QueuePolicy(numBufs, 2),
+	  kIn(std::max<std::uint32_t>(1, numBufs / 4)),
+	  kOut(std::max<std::uint32_t>(1, numBufs / 2))
+{
+}
+
+void TwoQPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const PageKey key = {file, pageNo};
+	pageOf[frame] = key;
+
+	// a page seen again after leaving A1in is worth keeping
+	if (a1out.erase(key))
+		moveTo(frame, AM);
+	else
+		moveTo(frame, A1IN);
+}
+
+void TwoQPolicy::frameAccessed(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	// hits in A1in are correlated references and leave the FIFO order alone
+	if (queueOf[frame] == AM)
+		moveTo(frame, AM);
+}
+
+void TwoQPolicy::rememberEvicted(const FrameId frame)
+{
+	a1out.push(pageOf[frame]);
+	PageKey oldest;
+	if (a1out.size() > kOut)
+		a1out.pop(oldest);
+}
+
+bool TwoQPolicy::evict(FrameId& frame, const ClaimFunction& claim)
+{
+	// take from A1in while it is over its share, otherwise from Am; fall back
+	// to the other queue if every frame on the first one is pinned
+	const bool fromA1in = queues[A1IN].size() > kIn || queues[AM].empty();
+	if (fromA1in && claimFrom(A1IN, frame, claim))
+	{
+		rememberEvicted(frame);
+		return true;
+	}
+	if (claimFrom(AM, frame, claim))
+		return true;
+	if (!fromA1in && claimFrom(A1IN, frame, claim))
+	{
+		rememberEvicted(frame);
+		return true;
+	}
+	return false;
+}
+
+void TwoQPolicy::forgetEvicted(const FrameId frame, const int queue)
+{
+	if (queue == A1IN)
+		a1out.erase(pageOf[frame]);
+}
+
+//----------------------------------------
+// ARCPolicy
+//----------------------------------------
+
+ARCPolicy::ARCPolicy(const std::uint32_t numBufs)
+	: QueuePolicy(numBufs, 2), p(0)
+{
+}
+
+void ARCPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const PageKey key = {file, pageNo};
+	pageOf[frame] = key;
+	const double c = numBufs;
+	PageKey oldest;
+
+	if (b1.contains(key))
+	{
+		// T1 was too small to keep this page: grow its target
+		p = std::min(c, p + std::max(1.0, (double) b2.size() / b1.size()));
+		b1.erase(key);
+		moveTo(frame, T2);
+	}
+	else if (b2.contains(key))
+	{
+		// T2 was too small to keep this page: shrink T1's target
+		p = std::max(0.0, p - std::max(1.0, (double) b1.size() / b2.size()));
+		b2.erase(key);
+		moveTo(frame, T2);
+	}
+	else
+	{
+		// a new page: keep the directory at no more than 2c pages
+		const std::size_t t1 = queues[T1].size();
+		const std::size_t t2 = queues[T2].size();
+		if (t1 + b1.size() >= numBufs)
+			b1.pop(oldest);
+		else if (t1 + t2 + b1.size() + b2.size() >= 2 * numBufs)
+			b2.pop(oldest);
+		moveTo(frame, T1);
+	}
+}
+
+void ARCPolicy::frameAccessed(const FrameId frame)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (queueOf[frame] == T1 || queueOf[frame] == T2)
+		moveTo(frame, T2);
+}
+
+bool ARCPolicy::evict(FrameId& frame, const ClaimFunction& claim)
+{
+	const std::size_t t1 = queues[T1].size();
+	const bool fromT1 = t1 > 0 && (t1 > p || queues[T2].empty());
+	const int first = fromT1 ? T1 : T2;
+	const int second = fromT1 ? T2 : T1;
+
+	if (claimFrom(first, frame, claim))
+	{
+		(first == T1 ? b1 : b2).push(pageOf[frame]);
+		return true;
+	}
+	if (claimFrom(second, frame, claim))
+	{
+		(second == T1 ? b1 : b2).push(pageOf[frame]);
+		return true;
+	}
+	return false;
+}
+
+void ARCPolicy::forgetEvicted(const FrameId frame, const int queue)
+{
+	// leave p alone: the page never left the cache
+	(queue == T1 ? b1 : b2).erase(pageOf[frame]);
+}
+
+double ARCPolicy::targetT1()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return p;
+}
+
+}
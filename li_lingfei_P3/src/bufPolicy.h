@@ -0,0 +1,481 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class BufDesc;
+
+/**
+ * @brief Page replacement policies BufMgr can be constructed with.
+ */
+enum ReplacementPolicyType
+{
+	CLOCK = 0,	/* Single reference bit clock */
+	LRU_K = 1,	/* LRU-2: evict the page whose second to last access is oldest */
+	TWO_Q = 2,	/* 2Q: FIFO probation queue, LRU main queue and a ghost queue */
+	ARC = 3		/* Adaptive Replacement Cache */
+};
+
+/**
+ * @brief Identifies a page regardless of the frame it occupies.  Used to
+ * remember pages after they are evicted.
+ */
+struct PageKey {
+	/**
+	 * File the page belongs to
+	 */
+	const File* file;
+
+	/**
+	 * Page number within the file
+	 */
+	PageId pageNo;
+
+	bool operator==(const PageKey& rhs) const
+	{
+		return file == rhs.file && pageNo == rhs.pageNo;
+	}
+};
+
+/**
+ * @brief Hash functor for PageKey, for use with std::unordered_map.
+ */
+struct PageKeyHash {
+	std::size_t operator()(const PageKey& key) const;
+};
+
+/**
+ * @brief Decides which frame BufMgr evicts next.
+ *
+ * BufMgr tells the policy about every frame it fills, every buffer hit and
+ * every frame it empties without an eviction (flushFile, disposePage, failed
+ * reads).  To find a victim it calls selectVictim(), which offers frames in
+ * the policy's eviction order to the claim callback until one is taken.
+ * claim() returns true only if the frame was unpinned and is now latched by
+ * the caller; it returns false for frames that are pinned or busy, and the
+ * policy moves on to its next candidate.  A claimed frame holding a dirty page
+ * is written back after selectVictim() returns, so no write happens under the
+ * policy's lock; if the page is pinned again meanwhile, or the write fails,
+ * BufMgr hands the frame back through evictionCancelled().
+ *
+ * Policies are called from many threads at once.  frameLoaded(), frameFreed()
+ * and evictionCancelled() are called with the frame latch held,
+ * frameAccessed() with the page pinned, and none of them with a hash
+ * partition locked.
+ */
+class ReplacementPolicy
+{
+ public:
+	/**
+	 * Callback through which a policy takes a victim frame from BufMgr.
+	 */
+	typedef std::function<bool(FrameId)> ClaimFunction;
+
+	/**
+	 * Creates a policy of the given type for a pool of numBufs frames.
+	 *
+	 * @param type			Policy to create
+	 * @param descs			Frame descriptors of the pool
+	 * @param numBufs		Number of frames in the pool
+	 * @return					Newly allocated policy, owned by the caller.
+	 */
+	static ReplacementPolicy* create(const ReplacementPolicyType type, BufDesc* descs, const std::uint32_t numBufs);
+
+	virtual ~ReplacementPolicy() {}
+
+	/**
+	 * Short name of the policy, for reports.
+	 */
+	virtual const char* name() const = 0;
+
+	/**
+	 * A frame now holds (file, pageNo), after a buffer miss or page allocation.
+	 *
+	 * @param frame		Frame that was filled
+	 * @param file		File the page belongs to
+	 * @param pageNo	Page number in the file
+	 */
+	virtual void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * The page in a frame was requested again while resident.
+	 *
+	 * @param frame		Frame that was hit
+	 */
+	virtual void frameAccessed(const FrameId frame) = 0;
+
+	/**
+	 * A frame was emptied without being chosen as a victim.
+	 *
+	 * @param frame		Frame that is free again
+	 */
+	virtual void frameFreed(const FrameId frame) = 0;
+
+	/**
+	 * Offers frames to claim in eviction order until one is taken.
+	 *
+	 * @param frame		Frame taken, returned via this variable
+	 * @param claim		Callback that tries to take a frame from BufMgr
+	 * @return				False if no frame could be taken.
+	 */
+	virtual bool selectVictim(FrameId& frame, const ClaimFunction& claim) = 0;
+
+	/**
+	 * The frame last taken by selectVictim() keeps its page after all, because
+	 * the page was pinned again or could not be written back.  The policy
+	 * forgets the eviction and puts the frame back where it was.
+	 *
+	 * @param frame		Frame that was not evicted
+	 */
+	virtual void evictionCancelled(const FrameId frame) = 0;
+
+	/**
+	 * Lists the frames the policy would offer as victims next, soonest first.
+	 * Used by the background writer to clean pages before they are evicted;
+	 * the frames may be pinned, clean or change order at any time.
+	 *
+	 * @param frames	Receives up to count frames
+	 * @param count		Number of frames wanted
+	 */
+	virtual void upcomingVictims(std::vector<FrameId>& frames, const std::size_t count) = 0;
+};
+
+/**
+ * @brief The classic single reference bit clock.  Uses BufDesc::refbit and
+ * takes no locks, so hits cost one atomic store.
+ */
+class ClockPolicy : public ReplacementPolicy
+{
+ private:
+	/**
+	 * Frame descriptors of the pool
+	 */
+	BufDesc* descs;
+
+	/**
+	 * Number of frames in the pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+	 * Ever increasing clock counter; the clock hand is its value modulo numBufs
+	 */
+	std::atomic<std::uint32_t> clockHand;
+
+ public:
+	ClockPolicy(BufDesc* descs, const std::uint32_t numBufs);
+
+	const char* name() const { return "clock"; }
+	void frameLoaded(const FrameId frame, const File* file, const PageId pageNo);
+	void frameAccessed(const FrameId frame);
+	void frameFreed(const FrameId frame);
+	bool selectVictim(FrameId& frame, const ClaimFunction& claim);
+	void evictionCancelled(const FrameId frame);
+	void upcomingVictims(std::vector<FrameId>& frames, const std::size_t count);
+};
+
+/**
+ * @brief Bounded FIFO of evicted pages, remembered by PageKey.
+ */
+class GhostList
+{
+ private:
+	/**
+	 * Keys in eviction order, oldest first
+	 */
+	std::list<PageKey> order;
+
+	/**
+	 * Position of each key in order
+	 */
+	std::unordered_map<PageKey, std::list<PageKey>::iterator, PageKeyHash> index;
+
+ public:
+	/**
+	 * Number of pages remembered
+	 */
+	std::size_t size() const { return order.size(); }
+
+	/**
+	 * Returns true if the page is remembered.
+	 */
+	bool contains(const PageKey& key) const { return index.count(key) != 0; }
+
+	/**
+	 * Remembers a page as the most recently evicted one.
+	 */
+	void push(const PageKey& key);
+
+	/**
+	 * Forgets a page.  Returns true if it was remembered.
+	 */
+	bool erase(const PageKey& key);
+
+	/**
+	 * Forgets the oldest page, returned via key.  Returns false if empty.
+	 */
+	bool pop(PageKey& key);
+};
+
+/**
+ * @brief Base for policies that keep frames on queues under one mutex.
+ *
+ * Every frame is on exactly one queue: FREE, or one of the policy's own
+ * queues numbered from 1.  Queues are ordered oldest first, so victims are
+ * looked for from the front and touched frames are moved to the back.
+ */
+class QueuePolicy : public ReplacementPolicy
+{
+ protected:
+	/**
+	 * Queue of empty frames, tried before any resident frame
+	 */
+	enum { FREE = 0 };
+
+	/**
+	 * Guards all policy state
+	 */
+	std::mutex lock;
+
+	/**
+	 * Number of frames in the pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+	 * The queues, indexed by queue number
+	 */
+	std::vector<std::list<FrameId> > queues;
+
+	/**
+	 * Queue each frame is on
+	 */
+	std::vector<int> queueOf;
+
+	/**
+	 * Position of each frame on its queue
+	 */
+	std::vector<std::list<FrameId>::iterator> position;
+
+	/**
+	 * Page each resident frame was loaded with
+	 */
+	std::vector<PageKey> pageOf;
+
+	/**
+	 * Queue each frame was last claimed from
+	 */
+	std::vector<int> claimedFrom;
+
+	/**
+	 * Moves a frame to the back of a queue.
+	 */
+	void moveTo(const FrameId frame, const int queue);
+
+	/**
+	 * Offers the frames of a queue to claim, oldest first.  A claimed frame is
+	 * moved to the free queue, where the next frameLoaded() picks it up.
+	 *
+	 * @return	True if a frame was claimed.
+	 */
+	bool claimFrom(const int queue, FrameId& frame, const ClaimFunction& claim);
+
+	/**
+	 * Undoes the bookkeeping evict() did for a frame claimed from queue, before
+	 * the frame goes back to the front of that queue.  Called with lock held.
+	 */
+	virtual void forgetEvicted(const FrameId frame, const int queue) {}
+
+	/**
+	 * Chooses a resident frame once no free frame could be claimed.  Called
+	 * with lock held.
+	 */
+	virtual bool evict(FrameId& frame, const ClaimFunction& claim) = 0;
+
+	QueuePolicy(const std::uint32_t numBufs, const int numQueues);
+
+ public:
+	void frameFreed(const FrameId frame);
+	bool selectVictim(FrameId& frame, const ClaimFunction& claim);
+	void evictionCancelled(const FrameId frame);
+
+	/**
+	 * Lists the frames of the policy's own queues in queue number order,
+	 * oldest first within each queue.
+	 */
+	void upcomingVictims(std::vector<FrameId>& frames, const std::size_t count);
+};
+
+/**
+ * @brief LRU-K with K = 2 (O'Neil et al.).  Evicts the frame whose K-th most
+ * recent access is oldest; frames referenced fewer than K times go first, in
+ * LRU order.  Access histories of evicted pages are kept for as many pages as
+ * the pool has frames, so a page that comes back is not treated as new.
+ */
+class LRUKPolicy : public QueuePolicy
+{
+ private:
+	enum { K = 2 };
+
+	/**
+	 * Queue holding all resident frames; unordered, the set below orders them
+	 */
+	enum { RESIDENT = 1 };
+
+	/**
+	 * Access times of a page, most recent first.  0 means no access.
+	 */
+	struct History {
+		std::uint64_t time[K];
+	};
+
+	/**
+	 * Logical clock, advanced on every access
+	 */
+	std::uint64_t tick;
+
+	/**
+	 * History of each resident frame
+	 */
+	std::vector<History> history;
+
+	/**
+	 * Resident frames ordered by eviction priority
+	 */
+	std::set<std::pair<std::uint64_t, FrameId> > byPriority;
+
+	/**
+	 * Histories of evicted pages
+	 */
+	std::unordered_map<PageKey, History, PageKeyHash> retained;
+
+	/**
+	 * Eviction order of the pages in retained
+	 */
+	GhostList retainedOrder;
+
+	/**
+	 * Eviction priority of a frame; lower is evicted first.
+	 */
+	std::uint64_t priority(const FrameId frame) const;
+
+	bool evict(FrameId& frame, const ClaimFunction& claim);
+	void forgetEvicted(const FrameId frame, const int queue);
+
+ public:
+	LRUKPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "lru-2"; }
+	void frameLoaded(const FrameId frame, const File* file, const PageId pageNo);
+	void frameAccessed(const FrameId frame);
+	void frameFreed(const FrameId frame);
+	void upcomingVictims(std::vector<FrameId>& frames, const std::size_t count);
+};
+
+/**
+ * @brief Full 2Q (Johnson and Shasha).  New pages enter the A1in FIFO;
+ * pages that come back after leaving it, as remembered by the A1out ghost
+ * queue, go to the Am LRU queue.  One-time accesses such as a sequential scan
+ * only ever cycle through A1in.
+ */
+class TwoQPolicy : public QueuePolicy
+{
+ private:
+	enum { A1IN = 1, AM = 2 };
+
+	/**
+	 * Target size of A1in, a quarter of the pool
+	 */
+	std::size_t kIn;
+
+	/**
+	 * Capacity of A1out, half of the pool
+	 */
+	std::size_t kOut;
+
+	/**
+	 * Pages evicted from A1in
+	 */
+	GhostList a1out;
+
+	/**
+	 * Adds the page of a frame evicted from A1in to A1out.
+	 */
+	void rememberEvicted(const FrameId frame);
+
+	bool evict(FrameId& frame, const ClaimFunction& claim);
+	void forgetEvicted(const FrameId frame, const int queue);
+
+ public:
+	TwoQPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "2q"; }
+	void frameLoaded(const FrameId frame, const File* file, const PageId pageNo);
+	void frameAccessed(const FrameId frame);
+};
+
+/**
+ * @brief Adaptive Replacement Cache (Megiddo and Modha).  T1 holds pages seen
+ * once recently and T2 pages seen at least twice; ghost lists B1 and B2
+ * remember pages evicted from each, and hits on them move the target size of
+ * T1 toward whichever list would have kept the page.
+ *
+ * BufMgr picks the victim before it knows which page will be loaded, so the
+ * replacement step cannot apply ARC's tie rule for pages coming back from B2.
+ */
+class ARCPolicy : public QueuePolicy
+{
+ private:
+	enum { T1 = 1, T2 = 2 };
+
+	/**
+	 * Target size of T1
+	 */
+	double p;
+
+	/**
+	 * Pages evicted from T1
+	 */
+	GhostList b1;
+
+	/**
+	 * Pages evicted from T2
+	 */
+	GhostList b2;
+
+	bool evict(FrameId& frame, const ClaimFunction& claim);
+	void forgetEvicted(const FrameId frame, const int queue);
+
+ public:
+	ARCPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "arc"; }
+
+	/**
+	 * Current target size of T1, for reports and tests.
+	 */
+	double targetT1();
+
+	void frameLoaded(const FrameId frame, const File* file, const PageId pageNo);
+	void frameAccessed(const FrameId frame);
+};
+
+}
@@ -5,6 +5,8 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include "buffer.h"
@@ -12,16 +14,22 @@
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
-#include "exceptions/hash_not_found_exception.h"
 
 namespace badgerdb { 
 
+const std::uint32_t BufAccessStrategy::DEFAULT_RING_SIZE;
+const std::uint32_t BufMgr::DEFAULT_PREFETCH_DEPTH;
+const std::uint32_t BufMgr::DEFAULT_IO_WORKERS;
+const std::uint32_t BufMgr::CLEANER_INTERVAL_MS;
+const std::uint32_t BufMgr::MAX_WRITE_RUN;
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, const ReplacementPolicyType policyType, const std::uint32_t ioWorkers)
+	: numBufs(bufs), allocTiming(false), numIoWorkers(ioWorkers), prefetchPending(0), stopIoWorkers(false),
+	  stopCleanerFlag(false) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -32,14 +40,30 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
   bufPool = new Page[bufs];
 
+  // each partition starts out sized for its share of the pool and grows if
+  // the hash spreads pages unevenly
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  for (std::uint32_t i = 0; i < NUM_PARTITIONS; i++)
+    hashTable[i] = new BufHashTbl (htsize / NUM_PARTITIONS + 1);  // allocate the buffer hash tables
 
-  clockHand = bufs - 1;
+  policy = ReplacementPolicy::create(policyType, bufDescTable, bufs);
 }
 
 
 BufMgr::~BufMgr() {
+  stopCleaner();
+
+  // stop the I/O workers; queued prefetches are dropped
+  {
+    std::lock_guard<std::mutex> guard(prefetchLock);
+    stopIoWorkers = true;
+    prefetchQueue.clear();
+    prefetchPending = 0;
+  }
+  prefetchQueued.notify_all();
+  for (std::size_t i = 0; i < ioWorkers.size(); i++)
+    ioWorkers[i].join();
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
@@ -50,104 +74,526 @@ BufMgr::~BufMgr() {
   	}
   }
 
+  delete policy;
   delete [] bufDescTable;
   delete [] bufPool;
+  for (std::uint32_t i = 0; i < NUM_PARTITIONS; i++)
+    delete hashTable[i];
 }
 
 void BufMgr::allocBuf(FrameId & frame) 
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  const bool timed = allocTiming;
+  std::chrono::steady_clock::time_point start;
+  if (timed)
+    start = std::chrono::steady_clock::now();
+
+  // the policy offers frames in its eviction order; frames pinned or latched
+  // by other threads are skipped without blocking.  A dirty victim is written
+  // back here, after the policy has released its lock, so that other misses
+  // do not wait behind the write.
+  bool found;
+  while ((found = policy->selectVictim(frame, [this](FrameId candidate) { return claimFrame(candidate, NULL, true); }))
+      && bufDescTable[frame].valid)
+  {
+    // if the page was pinned again while being written, it stays and the
+    // policy gets the frame back; try the next victim
+    if (releaseFrame(frame, true))
+      break;
+  }
+
+  if (timed)
+  {
+    const std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    int bucket = 0;
+    while (bucket < BufStats::LATENCY_BUCKETS - 1 && (ns >> (bucket + 1)) > 0)
+      bucket++;
+    bufStats.allocLatency[bucket]++;
+  }
+
+  if (!found)
+  {
+    // check for full buffer pool
+    throw BufferExceededException();
+  }
+} // end allocBuf
+
+
+bool BufMgr::claimFrame(const FrameId frame, const PageKey* expected, const bool deferWrite)
+{
+  BufDesc* tmpbuf = &bufDescTable[frame];
+  if (tmpbuf->pinCnt > 0)
+    return false;
+
+  // someone else is loading, writing or reassigning this frame
+  if (!tmpbuf->latch.try_lock())
+    return false;
+
+  // the frame was given to another page since the caller last saw it
+  if (expected != NULL && (tmpbuf->file != expected->file || tmpbuf->pageNo != expected->pageNo))
+  {
+    tmpbuf->latch.unlock();
+    return false;
+  }
+
+  // if invalid, use frame
+  if (! tmpbuf->valid)
+  {
+    if (tmpbuf->file == NULL && tmpbuf->pinCnt == 0)
+      return true;
+    tmpbuf->latch.unlock();
+    return false;
+  }
+
+  // a dirty page is written back by the caller once out of the policy's lock
+  if (deferWrite && tmpbuf->dirty)
+    return true;
+  return releaseFrame(frame);
+}
+
+
+bool BufMgr::releaseFrame(const FrameId frame, const bool victim)
+{
+  BufDesc* tmpbuf = &bufDescTable[frame];
+
+  // flush any existing changes to disk if necessary.  Threads that pin the
+  // page meanwhile wait on the latch, so the contents cannot change.
+  if (tmpbuf->pinCnt == 0 && tmpbuf->dirty)
+  {
+    try
+    {
+      tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[frame]);
+    }
+    catch(...)
+    {
+      if (victim)
+        policy->evictionCancelled(frame);
+      tmpbuf->latch.unlock();
+      throw;
+    }
+    bufStats.diskwrites++;
+    tmpbuf->dirty = false;
+
+    // the background writer, if running, has fallen behind
+    cleanerWake.notify_one();
+  }
+
+  // remove previous entry from hash table unless it was pinned meanwhile
+  bool stays;
+  const std::uint32_t part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partitionLock[part]);
+    stays = tmpbuf->pinCnt > 0 || tmpbuf->dirty;
+    if (!stays)
+      hashTable[part]->remove(tmpbuf->file, tmpbuf->pageNo);
+  }
+  if (stays)
+  {
+    // the policy is told outside the partition lock, but before other
+    // threads can take the frame
+    if (victim)
+      policy->evictionCancelled(frame);
+    tmpbuf->latch.unlock();
+    return false;
+  }
+  if (tmpbuf->prefetched)
+    bufStats.prefetchWasted++;
+
+  //Reset all the BufDesc entry for the frame before returning the frame
+  tmpbuf->Clear();
+  return true;
+}
+
+
+std::uint32_t BufMgr::ringFrames(const BufAccessStrategy* strategy) const
+{
+  return std::max<std::uint32_t>(1, std::min(strategy->ringSize, numBufs / 4));
+}
+
+
+void BufMgr::allocRingBuf(BufAccessStrategy* strategy, FrameId & frame, std::uint32_t & slot)
+{
+  std::lock_guard<std::mutex> guard(strategy->lock);
+
+  // fill the ring with frames from the policy first
+  if (strategy->frames.size() < ringFrames(strategy))
+  {
+    allocBuf(frame);
+    slot = strategy->frames.size();
+    strategy->frames.push_back(frame);
+    PageKey none = {NULL, Page::INVALID_NUMBER};
+    strategy->pages.push_back(none);
+    return;
+  }
+
+  slot = strategy->next;
+  strategy->next = (strategy->next + 1) % strategy->frames.size();
+
+  const FrameId candidate = strategy->frames[slot];
+  if (strategy->pages[slot].file != NULL && claimFrame(candidate, &strategy->pages[slot]))
+  {
+    // recycled outside the policy's own victim selection
+    policy->frameFreed(candidate);
+    strategy->reuses++;
+    frame = candidate;
+  }
+  else
+  {
+    // pinned or taken over by another page: replace it in the ring
+    allocBuf(frame);
+    strategy->frames[slot] = frame;
+  }
+  strategy->pages[slot].file = NULL;
+  strategy->pages[slot].pageNo = Page::INVALID_NUMBER;
+}
+
+
+bool BufMgr::pinIfResident(File* file, const PageId pageNo, FrameId & frameNo)
+{
+  const std::uint32_t part = partitionOf(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partitionLock[part]);
+    if (!hashTable[part]->tryLookup(file, pageNo, frameNo))
+      return false;
+    bufDescTable[frameNo].pinCnt++;
+  }
+  policy->frameAccessed(frameNo);
+
+  // the frame cannot be reassigned while pinned; wait out a read in progress
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  tmpbuf->latch.lock();
+  const bool loaded = tmpbuf->valid;
+  tmpbuf->latch.unlock();
+
+  if (!loaded)
+  {
+    // the thread reading the page failed and has unmapped the frame
+    tmpbuf->pinCnt--;
+    return false;
+  }
+  return true;
+}
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+	
+bool BufMgr::loadPage(File* file, const PageId pageNo, FrameId & frameNo, BufAccessStrategy* strategy,
+    const bool prefetch)
+{
+  // alloc a new frame; its latch is held until the read completes
+  std::uint32_t slot = 0;
+  if (strategy != NULL)
+    allocRingBuf(strategy, frameNo, slot);
+  else
+    allocBuf(frameNo);
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+
+  // set up the entry properly and insert in the hash table, unless
+  // another thread mapped the page while we were looking for a frame
+  const std::uint32_t part = partitionOf(file, pageNo);
+  bool mappedMeanwhile;
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    std::lock_guard<std::mutex> guard(partitionLock[part]);
+    FrameId otherFrame;
+    mappedMeanwhile = hashTable[part]->tryLookup(file, pageNo, otherFrame);
+    if (!mappedMeanwhile)
+    {
+      tmpbuf->Set(file, pageNo);
+      hashTable[part]->insert(file, pageNo, frameNo);
+    }
+  }
+  if (mappedMeanwhile)
+  {
+    // give the frame back; the caller pins the other thread's copy
+    policy->frameFreed(frameNo);
+    tmpbuf->latch.unlock();
+    return false;
+  }
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+  try
+  {
+    // read straight into the frame; no temporary Page is materialized
+    file->readPage(pageNo, bufPool[frameNo]);
+  }
+  catch(...)
+  {
+    // unmap the frame; threads waiting on the latch see it invalid
     {
+      std::lock_guard<std::mutex> guard(partitionLock[part]);
+      hashTable[part]->remove(file, pageNo);
+    }
+    tmpbuf->file = NULL;
+    tmpbuf->pageNo = Page::INVALID_NUMBER;
+    tmpbuf->pinCnt--;
+    policy->frameFreed(frameNo);
+    tmpbuf->latch.unlock();
+    throw;
+  }
+  bufStats.diskreads++;
+  if (prefetch)
+    bufStats.prefetchIssued++;
+
+  tmpbuf->prefetched = prefetch;
+  tmpbuf->valid = true;
+  policy->frameLoaded(frameNo, file, pageNo);
+  tmpbuf->latch.unlock();
+  if (strategy != NULL)
+  {
+    std::lock_guard<std::mutex> guard(strategy->lock);
+    strategy->pages[slot].file = file;
+    strategy->pages[slot].pageNo = pageNo;
+  }
+  return true;
+}
+
+	
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufAccessStrategy* strategy)
+{
+  bufStats.accesses++;
+  if (strategy != NULL)
+    strategy->accesses++;
+
+  // check to see if it is already in the buffer pool
+  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  FrameId frameNo = 0;
+  bool hit = true;
+  while (!pinIfResident(file, pageNo, frameNo))
+  {
+    hit = false;
+    // a prefetch still queued for the page has fallen behind the reader
+    if (prefetchPending > 0)
+      cancelPrefetch(file, pageNo, false);
+    //not in the buffer pool, must allocate a new page
+    if (loadPage(file, pageNo, frameNo, strategy, false))
       break;
+  }
+  if (hit)
+  {
+    if (strategy != NULL)
+      strategy->hits++;
+    if (bufDescTable[frameNo].prefetched.exchange(false))
+      bufStats.prefetchUseful++;
+  }
+  page = &bufPool[frameNo];
+}
+
+
+void BufMgr::prefetch(File* file, const std::vector<PageId>& pageNos, BufAccessStrategy* strategy)
+{
+  if (numIoWorkers == 0 || pageNos.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(prefetchLock);
+    if (ioWorkers.empty())
+    {
+      prefetchInFlight.assign(numIoWorkers, NULL);
+      for (std::uint32_t i = 0; i < numIoWorkers; i++)
+        ioWorkers.push_back(std::thread(&BufMgr::ioWorkerLoop, this, i));
+    }
+    for (std::size_t i = 0; i < pageNos.size(); i++)
+    {
+      // a backlog this long would only evict pages prefetched earlier
+      if (prefetchQueue.size() >= numBufs / 2)
+        break;
+      PrefetchRequest request = {file, pageNos[i], strategy};
+      prefetchQueue.push_back(request);
+    }
+    prefetchPending = prefetchQueue.size();
+  }
+  prefetchQueued.notify_all();
+}
+
+
+void BufMgr::ioWorkerLoop(const std::uint32_t worker)
+{
+  std::unique_lock<std::mutex> lock(prefetchLock);
+  while (true)
+  {
+    while (!stopIoWorkers && prefetchQueue.empty())
+      prefetchQueued.wait(lock);
+    if (stopIoWorkers)
+      return;
+
+    const PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    prefetchPending = prefetchQueue.size();
+    prefetchInFlight[worker] = request.file;
+    lock.unlock();
+
+    FrameId frameNo;
+    const std::uint32_t part = partitionOf(request.file, request.pageNo);
+    bool resident;
+    {
+      std::lock_guard<std::mutex> guard(partitionLock[part]);
+      resident = hashTable[part]->tryLookup(request.file, request.pageNo, frameNo);
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    bool loaded = false;
+    if (!resident)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      try
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        loaded = loadPage(request.file, request.pageNo, frameNo, request.strategy, true);
+      }
+      catch(...)
+      {
+        // no free frame, or the page is gone; the reader will find out itself
       }
     }
-    else
+    if (loaded)
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      std::lock_guard<std::mutex> guard(partitionLock[part]);
+      bufDescTable[frameNo].pinCnt--;
     }
+
+    lock.lock();
+    prefetchInFlight[worker] = NULL;
+    prefetchDone.notify_all();
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+}
+
+
+void BufMgr::startCleaner()
+{
+  std::lock_guard<std::mutex> guard(cleanerLock);
+  if (cleaner.joinable())
+    return;
+  stopCleanerFlag = false;
+  cleaner = std::thread(&BufMgr::cleanerLoop, this);
+}
+
+
+void BufMgr::stopCleaner()
+{
   {
-    throw BufferExceededException();
+    std::lock_guard<std::mutex> guard(cleanerLock);
+    if (!cleaner.joinable())
+      return;
+    stopCleanerFlag = true;
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+  cleanerWake.notify_all();
+  cleaner.join();
+}
+
+
+void BufMgr::cleanerLoop()
+{
+  std::unique_lock<std::mutex> lock(cleanerLock);
+  while (!stopCleanerFlag)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    lock.unlock();
+    cleanAhead();
+    lock.lock();
+    if (!stopCleanerFlag)
+      cleanerWake.wait_for(lock, std::chrono::milliseconds(CLEANER_INTERVAL_MS));
   }
+}
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+void BufMgr::cleanAhead()
+{
+  std::vector<FrameId> frames;
+  policy->upcomingVictims(frames, std::max<std::uint32_t>(1, numBufs / 4));
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+  // note which pages the dirty frames hold; file and pageNo are only stable
+  // under the latch
+  std::vector<DirtyPage> dirtyPages;
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc* tmpbuf = &bufDescTable[frames[i]];
+    if (!tmpbuf->dirty || tmpbuf->pinCnt > 0)
+      continue;
+    if (!tmpbuf->latch.try_lock())
+      continue;
+    if (tmpbuf->valid && tmpbuf->dirty)
+    {
+      DirtyPage page = {tmpbuf->file, tmpbuf->pageNo, frames[i]};
+      dirtyPages.push_back(page);
+    }
+    tmpbuf->latch.unlock();
+  }
+  std::sort(dirtyPages.begin(), dirtyPages.end());
+
+  // latch runs of consecutive pages and write each with one call.  A page
+  // that is pinned, busy or no longer dirty ends the run.
+  std::vector<DirtyPage> run;
+  for (std::size_t i = 0; i < dirtyPages.size(); i++)
+  {
+    const DirtyPage& page = dirtyPages[i];
+    if (!run.empty() && (run.back().file != page.file || run.back().pageNo + 1 != page.pageNo
+        || run.size() >= MAX_WRITE_RUN))
+      writeRun(run);
+
+    BufDesc* tmpbuf = &bufDescTable[page.frameNo];
+    if (!tmpbuf->latch.try_lock())
+    {
+      writeRun(run);
+      continue;
+    }
+    // pinners wait on the latch, so with no pin now the page cannot change
+    if (tmpbuf->file != page.file || tmpbuf->pageNo != page.pageNo || !tmpbuf->valid
+        || !tmpbuf->dirty || tmpbuf->pinCnt > 0)
+    {
+      tmpbuf->latch.unlock();
+      writeRun(run);
+      continue;
+    }
+    run.push_back(page);
+  }
+  writeRun(run);
+}
+
+
+void BufMgr::writeRun(std::vector<DirtyPage>& run)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  if (run.empty())
+    return;
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+  std::vector<const Page*> pages;
+  for (std::size_t i = 0; i < run.size(); i++)
+    pages.push_back(&bufPool[run[i].frameNo]);
+
+  bool written = true;
+  try
+  {
+    run[0].file->writePages(run[0].pageNo, pages);
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+  catch(...)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    // leave the pages dirty; eviction or flushFile reports the error
+    written = false;
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  for (std::size_t i = 0; i < run.size(); i++)
+  {
+    BufDesc* tmpbuf = &bufDescTable[run[i].frameNo];
+    if (written)
+      tmpbuf->dirty = false;
+    tmpbuf->latch.unlock();
+  }
+  if (written)
+  {
+    bufStats.diskwrites += run.size();
+    bufStats.cleanerWrites += run.size();
+    bufStats.cleanerBatches++;
+  }
+  run.clear();
+}
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+void BufMgr::cancelPrefetch(const File* file, const PageId pageNo, const bool wait)
+{
+  std::unique_lock<std::mutex> lock(prefetchLock);
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); )
+  {
+    if (it->file == file && (pageNo == Page::INVALID_NUMBER || it->pageNo == pageNo))
+      it = prefetchQueue.erase(it);
+    else
+      ++it;
   }
+  prefetchPending = prefetchQueue.size();
+  while (wait && std::find(prefetchInFlight.begin(), prefetchInFlight.end(), file) != prefetchInFlight.end())
+    prefetchDone.wait(lock);
 }
 
 
@@ -156,7 +602,9 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
 {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  const std::uint32_t part = partitionOf(file, pageNo);
+  std::lock_guard<std::mutex> guard(partitionLock[part]);
+  hashTable[part]->lookup(file, pageNo, frameNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
@@ -170,9 +618,12 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
 
 void BufMgr::flushFile(const File* file) 
 {
+  cancelPrefetch(file, Page::INVALID_NUMBER, true);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
+  	std::lock_guard<std::mutex> latch(tmpbuf->latch);
   	if(tmpbuf->valid == true && tmpbuf->file == file)
 		{
 	    if (tmpbuf->pinCnt > 0)
@@ -182,31 +633,63 @@ void BufMgr::flushFile(const File* file)
 			{
 				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
 				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+				bufStats.diskwrites++;
 				tmpbuf->dirty = false;
     	}
 
-    	hashTable->remove(file,tmpbuf->pageNo);
+    	const std::uint32_t part = partitionOf(file, tmpbuf->pageNo);
+    	{
+    		std::lock_guard<std::mutex> guard(partitionLock[part]);
+    		if (tmpbuf->pinCnt > 0)
+    			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+    		hashTable[part]->remove(file,tmpbuf->pageNo);
+    	}
+    	if (tmpbuf->prefetched)
+    		bufStats.prefetchWasted++;
     	tmpbuf->Clear();
+    	policy->frameFreed(i);
   	}
 		else if (tmpbuf->valid == false && tmpbuf->file == file)
   		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
   }
+  file->sync();
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
 	//Deallocate from file altogether
+  // a prefetch must not bring the page back once it is gone
+  cancelPrefetch(file, pageNo, true);
+
   //See if it is in the buffer pool
   FrameId frameNo = 0;
-  try
+  const std::uint32_t part = partitionOf(file, pageNo);
+  bool found;
   {
-      hashTable->lookup(file, pageNo, frameNo);
-      // clear the page
-      bufDescTable[frameNo].Clear();
-      hashTable->remove(file, pageNo);
+    std::lock_guard<std::mutex> guard(partitionLock[part]);
+    found = hashTable[part]->tryLookup(file, pageNo, frameNo);
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+  if (found)
   {
+    // take the latch before the partition, then make sure the frame still
+    // holds the page
+    BufDesc* tmpbuf = &bufDescTable[frameNo];
+    std::lock_guard<std::mutex> latch(tmpbuf->latch);
+    bool mapped;
+    {
+      std::lock_guard<std::mutex> guard(partitionLock[part]);
+      mapped = (tmpbuf->file == file && tmpbuf->pageNo == pageNo);
+      if (mapped)
+        hashTable[part]->remove(file, pageNo);
+    }
+    if (mapped)
+    {
+      // clear the page
+      if (tmpbuf->prefetched)
+        bufStats.prefetchWasted++;
+      tmpbuf->Clear();
+      policy->frameFreed(frameNo);
+    }
   }
 
 
@@ -217,21 +700,38 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  bufStats.accesses++;
+
   FrameId frameNo;
 
   // alloc a new frame
   allocBuf(frameNo);
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
 
   // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try
+  {
+    file->allocatePage(pageNo, bufPool[frameNo]);
+  }
+  catch(...)
+  {
+    policy->frameFreed(frameNo);
+    tmpbuf->latch.unlock();
+    throw;
+  }
+  bufStats.diskreads++;
   page = &bufPool[frameNo];
 
-  // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
-
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  // set up the entry properly and insert in the hash table
+  const std::uint32_t part = partitionOf(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partitionLock[part]);
+    tmpbuf->Set(file, pageNo);
+    tmpbuf->valid = true;
+    hashTable[part]->insert(file, pageNo, frameNo);
+  }
+  policy->frameLoaded(frameNo, file, pageNo);
+  tmpbuf->latch.unlock();
 }
 
 void BufMgr::printSelf(void) 
@@ -9,7 +9,14 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufPolicy.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -20,10 +27,15 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* pinCnt, dirty, valid and refbit are atomics so that the clock sweep can
+* inspect a frame without taking any lock.  file and pageNo only change while
+* the frame latch is held.
 */
 class BufDesc {
 
 	friend class BufMgr;
+	friend class ClockPolicy;
 
  private:
 	/**
@@ -42,24 +54,38 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Number of times this page has been pinned.  Only raised while the hash
+   * partition holding the page is locked.
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
-   * True if page is valid
+   * True if page is valid, i.e. its contents have been read into the frame
 	 */
-  bool valid;
+  std::atomic<bool> valid;
 
 	/**
-   * Has this buffer frame been reference recently
+   * Has this buffer frame been reference recently.  Only maintained by the
+   * clock replacement policy
 	 */
-  bool refbit;
+  std::atomic<bool> refbit;
+
+	/**
+   * True if the page was read by a prefetch and has not been requested since
+	 */
+  std::atomic<bool> prefetched;
+
+	/**
+   * Held while the frame is being loaded, written back or reassigned.  A
+   * thread that pins a page found in the hash table acquires and releases
+   * it to wait for a read in progress.
+	 */
+  std::mutex latch;
 
 	/**
    * Initialize buffer frame for a new user
@@ -72,11 +98,13 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+    prefetched = false;
   };
 
 	/**
 	 * Set values of member variables corresponding to assignment of frame to a page in the file. Called when a frame 
-	 * in buffer pool is allocated to any page in the file through readPage() or allocPage()
+	 * in buffer pool is allocated to any page in the file through readPage() or allocPage().  The frame is marked
+	 * valid once its contents are in place.
 	 *
 	 * @param filePtr	File object
 	 * @param pageNum	Page number in the file
@@ -87,8 +115,9 @@ class BufDesc {
     pageNo = pageNum;
     pinCnt = 1;
     dirty = false;
-    valid = true;
+    valid = false;
     refbit = true;
+    prefetched = false;
   }
 
   void Print()
@@ -122,20 +151,58 @@ class BufDesc {
 */
 struct BufStats
 {
+	/**
+   * Number of buckets in the allocBuf latency histogram
+	 */
+  enum { LATENCY_BUCKETS = 32 };
+
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+	/**
+   * Number of pages read from disk by prefetches
+	 */
+  std::atomic<int> prefetchIssued;
+
+	/**
+   * Number of prefetched pages requested while still in the pool
+	 */
+  std::atomic<int> prefetchUseful;
+
+	/**
+   * Number of prefetched pages evicted or flushed before being requested
+	 */
+  std::atomic<int> prefetchWasted;
+
+	/**
+   * Number of pages written back by the background writer
+	 */
+  std::atomic<int> cleanerWrites;
+
+	/**
+   * Number of writes the background writer issued; each covers a run of
+   * consecutive pages
+	 */
+  std::atomic<int> cleanerBatches;
+
+	/**
+   * Histogram of time spent finding a frame; bucket i counts calls that took
+   * from 2^i to 2^(i+1) nanoseconds.  Only kept while BufMgr::setAllocTiming()
+   * is on
+	 */
+  std::atomic<int> allocLatency[LATENCY_BUCKETS];
 
 	/**
    * Clear all values 
@@ -143,6 +210,10 @@ struct BufStats
   void clear()
   {
 		accesses = diskreads = diskwrites = 0;
+		prefetchIssued = prefetchUseful = prefetchWasted = 0;
+		cleanerWrites = cleanerBatches = 0;
+		for (int i = 0; i < LATENCY_BUCKETS; i++)
+			allocLatency[i] = 0;
   }
       
 	/**
@@ -151,20 +222,156 @@ struct BufStats
   BufStats()
   {
 		clear();
+  }
+
+	/**
+   * Copies a snapshot of the counters
+	 */
+  BufStats(const BufStats& other)
+  {
+		*this = other;
+  }
+
+  BufStats& operator=(const BufStats& other)
+  {
+		accesses = other.accesses.load();
+		diskreads = other.diskreads.load();
+		diskwrites = other.diskwrites.load();
+		prefetchIssued = other.prefetchIssued.load();
+		prefetchUseful = other.prefetchUseful.load();
+		prefetchWasted = other.prefetchWasted.load();
+		cleanerWrites = other.cleanerWrites.load();
+		cleanerBatches = other.cleanerBatches.load();
+		for (int i = 0; i < LATENCY_BUCKETS; i++)
+			allocLatency[i] = other.allocLatency[i].load();
+		return *this;
   }
 };
 
 
+/**
+* @brief A small ring of frames recycled in place by one sequential reader.
+*
+* Pages read through BufMgr::readPage() with a strategy are loaded into the
+* frames of the ring instead of frames picked by the replacement policy, so a
+* scan of a relation larger than the pool displaces at most ringSize pages.
+* A ring frame is only recycled if it still holds the page the ring loaded
+* into it and is unpinned; otherwise the ring takes a new frame from the
+* policy in its place.
+*
+* A strategy belongs to a single scan.  Its ring is locked so that prefetches
+* issued by the scan can load pages into it from BufMgr's I/O workers.
+*/
+class BufAccessStrategy
+{
+	friend class BufMgr;
+
+ public:
+	/**
+   * Ring size used by FileScan unless told otherwise
+	 */
+  static const std::uint32_t DEFAULT_RING_SIZE = 16;
+
+	/**
+   * Constructor of BufAccessStrategy class
+	 *
+	 * @param ringSize	Number of frames in the ring.  BufMgr never lets a ring
+	 *									grow past a quarter of the pool.
+	 */
+  BufAccessStrategy(const std::uint32_t ringSize = DEFAULT_RING_SIZE)
+		: ringSize(ringSize), next(0), accesses(0), hits(0), reuses(0)
+  {
+  }
+
+	/**
+   * Number of frames the ring may hold
+	 */
+  std::uint32_t getRingSize() const
+  {
+		return ringSize;
+  }
+
+	/**
+   * Number of pages requested through this strategy
+	 */
+  std::uint32_t getAccesses() const
+  {
+		return accesses;
+  }
+
+	/**
+   * Number of requests that found the page already in the pool
+	 */
+  std::uint32_t getHits() const
+  {
+		return hits;
+  }
+
+	/**
+   * Number of misses served by recycling a frame of the ring
+	 */
+  std::uint32_t getReuses() const
+  {
+		return reuses;
+  }
+
+ private:
+	/**
+   * Maximum number of frames in the ring
+	 */
+  std::uint32_t ringSize;
+
+	/**
+   * Frames of the ring
+	 */
+  std::vector<FrameId> frames;
+
+	/**
+   * Page the ring last loaded into each frame; file is NULL while unknown
+	 */
+  std::vector<PageKey> pages;
+
+	/**
+   * Next ring slot to recycle
+	 */
+  std::uint32_t next;
+
+	/**
+   * Guards frames, pages and next
+	 */
+  std::mutex lock;
+
+  std::atomic<std::uint32_t> accesses;
+  std::atomic<std::uint32_t> hits;
+  std::atomic<std::uint32_t> reuses;
+};
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* BufMgr may be shared by several threads.  The (file, page) to frame mapping
+* is split over NUM_PARTITIONS hash tables, each guarded by its own mutex, so
+* threads touching different pages rarely contend.  Pin counts and reference
+* bits are atomics, the clock hand is advanced with an atomic increment, and
+* each frame has a latch held while its contents are read, written back or
+* handed to another page.  Locks are always taken frame latch first, hash
+* partition second, and no thread waits on a latch while holding a partition.
+*
+* Which frame to evict is decided by a ReplacementPolicy chosen when the pool
+* is constructed; see bufPolicy.h.  Policies are called without any partition
+* locked, and the ones other than clock serialize on a mutex of their own.
+*
+* Pinning a page only keeps it resident; callers that modify a page shared
+* with other threads must coordinate access to its contents themselves.
 */
 class BufMgr 
 {
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Number of hash table partitions.  Must be a power of two
 	 */
-  FrameId clockHand;
+  static const std::uint32_t NUM_PARTITIONS = 16;
 
 	/**
    * Number of frames in the buffer pool
@@ -172,9 +379,15 @@ class BufMgr
   std::uint32_t numBufs;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Hash tables mapping (File, page) to frame, one per partition
 	 */
-  BufHashTbl *hashTable;
+  BufHashTbl *hashTable[NUM_PARTITIONS];
+
+	/**
+   * Mutexes guarding the hash table partitions and the pin counts of the
+   * pages they map
+	 */
+  std::mutex partitionLock[NUM_PARTITIONS];
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -187,7 +400,108 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-	 * Allocate a free frame.  
+   * Decides which frame allocBuf() evicts
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * True while allocBuf() times itself into BufStats::allocLatency
+	 */
+  std::atomic<bool> allocTiming;
+
+	/**
+   * A page queued for an I/O worker by prefetch()
+	 */
+  struct PrefetchRequest
+  {
+		File* file;
+		PageId pageNo;
+		BufAccessStrategy* strategy;
+  };
+
+	/**
+   * Number of I/O worker threads, started by the first prefetch()
+	 */
+  std::uint32_t numIoWorkers;
+
+	/**
+   * I/O worker threads
+	 */
+  std::vector<std::thread> ioWorkers;
+
+	/**
+   * Pages waiting for an I/O worker, oldest first
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * File each I/O worker is reading a page of, NULL if none
+	 */
+  std::vector<const File*> prefetchInFlight;
+
+	/**
+   * Number of requests in prefetchQueue, readable without prefetchLock
+	 */
+  std::atomic<std::uint32_t> prefetchPending;
+
+	/**
+   * Set by the destructor to stop the I/O workers
+	 */
+  bool stopIoWorkers;
+
+	/**
+   * Guards the prefetch queue and the state of the I/O workers
+	 */
+  std::mutex prefetchLock;
+
+	/**
+   * Signalled when a page is queued for the I/O workers
+	 */
+  std::condition_variable prefetchQueued;
+
+	/**
+   * Signalled when an I/O worker finishes a page
+	 */
+  std::condition_variable prefetchDone;
+
+	/**
+   * Background writer thread, if started
+	 */
+  std::thread cleaner;
+
+	/**
+   * Set to stop the background writer
+	 */
+  bool stopCleanerFlag;
+
+	/**
+   * Guards stopCleanerFlag
+	 */
+  std::mutex cleanerLock;
+
+	/**
+   * Wakes the background writer before its next scheduled pass
+	 */
+  std::condition_variable cleanerWake;
+
+	/**
+   * A dirty page awaiting the background writer
+	 */
+  struct DirtyPage
+  {
+		File* file;
+		PageId pageNo;
+		FrameId frameNo;
+
+		bool operator<(const DirtyPage& rhs) const
+		{
+			return file < rhs.file || (file == rhs.file && pageNo < rhs.pageNo);
+		}
+  };
+
+	/**
+	 * Allocate a free frame.  The frame is returned cleared, unmapped and with
+	 * its latch held by the caller.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
@@ -195,13 +509,110 @@ class BufMgr
   void allocBuf(FrameId & frame);
 
 	/**
-   * Advance clock to next frame in the buffer pool
+	 * Tries to take a frame for reuse on behalf of the replacement policy.
+	 * Succeeds if the frame is free, or unpinned and not latched, in which case
+	 * its page is written back if dirty and removed from the hash table.
+	 *
+	 * @param frame   	Frame to take
+	 * @param expected	If given, only take the frame while it holds this page
+	 * @param deferWrite	If true, a dirty page is left mapped for the caller to
+	 *									release with releaseFrame() once out of the policy's lock
+	 * @return					True if the frame is now latched by the caller, and cleared and
+	 *									unmapped unless its dirty page was left to write back.
+	 */
+  bool claimFrame(const FrameId frame, const PageKey* expected = NULL, const bool deferWrite = false);
+
+	/**
+	 * Writes back the page of an unpinned frame latched by the caller if it is
+	 * dirty, and removes it from the hash table.
+	 *
+	 * @param frame   	Frame to release
+	 * @param victim		If true, the policy took the frame as a victim and is told
+	 *									through evictionCancelled() if the page stays
+	 * @return					True if the frame is now cleared and unmapped, still latched; false,
+	 *									with the latch released, if the page was pinned meanwhile.
+	 */
+  bool releaseFrame(const FrameId frame, const bool victim = false);
+
+	/**
+	 * Allocate a frame for a read through an access strategy: the next frame of
+	 * the ring if it can be recycled, else a frame from allocBuf() that takes
+	 * that place in the ring.  The frame is returned latched like allocBuf().
+	 *
+	 * @param strategy	Access strategy owning the ring
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param slot   		Ring slot of the frame returned via this variable
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocRingBuf(BufAccessStrategy* strategy, FrameId & frame, std::uint32_t & slot);
+
+	/**
+	 * Reads a page that is not in the pool into a new frame and maps it.  On
+	 * success the page is left pinned once.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame the page was read into, returned via this variable
+	 * @param strategy	If given, the frame is taken from the strategy's ring
+	 * @param prefetch	True if the page is read ahead of use by an I/O worker
+	 * @return				False if another thread mapped the page meanwhile.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  bool loadPage(File* file, const PageId pageNo, FrameId & frameNo, BufAccessStrategy* strategy, const bool prefetch);
+
+	/**
+   * Body of an I/O worker thread: serves the prefetch queue until stopped
+	 *
+	 * @param worker	Index of the worker in prefetchInFlight
+	 */
+  void ioWorkerLoop(const std::uint32_t worker);
+
+	/**
+   * Body of the background writer thread
+	 */
+  void cleanerLoop();
+
+	/**
+   * Writes back the dirty, unpinned pages among the frames the replacement
+   * policy will offer as victims next, a run of consecutive pages per write
+	 */
+  void cleanAhead();
+
+	/**
+   * Writes a run of consecutive pages whose frames are latched by the caller,
+   * marks them clean and releases the latches
+	 *
+	 * @param run			Pages of one file with consecutive page numbers
+	 */
+  void writeRun(std::vector<DirtyPage>& run);
+
+	/**
+   * Drops the prefetches queued for a file, or for one page of it
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number, or Page::INVALID_NUMBER for every page of the file
+	 * @param wait		If true, also waits for the prefetches of the file in progress
 	 */
-  void advanceClock()
+  void cancelPrefetch(const File* file, const PageId pageNo, const bool wait);
+
+	/**
+   * Returns the partition holding the mapping for (file, pageNo)
+	 */
+  std::uint32_t partitionOf(const File* file, const PageId pageNo) const
   {
-		clockHand = (clockHand + 1) % numBufs;
+		return static_cast<std::uint32_t>(BufHashTbl::hashKey(file, pageNo) >> 32) & (NUM_PARTITIONS - 1);
   }
 
+	/**
+   * Pins the page if it is mapped to a frame.  Waits for a read of the page
+   * in progress by another thread and fails if that read failed.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame holding the page, set on success
+	 * @return				True if the page is resident and now pinned.
+	 */
+  bool pinIfResident(File* file, const PageId pageNo, FrameId & frameNo);
 
  public:
 	/**
@@ -209,10 +620,35 @@ class BufMgr
 	 */
   Page* bufPool;
 
+	/**
+   * Number of pages sequential scans read ahead of the page they are on
+	 */
+  static const std::uint32_t DEFAULT_PREFETCH_DEPTH = 8;
+
+	/**
+   * Number of I/O worker threads serving prefetch()
+	 */
+  static const std::uint32_t DEFAULT_IO_WORKERS = 2;
+
+	/**
+   * Milliseconds the background writer sleeps between passes
+	 */
+  static const std::uint32_t CLEANER_INTERVAL_MS = 5;
+
+	/**
+   * Longest run of pages the background writer merges into one write
+	 */
+  static const std::uint32_t MAX_WRITE_RUN = 16;
+
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param policyType  Page replacement policy, clock by default
+	 * @param ioWorkers	Number of threads reading prefetched pages
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, const ReplacementPolicyType policyType = CLOCK,
+			const std::uint32_t ioWorkers = DEFAULT_IO_WORKERS);
 	
 	/**
    * Destructor of BufMgr class
@@ -227,8 +663,42 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy	If given, a miss loads the page into the strategy's ring of frames
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPage(File* file, const PageId PageNo, Page*& page, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Asks the I/O workers to read pages into the buffer pool ahead of use and
+	 * returns at once.  Prefetched pages are not pinned.  Pages that are
+	 * already resident, that find no free frame or that fail to read are
+	 * skipped, and requests are dropped while half the pool is already queued.
+	 * flushFile() cancels the outstanding prefetches of its file.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Pages to read, in the order they will be requested
+	 * @param strategy	If given, the pages are loaded into the strategy's ring.  It must
+	 *									stay alive until the file is flushed.
+	 */
+  void prefetch(File* file, const std::vector<PageId>& pageNos, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Starts a background thread that writes back dirty, unpinned pages the
+	 * replacement policy will evict next, so that evictions rarely have to
+	 * write.  Does nothing if it is already running.
+	 */
+  void startCleaner();
+
+	/**
+	 * Stops the background writer and waits for it to finish its pass.
+	 */
+  void stopCleaner();
+
+	/**
+	 * Number of frames the ring of a strategy may hold in this pool
+	 *
+	 * @param strategy	Access strategy
+	 */
+  std::uint32_t ringFrames(const BufAccessStrategy* strategy) const;
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -251,7 +721,8 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, after cancelling its prefetches,
+	 * and syncs the file as its File::SyncPolicy asks.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
@@ -288,7 +759,24 @@ class BufMgr
   int pinnedCnt();
 
 	/**
-   * Get buffer pool usage statistics
+   * Number of frames in the buffer pool
+	 */
+  std::uint32_t numFrames() const
+  {
+    return numBufs;
+  }
+
+	/**
+   * Name of the page replacement policy in use
+	 */
+  const char* policyName() const
+  {
+		return policy->name();
+  }
+
+	/**
+   * Get buffer pool usage statistics.  The counters are updated atomically
+   * and may move while other threads use the pool.
 	 */
   BufStats & getBufStats()
   {
@@ -301,6 +789,15 @@ class BufMgr
   void clearBufStats() 
   {
 		bufStats.clear();
+  }
+
+	/**
+   * Turns the allocBuf latency histogram of BufStats on or off.  Off by
+   * default, as it reads the clock twice per allocation.
+	 */
+  void setAllocTiming(const bool on)
+  {
+		allocTiming = on;
   }
 };
 
@@ -13,8 +13,14 @@
 #include <string>
 #include <cstdio>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -23,8 +29,16 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+File::DescriptorMap File::open_files_;
+File::LockMap File::open_locks_;
 File::CountMap File::open_counts_;
+std::mutex File::open_mutex_;
+const std::size_t File::LIST_HEADER_SIZE;
+const std::uint32_t File::DIRECTORY_MAGIC;
+const PageId PageFile::PAGES_PER_BITMAP;
+const std::size_t PageFile::DIRECTORY_OFFSET;
+const PageId PageFile::MAX_BITMAP_PAGES;
+const std::uint32_t BlobFile::FREE_MARK;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,6 +54,7 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> guard(open_mutex_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
@@ -64,84 +79,195 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+File::File(const std::string& name, const bool create_new,
+           const Format format)
+    : filename_(name), format_(format), sync_policy_(SYNC_NONE) {
   openIfNeeded(create_new);
 
   if (create_new) {
+    if (format_ == DIRECTORY_FORMAT) {
+      // Reserve the header and the first (empty) allocation bitmap page.
+      FileGuard guard(*file_lock_);
+      std::vector<char> zeros(2 * Page::SIZE, 0);
+      std::memcpy(&zeros[0], &DIRECTORY_MAGIC, sizeof(DIRECTORY_MAGIC));
+      writeAt(&zeros[0], zeros.size(), 0 /* pos */);
+    }
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */, 1 /* num_bitmap_pages */};
     writeHeader(header);
+  } else {
+    std::uint32_t magic = 0;
+    readAt(&magic, sizeof(magic), 0 /* pos */);
+    format_ = magic == DIRECTORY_MAGIC ? DIRECTORY_FORMAT : LIST_FORMAT;
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
+  std::lock_guard<std::mutex> guard(open_mutex_);
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    descriptor_ = open_files_[filename_];
+    file_lock_ = open_locks_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR | O_CLOEXEC;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags |= O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    const int fd = ::open(filename_.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    descriptor_.reset(new Descriptor(fd));
+    file_lock_.reset(new std::recursive_mutex);
+    open_files_[filename_] = descriptor_;
+    open_locks_[filename_] = file_lock_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  std::lock_guard<std::mutex> guard(open_mutex_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  descriptor_.reset();
+  file_lock_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_files_.erase(filename_);
+    open_locks_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  FileGuard guard(*file_lock_);
+  FileHeader header = FileHeader();
+  if (format_ == DIRECTORY_FORMAT) {
+    readAt(&header, sizeof(FileHeader), sizeof(DIRECTORY_MAGIC));
+  } else {
+    readAt(&header, LIST_HEADER_SIZE, 0 /* pos */);
+  }
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  FileGuard guard(*file_lock_);
+  if (format_ == DIRECTORY_FORMAT) {
+    writeAt(&header, sizeof(FileHeader), sizeof(DIRECTORY_MAGIC));
+  } else {
+    writeAt(&header, LIST_HEADER_SIZE, 0 /* pos */);
+  }
+}
+
+void File::readAt(void* data, const std::size_t length,
+                  const off_t position) const {
+  char* bytes = static_cast<char*>(data);
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t n = ::pread(descriptor_->fd, bytes + done, length - done,
+                              position + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    if (n == 0) {
+      // Past the end of the file.
+      std::memset(bytes + done, 0, length - done);
+      break;
+    }
+    done += n;
+  }
+}
+
+void File::writeAt(const void* data, const std::size_t length,
+                   const off_t position) {
+  const char* bytes = static_cast<const char*>(data);
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t n = ::pwrite(descriptor_->fd, bytes + done, length - done,
+                               position + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    done += n;
+  }
+  if (sync_policy_ == SYNC_ALWAYS && ::fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+}
+
+void File::writeAtv(struct iovec* parts, int count, const off_t position) {
+  off_t done = 0;
+  while (count > 0) {
+    const ssize_t n = ::pwritev(descriptor_->fd, parts, count, position + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    done += n;
+    // Skip the buffers written, and the written part of the next one.
+    std::size_t left = n;
+    while (count > 0 && left >= parts->iov_len) {
+      left -= parts->iov_len;
+      ++parts;
+      --count;
+    }
+    if (count > 0) {
+      parts->iov_base = static_cast<char*>(parts->iov_base) + left;
+      parts->iov_len -= left;
+    }
+  }
+  if (sync_policy_ == SYNC_ALWAYS && ::fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+}
+
+void File::sync() const {
+  if (sync_policy_ != SYNC_NONE && ::fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+}
+
+File::Descriptor::~Descriptor() {
+  ::close(fd);
 }
 
 
 
 
 
-PageFile PageFile::create(const std::string& filename) {
-  return PageFile(filename, true /* create_new */);
+PageFile PageFile::create(const std::string& filename, const Format format) {
+  return PageFile(filename, true /* create_new */, format);
 }
 
 PageFile PageFile::open(const std::string& filename) {
   return PageFile(filename, false /* create_new */);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const Format format)
+: File(name, create_new, format)
 {
 }
 
@@ -151,6 +277,7 @@ PageFile::~PageFile() {
 PageFile::PageFile(const PageFile& other)
 : File(other.filename_, false /* create_new */)
 {
+  sync_policy_ = other.sync_policy_;
 }
 
 PageFile& PageFile::operator=(const PageFile& rhs) {
@@ -158,106 +285,91 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  format_ = rhs.format_;
+  sync_policy_ = rhs.sync_policy_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  FileGuard guard(*file_lock_);
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    new_page_number = header.first_free_page;
+    header.first_free_page = readPageHeader(new_page_number).next_page_number;
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+    if (format_ == DIRECTORY_FORMAT) {
+      // Bitmap pages are allocated from the end of the file as well, but are
+      // never part of the used or free lists.
+      while (header.num_pages / PAGES_PER_BITMAP >= header.num_bitmap_pages) {
+        appendBitmapPage(header);
       }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
     }
+		new_page_number = header.num_pages;
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  new_page.initialize();
+  new_page.set_page_number(new_page_number);
+
+  // Link the new page into the used list, which is kept in page number order.
+  const PageId previous_page_number = previousUsedPage(header, new_page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    new_page.set_next_page_number(header.first_used_page);
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    new_page.set_next_page_number(previous_header.next_page_number);
+    previous_header.next_page_number = new_page_number;
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+    header.last_used_page = new_page_number;
+  }
+  if (format_ == DIRECTORY_FORMAT) {
+    markPage(new_page_number, true);
   }
+  writePage(new_page_number, new_page.header_, new_page);
   writeHeader(header);
-
-  return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void PageFile::readPage(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPage(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+void PageFile::readPage(const PageId page_number, Page& page,
+                        const bool allow_free) const {
+  readAt(&page, Page::SIZE, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+	FileGuard guard(*file_lock_);
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
@@ -273,33 +385,54 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	writePage(new_page_number, header, new_page);
 }
 
+void PageFile::writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages) {
+  if (pages.empty()) {
+    return;
+  }
+  FileGuard guard(*file_lock_);
+  std::vector<char> buffer(pages.size() * Page::SIZE);
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    // Keep the next page pointers on disk, as writePage() does.
+    PageHeader header = readPageHeader(first_page_number + i);
+    if (header.current_page_number == Page::INVALID_NUMBER) {
+      throw InvalidPageException(first_page_number + i, filename_);
+    }
+    const PageId next_page_number = header.next_page_number;
+    header = pages[i]->header_;
+    header.next_page_number = next_page_number;
+    char* slot = &buffer[i * Page::SIZE];
+    std::memcpy(slot, &header, sizeof(PageHeader));
+    std::memcpy(slot + sizeof(PageHeader), &pages[i]->data_[0], Page::DATA_SIZE);
+  }
+  writeAt(&buffer[0], buffer.size(), pagePosition(first_page_number));
+}
+
 void PageFile::deletePage(const PageId page_number) {
+  FileGuard guard(*file_lock_);
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
+  // Unlink the page from the used list.
+  const PageId previous_page_number = previousUsedPage(header, page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
     header.first_used_page = existing_page.next_page_number();
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    previous_header.next_page_number = existing_page.next_page_number();
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (page_number == header.last_used_page) {
+    header.last_used_page = previous_page_number;
+  }
+  if (format_ == DIRECTORY_FORMAT) {
+    markPage(page_number, false);
   }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
@@ -315,20 +448,115 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  // One write of the whole page, with the given header in front.
+  struct iovec parts[2];
+  parts[0].iov_base = const_cast<PageHeader*>(&header);
+  parts[0].iov_len = sizeof(PageHeader);
+  parts[1].iov_base = const_cast<char*>(&new_page.data_[0]);
+  parts[1].iov_len = Page::DATA_SIZE;
+  writeAtv(parts, 2, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  FileGuard guard(*file_lock_);
+  writeAt(&header, sizeof(PageHeader), pagePosition(page_number));
+}
+
+PageId PageFile::previousUsedPage(const FileHeader& header,
+                                  const PageId page_number) const {
+  FileGuard guard(*file_lock_);
+  if (header.first_used_page == Page::INVALID_NUMBER ||
+      header.first_used_page >= page_number) {
+    return Page::INVALID_NUMBER;
+  }
+  if (format_ == LIST_FORMAT) {
+    PageId previous = header.first_used_page;
+    PageId next = readPageHeader(previous).next_page_number;
+    while (next != Page::INVALID_NUMBER && next < page_number) {
+      previous = next;
+      next = readPageHeader(previous).next_page_number;
+    }
+    return previous;
+  }
+  if (header.last_used_page < page_number) {
+    return header.last_used_page;
+  }
+  // Scan the bitmap backwards a word at a time, reading each bitmap page
+  // once.  The first used page lies below page_number, so this always finds
+  // a set bit.
+  std::vector<std::uint64_t> words(Page::SIZE / sizeof(std::uint64_t));
+  PageId index = (page_number - 1) / PAGES_PER_BITMAP;
+  PageId bit = (page_number - 1) % PAGES_PER_BITMAP;
+  while (true) {
+    readAt(&words[0], Page::SIZE, bitmapPosition(index));
+    while (true) {
+      const PageId word_bit = bit % 64;
+      std::uint64_t word = words[bit / 64];
+      if (word_bit < 63) {
+        word &= (static_cast<std::uint64_t>(1) << (word_bit + 1)) - 1;
+      }
+      if (word != 0) {
+        return index * PAGES_PER_BITMAP + bit - word_bit +
+               (63 - __builtin_clzll(word));
+      }
+      if (bit < 64) {
+        break;
+      }
+      bit -= word_bit + 1;
+    }
+    assert(index > 0);
+    --index;
+    bit = PAGES_PER_BITMAP - 1;
+  }
+}
+
+off_t PageFile::bitmapPosition(const PageId index) const {
+  if (index == 0) {
+    return Page::SIZE;
+  }
+  PageId bitmap_page_number;
+  readAt(&bitmap_page_number, sizeof(PageId),
+         DIRECTORY_OFFSET + (index - 1) * sizeof(PageId));
+  return pagePosition(bitmap_page_number);
+}
+
+void PageFile::appendBitmapPage(FileHeader& header) {
+  FileGuard guard(*file_lock_);
+  if (header.num_bitmap_pages >= MAX_BITMAP_PAGES) {
+    // The page directory is full; the file cannot address more pages.
+    throw InvalidPageException(header.num_pages, filename_);
+  }
+  const PageId bitmap_page_number = header.num_pages;
+  const std::vector<char> zeros(Page::SIZE, 0);
+  writeAt(&zeros[0], zeros.size(), pagePosition(bitmap_page_number));
+  writeAt(&bitmap_page_number, sizeof(PageId),
+          DIRECTORY_OFFSET + (header.num_bitmap_pages - 1) * sizeof(PageId));
+  ++header.num_bitmap_pages;
+  ++header.num_pages;
+}
+
+void PageFile::markPage(const PageId page_number, const bool used) {
+  FileGuard guard(*file_lock_);
+  const PageId bit = page_number % PAGES_PER_BITMAP;
+  const off_t position =
+      bitmapPosition(page_number / PAGES_PER_BITMAP) + bit / 8;
+  char byte = 0;
+  readAt(&byte, 1, position);
+  if (used) {
+    byte |= static_cast<char>(1 << (bit % 8));
+  } else {
+    byte &= static_cast<char>(~(1 << (bit % 8)));
+  }
+  writeAt(&byte, 1, position);
+}
+
 
 
 
@@ -350,6 +578,7 @@ BlobFile::~BlobFile() {
 BlobFile::BlobFile(const BlobFile& other)
 : File(other.filename_, false /* create_new */)
 {
+  sync_policy_ = other.sync_policy_;
 }
 
 BlobFile& BlobFile::operator=(const BlobFile& rhs) {
@@ -357,45 +586,106 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  format_ = rhs.format_;
+  sync_policy_ = rhs.sync_policy_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePage(new_page_number, new_page);
+	return new_page;
+}
 
-	new_page_number = header.num_pages;
+void BlobFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  FileGuard guard(*file_lock_);
+  FileHeader header = readHeader();
+	new_page.initialize();
+
+	if (header.num_free_pages > 0) {
+		// reuse the page deleted last; its first bytes hold the next free page
+		new_page_number = header.first_free_page;
+		readAt(&header.first_free_page, sizeof(PageId), pagePosition(new_page_number));
+		--header.num_free_pages;
+	} else {
+		new_page_number = header.num_pages;
+		++header.num_pages;
+	}
 
 	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
+		header.first_used_page = new_page_number;
 	}
 
-	++header.num_pages;
 	//Fix set the 'new_page's page number to new_page_number before writing it to the disk
 	new_page.set_page_number(new_page_number);
 	writePage(new_page_number, new_page);
 	writeHeader(header);
-
-	return new_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPage(page_number, page);
 	return page;
 }
 
+void BlobFile::readPage(const PageId page_number, Page& page) const {
+	readAt(&page, Page::SIZE, pagePosition(page_number));
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
+}
+
+void BlobFile::writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages) {
+	if (pages.empty()) {
+		return;
+	}
+	std::vector<char> buffer(pages.size() * Page::SIZE);
+	for (std::size_t i = 0; i < pages.size(); ++i) {
+		std::memcpy(&buffer[i * Page::SIZE], pages[i], Page::SIZE);
+	}
+	writeAt(&buffer[0], buffer.size(), pagePosition(first_page_number));
 }
 
-//delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+  FileGuard guard(*file_lock_);
+  FileHeader header = readHeader();
+	if (page_number == Page::INVALID_NUMBER || page_number >= header.num_pages) {
+		throw InvalidPageException(page_number, filename_);
+	}
+
+	// A page deleted twice would be on the free list twice and handed out to
+	// two owners.  Only a page with the free mark can be free, so the list is
+	// walked just for those.
+	std::uint32_t link[2];
+	readAt(link, sizeof(link), pagePosition(page_number));
+	if (link[1] == FREE_MARK) {
+		PageId free_page = header.first_free_page;
+		for (PageId i = 0; i < header.num_free_pages; ++i) {
+			if (free_page == page_number) {
+				throw InvalidPageException(page_number, filename_);
+			}
+			readAt(&free_page, sizeof(PageId), pagePosition(free_page));
+		}
+	}
+
+	// push the page on the free list
+	link[0] = header.first_free_page;
+	link[1] = FREE_MARK;
+	writeAt(link, sizeof(link), pagePosition(page_number));
+	header.first_free_page = page_number;
+	++header.num_free_pages;
+	writeHeader(header);
+}
+
+PageId BlobFile::pageCount() const {
+	return readHeader().num_pages - 1;
+}
+
+PageId BlobFile::freePageCount() const {
+	return readHeader().num_free_pages;
 }
 
 }
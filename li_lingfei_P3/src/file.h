@@ -7,10 +7,13 @@
 
 #pragma once
 
-#include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "page.h"
 
@@ -42,6 +45,19 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file, so pages can be appended
+   * to the used list without walking it.  Only persisted by files in
+   * File::DIRECTORY_FORMAT.
+   */
+  PageId last_used_page;
+
+  /**
+   * Number of allocation bitmap pages in the file.  Only used by files in
+   * File::DIRECTORY_FORMAT.
+   */
+  PageId num_bitmap_pages;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +68,9 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page &&
+        num_bitmap_pages == rhs.num_bitmap_pages;
   }
 };
 
@@ -60,32 +78,78 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the
+ * same underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_files_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * Pages are transferred with positional reads and writes (pread/pwrite), so
+ * there is no shared seek position and several threads may read and write
+ * pages through the buffer manager at once.  Updates of the file header and
+ * the page lists are serialized per underlying file by a mutex shared with
+ * the descriptor, and the open file maps are guarded by a global mutex.
+ * Iterating over a file while another thread allocates or deletes pages in
+ * it is not supported.
  */
 
 
 class File {
  public:
+  /**
+   * On-disk layouts of a file.
+   */
+  enum Format {
+    /**
+     * Original layout: a bare header followed by the pages.  Allocating and
+     * deleting pages walks the used page list.
+     */
+    LIST_FORMAT,
+
+    /**
+     * A page-sized header holding a tail pointer and the page directory,
+     * followed by the first allocation bitmap page and then the pages.
+     * Allocating and deleting pages costs a constant number of disk reads.
+     */
+    DIRECTORY_FORMAT
+  };
+
+  /**
+   * When writes to a file are forced to stable storage.
+   */
+  enum SyncPolicy {
+    /**
+     * Never; the operating system writes pages back when it likes.
+     */
+    SYNC_NONE,
+
+    /**
+     * When the file is flushed with sync(), e.g. by BufMgr::flushFile().
+     */
+    SYNC_ON_FLUSH,
+
+    /**
+     * After every page or header write.
+     */
+    SYNC_ALWAYS
+  };
 
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param format      Layout of a newly created file.  Existing files keep
+   *                    the layout found on disk.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const Format format = LIST_FORMAT);
 
   /**
    * Deletes an existing file.
@@ -124,6 +188,16 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file and initializes the caller-supplied page
+   * in place, so no temporary Page is materialized (e.g. a buffer pool frame).
+   *
+   * @param new_page_number Number of the new page is returned via this
+   *                        reference.
+   * @param new_page        Page to initialize as the new page.
+   */
+  virtual void allocatePage(PageId &new_page_number, Page& new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +208,17 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file directly into the caller-supplied
+   * page (e.g. a buffer pool frame).
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page the contents are read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -143,6 +228,16 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes pages with consecutive numbers, starting at the given page number,
+   * with a single write to the file.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with pages[0].
+   * @param pages             Pages to write, in page number order.
+   */
+  virtual void writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages) = 0;
+
   /**
    * Deletes a page from the file.
    *
@@ -157,6 +252,35 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the on-disk layout of the file.
+   *
+   * @return Format of file.
+   */
+  Format format() const { return format_; }
+
+  /**
+   * Sets when writes through this object are forced to stable storage.
+   *
+   * @param policy  New sync policy.
+   */
+  void setSyncPolicy(const SyncPolicy policy) { sync_policy_ = policy; }
+
+  /**
+   * Returns when writes through this object are forced to stable storage.
+   *
+   * @return Sync policy.
+   */
+  SyncPolicy syncPolicy() const { return sync_policy_; }
+
+  /**
+   * Forces writes to the file to stable storage, unless the sync policy is
+   * SYNC_NONE.
+   *
+   * @throws  FileIOException   If the operating system fails to sync.
+   */
+  void sync() const;
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -172,14 +296,30 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  off_t pagePosition(const PageId page_number) const {
+    if (format_ == DIRECTORY_FORMAT) {
+      // Header and first bitmap page come first, so pages are page aligned.
+      return static_cast<off_t>(page_number + 1) * Page::SIZE;
+    }
+    return LIST_HEADER_SIZE + static_cast<off_t>(page_number - 1) * Page::SIZE;
   }
 
+  /**
+   * Size of the header of a file in LIST_FORMAT: the first four fields of
+   * FileHeader.
+   */
+  static const std::size_t LIST_HEADER_SIZE = 4 * sizeof(PageId);
+
+  /**
+   * First word of a file in DIRECTORY_FORMAT.  A LIST_FORMAT file starts with
+   * its page count instead, which never gets anywhere near this value.
+   */
+  static const std::uint32_t DIRECTORY_MAGIC = 0x46504442;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,7 +330,41 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Reads bytes at the given position of the file.  Bytes past the end of
+   * the file read as zero.
+   *
+   * @param data      Buffer the bytes are read into.
+   * @param length    Number of bytes to read.
+   * @param position  Offset from the beginning of the file.
+   * @throws  FileIOException   If the operating system fails to read.
+   */
+  void readAt(void* data, const std::size_t length, const off_t position) const;
+
+  /**
+   * Writes bytes at the given position of the file, syncing them if the
+   * sync policy is SYNC_ALWAYS.
+   *
+   * @param data      Bytes to write.
+   * @param length    Number of bytes to write.
+   * @param position  Offset from the beginning of the file.
+   * @throws  FileIOException   If the operating system fails to write.
+   */
+  void writeAt(const void* data, const std::size_t length,
+               const off_t position);
+
+  /**
+   * Writes the bytes of several buffers, one after the other, at the given
+   * position of the file with one call, syncing them as writeAt() does.
+   *
+   * @param parts     Buffers to write.  Changed as they are written.
+   * @param count     Number of buffers.
+   * @param position  Offset from the beginning of the file.
+   * @throws  FileIOException   If the operating system fails to write.
+   */
+  void writeAtv(struct iovec* parts, int count, const off_t position);
+
+  /**
+   * Closes the underlying file descriptor in <descriptor_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -210,28 +384,71 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * @brief Descriptor of an open file, closed when the last File object
+   *        using it goes away.
+   */
+  struct Descriptor {
+    explicit Descriptor(const int fd) : fd(fd) {}
+    ~Descriptor();
+
+    /**
+     * Operating system file descriptor.
+     */
+    const int fd;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<Descriptor> > DescriptorMap;
+  typedef std::map<std::string, std::shared_ptr<std::recursive_mutex> > LockMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::lock_guard<std::recursive_mutex> FileGuard;
 
   /**
-   * Streams for opened files.
+   * Descriptors of opened files.
    */
-  static StreamMap open_streams_;
+  static DescriptorMap open_files_;
+
+  /**
+   * Update mutexes for opened files, shared like the descriptors.
+   */
+  static LockMap open_locks_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Guards open_files_, open_locks_ and open_counts_.
+   */
+  static std::mutex open_mutex_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<Descriptor> descriptor_;
+
+  /**
+   * Serializes updates of the file header and page lists, and writes that
+   * must not interleave with them.  Recursive because compound operations
+   * such as page allocation call the primitive reads and writes.
+   */
+  std::shared_ptr<std::recursive_mutex> file_lock_;
+
+  /**
+   * On-disk layout of the file.
+   */
+  Format format_;
+
+  /**
+   * When writes through this object are forced to stable storage.
+   */
+  SyncPolicy sync_policy_;
 
   friend class FileIterator;
 };
@@ -243,16 +460,18 @@ class PageFile : public File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param format    On-disk layout of the file.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static PageFile create(const std::string& filename);
+  static PageFile create(const std::string& filename,
+                         const Format format = DIRECTORY_FORMAT);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_files_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -264,12 +483,14 @@ class PageFile : public File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param format      Layout of a newly created file.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const Format format = DIRECTORY_FORMAT);
 
   /**
    * Copy constructor.
@@ -300,6 +521,15 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file, initializing the given page in place.
+   *
+   * @param new_page_number Number of the new page is returned via this
+   *                        reference.
+   * @param new_page        Page to initialize as the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page);
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +540,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page the contents are read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -319,6 +559,16 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page);
 
+  /**
+   * Writes pages with consecutive numbers, starting at the given page number,
+   * with a single write to the file.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with pages[0].
+   * @param pages             Pages to write, in page number order.
+   */
+  void writePages(const PageId first_page_number,
+                  const std::vector<const Page*>& pages);
+
   /**
    * Deletes a page from the file.
    *
@@ -344,19 +594,21 @@ class PageFile : public File {
  private:
 
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Reads a page from the file into the given page.  If <allow_free> is not
+   * set, an exception will be thrown if the page read from disk is not
+   * currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Page the contents are read into.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, Page& page,
+                const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -379,6 +631,73 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk.  No bounds checking is
+   * performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns the used page preceding the given page in the used list, i.e.
+   * the highest numbered used page below it.  LIST_FORMAT files walk the list
+   * to find it; DIRECTORY_FORMAT files use the tail pointer or scan the
+   * allocation bitmap backwards.
+   *
+   * @param header        Current header of the file.
+   * @param page_number   Number of page.
+   * @return  Number of the preceding used page, or Page::INVALID_NUMBER if
+   *          the page belongs at the head of the used list.
+   */
+  PageId previousUsedPage(const FileHeader& header,
+                          const PageId page_number) const;
+
+  /**
+   * Returns the position of the given allocation bitmap page in the file.
+   * The first bitmap page follows the header; the page directory in the
+   * header holds the page numbers of the others.
+   *
+   * @param index   Index of bitmap page.
+   * @return  Position of bitmap page in file.
+   */
+  off_t bitmapPosition(const PageId index) const;
+
+  /**
+   * Appends a zeroed allocation bitmap page to the file and records it in
+   * the page directory.
+   *
+   * @param header  Header of the file, updated in place.
+   */
+  void appendBitmapPage(FileHeader& header);
+
+  /**
+   * Sets or clears the allocation bitmap bit of the given page.
+   *
+   * @param page_number   Number of page.
+   * @param used          Whether the page is now used.
+   */
+  void markPage(const PageId page_number, const bool used);
+
+  /**
+   * Number of pages tracked by one allocation bitmap page.
+   */
+  static const PageId PAGES_PER_BITMAP = Page::SIZE * 8;
+
+  /**
+   * Offset of the page directory within the header of a DIRECTORY_FORMAT
+   * file.
+   */
+  static const std::size_t DIRECTORY_OFFSET = 32;
+
+  /**
+   * Maximum number of allocation bitmap pages a DIRECTORY_FORMAT file can
+   * address: the first one plus one per page directory entry.
+   */
+  static const PageId MAX_BITMAP_PAGES =
+      1 + (Page::SIZE - DIRECTORY_OFFSET) / sizeof(PageId);
+
   friend class FileIterator;
 };
 
@@ -395,10 +714,10 @@ class BlobFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_files_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -448,6 +767,15 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file, initializing the given page in place.
+   *
+   * @param new_page_number Number of the new page is returned via this
+   *                        reference.
+   * @param new_page        Page to initialize as the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page);
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +786,16 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page the contents are read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -468,11 +806,44 @@ class BlobFile : public File {
   void writePage(const PageId page_number, const Page& new_page);
 
   /**
-   * Deletes a page from the file.
+   * Writes pages with consecutive numbers, starting at the given page number,
+   * with a single write to the file.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with pages[0].
+   * @param pages             Pages to write, in page number order.
+   */
+  void writePages(const PageId first_page_number,
+                  const std::vector<const Page*>& pages);
+
+  /**
+   * Deletes a page from the file.  The page goes on the file's free list,
+   * which is chained through the first bytes of the free pages and headed in
+   * the file header, and is handed out again by the next allocatePage.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file, or
+   *                                is already on the free list.
    */
   void deletePage(const PageId page_number);
+
+  /**
+   * Returns the number of pages in the file, not counting the header but
+   * counting the free pages.
+   */
+  PageId pageCount() const;
+
+  /**
+   * Returns the number of pages on the free list.
+   */
+  PageId freePageCount() const;
+
+ private:
+  /**
+   * Written after the free list link of a deleted page.  Only a page that has
+   * it can be free, so deletePage looks for the page on the free list only
+   * then; a used page holding the same bytes by chance is not on the list.
+   */
+  static const std::uint32_t FREE_MARK = 0x45455246;
 };
 
 }
@@ -5,15 +5,22 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <vector>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const std::uint32_t ringSize,
+                   const std::uint32_t depth)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
+  strategy = ringSize > 0 ? new BufAccessStrategy(ringSize) : NULL;
+  //prefetched pages must not be recycled by the ring before the scan gets to them
+  prefetchDepth = strategy ? std::min(depth, bufMgr->ringFrames(strategy) / 2) : depth;
+  aheadCount = 0;
 	curDirtyFlag = false;
   curPage = NULL;
 	filePageIter = file->begin();
@@ -24,22 +31,43 @@ FileScan::~FileScan()
   // generally must unpin last page of the scan
   if (curPage != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
 		curDirtyFlag = false;
     filePageIter = file->begin();
   }
   bufMgr->flushFile(file);
   delete file;
+  delete strategy;
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
+  if (!nextRecord())
+	{
+		throw EndOfFileException();
+	}
+
+	// curRec points at a valid record
+	// return rid of the record
+	outRid = pageRecordIter.getCurrentRecord();
+}
+
+std::size_t FileScan::scanNextBatch(RecordId* outRids, const std::size_t maxRids)
+{
+  std::size_t count = 0;
+  while (count < maxRids && nextRecord())
+  {
+    outRids[count++] = pageRecordIter.getCurrentRecord();
+  }
+  return count;
+}
 
+bool FileScan::nextRecord()
+{
   if (filePageIter == file->end())
 	{
-		throw EndOfFileException();
+		return false;
 	}
 
   // special case of the first record of the first page of the file
@@ -49,34 +77,33 @@ void FileScan::scanNext(RecordId& outRid)
 		filePageIter = file->begin();
     if(filePageIter == file->end())
 		{
-			throw EndOfFileException();
+			return false;
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
+    bufMgr->readPage(file, filePageIter.page_number(), curPage, strategy); 
 		curDirtyFlag = false;
+		if (prefetchDepth > 0)
+		{
+			aheadIter = filePageIter;
+			++aheadIter;
+			aheadCount = 0;
+			readAhead();
+		}
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
-
-		if(pageRecordIter != curPage->end()) 
-		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
-		}
   }
-
-	// Loop, looking for a record that satisfied the predicate.
-	// First try and get the next record off the current page
-	pageRecordIter++;
+  else
+  {
+    // First try and get the next record off the current page
+    pageRecordIter++;
+  }
 
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
 
@@ -84,24 +111,43 @@ void FileScan::scanNext(RecordId& outRid)
     if (filePageIter == file->end())
     {
       curPage = NULL;
-			throw EndOfFileException();
+			return false;
+    }
+
+    // the new page was either prefetched already or is next in line
+    if (prefetchDepth > 0)
+    {
+      if (aheadCount > 0)
+        aheadCount--;
+      else
+        ++aheadIter;
+      readAhead();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    bufMgr->readPage(file, filePageIter.page_number(), curPage, strategy);
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
   }
+  return true;
+}
 
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
+void FileScan::readAhead()
+{
+  // top up in batches so the I/O workers are woken once per few pages
+  if (aheadCount > prefetchDepth / 2)
+    return;
 
-	// return rid of the record
-	outRid = pageRecordIter.getCurrentRecord();
-	return;
+  std::vector<PageId> pageNos;
+  while (aheadCount < prefetchDepth && aheadIter != file->end())
+  {
+    pageNos.push_back(aheadIter.page_number());
+    ++aheadIter;
+    aheadCount++;
+  }
+  if (!pageNos.empty())
+    bufMgr->prefetch(file, pageNos, strategy);
 }
 
 // returns pointer to the current record.  page is left pinned
@@ -111,6 +157,13 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+// returns a view of the current record without copying it.  the view points
+// into the pinned page and is only valid until the scan moves to the next page
+RecordView FileScan::getRecordView()
+{
+  return pageRecordIter.getCurrentRecordView();
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
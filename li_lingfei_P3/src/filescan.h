@@ -24,19 +24,40 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  //ringSize is the number of buffer frames the scan recycles for its pages,
+  //so that scanning a large relation does not flush the rest of the pool.
+  //0 reads pages through the pool's replacement policy like any other access.
+  //prefetchDepth is how many pages the scan asks the pool to read ahead of the
+  //page it is on; with a ring it is limited to half the ring
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           const std::uint32_t ringSize = BufAccessStrategy::DEFAULT_RING_SIZE,
+           const std::uint32_t prefetchDepth = BufMgr::DEFAULT_PREFETCH_DEPTH);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
-  //read current record, returning pointer and length
+  //fill outRids with the RecordIds of up to maxRids next records, moving on
+  //to the following pages as needed.  returns the number filled, which is less
+  //than maxRids only at the end of the file.  the current record afterwards is
+  //the last one returned
+  std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids);
+
+  //read current record, returning a copy of it
   std::string getRecord();
 
+  //read current record, returning pointer and length. valid until the next
+  //call to scanNext since the scan unpins the page when it moves on
+  RecordView getRecordView();
+
   //marks current page of scan dirty
   void markDirty();
 
+  //ring of frames the scan reads through, NULL if it has none.  its counters
+  //report how many of the scan's page reads hit the pool
+  const BufAccessStrategy* getStrategy() const { return strategy; }
+
  private:
   /**
    * File which is being scanned.
@@ -48,6 +69,11 @@ class FileScan
    */
 	BufMgr				*bufMgr;
 
+  /**
+   * Ring of frames the scan's pages are read into, or NULL.
+   */
+  BufAccessStrategy *strategy;
+
   /**
    * Current page being scanned.
    */
@@ -56,6 +82,32 @@ class FileScan
   FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
+  /**
+   * Number of pages to keep prefetched ahead of the current page
+   */
+  std::uint32_t prefetchDepth;
+
+  /**
+   * First page after the current one that has not been prefetched
+   */
+  FileIterator  aheadIter;
+
+  /**
+   * Number of pages prefetched after the current one
+   */
+  std::uint32_t aheadCount;
+
+  /**
+   * Moves to the next record, reading the next page when the current one runs out.
+   * Returns false at the end of the file
+   */
+  bool nextRecord();
+
+  /**
+   * Prefetches pages until prefetchDepth are in flight after the current page
+   */
+  void readAhead();
+
   /**
    * True if page has been updated
    */
@@ -0,0 +1,567 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hashindex.h"
+#include "filescan.h"
+#include "exceptions/end_of_file_exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace badgerdb
+{
+
+static_assert(sizeof(HashDirectoryPage) <= Page::SIZE, "a directory page fits a page");
+static_assert(sizeof(HashBucketPage<StringKeyValue>) <= Page::SIZE, "a string bucket fits a page");
+static_assert(sizeof(HashMetaInfo) <= Page::SIZE, "the meta page fits a page");
+static_assert(((std::uint64_t)1 << ExtendibleHash<IntKeyTraits>::MAX_DEPTH) / HashDirectoryPage::SLOTS
+    <= (std::uint64_t)HashMetaInfo::MAX_DIRECTORY_PAGES, "the meta page lists the largest directory");
+
+//Record id order of BTreeIndex: by page, then slot number
+static bool ridLess(const RecordId& lhs, const RecordId& rhs)
+{
+    if(lhs.page_number != rhs.page_number) {
+        return lhs.page_number < rhs.page_number;
+    }
+    return lhs.slot_number < rhs.slot_number;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::HashIndex -- Constructor
+// -----------------------------------------------------------------------------
+HashIndex::HashIndex(const std::string & relationName,
+		std::string & outIndexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset,
+		const Datatype attrType)
+{
+    std::ostringstream idxStr;
+    idxStr<<relationName<<"."<<attrByteOffset<<".hash";
+    outIndexName = idxStr.str();
+
+    if(attrType == INTEGER) {
+        this->index = new ExtendibleHash<IntKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    } else if(attrType == DOUBLE) {
+        this->index = new ExtendibleHash<DoubleKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    } else {
+        this->index = new ExtendibleHash<StringKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// ExtendibleHash::ExtendibleHash -- Constructor
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+ExtendibleHash<KeyTraits>::ExtendibleHash(const std::string & relationName,
+		const std::string & indexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset)
+{
+    this->bufMgr = bufMgrIn;
+    this->attrByteOffset = attrByteOffset;
+    this->headerPageNum = 1;
+
+    if(File::exists(indexName)) {
+        this->file = new BlobFile(indexName, false);
+
+        Page* metaInfoPage = NULL;
+        this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+        const HashMetaInfo* meta = (const HashMetaInfo*)metaInfoPage;
+        this->depth = meta->globalDepth;
+        this->directoryPages.assign(meta->directory, meta->directory + meta->directoryPages);
+        this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+        return;
+    }
+
+    this->file = new BlobFile(indexName, true);
+
+    Page* metaInfoPage = NULL;
+    this->bufMgr->allocPage(this->file, this->headerPageNum, metaInfoPage);
+    HashMetaInfo* meta = (HashMetaInfo*)metaInfoPage;
+    memset(meta, 0, sizeof(HashMetaInfo));
+    strncpy(meta->relationName, relationName.c_str(), sizeof(meta->relationName) - 1);
+    meta->attrByteOffset = attrByteOffset;
+    meta->attrType = KeyTraits::TYPE;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+    //One slot, pointing to one empty bucket
+    PageId directoryPageNo, bucketPageNo;
+    Page* directoryPage;
+    Page* bucketPage;
+    this->bufMgr->allocPage(this->file, directoryPageNo, directoryPage);
+    this->bufMgr->allocPage(this->file, bucketPageNo, bucketPage);
+    Bucket* bucket = (Bucket*)bucketPage;
+    bucket->localDepth = 0;
+    bucket->usage = 0;
+    bucket->overflowPageNo = 0;
+    ((HashDirectoryPage*)directoryPage)->buckets[0] = bucketPageNo;
+    this->bufMgr->unPinPage(this->file, directoryPageNo, true);
+    this->bufMgr->unPinPage(this->file, bucketPageNo, true);
+    this->depth = 0;
+    this->directoryPages.assign(1, directoryPageNo);
+    this->writeMeta();
+
+    this->createIndexFromRelation(relationName);
+}
+
+//Reads the relation and inserts all <key, rid> pairs
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::createIndexFromRelation(const std::string& relationName)
+{
+    FileScan fscan(relationName, this->bufMgr, BufAccessStrategy::DEFAULT_RING_SIZE);
+    try {
+        RecordId scanRid;
+        while(1) {
+            fscan.scanNext(scanRid);
+            Value key;
+            KeyTraits::load(key, fscan.getRecordView().data + this->attrByteOffset);
+            this->insertEntry(KeyTraits::key(key), scanRid);
+        }
+    } catch(const EndOfFileException&) {
+    }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::~HashIndex -- destructor
+// -----------------------------------------------------------------------------
+HashIndex::~HashIndex()
+{
+    delete this->index;
+}
+
+template<class KeyTraits>
+ExtendibleHash<KeyTraits>::~ExtendibleHash()
+{
+    this->writeMeta();
+    this->bufMgr->flushFile(this->file);
+    delete this->file;
+}
+
+// -----------------------------------------------------------------------------
+// Directory
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+PageId ExtendibleHash<KeyTraits>::bucketOf(const std::uint32_t slot)
+{
+    const PageId pageNo = this->directoryPages[slot / HashDirectoryPage::SLOTS];
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    const PageId bucketPageNo = ((const HashDirectoryPage*)page)->buckets[slot % HashDirectoryPage::SLOTS];
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    return bucketPageNo;
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::setBucket(const std::uint32_t slot, const PageId bucketPageNo)
+{
+    const PageId pageNo = this->directoryPages[slot / HashDirectoryPage::SLOTS];
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    ((HashDirectoryPage*)page)->buckets[slot % HashDirectoryPage::SLOTS] = bucketPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, true);
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::growDirectory()
+{
+    //Slot i + 2^depth is a copy of slot i: within the first page while it has room,
+    //and after that page p + pages is a copy of page p
+    const std::uint32_t slots = (std::uint32_t)1 << this->depth;
+    if(2 * slots <= (std::uint32_t)HashDirectoryPage::SLOTS) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, this->directoryPages[0], page);
+        PageId* buckets = ((HashDirectoryPage*)page)->buckets;
+        std::copy(buckets, buckets + slots, buckets + slots);
+        this->bufMgr->unPinPage(this->file, this->directoryPages[0], true);
+    } else {
+        const size_t pages = this->directoryPages.size();
+        for(size_t p = 0; p < pages; p ++) {
+            Page* from = NULL;
+            Page* to = NULL;
+            PageId toPageNo;
+            this->bufMgr->readPage(this->file, this->directoryPages[p], from);
+            this->bufMgr->allocPage(this->file, toPageNo, to);
+            *(HashDirectoryPage*)to = *(const HashDirectoryPage*)from;
+            this->bufMgr->unPinPage(this->file, this->directoryPages[p], false);
+            this->bufMgr->unPinPage(this->file, toPageNo, true);
+            this->directoryPages.push_back(toPageNo);
+        }
+    }
+    this->depth ++;
+    this->writeMeta();
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::writeMeta()
+{
+    Page* metaInfoPage = NULL;
+    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+    HashMetaInfo* meta = (HashMetaInfo*)metaInfoPage;
+    meta->globalDepth = this->depth;
+    meta->directoryPages = this->directoryPages.size();
+    std::copy(this->directoryPages.begin(), this->directoryPages.end(), meta->directory);
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// Buckets
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::readChain(const PageId pageNo, std::vector<Pair>& entries,
+        std::vector<PageId>& pages, int& localDepth)
+{
+    PageId curPageNo = pageNo;
+    while(curPageNo != 0) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, page);
+        const Bucket* node = (const Bucket*)page;
+        if(curPageNo == pageNo) {
+            localDepth = node->localDepth;
+        }
+        entries.insert(entries.end(), node->entries, node->entries + node->usage);
+        pages.push_back(curPageNo);
+        const PageId nextPageNo = node->overflowPageNo;
+        this->bufMgr->unPinPage(this->file, curPageNo, false);
+        curPageNo = nextPageNo;
+    }
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::writeChain(const PageId pageNo, const int localDepth,
+        const std::vector<Pair>& entries, const std::vector<PageId>& pages)
+{
+    size_t written = 0;
+    size_t reused = 1;
+    PageId curPageNo = pageNo;
+    while(curPageNo != 0) {
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, curPageNo, page);
+        Bucket* node = (Bucket*)page;
+        node->localDepth = localDepth;
+        node->usage = std::min(entries.size() - written, (size_t)Bucket::MAX_USAGE);
+        std::copy(entries.begin() + written, entries.begin() + written + node->usage, node->entries);
+        written += node->usage;
+        node->overflowPageNo = 0;
+        if(written < entries.size()) {
+            if(reused < pages.size()) {
+                node->overflowPageNo = pages[reused ++];
+            } else {
+                Page* overflowPage;
+                this->bufMgr->allocPage(this->file, node->overflowPageNo, overflowPage);
+                this->bufMgr->unPinPage(this->file, node->overflowPageNo, true);
+            }
+        }
+        const PageId nextPageNo = node->overflowPageNo;
+        this->bufMgr->unPinPage(this->file, curPageNo, true);
+        curPageNo = nextPageNo;
+    }
+    for(; reused < pages.size(); reused ++) {
+        this->bufMgr->disposePage(this->file, pages[reused]);
+    }
+}
+
+template<class KeyTraits>
+const bool ExtendibleHash<KeyTraits>::split(const std::uint32_t slot, const std::uint64_t hash)
+{
+    const PageId pageNo = this->bucketOf(slot);
+    std::vector<Pair> entries;
+    std::vector<PageId> pages;
+    int localDepth = 0;
+    this->readChain(pageNo, entries, pages, localDepth);
+
+    //Worth it only if some entry differs from the new one in a bit a split can use
+    const std::uint64_t usable = (((std::uint64_t)1 << MAX_DEPTH) - 1) & ~(((std::uint64_t)1 << localDepth) - 1);
+    bool separable = false;
+    for(size_t i = 0; !separable && i < entries.size(); i ++) {
+        separable = ((KeyTraits::hash(keyOf(entries[i])) ^ hash) & usable) != 0;
+    }
+    if(!separable) {
+        return false;
+    }
+    if(localDepth == this->depth) {
+        this->growDirectory();
+    }
+
+    //Entries with the next bit set move to a new bucket, as do the slots that end in it
+    const std::uint64_t bit = (std::uint64_t)1 << localDepth;
+    std::vector<Pair> low, high;
+    for(size_t i = 0; i < entries.size(); i ++) {
+        (KeyTraits::hash(keyOf(entries[i])) & bit ? high : low).push_back(entries[i]);
+    }
+    PageId newPageNo;
+    Page* newPage;
+    this->bufMgr->allocPage(this->file, newPageNo, newPage);
+    this->bufMgr->unPinPage(this->file, newPageNo, true);
+    this->writeChain(pageNo, localDepth + 1, low, pages);
+    this->writeChain(newPageNo, localDepth + 1, high, std::vector<PageId>());
+
+    const std::uint32_t slots = (std::uint32_t)1 << this->depth;
+    for(std::uint32_t s = (std::uint32_t)((hash & (bit - 1)) | bit); s < slots; s += (std::uint32_t)(bit << 1)) {
+        this->setBucket(s, newPageNo);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Insertion functions
+// -----------------------------------------------------------------------------
+const void HashIndex::insertEntry(const void *key, const RecordId rid)
+{
+    this->index->insertEntry(key, rid);
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::insertEntry(const void *key, const RecordId rid)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    this->insertEntry(KeyTraits::key(value), rid);
+}
+
+template<class KeyTraits>
+const void ExtendibleHash<KeyTraits>::insertEntry(Key key, const RecordId rid)
+{
+    Pair pair;
+    KeyTraits::assign(pair.key, key);
+    pair.rid = rid;
+    const std::uint64_t hash = KeyTraits::hash(key);
+
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    while(1) {
+        const std::uint32_t slot = this->slotOf(hash);
+        const PageId pageNo = this->bucketOf(slot);
+        Page* page = NULL;
+        this->bufMgr->readPage(this->file, pageNo, page);
+        Bucket* node = (Bucket*)page;
+        if(node->usage < Bucket::MAX_USAGE) {
+            node->entries[node->usage ++] = pair;
+            this->bufMgr->unPinPage(this->file, pageNo, true);
+            return;
+        }
+
+        //A full bucket splits, unless it already overflows with entries of the new one's
+        //hash: then it would not help, and reading its chain to find out costs a lot
+        const bool sameHash = KeyTraits::hash(keyOf(node->entries[0])) == hash;
+        const bool overflows = node->overflowPageNo != 0;
+        this->bufMgr->unPinPage(this->file, pageNo, false);
+        if(!(overflows && sameHash) && this->split(slot, hash)) {
+            continue;
+        }
+
+        //Into the first overflow page with room, or a new one at the end of the chain
+        PageId curPageNo = pageNo;
+        while(1) {
+            this->bufMgr->readPage(this->file, curPageNo, page);
+            node = (Bucket*)page;
+            if(node->usage < Bucket::MAX_USAGE) {
+                node->entries[node->usage ++] = pair;
+                this->bufMgr->unPinPage(this->file, curPageNo, true);
+                return;
+            }
+            if(node->overflowPageNo == 0) {
+                Page* overflowPage;
+                this->bufMgr->allocPage(this->file, node->overflowPageNo, overflowPage);
+                Bucket* overflow = (Bucket*)overflowPage;
+                overflow->localDepth = node->localDepth;
+                overflow->usage = 1;
+                overflow->overflowPageNo = 0;
+                overflow->entries[0] = pair;
+                this->bufMgr->unPinPage(this->file, node->overflowPageNo, true);
+                this->bufMgr->unPinPage(this->file, curPageNo, true);
+                return;
+            }
+            const PageId nextPageNo = node->overflowPageNo;
+            this->bufMgr->unPinPage(this->file, curPageNo, false);
+            curPageNo = nextPageNo;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Deletion functions
+// -----------------------------------------------------------------------------
+const bool HashIndex::deleteEntry(const void *key)
+{
+    return this->index->deleteEntry(key);
+}
+
+template<class KeyTraits>
+const bool ExtendibleHash<KeyTraits>::deleteEntry(const void *key)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->deleteEntry(KeyTraits::key(value));
+}
+
+template<class KeyTraits>
+const bool ExtendibleHash<KeyTraits>::deleteEntry(Key key)
+{
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+
+    //The least record id of the key, in any bucket it may hash to
+    std::uint64_t hashes[3];
+    const int n = KeyTraits::hashes(key, hashes);
+    std::vector<PageId> buckets;
+    PageId bestPageNo = 0;
+    int bestIndex = 0;
+    RecordId bestRid;
+    for(int h = 0; h < n; h ++) {
+        const PageId bucketPageNo = this->bucketOf(this->slotOf(hashes[h]));
+        if(std::find(buckets.begin(), buckets.end(), bucketPageNo) != buckets.end()) {
+            continue;
+        }
+        buckets.push_back(bucketPageNo);
+        PageId curPageNo = bucketPageNo;
+        while(curPageNo != 0) {
+            Page* page = NULL;
+            this->bufMgr->readPage(this->file, curPageNo, page);
+            const Bucket* node = (const Bucket*)page;
+            for(int i = 0; i < node->usage; i ++) {
+                if(KeyTraits::equals(keyOf(node->entries[i]), key)
+                        && (bestPageNo == 0 || ridLess(node->entries[i].rid, bestRid))) {
+                    bestPageNo = curPageNo;
+                    bestIndex = i;
+                    bestRid = node->entries[i].rid;
+                }
+            }
+            const PageId nextPageNo = node->overflowPageNo;
+            this->bufMgr->unPinPage(this->file, curPageNo, false);
+            curPageNo = nextPageNo;
+        }
+    }
+    if(bestPageNo == 0) {
+        return false;
+    }
+
+    //The last entry of the page takes its place
+    Page* page = NULL;
+    this->bufMgr->readPage(this->file, bestPageNo, page);
+    Bucket* node = (Bucket*)page;
+    node->entries[bestIndex] = node->entries[-- node->usage];
+    this->bufMgr->unPinPage(this->file, bestPageNo, true);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Lookup functions
+// -----------------------------------------------------------------------------
+const std::size_t HashIndex::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    return this->index->lookup(key, outRids);
+}
+
+template<class KeyTraits>
+const std::size_t ExtendibleHash<KeyTraits>::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->lookup(KeyTraits::key(value), outRids);
+}
+
+template<class KeyTraits>
+const std::size_t ExtendibleHash<KeyTraits>::lookup(Key key, std::vector<RecordId>& outRids)
+{
+    SharedLatchGuard shared(this->treeLatch);
+
+    std::uint64_t hashes[3];
+    const int n = KeyTraits::hashes(key, hashes);
+    std::vector<PageId> buckets;
+    const size_t first = outRids.size();
+    for(int h = 0; h < n; h ++) {
+        const PageId bucketPageNo = this->bucketOf(this->slotOf(hashes[h]));
+        if(std::find(buckets.begin(), buckets.end(), bucketPageNo) != buckets.end()) {
+            continue;
+        }
+        buckets.push_back(bucketPageNo);
+        PageId curPageNo = bucketPageNo;
+        while(curPageNo != 0) {
+            Page* page = NULL;
+            this->bufMgr->readPage(this->file, curPageNo, page);
+            const Bucket* node = (const Bucket*)page;
+            for(int i = 0; i < node->usage; i ++) {
+                if(KeyTraits::equals(keyOf(node->entries[i]), key)) {
+                    outRids.push_back(node->entries[i].rid);
+                }
+            }
+            const PageId nextPageNo = node->overflowPageNo;
+            this->bufMgr->unPinPage(this->file, curPageNo, false);
+            curPageNo = nextPageNo;
+        }
+    }
+    std::sort(outRids.begin() + first, outRids.end(), ridLess);
+    return outRids.size() - first;
+}
+
+const int HashIndex::globalDepth()
+{
+    return this->index->globalDepth();
+}
+
+template<class KeyTraits>
+const int ExtendibleHash<KeyTraits>::globalDepth()
+{
+    SharedLatchGuard shared(this->treeLatch);
+    return this->depth;
+}
+
+// -----------------------------------------------------------------------------
+// Validation functions
+// -----------------------------------------------------------------------------
+const bool HashIndex::validate(bool showInfo)
+{
+    return this->index->validate(showInfo);
+}
+
+template<class KeyTraits>
+const bool ExtendibleHash<KeyTraits>::validate(bool showInfo)
+{
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+
+    //Slots pointing to each bucket, and the first of them
+    std::map<PageId, std::pair<std::uint32_t, std::uint32_t> > buckets;
+    const std::uint32_t slots = (std::uint32_t)1 << this->depth;
+    for(std::uint32_t slot = 0; slot < slots; slot ++) {
+        const PageId pageNo = this->bucketOf(slot);
+        if(buckets.count(pageNo) == 0) {
+            buckets[pageNo] = std::make_pair(slot, 0u);
+        }
+        buckets[pageNo].second ++;
+    }
+
+    bool valid = true;
+    std::size_t entries = 0, overflowPages = 0;
+    for(std::map<PageId, std::pair<std::uint32_t, std::uint32_t> >::const_iterator it = buckets.begin();
+            valid && it != buckets.end(); ++ it) {
+        std::vector<Pair> chain;
+        std::vector<PageId> pages;
+        int localDepth = -1;
+        this->readChain(it->first, chain, pages, localDepth);
+        valid = localDepth >= 0 && localDepth <= this->depth
+            && it->second.second == (std::uint32_t)1 << (this->depth - localDepth);
+        const std::uint64_t mask = ((std::uint64_t)1 << localDepth) - 1;
+        for(size_t i = 0; valid && i < chain.size(); i ++) {
+            valid = (KeyTraits::hash(keyOf(chain[i])) & mask) == (it->second.first & mask);
+        }
+        entries += chain.size();
+        overflowPages += pages.size() - 1;
+    }
+    if(showInfo) {
+        std::cout << "Extendible hash of global depth " << this->depth << ", " << buckets.size() << " buckets, "
+            << overflowPages << " overflow pages, " << entries << " entries: " << (valid ? "valid" : "invalid") << "\n";
+    }
+    return valid;
+}
+
+template class ExtendibleHash<IntKeyTraits>;
+template class ExtendibleHash<DoubleKeyTraits>;
+template class ExtendibleHash<StringKeyTraits>;
+
+}
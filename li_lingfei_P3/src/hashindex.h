@@ -0,0 +1,324 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "latch.h"
+#include "btree.h"
+
+/**
+ * Extendible hash index: an index for equality lookups only, with the entries and the
+ * constructor of BTreeIndex. A key's hash picks a slot of the directory, and the slot
+ * the bucket page that holds the key's entries, so a lookup reads one directory page and
+ * one bucket page however many entries the index has.
+ *
+ * The directory has 2 to the global depth slots, indexed by that many low bits of the
+ * hash. A bucket of local depth d holds the entries whose hashes end in its d bits, and
+ * the 2 to the (global depth - d) slots that end in them point to it. A full bucket is
+ * split in two on its next bit, and only its entries move; the directory doubles, by
+ * copying its slots, when the bucket's depth reaches the global depth. Entries whose
+ * hashes no split can tell apart, such as the record ids of one key, go on a chain of
+ * overflow pages behind the bucket.
+ */
+
+namespace badgerdb
+{
+
+/**
+ * @brief Page of the directory: bucket page numbers of consecutive slots.
+ */
+struct HashDirectoryPage {
+	static const int SLOTS = Page::SIZE / sizeof(PageId);
+
+	PageId buckets[SLOTS];
+};
+
+/**
+ * @brief Bucket page, or overflow page of a bucket: entries in no particular order.
+ */
+template<class Value>
+struct HashBucketPage {
+	static const int MAX_USAGE = (Page::SIZE - 3 * sizeof(int)) / sizeof(RIDKeyPair<Value>);
+
+  /**
+   * Number of low hash bits all the entries share. Set on the bucket page only
+   */
+	int localDepth;
+
+	int usage;
+
+  /**
+   * Next overflow page, 0 if none
+   */
+	PageId overflowPageNo;
+
+	RIDKeyPair<Value> entries[MAX_USAGE];
+};
+
+/**
+ * @brief Meta page of a hash index, with the pages of its directory.
+ */
+struct HashMetaInfo {
+	static const int MAX_DIRECTORY_PAGES = (Page::SIZE - 20 - 4 * sizeof(int)) / sizeof(PageId);
+
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset and type of the attribute over which the index is built.
+   */
+	int attrByteOffset;
+	Datatype attrType;
+
+  /**
+   * Number of hash bits that index the directory, and number of its pages.
+   */
+	int globalDepth;
+	std::uint32_t directoryPages;
+
+	PageId directory[MAX_DIRECTORY_PAGES];
+};
+
+
+/**
+ * @brief Type erased interface of an extendible hash index, through which HashIndex
+ * reaches the one instantiated for its key type. Keys are passed as pointers to an
+ * integer, a double or a char string.
+ */
+class HashCore {
+ public:
+	virtual ~HashCore() { }
+
+	virtual const void createIndexFromRelation(const std::string& relationName) = 0;
+	virtual const void insertEntry(const void* key, const RecordId rid) = 0;
+	virtual const bool deleteEntry(const void* key) = 0;
+	virtual const std::size_t lookup(const void* key, std::vector<RecordId>& outRids) = 0;
+	virtual const int globalDepth() = 0;
+	virtual const bool validate(bool showInfo) = 0;
+};
+
+
+/**
+ * @brief Extendible hash index on one key type, hashed and compared as the BTree of the
+ * same KeyTraits. Instantiated in hashindex.cpp for IntKeyTraits, DoubleKeyTraits and
+ * StringKeyTraits.
+ *
+ * A key is entered under KeyTraits::hash, and looked up under each of KeyTraits::hashes,
+ * so a double finds the keys within DOUBLEEPSILON of it in the buckets of its interval
+ * and of the two next to it. Inserts and deletes hold treeLatch exclusive, and lookups
+ * hold it shared.
+ */
+template<class KeyTraits>
+class ExtendibleHash : public HashCore {
+
+ public:
+	typedef typename KeyTraits::Key Key;
+	typedef typename KeyTraits::Value Value;
+	typedef RIDKeyPair<Value> Pair;
+	typedef HashBucketPage<Value> Bucket;
+
+  /**
+   * Most hash bits the directory is indexed by.
+   */
+	static const int MAX_DEPTH = 20;
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * Global depth and the directory's pages, as on the meta page.
+   */
+	int	depth;
+	std::vector<PageId>	directoryPages;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+	int	attrByteOffset;
+
+  /**
+   * Held exclusive by inserts and deletes, and shared by lookups.
+   */
+	RWLatch	treeLatch;
+
+    static Key keyOf(const Pair& pair) {
+        return KeyTraits::key(const_cast<Value&>(pair.key));
+    }
+
+    /**
+     * Directory slot of a hash at the global depth
+     * */
+    std::uint32_t slotOf(const std::uint64_t hash) const {
+        return (std::uint32_t)(hash & (((std::uint64_t)1 << this->depth) - 1));
+    }
+
+    /**
+     * Bucket page that directory slot points to
+     * */
+    PageId bucketOf(const std::uint32_t slot);
+
+    /**
+     * Points directory slot to bucket page pageNo
+     * */
+    const void setBucket(const std::uint32_t slot, const PageId pageNo);
+
+    /**
+     * Doubles the directory, each new slot pointing where its twin below does
+     * */
+    const void growDirectory();
+
+    /**
+     * Writes the global depth and the directory's pages to the meta page
+     * */
+    const void writeMeta();
+
+    /**
+     * Reads the entries of a bucket and of its overflow pages, their page numbers and
+     * the bucket's local depth
+     * */
+    const void readChain(const PageId pageNo, std::vector<Pair>& entries, std::vector<PageId>& pages, int& localDepth);
+
+    /**
+     * Writes entries to bucket page pageNo and as many overflow pages as they need,
+     * reusing those in pages past the first before allocating more, and disposing of
+     * the ones left over
+     * */
+    const void writeChain(const PageId pageNo, const int localDepth, const std::vector<Pair>& entries,
+        const std::vector<PageId>& pages);
+
+    /**
+     * Splits the bucket of a directory slot in two on its next hash bit, doubling the
+     * directory first if need be. Returns false, changing nothing, if no split can
+     * separate its entries and the new one of the given hash
+     * */
+    const bool split(const std::uint32_t slot, const std::uint64_t hash);
+
+ public:
+
+  /**
+   * Opens the index file of indexName, or creates it and inserts an entry for every
+   * record of relationName.
+   */
+	ExtendibleHash(const std::string& relationName, const std::string& indexName,
+						BufMgr* bufMgrIn, const int attrByteOffset);
+
+	~ExtendibleHash();
+
+	const void createIndexFromRelation(const std::string& relationName);
+
+	const void insertEntry(Key key, const RecordId rid);
+	const bool deleteEntry(Key key);
+	const std::size_t lookup(Key key, std::vector<RecordId>& outRids);
+
+	/* Type erased operations */
+	const void insertEntry(const void* key, const RecordId rid);
+	const bool deleteEntry(const void* key);
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+	const int globalDepth();
+	const bool validate(bool showInfo);
+};
+
+
+/**
+ * @brief Equality only alternative to BTreeIndex, with the same constructor, inserts,
+ * deletes and lookups but no range scans. A lookup reads a directory page and a bucket
+ * page, and more only for a key with more record ids than a page holds. Buckets emptied
+ * by deletes are kept, not merged.
+ */
+class HashIndex {
+
+ private:
+
+  /**
+   * Index on the attribute's key type.
+   */
+	HashCore	*index;
+
+ public:
+
+	/**
+   * HashIndex Constructor.
+	 * Open the index file if it exists. If not, create it and insert an entry for every
+	 * tuple in the base relation.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file: that of the BTreeIndex on the attribute, with ".hash" added.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built
+   */
+	HashIndex(const std::string& relationName, std::string& outIndexName,
+						BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType);
+
+	/**
+   * HashIndex Destructor.
+	 * Save the directory to the meta page and flush the index file.
+	 * */
+	~HashIndex();
+
+    /**
+	 * Insert a new entry using the pair <value,rid>, splitting its bucket if it is full.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	**/
+	const void insertEntry(const void* key, const RecordId rid);
+
+	/**
+	 * Delete the first record id of a key, in (page, slot) order, as BTreeIndex does.
+   * @param key			Key to delete, pointer to integer/double/char string
+	 * @return False if the key has no record id.
+	**/
+	const bool deleteEntry(const void* key);
+
+	/**
+	 * Find every entry of the given key, as BTreeIndex::lookup.
+   * @param key			Key to look up, pointer to integer/double/char string
+   * @param outRids	The record ids of the key are appended to this, in (page, slot) order
+	 * @return Number of record ids appended, 0 if the key is not in the index.
+	**/
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+
+	/**
+	 * Number of hash bits the directory is indexed by.
+	**/
+	const int globalDepth();
+
+	/**
+	 * Check that every directory slot points to a bucket whose depth is at most the
+	 * global depth, whose entries' hashes end in the slot's bits, and which the right
+	 * number of slots point to.
+   * @param showInfo	Print the result
+	 * @return True if the index is valid.
+	**/
+	const bool validate(bool showInfo);
+};
+
+}
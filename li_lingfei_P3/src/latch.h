@@ -0,0 +1,108 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace badgerdb {
+
+/**
+* @brief Reader-writer latch on a single atomic word. Any number of threads can
+* hold it shared, or one thread exclusive. A writer that is kept waiting stops
+* new readers from coming in, so a steady stream of readers cannot starve it.
+* Latches are held briefly, so waiting threads yield rather than sleep.
+*
+* lock() and unlock() make it usable with std::lock_guard.
+*/
+class RWLatch
+{
+ public:
+  RWLatch() : state(0) {}
+
+  /**
+   * Takes the latch shared
+   */
+  void lockShared()
+  {
+    while (true)
+    {
+      std::uint32_t s = state.load(std::memory_order_relaxed);
+      if ((s & (WRITER | WRITER_WAITING)) == 0
+          && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+        return;
+      std::this_thread::yield();
+    }
+  }
+
+  void unlockShared()
+  {
+    state.fetch_sub(1, std::memory_order_release);
+  }
+
+  /**
+   * Takes the latch exclusive
+   */
+  void lock()
+  {
+    while (true)
+    {
+      std::uint32_t s = state.load(std::memory_order_relaxed);
+      if ((s & ~WRITER_WAITING) == 0)
+      {
+        if (state.compare_exchange_weak(s, WRITER, std::memory_order_acquire))
+          return;
+      }
+      else if ((s & WRITER_WAITING) == 0)
+      {
+        state.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void unlock()
+  {
+    state.fetch_and(~WRITER, std::memory_order_release);
+  }
+
+ private:
+  /**
+   * Set while a thread holds the latch exclusive
+   */
+  static const std::uint32_t WRITER = 1u << 31;
+
+  /**
+   * Set while a thread waits to take the latch exclusive
+   */
+  static const std::uint32_t WRITER_WAITING = 1u << 30;
+
+  /**
+   * WRITER and WRITER_WAITING bits, and the number of shared holders below them
+   */
+  std::atomic<std::uint32_t> state;
+};
+
+/**
+* @brief Holds an RWLatch shared for the lifetime of the guard
+*/
+class SharedLatchGuard
+{
+ public:
+  explicit SharedLatchGuard(RWLatch& latchIn) : latch(latchIn) { latch.lockShared(); }
+  ~SharedLatchGuard() { latch.unlockShared(); }
+
+ private:
+  RWLatch& latch;
+
+  SharedLatchGuard(const SharedLatchGuard&);
+  SharedLatchGuard& operator=(const SharedLatchGuard&);
+};
+
+}
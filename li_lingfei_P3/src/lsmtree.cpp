@@ -0,0 +1,1060 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "lsmtree.h"
+#include "filescan.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace badgerdb
+{
+
+static_assert(sizeof(LsmMetaInfo) <= Page::SIZE, "the manifest fits a page");
+static_assert(sizeof(LsmRunHeader) <= Page::SIZE, "a run header fits a page");
+static_assert(sizeof(LsmRunPage<StringKeyValue>) <= Page::SIZE, "a string run page fits a page");
+static_assert(sizeof(LsmFencePage<StringKeyValue>) <= Page::SIZE, "a string fence page fits a page");
+
+//Run runId of the index whose manifest is indexName
+static std::string runFileName(const std::string& indexName, const std::int32_t runId)
+{
+    std::ostringstream runStr;
+    runStr<<indexName<<"."<<runId;
+    return runStr.str();
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::LSMIndex -- Constructor
+// -----------------------------------------------------------------------------
+LSMIndex::LSMIndex(const std::string & relationName,
+		std::string & outIndexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset,
+		const Datatype attrType,
+		const std::size_t memtableEntries)
+{
+    std::ostringstream idxStr;
+    idxStr<<relationName<<"."<<attrByteOffset<<".lsm";
+    outIndexName = idxStr.str();
+
+    if(attrType == INTEGER) {
+        this->tree = new LSMTree<IntKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset, memtableEntries);
+    } else if(attrType == DOUBLE) {
+        this->tree = new LSMTree<DoubleKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset, memtableEntries);
+    } else {
+        this->tree = new LSMTree<StringKeyTraits>(relationName, outIndexName, bufMgrIn, attrByteOffset, memtableEntries);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// LSMTree::LSMTree -- Constructor
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+LSMTree<KeyTraits>::LSMTree(const std::string & relationName,
+		const std::string & indexName,
+		BufMgr *bufMgrIn,
+		const int attrByteOffset,
+		const std::size_t memtableEntries)
+    : indexName(indexName), memtable(pairLess), nextRunId(0), level0Runs(0),
+      compactRequested(false), compacting(false), stopping(false), compactFailed(false)
+{
+    this->bufMgr = bufMgrIn;
+    this->attrByteOffset = attrByteOffset;
+    this->memtableEntries = std::max((std::size_t)1, memtableEntries);
+    this->scanExecuting = false;
+    this->headerPageNum = 1;
+    this->levels.resize(1);
+
+    if(File::exists(indexName)) {
+        this->file = new BlobFile(indexName, false);
+
+        Page* metaInfoPage = NULL;
+        this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+        const LsmMetaInfo* meta = (const LsmMetaInfo*)metaInfoPage;
+        this->nextRunId = meta->nextRunId;
+        std::vector<LsmRunInfo> runs(meta->runs, meta->runs + meta->runCount);
+        this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+        //Listed newest first; each level keeps its runs oldest first
+        for(size_t i = runs.size(); i -- > 0; ) {
+            if(this->levels.size() <= (size_t)runs[i].level) {
+                this->levels.resize(runs[i].level + 1);
+            }
+            this->levels[runs[i].level].push_back(this->openRun(runs[i].runId));
+        }
+        this->level0Runs = this->levels[0].size();
+        this->compactRequested = true;
+        this->compactor = std::thread(&LSMTree::compactLoop, this);
+        return;
+    }
+
+    this->file = new BlobFile(indexName, true);
+
+    Page* metaInfoPage = NULL;
+    this->bufMgr->allocPage(this->file, this->headerPageNum, metaInfoPage);
+    LsmMetaInfo* meta = (LsmMetaInfo*)metaInfoPage;
+    memset(meta, 0, sizeof(LsmMetaInfo));
+    strncpy(meta->relationName, relationName.c_str(), sizeof(meta->relationName) - 1);
+    meta->attrByteOffset = attrByteOffset;
+    meta->attrType = KeyTraits::TYPE;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+    //Runs written while the relation is read are merged as they come
+    this->compactor = std::thread(&LSMTree::compactLoop, this);
+    this->createIndexFromRelation(relationName);
+}
+
+//Reads the relation and inserts all <key, rid> pairs
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::createIndexFromRelation(const std::string& relationName)
+{
+    FileScan fscan(relationName, this->bufMgr, BufAccessStrategy::DEFAULT_RING_SIZE);
+    try {
+        RecordId scanRid;
+        while(1) {
+            fscan.scanNext(scanRid);
+            Value key;
+            KeyTraits::load(key, fscan.getRecordView().data + this->attrByteOffset);
+            this->insertEntry(KeyTraits::key(key), scanRid);
+        }
+    } catch(const EndOfFileException&) {
+    }
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::~LSMIndex -- destructor
+// -----------------------------------------------------------------------------
+LSMIndex::~LSMIndex()
+{
+    delete this->tree;
+}
+
+template<class KeyTraits>
+LSMTree<KeyTraits>::~LSMTree()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->compactMutex);
+        this->stopping = true;
+    }
+    this->compactWake.notify_all();
+    this->compactor.join();
+
+    this->scanExecuting = false;
+    this->scanMerge.sources.clear();
+    this->scanMerge.heap.clear();
+
+    this->flushMemtableLocked();
+    this->writeManifest();
+    this->levels.clear();
+
+    this->bufMgr->flushFile(this->file);
+    delete this->file;
+}
+
+template<class KeyTraits>
+LSMTree<KeyTraits>::Run::~Run()
+{
+    if(this->file == NULL) {
+        return;
+    }
+    const std::string name = this->file->filename();
+    this->bufMgr->flushFile(this->file);
+    delete this->file;
+    if(this->obsolete) {
+        File::remove(name);
+    }
+}
+
+const void LSMIndex::remove(const std::string& indexName, BufMgr* bufMgrIn)
+{
+    if(File::isOpen(indexName)) {
+        throw FileOpenException(indexName);
+    }
+
+    std::vector<LsmRunInfo> runs;
+    {
+        BlobFile file(indexName, false);
+        Page* metaInfoPage = NULL;
+        bufMgrIn->readPage(&file, 1, metaInfoPage);
+        const LsmMetaInfo* meta = (const LsmMetaInfo*)metaInfoPage;
+        runs.assign(meta->runs, meta->runs + meta->runCount);
+        bufMgrIn->unPinPage(&file, 1, false);
+        bufMgrIn->flushFile(&file);
+    }
+    for(size_t i = 0; i < runs.size(); i ++) {
+        const std::string name = runFileName(indexName, runs[i].runId);
+        if(File::exists(name)) {
+            File::remove(name);
+        }
+    }
+    File::remove(indexName);
+}
+
+// -----------------------------------------------------------------------------
+// Runs
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+bool LSMTree<KeyTraits>::pairLess(const Pair& lhs, const Pair& rhs)
+{
+    if(KeyTraits::less(keyOf(lhs), keyOf(rhs))) {
+        return true;
+    }
+    if(KeyTraits::less(keyOf(rhs), keyOf(lhs))) {
+        return false;
+    }
+    if(lhs.rid.page_number != rhs.rid.page_number) {
+        return lhs.rid.page_number < rhs.rid.page_number;
+    }
+    return lhs.rid.slot_number < rhs.rid.slot_number;
+}
+
+template<class KeyTraits>
+typename LSMTree<KeyTraits>::RunPtr LSMTree<KeyTraits>::openRun(const std::int32_t runId)
+{
+    RunPtr run(new Run());
+    run->bufMgr = this->bufMgr;
+    run->runId = runId;
+    run->file = new BlobFile(runFileName(this->indexName, runId), false);
+
+    Page* page = NULL;
+    this->bufMgr->readPage(run->file, 1, page);
+    const LsmRunHeader header = *(const LsmRunHeader*)page;
+    this->bufMgr->unPinPage(run->file, 1, false);
+    run->entries = header.entries;
+    run->firstDataPageNo = header.firstDataPageNo;
+    run->dataPages = header.dataPages;
+
+    PageId pageNo = header.fencePageNo;
+    while(pageNo != 0) {
+        this->bufMgr->readPage(run->file, pageNo, page);
+        const FencePage* node = (const FencePage*)page;
+        run->fences.insert(run->fences.end(), node->fences, node->fences + node->usage);
+        const PageId nextPageNo = node->nextPageNo;
+        this->bufMgr->unPinPage(run->file, pageNo, false);
+        pageNo = nextPageNo;
+    }
+
+    run->filter.reset(header.bloomPages, header.bloomHashes);
+    pageNo = header.bloomPageNo;
+    for(std::uint32_t i = 0; i < header.bloomPages; i ++) {
+        this->bufMgr->readPage(run->file, pageNo, page);
+        run->filter.load(i, (const BloomPage*)page);
+        const PageId nextPageNo = ((const BloomPage*)page)->nextPageNo;
+        this->bufMgr->unPinPage(run->file, pageNo, false);
+        pageNo = nextPageNo;
+    }
+    return run;
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::writerOpen(RunWriter& writer)
+{
+    writer.run.reset(new Run());
+    writer.run->bufMgr = this->bufMgr;
+    writer.run->runId = this->nextRunId ++;
+    writer.run->file = new BlobFile(runFileName(this->indexName, writer.run->runId), true);
+    writer.page = NULL;
+    writer.pageNo = 0;
+    writer.hashes.clear();
+
+    //The header is page 1, filled in last
+    PageId headerPageNo;
+    Page* headerPage;
+    this->bufMgr->allocPage(writer.run->file, headerPageNo, headerPage);
+    this->bufMgr->unPinPage(writer.run->file, headerPageNo, true);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::writerAdd(RunWriter& writer, const Entry& entry)
+{
+    Run* run = writer.run.get();
+    RunPage* node = (RunPage*)writer.page;
+    if(node == NULL || node->usage == RunPage::MAX_USAGE) {
+        //A new file hands out its pages in order, so the data pages are consecutive
+        if(node != NULL) {
+            this->bufMgr->unPinPage(run->file, writer.pageNo, true);
+        }
+        this->bufMgr->allocPage(run->file, writer.pageNo, writer.page);
+        if(run->dataPages == 0) {
+            run->firstDataPageNo = writer.pageNo;
+        }
+        run->dataPages ++;
+        node = (RunPage*)writer.page;
+        node->usage = 0;
+        run->fences.push_back(entry.pair);
+    }
+    node->entries[node->usage ++] = entry;
+    run->entries ++;
+
+    //Tombstones too, or a probe could skip the run and find the entry they delete
+    std::uint64_t hashes[3];
+    const int n = KeyTraits::hashes(keyOf(entry.pair), hashes);
+    writer.hashes.insert(writer.hashes.end(), hashes, hashes + n);
+}
+
+template<class KeyTraits>
+typename LSMTree<KeyTraits>::RunPtr LSMTree<KeyTraits>::writerClose(RunWriter& writer)
+{
+    Run* run = writer.run.get();
+    if(writer.page != NULL) {
+        this->bufMgr->unPinPage(run->file, writer.pageNo, true);
+        writer.page = NULL;
+    }
+
+    LsmRunHeader header;
+    memset(&header, 0, sizeof(header));
+    header.entries = run->entries;
+    header.firstDataPageNo = run->firstDataPageNo;
+    header.dataPages = run->dataPages;
+
+    //Fences, then the Bloom filter, each a chain of pages
+    PageId prevPageNo = 0;
+    Page* prevPage = NULL;
+    for(size_t start = 0; start < run->fences.size(); start += FencePage::MAX_USAGE) {
+        PageId pageNo;
+        Page* page;
+        this->bufMgr->allocPage(run->file, pageNo, page);
+        FencePage* node = (FencePage*)page;
+        node->nextPageNo = 0;
+        node->usage = std::min(run->fences.size() - start, (size_t)FencePage::MAX_USAGE);
+        std::copy(run->fences.begin() + start, run->fences.begin() + start + node->usage, node->fences);
+        if(prevPage == NULL) {
+            header.fencePageNo = pageNo;
+        } else {
+            ((FencePage*)prevPage)->nextPageNo = pageNo;
+            this->bufMgr->unPinPage(run->file, prevPageNo, true);
+        }
+        prevPageNo = pageNo;
+        prevPage = page;
+    }
+    if(prevPage != NULL) {
+        this->bufMgr->unPinPage(run->file, prevPageNo, true);
+    }
+
+    run->filter.reset(BloomFilter::pagesFor(run->entries, BLOOM_BITS_PER_KEY), BloomFilter::hashesFor(BLOOM_BITS_PER_KEY));
+    for(size_t i = 0; i < writer.hashes.size(); i ++) {
+        run->filter.add(writer.hashes[i]);
+    }
+    std::vector<std::uint64_t>().swap(writer.hashes);
+    header.bloomPages = run->filter.pageCount();
+    header.bloomHashes = run->filter.hashCount();
+    prevPage = NULL;
+    for(std::uint32_t i = 0; i < header.bloomPages; i ++) {
+        PageId pageNo;
+        Page* page;
+        this->bufMgr->allocPage(run->file, pageNo, page);
+        run->filter.store(i, (BloomPage*)page);
+        ((BloomPage*)page)->nextPageNo = 0;
+        if(prevPage == NULL) {
+            header.bloomPageNo = pageNo;
+        } else {
+            ((BloomPage*)prevPage)->nextPageNo = pageNo;
+            this->bufMgr->unPinPage(run->file, prevPageNo, true);
+        }
+        prevPageNo = pageNo;
+        prevPage = page;
+    }
+    if(prevPage != NULL) {
+        this->bufMgr->unPinPage(run->file, prevPageNo, true);
+    }
+
+    Page* headerPage = NULL;
+    this->bufMgr->readPage(run->file, 1, headerPage);
+    *(LsmRunHeader*)headerPage = header;
+    this->bufMgr->unPinPage(run->file, 1, true);
+
+    RunPtr done = writer.run;
+    writer.run.reset();
+    return done;
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::writeManifest()
+{
+    std::size_t runCount = 0;
+    for(size_t level = 0; level < this->levels.size(); level ++) {
+        runCount += this->levels[level].size();
+    }
+    if(runCount > (size_t)LsmMetaInfo::MAX_RUNS) {
+        throw InsufficientSpaceException(this->headerPageNum, runCount * sizeof(LsmRunInfo),
+            LsmMetaInfo::MAX_RUNS * sizeof(LsmRunInfo));
+    }
+
+    Page* metaInfoPage = NULL;
+    this->bufMgr->readPage(this->file, this->headerPageNum, metaInfoPage);
+    LsmMetaInfo* meta = (LsmMetaInfo*)metaInfoPage;
+    meta->nextRunId = this->nextRunId;
+    meta->runCount = 0;
+    for(size_t level = 0; level < this->levels.size(); level ++) {
+        for(size_t i = this->levels[level].size(); i -- > 0; ) {
+            meta->runs[meta->runCount].runId = this->levels[level][i]->runId;
+            meta->runs[meta->runCount].level = level;
+            meta->runCount ++;
+        }
+    }
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// Insertion functions
+// -----------------------------------------------------------------------------
+const void LSMIndex::insertEntry(const void *key, const RecordId rid)
+{
+    this->tree->insertEntry(key, rid);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::insertEntry(const void *key, const RecordId rid)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    this->insertEntry(KeyTraits::key(value), rid);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::insertEntry(Key key, const RecordId rid)
+{
+    Pair pair;
+    KeyTraits::assign(pair.key, key);
+    pair.rid = rid;
+
+    this->stallWrites();
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    this->memtable[pair] = LSM_INSERT;
+    if(this->memtable.size() >= this->memtableEntries) {
+        this->flushMemtableLocked();
+    }
+}
+
+const void LSMIndex::flushMemtable()
+{
+    this->tree->flushMemtable();
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::flushMemtable()
+{
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+    this->flushMemtableLocked();
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::flushMemtableLocked()
+{
+    if(this->memtable.empty()) {
+        return;
+    }
+    RunWriter writer;
+    this->writerOpen(writer);
+    for(typename std::map<Pair, int, bool(*)(const Pair&, const Pair&)>::const_iterator it = this->memtable.begin();
+            it != this->memtable.end(); ++ it) {
+        Entry entry;
+        entry.pair = it->first;
+        entry.op = it->second;
+        this->writerAdd(writer, entry);
+    }
+    this->levels[0].push_back(this->writerClose(writer));
+    this->level0Runs = this->levels[0].size();
+    this->memtable.clear();
+    this->writeManifest();
+
+    {
+        std::lock_guard<std::mutex> lock(this->compactMutex);
+        this->compactRequested = true;
+    }
+    this->compactWake.notify_one();
+}
+
+// -----------------------------------------------------------------------------
+// Merging
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::snapshot(Merge& merge, Key low, Key high, const bool equal)
+{
+    merge.sources.clear();
+    merge.heap.clear();
+
+    //The memtable is the newest source
+    Source memory;
+    memory.nextPage = 0;
+    memory.pos = 0;
+    Pair lowPair;
+    KeyTraits::assign(lowPair.key, low);
+    lowPair.rid.page_number = 0;
+    lowPair.rid.slot_number = 0;
+    for(typename std::map<Pair, int, bool(*)(const Pair&, const Pair&)>::const_iterator it = this->memtable.lower_bound(lowPair);
+            it != this->memtable.end() && !KeyTraits::less(high, keyOf(it->first)); ++ it) {
+        Entry entry;
+        entry.pair = it->first;
+        entry.op = it->second;
+        memory.entries.push_back(entry);
+    }
+    merge.sources.push_back(memory);
+
+    //Then level 0 from its newest run, and the levels below
+    const std::uint64_t hash = KeyTraits::hash(low);
+    for(size_t level = 0; level < this->levels.size(); level ++) {
+        for(size_t i = this->levels[level].size(); i -- > 0; ) {
+            const RunPtr& run = this->levels[level][i];
+            if(equal && !run->filter.mayContain(hash)) {
+                continue;
+            }
+            Source source;
+            source.run = run;
+            source.nextPage = 0;
+            source.pos = 0;
+            merge.sources.push_back(source);
+        }
+    }
+}
+
+template<class KeyTraits>
+bool LSMTree<KeyTraits>::heapLater(const Merge& merge, const int a, const int b)
+{
+    const Source& sa = merge.sources[a];
+    const Source& sb = merge.sources[b];
+    const Pair& pa = sa.entries[sa.pos].pair;
+    const Pair& pb = sb.entries[sb.pos].pair;
+    if(pairLess(pb, pa)) {
+        return true;
+    }
+    return !pairLess(pa, pb) && a > b;
+}
+
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::sourceFill(Source& source)
+{
+    source.entries.clear();
+    source.pos = 0;
+    if(!source.run || source.nextPage >= source.run->dataPages) {
+        return false;
+    }
+    const PageId pageNo = source.run->firstDataPageNo + source.nextPage ++;
+    Page* page = NULL;
+    this->bufMgr->readPage(source.run->file, pageNo, page);
+    const RunPage* node = (const RunPage*)page;
+    source.entries.assign(node->entries, node->entries + node->usage);
+    this->bufMgr->unPinPage(source.run->file, pageNo, false);
+    return true;
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::mergeOpen(Merge& merge, const Pair* target)
+{
+    merge.heap.clear();
+    for(size_t s = 0; s < merge.sources.size(); s ++) {
+        Source& source = merge.sources[s];
+        if(source.run) {
+            //The fences give the one page the target can be on: the last that starts
+            //at or before it
+            source.nextPage = 0;
+            if(target != NULL) {
+                const std::vector<Pair>& fences = source.run->fences;
+                const size_t after = std::upper_bound(fences.begin(), fences.end(), *target, pairLess) - fences.begin();
+                source.nextPage = (after > 0) ? after - 1 : 0;
+            }
+            this->sourceFill(source);
+        }
+        if(target != NULL) {
+            source.pos = std::lower_bound(source.entries.begin(), source.entries.end(), *target,
+                [](const Entry& entry, const Pair& pair) { return pairLess(entry.pair, pair); }) - source.entries.begin();
+            if(source.pos == source.entries.size()) {
+                this->sourceFill(source);
+            }
+        }
+        if(source.pos < source.entries.size()) {
+            merge.heap.push_back(s);
+        }
+    }
+    std::make_heap(merge.heap.begin(), merge.heap.end(),
+        [&merge](const int a, const int b) { return heapLater(merge, a, b); });
+}
+
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::mergeNext(Merge& merge, Entry& out)
+{
+    if(merge.heap.empty()) {
+        return false;
+    }
+    auto later = [&merge](const int a, const int b) { return heapLater(merge, a, b); };
+
+    //The least pair, from the newest source that has it; older copies are dropped
+    bool first = true;
+    while(!merge.heap.empty()) {
+        const Source& top = merge.sources[merge.heap.front()];
+        if(!first && pairLess(out.pair, top.entries[top.pos].pair)) {
+            break;
+        }
+        std::pop_heap(merge.heap.begin(), merge.heap.end(), later);
+        const int s = merge.heap.back();
+        merge.heap.pop_back();
+        Source& source = merge.sources[s];
+        if(first) {
+            out = source.entries[source.pos];
+            first = false;
+        }
+        source.pos ++;
+        if(source.pos < source.entries.size() || this->sourceFill(source)) {
+            merge.heap.push_back(s);
+            std::push_heap(merge.heap.begin(), merge.heap.end(), later);
+        }
+    }
+    return true;
+}
+
+template<class KeyTraits>
+const std::size_t LSMTree<KeyTraits>::collect(Merge& merge, Key key, std::vector<RecordId>& outRids, const std::size_t max)
+{
+    Pair target;
+    KeyTraits::assign(target.key, key);
+    target.rid.page_number = 0;
+    target.rid.slot_number = 0;
+    this->mergeOpen(merge, &target);
+
+    std::size_t found = 0;
+    Entry entry;
+    while(found < max && this->mergeNext(merge, entry)) {
+        if(!KeyTraits::equals(keyOf(entry.pair), key)) {
+            break;
+        }
+        if(entry.op == LSM_INSERT) {
+            outRids.push_back(entry.pair.rid);
+            found ++;
+        }
+    }
+    merge.sources.clear();
+    merge.heap.clear();
+    return found;
+}
+
+// -----------------------------------------------------------------------------
+// Compaction
+// -----------------------------------------------------------------------------
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::compactOnce()
+{
+    //Pick the first level over full, and take its runs and the next level's, newest first
+    std::vector<RunPtr> inputs;
+    size_t level, fromLevel = 0;
+    bool bottom = true;
+    {
+        SharedLatchGuard shared(this->treeLatch);
+        level = this->levels.size();
+        if(this->levels[0].size() >= (size_t)L0_RUNS) {
+            level = 0;
+        }
+        std::uint64_t capacity = this->memtableEntries;
+        for(size_t l = 1; level == this->levels.size() && l < this->levels.size(); l ++) {
+            capacity *= LEVEL_FANOUT;
+            if(!this->levels[l].empty() && this->levels[l][0]->entries > capacity) {
+                level = l;
+            }
+        }
+        if(level == this->levels.size()) {
+            return false;
+        }
+        inputs.assign(this->levels[level].rbegin(), this->levels[level].rend());
+        fromLevel = inputs.size();
+        if(level + 1 < this->levels.size()) {
+            inputs.insert(inputs.end(), this->levels[level + 1].begin(), this->levels[level + 1].end());
+        }
+        for(size_t l = level + 2; l < this->levels.size(); l ++) {
+            bottom = bottom && this->levels[l].empty();
+        }
+    }
+
+    //Only the bottom level can drop tombstones: nothing older is left for them to hide
+    Merge merge;
+    for(size_t i = 0; i < inputs.size(); i ++) {
+        Source source;
+        source.run = inputs[i];
+        source.nextPage = 0;
+        source.pos = 0;
+        merge.sources.push_back(source);
+    }
+    RunWriter writer;
+    RunPtr run;
+    try {
+        this->mergeOpen(merge, NULL);
+        this->writerOpen(writer);
+        Entry entry;
+        while(this->mergeNext(merge, entry)) {
+            if(bottom && entry.op == LSM_DELETE) {
+                continue;
+            }
+            this->writerAdd(writer, entry);
+        }
+        run = this->writerClose(writer);
+
+        //The new run is on disk before the manifest lists it
+        this->bufMgr->flushFile(run->file);
+    } catch(...) {
+        //The inputs stay listed; the run half written goes with its last reference
+        if(writer.run) {
+            if(writer.page != NULL) {
+                this->bufMgr->unPinPage(writer.run->file, writer.pageNo, true);
+            }
+            writer.run->obsolete = true;
+        }
+        if(run) {
+            run->obsolete = true;
+        }
+        throw;
+    }
+    merge.sources.clear();
+
+    {
+        std::lock_guard<RWLatch> exclusive(this->treeLatch);
+        //The runs taken from level 0 are its oldest; newer ones may have come since
+        this->levels[level].erase(this->levels[level].begin(), this->levels[level].begin() + fromLevel);
+        if(this->levels.size() < level + 2) {
+            this->levels.resize(level + 2);
+        }
+        this->levels[level + 1].clear();
+        if(run->entries > 0) {
+            this->levels[level + 1].push_back(run);
+        } else {
+            run->obsolete = true;
+        }
+        this->level0Runs = this->levels[0].size();
+
+        //The inputs are removed only once the manifest on disk no longer lists them
+        this->writeManifest();
+        this->bufMgr->flushFile(this->file);
+        for(size_t i = 0; i < inputs.size(); i ++) {
+            inputs[i]->obsolete = true;
+        }
+    }
+    return true;
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::compactLoop()
+{
+    std::unique_lock<std::mutex> lock(this->compactMutex);
+    while(!this->stopping) {
+        if(!this->compactRequested) {
+            this->compactWake.wait(lock);
+            continue;
+        }
+        this->compactRequested = false;
+        this->compacting = true;
+        lock.unlock();
+
+        //Merging one level may over fill the next, so go on until no level is. Writes
+        //stalled on level 0 are woken after each merge
+        bool more = true;
+        bool failed = false;
+        while(more) {
+            try {
+                more = this->compactOnce();
+            } catch(BadgerDbException& e) {
+                std::cerr << "LSM compaction failed: " << e.message() << std::endl;
+                more = false;
+                failed = true;
+            }
+            lock.lock();
+            more = more && !this->stopping;
+            this->compactIdle.notify_all();
+            lock.unlock();
+        }
+
+        lock.lock();
+        this->compactFailed = failed;
+        this->compacting = false;
+        this->compactIdle.notify_all();
+    }
+    this->compactIdle.notify_all();
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::stallWrites()
+{
+    if(this->level0Runs < (size_t)L0_STALL_RUNS) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(this->compactMutex);
+    this->compactIdle.wait(lock, [this]() {
+        return this->level0Runs < (size_t)L0_STALL_RUNS || this->compactFailed || this->stopping;
+    });
+}
+
+const void LSMIndex::waitForCompaction()
+{
+    this->tree->waitForCompaction();
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::waitForCompaction()
+{
+    std::unique_lock<std::mutex> lock(this->compactMutex);
+    this->compactIdle.wait(lock, [this]() {
+        return (!this->compactRequested && !this->compacting) || this->stopping;
+    });
+}
+
+const std::vector<std::size_t> LSMIndex::levelRuns()
+{
+    return this->tree->levelRuns();
+}
+
+template<class KeyTraits>
+const std::vector<std::size_t> LSMTree<KeyTraits>::levelRuns()
+{
+    SharedLatchGuard shared(this->treeLatch);
+    std::vector<std::size_t> runs;
+    for(size_t level = 0; level < this->levels.size(); level ++) {
+        runs.push_back(this->levels[level].size());
+    }
+    return runs;
+}
+
+// -----------------------------------------------------------------------------
+// Deletion functions
+// -----------------------------------------------------------------------------
+const bool LSMIndex::deleteEntry(const void *key)
+{
+    return this->tree->deleteEntry(key);
+}
+
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::deleteEntry(const void *key)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->deleteEntry(KeyTraits::key(value));
+}
+
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::deleteEntry(Key key)
+{
+    //Held throughout, so that two deletes of a key take different record ids
+    this->stallWrites();
+    std::lock_guard<RWLatch> exclusive(this->treeLatch);
+
+    Merge merge;
+    this->snapshot(merge, key, key, true);
+    std::vector<RecordId> rids;
+    if(this->collect(merge, key, rids, 1) == 0) {
+        return false;
+    }
+    Pair pair;
+    KeyTraits::assign(pair.key, key);
+    pair.rid = rids[0];
+    this->memtable[pair] = LSM_DELETE;
+    if(this->memtable.size() >= this->memtableEntries) {
+        this->flushMemtableLocked();
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Lookup and scan functions
+// -----------------------------------------------------------------------------
+const std::size_t LSMIndex::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    return this->tree->lookup(key, outRids);
+}
+
+template<class KeyTraits>
+const std::size_t LSMTree<KeyTraits>::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+    Value value;
+    KeyTraits::load(value, key);
+    return this->lookup(KeyTraits::key(value), outRids);
+}
+
+template<class KeyTraits>
+const std::size_t LSMTree<KeyTraits>::lookup(Key key, std::vector<RecordId>& outRids)
+{
+    Merge merge;
+    {
+        SharedLatchGuard shared(this->treeLatch);
+        this->snapshot(merge, key, key, true);
+    }
+    return this->collect(merge, key, outRids, (std::size_t)-1);
+}
+
+const void LSMIndex::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    this->tree->startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    Value low, high;
+    KeyTraits::load(low, lowValParm);
+    KeyTraits::load(high, highValParm);
+    this->startScan(KeyTraits::key(low), lowOpParm, KeyTraits::key(high), highOpParm);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::startScan(Key lowValParm,
+				   const Operator lowOpParm,
+				   Key highValParm,
+				   const Operator highOpParm)
+{
+    this->scanExecuting = false;
+    this->scanMerge.sources.clear();
+    this->scanMerge.heap.clear();
+    if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
+    }
+    if(KeyTraits::less(highValParm, lowValParm)) {
+        throw BadScanrangeException();
+    }
+    KeyTraits::assign(this->lowVal, lowValParm);
+    KeyTraits::assign(this->highVal, highValParm);
+    this->lowOp = lowOpParm;
+    this->highOp = highOpParm;
+
+    //A one key range reads only the runs whose Bloom filter admits the key
+    {
+        SharedLatchGuard shared(this->treeLatch);
+        this->snapshot(this->scanMerge, lowValParm, highValParm, KeyTraits::equals(lowValParm, highValParm));
+    }
+    Pair target;
+    KeyTraits::assign(target.key, lowValParm);
+    target.rid.page_number = 0;
+    target.rid.slot_number = 0;
+    this->mergeOpen(this->scanMerge, &target);
+
+    this->scanAdvance();
+    if(!this->scanHasNext) {
+        throw NoSuchKeyFoundException();
+    }
+    this->scanExecuting = true;
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::scanAdvance()
+{
+    const Key low = KeyTraits::key(this->lowVal);
+    const Key high = KeyTraits::key(this->highVal);
+    this->scanHasNext = false;
+    Entry entry;
+    while(this->mergeNext(this->scanMerge, entry)) {
+        const Key key = keyOf(entry.pair);
+        if(this->highOp == LTE ? KeyTraits::less(high, key) : !KeyTraits::less(key, high)) {
+            break;
+        }
+        if(entry.op == LSM_DELETE || (this->lowOp == GT && !KeyTraits::less(low, key))) {
+            continue;
+        }
+        this->scanNextRid = entry.pair.rid;
+        this->scanHasNext = true;
+        return;
+    }
+    //Let go of the runs, so that those merged away meanwhile can be removed
+    this->scanMerge.sources.clear();
+    this->scanMerge.heap.clear();
+}
+
+const void LSMIndex::scanNext(RecordId& outRid)
+{
+    this->tree->scanNext(outRid);
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::scanNext(RecordId& outRid)
+{
+    if(!this->scanExecuting) {
+        throw ScanNotInitializedException();
+    }
+    if(!this->scanHasNext) {
+        throw IndexScanCompletedException();
+    }
+    outRid = this->scanNextRid;
+    this->scanAdvance();
+}
+
+const void LSMIndex::endScan()
+{
+    this->tree->endScan();
+}
+
+template<class KeyTraits>
+const void LSMTree<KeyTraits>::endScan()
+{
+    if(!this->scanExecuting) {
+        throw ScanNotInitializedException();
+    }
+    this->scanExecuting = false;
+    this->scanMerge.sources.clear();
+    this->scanMerge.heap.clear();
+}
+
+// -----------------------------------------------------------------------------
+// Validation functions
+// -----------------------------------------------------------------------------
+const bool LSMIndex::validate(bool showInfo)
+{
+    return this->tree->validate(showInfo);
+}
+
+template<class KeyTraits>
+const bool LSMTree<KeyTraits>::validate(bool showInfo)
+{
+    SharedLatchGuard shared(this->treeLatch);
+    bool valid = true;
+    std::size_t runs = 0;
+    std::uint64_t entries = 0;
+    for(size_t level = 0; valid && level < this->levels.size(); level ++) {
+        valid = (level == 0 || this->levels[level].size() <= 1);
+        for(size_t i = 0; valid && i < this->levels[level].size(); i ++) {
+            const Run* run = this->levels[level][i].get();
+            valid = run->fences.size() == run->dataPages;
+            std::uint64_t count = 0;
+            Pair prev;
+            for(std::uint32_t p = 0; valid && p < run->dataPages; p ++) {
+                Page* page = NULL;
+                this->bufMgr->readPage(run->file, run->firstDataPageNo + p, page);
+                const RunPage* node = (const RunPage*)page;
+                valid = node->usage > 0 && node->usage <= RunPage::MAX_USAGE
+                    && !pairLess(node->entries[0].pair, run->fences[p]) && !pairLess(run->fences[p], node->entries[0].pair);
+                for(int e = 0; valid && e < node->usage; e ++) {
+                    valid = (node->entries[e].op == LSM_INSERT || node->entries[e].op == LSM_DELETE)
+                        && (count == 0 || pairLess(prev, node->entries[e].pair));
+                    prev = node->entries[e].pair;
+                    count ++;
+                }
+                this->bufMgr->unPinPage(run->file, run->firstDataPageNo + p, false);
+            }
+            valid = valid && count == run->entries;
+            runs ++;
+            entries += count;
+        }
+    }
+    if(showInfo) {
+        std::cout << "LSM tree of " << this->levels.size() << " levels, " << runs << " runs of " << entries
+            << " entries, " << this->memtable.size() << " in the memtable: " << (valid ? "valid" : "invalid") << "\n";
+    }
+    return valid;
+}
+
+template class LSMTree<IntKeyTraits>;
+template class LSMTree<DoubleKeyTraits>;
+template class LSMTree<StringKeyTraits>;
+
+}
@@ -0,0 +1,599 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "latch.h"
+#include "bloomFilter.h"
+#include "btree.h"
+
+/**
+ * LSM tree: an ingest optimized index with the insert, delete and scan interface of
+ * BTreeIndex. Inserts and deletes go to a sorted memtable in memory. A full memtable is
+ * written out in one pass as an immutable sorted run, a BlobFile of its own, and runs
+ * are merged into larger ones by a background thread. No page is ever updated in place.
+ *
+ * Runs are kept in levels. Level 0 holds the runs written from the memtable, whose keys
+ * overlap; every deeper level holds at most one run, LEVEL_FANOUT times larger than the
+ * one above it may grow. A delete is a tombstone entry that hides the entry it names in
+ * older runs, until both meet in a merge. Each run keeps its fence pointers (the least
+ * entry of each data page) and a Bloom filter over its keys in memory, so a probe reads
+ * at most about one page of each run whose filter lets the key through.
+ */
+
+namespace badgerdb
+{
+
+/**
+ * @brief What an entry of the memtable or of a run does.
+ */
+enum LsmEntryOp
+{
+	LSM_INSERT = 0,	/* The record id is in the index */
+	LSM_DELETE = 1	/* Tombstone: the record id was deleted */
+};
+
+/**
+ * @brief Entry of a run: a <key, rid> pair, and whether it was inserted or deleted.
+ */
+template<class Value>
+struct LsmEntry {
+	RIDKeyPair<Value> pair;
+	int op;
+};
+
+/**
+ * @brief First page of a run file. The data pages are the dataPages pages from
+ * firstDataPageNo on; the fences and the Bloom filter follow them in chains of pages.
+ */
+struct LsmRunHeader {
+	std::uint64_t entries;
+	PageId firstDataPageNo;
+	std::uint32_t dataPages;
+	PageId fencePageNo;
+	PageId bloomPageNo;
+	std::uint32_t bloomPages;
+	int bloomHashes;
+};
+
+/**
+ * @brief Data page of a run: entries in <key, rid> order.
+ */
+template<class Value>
+struct LsmRunPage {
+	static const int MAX_USAGE = (Page::SIZE - sizeof(int)) / sizeof(LsmEntry<Value>);
+
+	int usage;
+
+	LsmEntry<Value> entries[MAX_USAGE];
+};
+
+/**
+ * @brief Page of the fence pointers of a run: the least pair of each data page, in order.
+ */
+template<class Value>
+struct LsmFencePage {
+	static const int MAX_USAGE = (Page::SIZE - sizeof(PageId) - sizeof(int)) / sizeof(RIDKeyPair<Value>);
+
+	/**
+	 * Next page of fences, 0 on the last
+	 */
+	PageId nextPageNo;
+
+	int usage;
+
+	RIDKeyPair<Value> fences[MAX_USAGE];
+};
+
+/**
+ * @brief A run of the index, as listed in the manifest.
+ */
+struct LsmRunInfo {
+	std::int32_t runId;
+	std::int32_t level;
+};
+
+/**
+ * @brief Meta page of the manifest of an LSM index, the index file proper. Runs are
+ * listed newest first; run n is stored in the file named after the index with ".n" added.
+ */
+struct LsmMetaInfo {
+	static const int MAX_RUNS = (Page::SIZE - 20 - 4 * sizeof(int)) / sizeof(LsmRunInfo);
+
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset and type of the attribute over which the index is built.
+   */
+	int attrByteOffset;
+	Datatype attrType;
+
+  /**
+   * Number the next run file will get, and the number of runs listed.
+   */
+	std::int32_t nextRunId;
+	std::int32_t runCount;
+
+	LsmRunInfo runs[MAX_RUNS];
+};
+
+
+/**
+ * @brief Type erased interface of an LSM tree, through which LSMIndex reaches the tree
+ * instantiated for its key type. Keys are passed as pointers to an integer, a double or
+ * a char string.
+ */
+class LSMCore {
+ public:
+	virtual ~LSMCore() { }
+
+	virtual const void createIndexFromRelation(const std::string& relationName) = 0;
+	virtual const void insertEntry(const void* key, const RecordId rid) = 0;
+	virtual const bool deleteEntry(const void* key) = 0;
+	virtual const std::size_t lookup(const void* key, std::vector<RecordId>& outRids) = 0;
+	virtual const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp) = 0;
+	virtual const void scanNext(RecordId& outRid) = 0;
+	virtual const void endScan() = 0;
+	virtual const void flushMemtable() = 0;
+	virtual const void waitForCompaction() = 0;
+	virtual const std::vector<std::size_t> levelRuns() = 0;
+	virtual const bool validate(bool showInfo) = 0;
+};
+
+
+/**
+ * @brief LSM tree on one key type, with the keys and their order of the BTree of the
+ * same KeyTraits. Instantiated in lsmtree.cpp for IntKeyTraits, DoubleKeyTraits and
+ * StringKeyTraits.
+ *
+ * treeLatch guards the memtable and the list of runs. Inserts and deletes hold it
+ * exclusive, as does writing out a full memtable. A scan or lookup holds it shared only
+ * to take a snapshot: a copy of the memtable's entries in range and references to the
+ * runs. The background compactor merges runs holding no latch, as runs never change,
+ * and holds it exclusive only to swap the merged run in. A run replaced while a scan
+ * still reads it is removed when the scan ends.
+ */
+template<class KeyTraits>
+class LSMTree : public LSMCore {
+
+ public:
+	typedef typename KeyTraits::Key Key;
+	typedef typename KeyTraits::Value Value;
+	typedef RIDKeyPair<Value> Pair;
+	typedef LsmEntry<Value> Entry;
+	typedef LsmRunPage<Value> RunPage;
+	typedef LsmFencePage<Value> FencePage;
+
+  /**
+   * Number of level 0 runs that starts a compaction into level 1.
+   */
+	static const int L0_RUNS = 4;
+
+  /**
+   * Number of level 0 runs at which inserts and deletes wait for the compactor, so runs
+   * do not pile up faster than they are merged.
+   */
+	static const int L0_STALL_RUNS = 3 * L0_RUNS;
+
+  /**
+   * Level n > 0 is merged into the level below once it has more than memtableEntries
+   * times LEVEL_FANOUT to the n entries.
+   */
+	static const int LEVEL_FANOUT = 10;
+
+  /**
+   * Bits per key of the Bloom filter of each run.
+   */
+	static const int BLOOM_BITS_PER_KEY = 10;
+
+ private:
+
+  /**
+   * Run file open for reading, with its fence pointers and Bloom filter. Once replaced
+   * by a merge it is obsolete, and its file is removed when the last reference goes.
+   */
+	struct Run {
+		BufMgr* bufMgr;
+		File* file;
+		std::int32_t runId;
+		std::uint64_t entries;
+		PageId firstDataPageNo;
+		std::uint32_t dataPages;
+		std::vector<Pair> fences;
+		BloomFilter filter;
+		bool obsolete;
+
+		Run(): bufMgr(NULL), file(NULL), runId(0), entries(0), firstDataPageNo(0), dataPages(0), obsolete(false) { }
+		~Run();
+	};
+	typedef std::shared_ptr<Run> RunPtr;
+
+  /**
+   * Run file being written, a data page at a time.
+   */
+	struct RunWriter {
+		RunPtr run;
+		Page* page;
+		PageId pageNo;
+		std::vector<std::uint64_t> hashes;
+	};
+
+  /**
+   * One input of a merge: a run from some data page on, or entries in memory.
+   * entries holds the page being read.
+   */
+	struct Source {
+		RunPtr run;
+		std::uint32_t nextPage;
+		std::vector<Entry> entries;
+		std::size_t pos;
+	};
+
+  /**
+   * K-way merge of sources, newest first: heap holds the sources with entries left, the
+   * one with the least current entry on top and, among equal ones, the newest.
+   */
+	struct Merge {
+		std::vector<Source> sources;
+		std::vector<int> heap;
+	};
+
+  /**
+   * File object for the manifest.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * Name of the manifest, from which run file names are made.
+   */
+	std::string	indexName;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+	int	attrByteOffset;
+
+  /**
+   * Entries the memtable takes before it is written out as a run.
+   */
+	std::size_t	memtableEntries;
+
+  /**
+   * Guards memtable and levels.
+   */
+	RWLatch	treeLatch;
+
+  /**
+   * Newest entry of each <key, rid> changed since the last run was written.
+   */
+	std::map<Pair, int, bool(*)(const Pair&, const Pair&)>	memtable;
+
+  /**
+   * Runs of each level, oldest first.
+   */
+	std::vector<std::vector<RunPtr> >	levels;
+
+  /**
+   * Number the next run file gets.
+   */
+	std::atomic<std::int32_t>	nextRunId;
+
+  /**
+   * Number of runs on level 0, changed with treeLatch exclusive and read by writes
+   * deciding whether to stall.
+   */
+	std::atomic<std::size_t>	level0Runs;
+
+  /**
+   * Background compactor, and what it waits on: compactRequested is set whenever a run
+   * is written, compacting while it merges, and stopping when the tree closes.
+   * compactFailed is set while the last merge failed, so that writes do not stall on a
+   * compactor that cannot make progress; the next run written retries it.
+   */
+	std::thread	compactor;
+	std::mutex	compactMutex;
+	std::condition_variable	compactWake;
+	std::condition_variable	compactIdle;
+	bool	compactRequested;
+	bool	compacting;
+	bool	stopping;
+	bool	compactFailed;
+
+  /**
+   * State of the scan of startScan: its bounds, the merge it reads, and the record id
+   * it returns next.
+   */
+	bool	scanExecuting;
+	Value	lowVal;
+	Value	highVal;
+	Operator	lowOp;
+	Operator	highOp;
+	Merge	scanMerge;
+	bool	scanHasNext;
+	RecordId	scanNextRid;
+
+    /**
+     * Entry order: by key, then by page and slot number
+     * */
+    static bool pairLess(const Pair& lhs, const Pair& rhs);
+
+    static Key keyOf(const Pair& pair) {
+        return KeyTraits::key(const_cast<Value&>(pair.key));
+    }
+
+    /**
+     * Opens the run file of runId, reading its fences and Bloom filter
+     * */
+    RunPtr openRun(const std::int32_t runId);
+
+    /**
+     * Starts, adds the next entry in order to, and finishes a new run file
+     * */
+    const void writerOpen(RunWriter& writer);
+    const void writerAdd(RunWriter& writer, const Entry& entry);
+    RunPtr writerClose(RunWriter& writer);
+
+    /**
+     * Writes the list of runs to the manifest. Called with treeLatch exclusive
+     * @throws InsufficientSpaceException If there are more runs than the manifest lists
+     * */
+    const void writeManifest();
+
+    /**
+     * Waits while level 0 has L0_STALL_RUNS runs and the compactor works on them. Called
+     * by inserts and deletes before they take treeLatch
+     * */
+    const void stallWrites();
+
+    /**
+     * Writes the memtable out as a level 0 run and wakes the compactor. Called with
+     * treeLatch exclusive
+     * */
+    const void flushMemtableLocked();
+
+    /**
+     * Sets up merge over the memtable's entries from low through high and the runs,
+     * newest first, skipping runs whose Bloom filter rules out the key if equal is set.
+     * Called with treeLatch held
+     * */
+    const void snapshot(Merge& merge, Key low, Key high, const bool equal);
+
+    /**
+     * Positions each source at its first entry not below target, or at its first entry
+     * if target is NULL, then fills the heap
+     * */
+    const void mergeOpen(Merge& merge, const Pair* target);
+
+    /**
+     * Heap order of a merge: true if source a's current entry comes out after b's
+     * */
+    static bool heapLater(const Merge& merge, const int a, const int b);
+
+    /**
+     * Reads the next data page of a run source, if any
+     * */
+    const bool sourceFill(Source& source);
+
+    /**
+     * Returns in out the newest entry of the least <key, rid> left, tombstones included
+     * */
+    const bool mergeNext(Merge& merge, Entry& out);
+
+    /**
+     * Appends the record ids of key in a snapshot to outRids, in order, at most max of
+     * them. Returns how many
+     * */
+    const std::size_t collect(Merge& merge, Key key, std::vector<RecordId>& outRids, const std::size_t max);
+
+    /**
+     * Moves the scan on to the next record id in range that is not deleted, dropping
+     * the snapshot once there is none
+     * */
+    const void scanAdvance();
+
+    /**
+     * Merges the runs of one level into the next if the level is over full. Returns
+     * false if no level is
+     * */
+    const bool compactOnce();
+
+    /**
+     * Body of the background compactor
+     * */
+    const void compactLoop();
+
+ public:
+
+  /**
+   * Opens the manifest of indexName and its runs, or creates it and inserts an entry for
+   * every record of relationName. Starts the compactor.
+   */
+	LSMTree(const std::string& relationName, const std::string& indexName,
+						BufMgr* bufMgrIn, const int attrByteOffset, const std::size_t memtableEntries);
+
+	~LSMTree();
+
+	const void createIndexFromRelation(const std::string& relationName);
+
+	const void insertEntry(Key key, const RecordId rid);
+	const bool deleteEntry(Key key);
+	const std::size_t lookup(Key key, std::vector<RecordId>& outRids);
+	const void startScan(Key lowVal, const Operator lowOp, Key highVal, const Operator highOp);
+
+	/* Type erased operations */
+	const void insertEntry(const void* key, const RecordId rid);
+	const bool deleteEntry(const void* key);
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const void scanNext(RecordId& outRid);
+	const void endScan();
+	const void flushMemtable();
+	const void waitForCompaction();
+	const std::vector<std::size_t> levelRuns();
+	const bool validate(bool showInfo);
+};
+
+
+/**
+ * @brief Ingest optimized alternative to BTreeIndex, with the same constructor, inserts,
+ * deletes, lookups and scans. An insert costs a memtable insert, and its share of the
+ * sequential writes of a run and of the merges it later goes through. Scans merge the
+ * memtable and every run; lookups and deletes only read the runs whose Bloom filter
+ * admits the key.
+ */
+class LSMIndex {
+
+ private:
+
+  /**
+   * Tree on the attribute's key type.
+   */
+	LSMCore	*tree;
+
+ public:
+
+  /**
+   * Default number of entries the memtable takes before it is written out as a run.
+   */
+	static const std::size_t DEFAULT_MEMTABLE_ENTRIES = 65536;
+
+	/**
+   * LSMIndex Constructor.
+	 * Open the index if its manifest exists. If not, create it and insert an entry for
+	 * every tuple in the base relation, as BTreeIndex does without bulk loading.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of the manifest: that of the BTreeIndex on the attribute, with ".lsm" added. Runs are in files named after it.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built
+   * @param memtableEntries			Entries the memtable takes before it is written out as a run
+   */
+	LSMIndex(const std::string& relationName, std::string& outIndexName,
+						BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType,
+						const std::size_t memtableEntries = DEFAULT_MEMTABLE_ENTRIES);
+
+	/**
+   * LSMIndex Destructor.
+	 * End any initialized scan, let a running merge finish, write the memtable out as a
+	 * run and flush the manifest and the runs.
+	 * */
+	~LSMIndex();
+
+	/**
+	 * Remove the manifest of the given name and every run file it lists. The index must
+	 * not be open.
+   * @param indexName	Name of the manifest, as returned by the constructor
+   * @param bufMgrIn	Buffer Manager Instance
+	**/
+	static const void remove(const std::string& indexName, BufMgr* bufMgrIn);
+
+    /**
+	 * Insert a new entry using the pair <value,rid> into the memtable, writing the
+	 * memtable out as a run if it is full. Waits first while level 0 has too many runs
+	 * for the compactor to keep up.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	**/
+	const void insertEntry(const void* key, const RecordId rid);
+
+	/**
+	 * Delete the first record id of a key, in (page, slot) order, as BTreeIndex does, by
+	 * adding a tombstone for it to the memtable. Waits as insertEntry does.
+   * @param key			Key to delete, pointer to integer/double/char string
+	 * @return False if the key has no record id.
+	**/
+	const bool deleteEntry(const void* key);
+
+	/**
+	 * Find every entry of the given key, reading only the runs whose Bloom filter admits it.
+   * @param key			Key to look up, pointer to integer/double/char string
+   * @param outRids	The record ids of the key are appended to this, in (page, slot) order
+	 * @return Number of record ids appended, 0 if the key is not in the index.
+	**/
+	const std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+
+	/**
+	 * Begin a filtered scan of the index, as BTreeIndex::startScan. The scan reads a
+	 * snapshot of the index taken here; later inserts and deletes do not show in it.
+	 * Record ids come back in key and then (page, slot) order.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the index that satisfies the scan criteria.
+	**/
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+	/**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	const void scanNext(RecordId& outRid);
+
+	/**
+	 * Terminate the current scan.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	const void endScan();
+
+	/**
+	 * Write the memtable out as a run now, if it has entries.
+	**/
+	const void flushMemtable();
+
+	/**
+	 * Wait until the compactor has no level left to merge.
+	**/
+	const void waitForCompaction();
+
+	/**
+	 * Number of runs on each level, from level 0 down.
+	**/
+	const std::vector<std::size_t> levelRuns();
+
+	/**
+	 * Check that every run is in order, that its fences are the least entries of its
+	 * pages, and that levels below 0 have at most one run.
+   * @param showInfo	Print the result
+	 * @return True if the index is valid.
+	**/
+	const bool validate(bool showInfo);
+};
+
+}
@@ -6,7 +6,15 @@
  */
 
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include "btree.h"
+#include "btreeNode.h"
+#include "betree.h"
+#include "lsmtree.h"
+#include "hashindex.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
@@ -19,6 +27,9 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -91,6 +102,63 @@ void negtest1();
 void negtest2();
 void negtest3();
 void errorTests();
+void concurrentBufferTests(ReplacementPolicyType policyType);
+void evictionOrderTests();
+void cancelledEvictionTests();
+void ringScanTests();
+void prefetchTests();
+void cleanerTests();
+void pageFileFormatTests(File::Format format);
+int countUsedPages(PageFile& file, bool& ordered);
+void positionalIoTests();
+void bulkLoadTests();
+void nodeSearchTests();
+void typedTreeTests();
+void stringKeyTests();
+void scanCursorTests();
+int cursorCount(ScanCursor* cursor);
+void batchScanTests();
+void concurrentIndexTests();
+void postingListTests();
+void lookupTests();
+void sequentialInsertTests();
+void freePageTests();
+void orderStatisticTests();
+void bEpsilonTests();
+void lsmTreeTests();
+void hashIndexTests();
+template <class Index> std::vector<RecordId> scanRids(Index& index, const void* lowVal, Operator lowOp, const void* highVal, Operator highOp);
+
+// Key i of the random relation as each key type takes it
+struct RelationKey
+{
+	int i;
+	double d;
+	char s[STRINGSIZE + 1];
+
+	RelationKey(int key);
+	const void* of(int type) const;
+};
+
+// record ids of keys low through high - 1 of the random relation, in key order: from a
+// scan, or from a lookup of each key in an index without scans
+template <class Index> std::vector<RecordId> rangeRids(Index& index, int type, int low, int high);
+std::vector<RecordId> rangeRids(HashIndex& index, int type, int low, int high);
+template <class Index> void removeIndex(const std::string& indexName);
+// Index against a B+ Tree on every key type of the random relation: the same record ids
+// once built, once three keys in four are deleted and once reopened. The index is
+// opened with args after the attribute type; built and deleted add the checks of the
+// engine after the first two steps
+template <class Index, class Built, class Deleted, class... Args> void indexEngineTests(Built built, Deleted deleted, Args... args);
+// scans with each operator of an index built on the random relation
+template <class Index> void scanOperatorTests(Index& index, BTreeIndex& btree, int type);
+// scan errors, which are those of BTreeIndex, on an integer index of keys 0 and 1
+template <class Index> void scanErrorTests(Index& index);
+void createRelationDuplicates(int distinctKeys);
+int ridOrderCount(ScanCursor* cursor);
+template <class Entry, class Key> int nodeSearchMismatches(const Entry* entries, int usage, Key key);
+template <class Node> int stringNodeMismatches(const Node* node, const char* probe);
+int ringScanHotReads(const std::uint32_t ringSize);
 void deleteRelation();
 void checkDeletionPassFail(bool result, int line);
 void checkDeletionPassFail1(bool result, int line, size_t index);
@@ -118,7 +186,7 @@ int main(int argc, char **argv)
 			std::cout << "leaf size:" << DOUBLEARRAYLEAFSIZE << " non-leaf size:" << DOUBLEARRAYNONLEAFSIZE << std::endl;
 			break;
 		case 3:
-			std::cout << "leaf size:" << STRINGARRAYLEAFSIZE << " non-leaf size:" << STRINGARRAYNONLEAFSIZE << std::endl;
+			std::cout << "leaf key heap:" << StringLeafNode::DATA_SIZE << " bytes, keys up to " << STRINGSIZE << " chars" << std::endl;
 			break;
 	}
 
@@ -164,8 +232,7 @@ int main(int argc, char **argv)
 			{
 				fscan.scanNext(scanRid);
 				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
+				const char *record = fscan.getRecordView().data;
 				int key = *((int *)(record + offsetof (RECORD, i)));
 				std::cout << "Extracted : " << key << std::endl;
 			}
@@ -186,6 +253,33 @@ int main(int argc, char **argv)
 	negtest2();
 	negtest3();
 	errorTests();
+	concurrentBufferTests(CLOCK);
+	concurrentBufferTests(LRU_K);
+	concurrentBufferTests(TWO_Q);
+	concurrentBufferTests(ARC);
+	evictionOrderTests();
+	cancelledEvictionTests();
+	ringScanTests();
+	prefetchTests();
+	cleanerTests();
+	pageFileFormatTests(File::LIST_FORMAT);
+	pageFileFormatTests(File::DIRECTORY_FORMAT);
+	positionalIoTests();
+	bulkLoadTests();
+	nodeSearchTests();
+	typedTreeTests();
+	stringKeyTests();
+	scanCursorTests();
+	batchScanTests();
+	concurrentIndexTests();
+	postingListTests();
+	lookupTests();
+	sequentialInsertTests();
+	freePageTests();
+	orderStatisticTests();
+	bEpsilonTests();
+	lsmTreeTests();
+	hashIndexTests();
 
 	delete bufMgr;
 	return 0;
@@ -833,7 +927,7 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 		{
 			index->scanNext(scanRid);
 			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecordView(scanRid).data));
 			bufMgr->unPinPage(file1, scanRid.page_number, false);
 
 			if( numResults < 5 )
@@ -961,7 +1055,7 @@ int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal
 		{
 			index->scanNext(scanRid);
 			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecordView(scanRid).data));
 			bufMgr->unPinPage(file1, scanRid.page_number, false);
 
 			if( numResults < 5 )
@@ -1057,7 +1151,7 @@ int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Oper
 		{
 			index->scanNext(scanRid);
 			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecordView(scanRid).data));
 			bufMgr->unPinPage(file1, scanRid.page_number, false);
 
 			if( numResults < 20 )
@@ -1204,6 +1298,2294 @@ void errorTests()
 	deleteRelation();
 }
 
+// -----------------------------------------------------------------------------
+// concurrentBufferTests
+// -----------------------------------------------------------------------------
+
+struct StressRecord {
+	PageId pageNo;
+	int counter;
+};
+
+void concurrentBufferTests(ReplacementPolicyType policyType)
+{
+	// far fewer frames than pages, so threads constantly evict each other's pages
+	BufMgr* pool = new BufMgr(64, policyType);
+
+	std::cout << "Concurrent buffer manager tests (" << pool->policyName() << ")" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	const std::string stressName = "bufstress";
+	const int numThreads = 8;
+	const int numPages = 256;
+	const int opsPerThread = 20000;
+
+	try
+	{
+		File::remove(stressName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BlobFile* stressFile = new BlobFile(stressName, true);
+
+	std::vector<PageId> pageNos(numPages);
+	std::vector<RecordId> rids(numPages);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page* page;
+		pool->allocPage(stressFile, pageNos[i], page);
+		StressRecord rec = {pageNos[i], 0};
+		rids[i] = page->insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		pool->unPinPage(stressFile, pageNos[i], true);
+	}
+
+	// Phase 1: every thread updates its own pages; page i belongs to thread i % numThreads.
+	std::vector<std::vector<int> > expected(numThreads, std::vector<int>(numPages, 0));
+	std::vector<int> errors(numThreads, 0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < numThreads; t++)
+	{
+		workers.push_back(std::thread([&, t]() {
+			std::uint32_t seed = 564 + t;
+			for (int op = 0; op < opsPerThread; op++)
+			{
+				seed = seed * 1103515245 + 12345;
+				const int i = ((seed >> 8) % (numPages / numThreads)) * numThreads + t;
+				Page* page;
+				pool->readPage(stressFile, pageNos[i], page);
+				StressRecord rec = *reinterpret_cast<const StressRecord*>(page->getRecordView(rids[i]).data);
+				if (rec.pageNo != pageNos[i] || rec.counter != expected[t][i])
+					errors[t]++;
+				const bool update = (op % 3 == 0);
+				if (update)
+				{
+					rec.counter++;
+					expected[t][i]++;
+					page->updateRecord(rids[i], std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+				}
+				pool->unPinPage(stressFile, pageNos[i], update);
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+		workers[t].join();
+
+	int totalErrors = 0;
+	for (int t = 0; t < numThreads; t++)
+		totalErrors += errors[t];
+	checkPassFail(totalErrors, 0)
+
+	// Phase 2: all threads read all pages at once, sharing frames.
+	workers.clear();
+	for (int t = 0; t < numThreads; t++)
+	{
+		errors[t] = 0;
+		workers.push_back(std::thread([&, t]() {
+			std::uint32_t seed = 7 * t + 1;
+			for (int op = 0; op < opsPerThread; op++)
+			{
+				seed = seed * 1103515245 + 12345;
+				const int i = (seed >> 8) % numPages;
+				Page* page;
+				pool->readPage(stressFile, pageNos[i], page);
+				const StressRecord* rec = reinterpret_cast<const StressRecord*>(page->getRecordView(rids[i]).data);
+				if (rec->pageNo != pageNos[i] || rec->counter != expected[i % numThreads][i])
+					errors[t]++;
+				pool->unPinPage(stressFile, pageNos[i], false);
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+		workers[t].join();
+
+	totalErrors = 0;
+	for (int t = 0; t < numThreads; t++)
+		totalErrors += errors[t];
+	checkPassFail(totalErrors, 0)
+	checkPassFail(pool->pinnedCnt(), 0)
+
+	// No update may be lost on the way to disk.
+	pool->flushFile(stressFile);
+	int lost = 0;
+	for (int i = 0; i < numPages; i++)
+	{
+		Page page = stressFile->readPage(pageNos[i]);
+		const StressRecord* rec = reinterpret_cast<const StressRecord*>(page.getRecordView(rids[i]).data);
+		if (rec->pageNo != pageNos[i] || rec->counter != expected[i % numThreads][i])
+			lost++;
+	}
+	checkPassFail(lost, 0)
+
+	delete pool;
+	delete stressFile;
+	File::remove(stressName);
+}
+
+void evictionOrderTests()
+{
+	std::cout << "Eviction order tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// pages read in order into a pool of four frames, the page the last miss must
+	// have evicted, and pages that must still be resident
+	struct EvictionCase
+	{
+		ReplacementPolicyType policyType;
+		std::vector<int> reads;
+		int evicted;
+		std::vector<int> resident;
+	};
+	const EvictionCase cases[] = {
+		// the second miss finds 2 referenced since the sweep of the first
+		{CLOCK, {1, 2, 3, 4, 5, 2, 6}, 3, {2, 4, 5, 6}},
+		// pages read once go before pages read twice, however recently
+		{LRU_K, {1, 2, 1, 2, 3, 4, 5}, 3, {1, 2, 4, 5}},
+		// a hit on A1in leaves its FIFO order alone
+		{TWO_Q, {1, 2, 3, 4, 1, 5}, 1, {2, 3, 4, 5}},
+		// T1 gives up its oldest page before T2 its least recently used
+		{ARC, {1, 1, 2, 3, 4, 5}, 2, {1, 3, 4, 5}},
+	};
+
+	const std::string orderName = "evictorder";
+	for (const EvictionCase& test : cases)
+	{
+		try
+		{
+			File::remove(orderName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		// pages written through another pool, so that this one starts with no history
+		BlobFile* orderFile = new BlobFile(orderName, true);
+		std::vector<PageId> pageNos(7);
+		{
+			BufMgr setup(8);
+			for (int i = 1; i < 7; i++)
+			{
+				Page* page;
+				setup.allocPage(orderFile, pageNos[i], page);
+				setup.unPinPage(orderFile, pageNos[i], true);
+			}
+			setup.flushFile(orderFile);
+		}
+		BufMgr* pool = new BufMgr(4, test.policyType, 0);
+
+		for (int i : test.reads)
+		{
+			Page* page;
+			pool->readPage(orderFile, pageNos[i], page);
+			pool->unPinPage(orderFile, pageNos[i], false);
+		}
+
+		// hits first, as they evict nothing
+		std::cout << pool->policyName() << ": ";
+		pool->clearBufStats();
+		for (int i : test.resident)
+		{
+			Page* page;
+			pool->readPage(orderFile, pageNos[i], page);
+			pool->unPinPage(orderFile, pageNos[i], false);
+		}
+		checkPassFail(pool->getBufStats().diskreads, 0)
+		Page* page;
+		pool->readPage(orderFile, pageNos[test.evicted], page);
+		pool->unPinPage(orderFile, pageNos[test.evicted], false);
+		checkPassFail(pool->getBufStats().diskreads, 1)
+
+		delete pool;
+		delete orderFile;
+		File::remove(orderName);
+	}
+}
+
+void cancelledEvictionTests()
+{
+	std::cout << "Cancelled eviction tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// pages 1 to 4 fill frames 0 to 3 in order, each read once.  Frame 0 is
+	// then taken as a victim, but its page is pinned again while BufMgr writes
+	// it back, so the policy must end up as if nothing had been evicted.
+	LRUKPolicy lruK(4);
+	TwoQPolicy twoQ(4);
+	ARCPolicy arc(4);
+	ReplacementPolicy* policies[] = {&lruK, &twoQ, &arc};
+	const std::vector<FrameId> loadOrder = {0, 1, 2, 3};
+
+	for (ReplacementPolicy* policy : policies)
+	{
+		std::cout << policy->name() << ": ";
+		// the pages only need to be told apart, not read
+		for (FrameId frame = 0; frame < 4; frame++)
+			policy->frameLoaded(frame, NULL, frame + 1);
+
+		FrameId victim;
+		checkPassFail(policy->selectVictim(victim, [](FrameId) { return true; }), true)
+		checkPassFail(victim, 0)
+		policy->evictionCancelled(victim);
+
+		// the page is neither remembered as evicted nor promoted: frame 0 is
+		// still the first victim, on the same queue as before
+		std::vector<FrameId> victims;
+		policy->upcomingVictims(victims, 4);
+		checkPassFail((victims == loadOrder), true)
+	}
+
+	// a ghost hit would have grown T1's target
+	checkPassFail(arc.targetT1(), 0)
+
+	// a real eviction is still remembered
+	FrameId victim;
+	arc.selectVictim(victim, [](FrameId) { return true; });
+	arc.frameLoaded(victim, NULL, victim + 1);
+	checkPassFail(arc.targetT1(), 1)
+}
+
+void ringScanTests()
+{
+	std::cout << "Ring buffer scan tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// without a ring, a scan larger than the pool pushes out every hot page;
+	// with one it only recycles its own frames
+	checkPassFail(ringScanHotReads(0), 8)
+	checkPassFail(ringScanHotReads(4), 0)
+}
+
+// Reads 8 hot pages into a 32 frame pool, scans a 100 page relation and
+// returns how many hot pages had to be read from disk again afterwards.
+int ringScanHotReads(const std::uint32_t ringSize)
+{
+	BufMgr* pool = new BufMgr(32);
+	const std::string hotName = "ringhot";
+	const std::string scanName = "ringscan";
+	const int numHot = 8;
+	const int numScan = 100;
+
+	try
+	{
+		File::remove(hotName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(scanName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile scanFile = PageFile::create(scanName);
+		for (int i = 0; i < numScan; i++)
+		{
+			PageId pageNo;
+			Page page = scanFile.allocatePage(pageNo);
+			record1.i = i;
+			page.insertRecord(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+			scanFile.writePage(pageNo, page);
+		}
+	}
+
+	BlobFile* hotFile = new BlobFile(hotName, true);
+	std::vector<PageId> hotPages(numHot);
+	for (int i = 0; i < numHot; i++)
+	{
+		Page* page;
+		pool->allocPage(hotFile, hotPages[i], page);
+		pool->unPinPage(hotFile, hotPages[i], true);
+	}
+
+	int scanned = 0;
+	{
+		// no read-ahead, so the ring is filled and recycled in a fixed order
+		FileScan fscan(scanName, pool, ringSize, 0);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				scanned++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+		if (ringSize > 0)
+		{
+			checkPassFail(fscan.getStrategy()->getAccesses(), numScan)
+			checkPassFail(fscan.getStrategy()->getReuses(), numScan - ringSize)
+		}
+	}
+	checkPassFail(scanned, numScan)
+
+	pool->clearBufStats();
+	for (int i = 0; i < numHot; i++)
+	{
+		Page* page;
+		pool->readPage(hotFile, hotPages[i], page);
+		pool->unPinPage(hotFile, hotPages[i], false);
+	}
+	const int hotReads = pool->getBufStats().diskreads;
+
+	delete pool;
+	delete hotFile;
+	File::remove(hotName);
+	File::remove(scanName);
+	return hotReads;
+}
+
+void prefetchTests()
+{
+	std::cout << "Prefetch tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	BufMgr* pool = new BufMgr(64);
+	const std::string prefetchName = "prefetch";
+	const int numPages = 32;
+
+	try
+	{
+		File::remove(prefetchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BlobFile* prefetchFile = new BlobFile(prefetchName, true);
+	std::vector<PageId> pageNos(numPages);
+	std::vector<RecordId> rids(numPages);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page* page;
+		pool->allocPage(prefetchFile, pageNos[i], page);
+		StressRecord rec = {pageNos[i], i};
+		rids[i] = page->insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		pool->unPinPage(prefetchFile, pageNos[i], true);
+	}
+	pool->flushFile(prefetchFile);
+	pool->clearBufStats();
+
+	// reads racing the I/O workers must see every page exactly once from disk
+	const std::vector<PageId> firstHalf(pageNos.begin(), pageNos.begin() + numPages / 2);
+	pool->prefetch(prefetchFile, firstHalf);
+	int errors = 0;
+	for (int i = 0; i < numPages / 2; i++)
+	{
+		Page* page;
+		pool->readPage(prefetchFile, pageNos[i], page);
+		const StressRecord* rec = reinterpret_cast<const StressRecord*>(page->getRecordView(rids[i]).data);
+		if (rec->pageNo != pageNos[i] || rec->counter != i)
+			errors++;
+		pool->unPinPage(prefetchFile, pageNos[i], false);
+	}
+	checkPassFail(errors, 0)
+	checkPassFail(pool->getBufStats().diskreads, numPages / 2)
+
+	// pages prefetched and never requested are wasted once flushed
+	const std::vector<PageId> secondHalf(pageNos.begin() + numPages / 2, pageNos.end());
+	pool->prefetch(prefetchFile, secondHalf);
+	pool->flushFile(prefetchFile);
+	const BufStats stats = pool->getBufStats();
+	checkPassFail(stats.prefetchUseful + stats.prefetchWasted, stats.prefetchIssued)
+	checkPassFail(pool->pinnedCnt(), 0)
+
+	delete pool;
+	delete prefetchFile;
+	File::remove(prefetchName);
+}
+
+void cleanerTests()
+{
+	std::cout << "Background writer tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	BufMgr* pool = new BufMgr(64);
+	const std::string cleanerName = "cleaner";
+	const int numPages = 64;
+
+	try
+	{
+		File::remove(cleanerName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BlobFile* cleanerFile = new BlobFile(cleanerName, true);
+	std::vector<PageId> pageNos(numPages);
+	std::vector<RecordId> rids(numPages);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page* page;
+		pool->allocPage(cleanerFile, pageNos[i], page);
+		StressRecord rec = {pageNos[i], i};
+		rids[i] = page->insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		pool->unPinPage(cleanerFile, pageNos[i], true);
+	}
+	pool->clearBufStats();
+
+	// the writer cleans the frames ahead of the clock hand, a quarter of the pool
+	pool->startCleaner();
+	for (int wait = 0; wait < 1000 && pool->getBufStats().cleanerWrites < numPages / 4; wait++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	pool->stopCleaner();
+	const BufStats stats = pool->getBufStats();
+	checkPassFail(stats.cleanerWrites, numPages / 4)
+	// the pages were allocated in order, so they go out in runs
+	const bool merged = stats.cleanerBatches < stats.cleanerWrites;
+	checkPassFail(merged, true)
+
+	// the rest is written by flushFile, and every page reaches the disk
+	pool->flushFile(cleanerFile);
+	checkPassFail(pool->getBufStats().diskwrites, numPages)
+	int lost = 0;
+	for (int i = 0; i < numPages; i++)
+	{
+		Page page = cleanerFile->readPage(pageNos[i]);
+		const StressRecord* rec = reinterpret_cast<const StressRecord*>(page.getRecordView(rids[i]).data);
+		if (rec->pageNo != pageNos[i] || rec->counter != i)
+			lost++;
+	}
+	checkPassFail(lost, 0)
+
+	delete pool;
+	delete cleanerFile;
+	File::remove(cleanerName);
+}
+
+void pageFileFormatTests(File::Format format)
+{
+	std::cout << "Page file format tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	const std::string formatName = "pageformat";
+	const int numPages = 40;
+
+	try
+	{
+		File::remove(formatName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile formatFile = PageFile::create(formatName, format);
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+			formatFile.allocatePage(pageNos[i]);
+		// the first page stays page 1, which the index header relies on
+		checkPassFail(pageNos[0], 1)
+
+		// delete every third page, then reuse some of them from the free list
+		for (int i = 0; i < numPages; i += 3)
+			formatFile.deletePage(pageNos[i]);
+		formatFile.deletePage(pageNos[numPages - 2]);
+		for (int i = 0; i < 5; i++)
+		{
+			PageId pageNo;
+			formatFile.allocatePage(pageNo);
+		}
+	}
+
+	{
+		// reopening finds the format on disk, and the used pages in page order
+		PageFile formatFile = PageFile::open(formatName);
+		checkPassFail(formatFile.format(), format)
+		bool ordered = false;
+		const int used = countUsedPages(formatFile, ordered);
+		checkPassFail(used, numPages - (numPages + 2) / 3 - 1 + 5)
+		checkPassFail(ordered, true)
+
+		// drain the free list; the pages after it are appended at the tail
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			formatFile.allocatePage(pageNo);
+		}
+		const int grown = countUsedPages(formatFile, ordered);
+		checkPassFail(grown, used + numPages)
+		checkPassFail(ordered, true)
+	}
+
+	File::remove(formatName);
+}
+
+void positionalIoTests()
+{
+	std::cout << "Positional file I/O tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	const std::string ioName = "positionalio";
+	const int numPages = 64;
+	const int numThreads = 4;
+
+	try
+	{
+		File::remove(ioName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BlobFile* ioFile = new BlobFile(ioName, true);
+	ioFile->setSyncPolicy(File::SYNC_ALWAYS);
+	std::vector<PageId> pageNos(numPages);
+	std::vector<RecordId> rids(numPages);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page page;
+		ioFile->allocatePage(pageNos[i], page);
+		StressRecord rec = {pageNos[i], i};
+		rids[i] = page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		ioFile->writePage(pageNos[i], page);
+	}
+
+	// threads read through the one descriptor without sharing a seek position
+	std::atomic<int> torn(0);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < numThreads; t++)
+	{
+		readers.push_back(std::thread([&, t]() {
+			for (int round = 0; round < 20; round++)
+				for (int i = t; i < numPages; i += 1 + t)
+				{
+					Page page;
+					ioFile->readPage(pageNos[i], page);
+					const StressRecord* rec = reinterpret_cast<const StressRecord*>(page.getRecordView(rids[i]).data);
+					if (rec->pageNo != pageNos[i] || rec->counter != i)
+						torn++;
+				}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+		readers[t].join();
+	checkPassFail(torn.load(), 0)
+
+	{
+		// copies keep the sync policy, and flushing the pool syncs the file
+		BlobFile copy(*ioFile);
+		checkPassFail(copy.syncPolicy(), File::SYNC_ALWAYS)
+		BufMgr* pool = new BufMgr(8);
+		Page* page;
+		pool->readPage(&copy, pageNos[0], page);
+		pool->unPinPage(&copy, pageNos[0], true);
+		pool->flushFile(&copy);
+		checkPassFail(pool->getBufStats().diskwrites, 1)
+		delete pool;
+	}
+
+	delete ioFile;
+	File::remove(ioName);
+}
+
+void bulkLoadTests()
+{
+	std::cout << "Bulk loading tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	// errorTests leaves its index file behind; an existing index would be opened, not built
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+
+	// an 8 frame pool sorts runs of two pages and merges two runs at a time,
+	// so every key type goes through several merge passes
+	BufMgr* pool = new BufMgr(8);
+	const double fillFactors[] = {0.5, 1.0};
+	for (int f = 0; f < 2; f++)
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, pool, offsetof(tuple,i), INTEGER, true, fillFactors[f]);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(intScan(&index,25,GT,40,LT), 14)
+			checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+			// inserting after the load splits packed nodes; the new keys all point at record 0
+			int zero = 0;
+			RecordId rid;
+			index.startScan(&zero, GTE, &zero, LTE);
+			index.scanNext(rid);
+			index.endScan();
+			for (int key = relationSize; key < relationSize + 1000; key++)
+				index.insertEntry(&key, rid);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(intScan(&index,4990,GTE,6000,LT), 1010)
+		}
+		File::remove(indexName);
+	}
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, pool, offsetof(tuple,d), DOUBLE, true);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(doubleScan(&index,20,GTE,35,LTE), 16)
+		}
+		File::remove(indexName);
+	}
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, pool, offsetof(tuple,s), STRING, true);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+		}
+		File::remove(indexName);
+	}
+	delete pool;
+	deleteRelation();
+}
+
+void nodeSearchTests()
+{
+	std::cout << "Node search kernel tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// every kernel must find the positions the linear scan finds, duplicates,
+	// keys within DOUBLEEPSILON of each other and empty nodes included
+	static RIDKeyPair<int> intLeaf[INTARRAYLEAFSIZE];
+	static RIDKeyPair<double> doubleLeaf[DOUBLEARRAYLEAFSIZE];
+	static PageKeyPair<int> intNode[INTARRAYNONLEAFSIZE + 1];
+	static StringLeafNode stringLeaf;
+	static StringNonLeafNode<PageRef> stringNode;
+	int mismatches = 0;
+	for (int usage = 0; usage <= INTARRAYLEAFSIZE; usage += (usage < 40) ? 1 : 97)
+	{
+		for (int i = 0; i < usage; i++)
+		{
+			intLeaf[i].key = (i / 3) * 2;
+			intNode[i].key = i * 2;
+		}
+		for (int key = -2; key <= usage + 1; key++)
+		{
+			mismatches += nodeSearchMismatches(intLeaf, usage, key);
+			mismatches += nodeSearchMismatches(intNode, usage, key);
+		}
+		mismatches += nodeSearchMismatches(intLeaf, usage, INT_MIN);
+		mismatches += nodeSearchMismatches(intLeaf, usage, INT_MAX);
+	}
+	for (int usage = 0; usage <= DOUBLEARRAYLEAFSIZE; usage += (usage < 40) ? 1 : 53)
+	{
+		for (int i = 0; i < usage; i++)
+			doubleLeaf[i].key = (i / 2) + (i % 2) * DOUBLEEPSILON / 2;
+		for (int key = -4; key <= usage + 1; key++)
+		{
+			mismatches += nodeSearchMismatches(doubleLeaf, usage, key / 2.0);
+			mismatches += nodeSearchMismatches(doubleLeaf, usage, key / 2.0 + DOUBLEEPSILON * 0.99);
+			mismatches += nodeSearchMismatches(doubleLeaf, usage, key / 2.0 - DOUBLEEPSILON * 1.01);
+		}
+	}
+
+	// string nodes keep their keys in a heap behind one common prefix; the prefix
+	// changes as keys of different lengths come and go, and probes may end inside it
+	const char* const edgeProbes[] = {"", "a", "node", "node/key/", "node/kez", "zzz"};
+	stringLeaf.init();
+	stringNode.init(0);
+	RecordId rid;
+	char ridValue[16];
+	const std::uint64_t ridCode = PostingList::code(rid);
+	const int ridLength = PostingList::putInline(ridValue, &ridCode, 1);
+	int inserted = 0;
+	for (int i = 0; ; i++)
+	{
+		char key[STRINGSIZE + 1];
+		sprintf(key, "node/key/%d", (i * 7919) % 100000 * 2);
+		const bool leafFull = !stringLeaf.put(key, ridValue, ridLength);
+		const bool nodeFull = !stringNode.insert(key, i + 1);
+		if (leafFull || nodeFull)
+			break;
+		inserted++;
+		if (inserted > 40 && inserted % 31 != 0)
+			continue;
+		for (int key = -1; key <= 200000; key += 1 + inserted / 8)
+		{
+			char probe[STRINGSIZE + 1];
+			sprintf(probe, "node/key/%d", key);
+			mismatches += stringNodeMismatches(&stringLeaf, probe);
+			mismatches += stringNodeMismatches(&stringNode, probe);
+		}
+		for (int p = 0; p < 6; p++)
+		{
+			mismatches += stringNodeMismatches(&stringLeaf, edgeProbes[p]);
+			mismatches += stringNodeMismatches(&stringNode, edgeProbes[p]);
+		}
+	}
+	// removing keys leaves holes in the heap that later inserts reuse
+	for (int i = stringLeaf.usage - 1; i >= 0; i -= 3)
+		stringLeaf.removeAt(i);
+	for (int i = 0; ; i++)
+	{
+		char key[STRINGSIZE + 1];
+		sprintf(key, i % 2 ? "node/k%d" : "node/key/longer/than/the/rest/%d", i);
+		if (!stringLeaf.put(key, ridValue, ridLength))
+			break;
+	}
+	for (int p = 0; p < 6; p++)
+		mismatches += stringNodeMismatches(&stringLeaf, edgeProbes[p]);
+	checkPassFail((inserted > 400), true)
+	checkPassFail(mismatches, 0)
+}
+
+void typedTreeTests()
+{
+	std::cout << "Typed tree tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+
+	// the tree behind BTreeIndex, used with plain keys instead of pointers to them
+	{
+		BTree<IntKeyTraits> tree(relationName, intIndexName, bufMgr, offsetof(tuple,i), true, BTreeIndex::DEFAULT_FILL_FACTOR);
+		checkPassFail(tree.validate(false), true)
+		int found = 0;
+		RecordId rid;
+		tree.startScan(25, GT, 40, LT);
+		try
+		{
+			while (1)
+			{
+				tree.scanNext(rid);
+				found++;
+			}
+		}
+		catch (IndexScanCompletedException e)
+		{
+		}
+		tree.endScan();
+		checkPassFail(found, 14)
+		checkPassFail(tree.deleteEntry(30), true)
+		checkPassFail(tree.deleteEntry(30), false)
+		checkPassFail(tree.validate(false), true)
+	}
+	{
+		std::string indexName;
+		BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+		checkPassFail(intScan(&index,25,GT,40,LT), 13)
+	}
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+void stringKeyTests()
+{
+	std::cout << "String key tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	// keys of STRINGSIZE characters that differ only in their last five, next to the
+	// short keys of the relation; longer keys are cut to STRINGSIZE characters
+	const int longKeyHead = STRINGSIZE - 5;
+	char low[STRINGSIZE + 1], high[STRINGSIZE + 1], key[STRINGSIZE + 10];
+	memset(key, 'k', longKeyHead);
+	memcpy(low, key, longKeyHead);
+	memcpy(high, key, longKeyHead);
+	sprintf(low + longKeyHead, "%05d", 100);
+	sprintf(high + longKeyHead, "%05d", 200);
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), STRING, true);
+			// the long keys all point at the first record
+			RecordId rid;
+			{
+				FileScan scan(relationName, bufMgr);
+				scan.scanNext(rid);
+			}
+			for (int i = 0; i < relationSize; i++)
+			{
+				sprintf(key + longKeyHead, "%05d", i);
+				index.insertEntry(key, rid);
+			}
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.shape().entries, (size_t)(2 * relationSize))
+			checkPassFail(cursorCount(index.openScan(low, GTE, high, LT)), 100)
+			checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+			bool deleted = true;
+			for (int i = 0; i < relationSize; i++)
+			{
+				sprintf(key + longKeyHead, "%05d cut", i);
+				deleted = index.deleteEntry(key) && deleted;
+			}
+			checkPassFail(deleted, true)
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.shape().entries, (size_t)relationSize)
+			checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
+		}
+
+		// an index file of another format version, such as one of the old fixed size
+		// string nodes, is refused on open
+		{
+			BlobFile file(indexName, false);
+			Page* page;
+			bufMgr->readPage(&file, 1, page);
+			((IndexMetaInfo*)page)->formatVersion = INDEX_FORMAT_VERSION - 1;
+			bufMgr->unPinPage(&file, 1, true);
+			bufMgr->flushFile(&file);
+		}
+		bool refused = false;
+		try
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), STRING);
+		}
+		catch(BadIndexInfoException e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+		checkPassFail(bufMgr->pinnedCnt(), 0)
+		File::remove(indexName);
+	}
+	deleteRelation();
+}
+
+void scanCursorTests()
+{
+	std::cout << "Scan cursor tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+
+	{
+		std::string indexName;
+		BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+
+		// two cursors and startScan, stepped in turn, each see their own range
+		int low1 = 25, high1 = 40, low2 = 3000, high2 = 4000;
+		ScanCursor* first = index.openScan(&low1, GT, &high1, LT);
+		ScanCursor* second = index.openScan(&low2, GTE, &high2, LT);
+		index.startScan(&low1, GTE, &high1, LTE);
+		int found[3] = {0, 0, 0};
+		bool done[3] = {false, false, false};
+		while (!done[0] || !done[1] || !done[2])
+		{
+			RecordId rid;
+			for (int c = 0; c < 3; c++)
+			{
+				if (done[c])
+					continue;
+				try
+				{
+					if (c == 0)
+						first->scanNext(rid);
+					else if (c == 1)
+						second->scanNext(rid);
+					else
+						index.scanNext(rid);
+					found[c]++;
+				}
+				catch (IndexScanCompletedException e)
+				{
+					done[c] = true;
+				}
+			}
+		}
+		index.endScan();
+		delete first;
+		delete second;
+		checkPassFail(found[0], 14)
+		checkPassFail(found[1], 1000)
+		checkPassFail(found[2], 16)
+
+		// a cursor per key of an outer cursor, as an index nested-loop join opens them
+		int outerLow = 100, outerHigh = 200;
+		ScanCursor* outer = index.openScan(&outerLow, GTE, &outerHigh, LT);
+		int matches = 0;
+		for (int key = outerLow; ; key++)
+		{
+			RecordId rid;
+			try
+			{
+				outer->scanNext(rid);
+			}
+			catch (IndexScanCompletedException e)
+			{
+				break;
+			}
+			int innerHigh = key + 1;
+			matches += cursorCount(index.openScan(&key, GTE, &innerHigh, LT));
+		}
+		delete outer;
+		checkPassFail(matches, 100)
+
+		// range partitions scanned by one thread each
+		const int numThreads = 4;
+		const int part = relationSize / numThreads;
+		std::vector<int> counts(numThreads, 0);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&, t]() {
+				int low = t * part;
+				int high = (t + 1) * part;
+				counts[t] = cursorCount(index.openScan(&low, GTE, &high, LT));
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+			workers[t].join();
+		int total = 0;
+		for (int t = 0; t < numThreads; t++)
+			total += counts[t];
+		checkPassFail(total, relationSize)
+		checkPassFail(bufMgr->pinnedCnt(), 0)
+	}
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+// Counts the entries left in the cursor's range, then deletes the cursor
+int cursorCount(ScanCursor* cursor)
+{
+	int count = 0;
+	RecordId rid;
+	try
+	{
+		while (1)
+		{
+			cursor->scanNext(rid);
+			count++;
+		}
+	}
+	catch (IndexScanCompletedException e)
+	{
+	}
+	delete cursor;
+	return count;
+}
+
+void batchScanTests()
+{
+	std::cout << "Batch scan tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+
+	{
+		std::string indexName;
+		BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+
+		// batches of every size must return what scanNext returns, in the same order,
+		// through leaf boundaries and up to either kind of high bound
+		const int lows[] = {-10, 25, 0, 4990, 6000};
+		const int highs[] = {5010, 40, 5000, 4999, 7000};
+		const std::size_t batchSizes[] = {1, 7, 1000, 10000};
+		int mismatches = 0;
+		for (int r = 0; r < 5; r++)
+		{
+			for (int op = 0; op < 2; op++)
+			{
+				std::vector<RecordId> expected;
+				ScanCursor* cursor = index.openScan(&lows[r], op ? GT : GTE, &highs[r], op ? LTE : LT);
+				try
+				{
+					RecordId rid;
+					while (1)
+					{
+						cursor->scanNext(rid);
+						expected.push_back(rid);
+					}
+				}
+				catch (IndexScanCompletedException e)
+				{
+				}
+				delete cursor;
+				for (int b = 0; b < 4; b++)
+				{
+					std::vector<RecordId> found;
+					std::vector<RecordId> batch(batchSizes[b]);
+					cursor = index.openScan(&lows[r], op ? GT : GTE, &highs[r], op ? LTE : LT);
+					std::size_t n;
+					do
+					{
+						n = cursor->scanNextBatch(&batch[0], batch.size());
+						found.insert(found.end(), batch.begin(), batch.begin() + n);
+					} while (n == batch.size());
+					mismatches += cursor->scanNextBatch(&batch[0], batch.size()) != 0;
+					delete cursor;
+					mismatches += found.size() != expected.size();
+					for (std::size_t i = 0; i < found.size() && i < expected.size(); i++)
+						mismatches += found[i].page_number != expected[i].page_number || found[i].slot_number != expected[i].slot_number;
+				}
+			}
+		}
+		checkPassFail(mismatches, 0)
+
+		int low = 0, high = 5000;
+		RecordId rids[64];
+		index.startScan(&low, GTE, &high, LT);
+		int total = 0;
+		std::size_t n;
+		while ((n = index.scanNextBatch(rids, 64)) > 0)
+			total += n;
+		index.endScan();
+		checkPassFail(total, relationSize)
+	}
+	File::remove(intIndexName);
+
+	{
+		FileScan scan(relationName, bufMgr);
+		RecordId rids[100];
+		int total = 0;
+		std::size_t n;
+		while ((n = scan.scanNextBatch(rids, 100)) > 0)
+			total += n;
+		checkPassFail(total, relationSize)
+		checkPassFail(scan.scanNextBatch(rids, 100), 0)
+	}
+	deleteRelation();
+}
+
+void concurrentIndexTests()
+{
+	std::cout << "Concurrent index tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	createRelationRandom();
+
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+
+	{
+		std::string indexName;
+		BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+
+		// inserted keys point at the record of key 0
+		int zero = 0;
+		RecordId zeroRid;
+		index.startScan(&zero, GTE, &zero, LTE);
+		index.scanNext(zeroRid);
+		index.endScan();
+
+		// writers split leaves above the relation's keys, deleters merge and redistribute
+		// the leaves below 2500, and readers keep scanning [2500, 5000), which nobody changes
+		const int numWriters = 4;
+		const int numDeleters = 2;
+		const int numReaders = 2;
+		const int insertsPerWriter = 3000;
+		const int half = relationSize / 2;
+		std::atomic<int> failures(0);
+		std::atomic<int> writersLeft(numWriters + numDeleters);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numWriters; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				for (int key = relationSize + t; key < relationSize + numWriters * insertsPerWriter; key += numWriters)
+					index.insertEntry(&key, zeroRid);
+				writersLeft--;
+			}));
+		}
+		for (int t = 0; t < numDeleters; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				for (int key = t; key < half; key += numDeleters)
+					failures += !index.deleteEntry(&key);
+				writersLeft--;
+			}));
+		}
+		for (int t = 0; t < numReaders; t++)
+		{
+			threads.push_back(std::thread([&]() {
+				int low = half, high = relationSize;
+				do
+				{
+					failures += cursorCount(index.openScan(&low, GTE, &high, LT)) != relationSize - half;
+				} while (writersLeft > 0);
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		checkPassFail(failures, 0)
+		checkPassFail(index.validate(false), true)
+		int low = 0, high = relationSize + numWriters * insertsPerWriter;
+		checkPassFail(cursorCount(index.openScan(&low, GTE, &high, LT)), relationSize - half + numWriters * insertsPerWriter)
+		checkPassFail(index.deleteEntry(&zero), false)
+		checkPassFail(bufMgr->pinnedCnt(), 0)
+	}
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+void postingListTests()
+{
+	std::cout << "Posting list tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// record ids round trip through the inline coding, gaps of many pages included
+	std::vector<std::uint64_t> codes, decoded;
+	for (int i = 0; i < 200; i++)
+	{
+		RecordId r;
+		r.page_number = i * i * 977 + 1;
+		r.slot_number = (i * 31) % 300;
+		codes.push_back(PostingList::code(r));
+	}
+	char value[8 * PostingList::MAX_INLINE];
+	const int length = PostingList::putInline(value, codes.data(), codes.size());
+	PostingList::getInline(value, decoded);
+	checkPassFail(length, PostingList::inlineLength(codes.data(), codes.size()))
+	checkPassFail((decoded == codes), true)
+	checkPassFail(PostingList::count(value), 200u)
+	checkPassFail(PostingList::code(PostingList::rid(codes[199])), codes[199])
+
+	// three keys of about 1700 records each: every list spills to an overflow page
+	const int distinctKeys = 3;
+	createRelationDuplicates(distinctKeys);
+	if (File::exists(intIndexName))
+	{
+		File::remove(intIndexName);
+	}
+	for (int bulk = 0; bulk < 2; bulk++)
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, bulk == 1);
+			checkPassFail(index.validate(false), true)
+			IndexShape shape = index.shape();
+			checkPassFail(shape.entries, (size_t)distinctKeys)
+			checkPassFail(shape.rids, (size_t)relationSize)
+			checkPassFail((shape.postingPages >= (size_t)distinctKeys), true)
+			const size_t spilledPages = shape.postingPages;
+			checkPassFail(intScan(&index,1,GTE,1,LTE), 1667)
+			checkPassFail(intScan(&index,0,GT,2,LTE), 3333)
+
+			// the record ids of key 0 added to key 1 in random order land in the middle of
+			// its overflow pages and split them; a scan still returns them in page order
+			int zero = 0, one = 1;
+			std::vector<RecordId> zeroRids(1667);
+			index.startScan(&zero, GTE, &zero, LTE);
+			checkPassFail(index.scanNextBatch(zeroRids.data(), zeroRids.size()), zeroRids.size())
+			index.endScan();
+			for (int round = 0; round < 6; round++)
+			{
+				std::random_shuffle(zeroRids.begin(), zeroRids.end());
+				for (size_t i = 0; i < zeroRids.size(); i++)
+					index.insertEntry(&one, zeroRids[i]);
+			}
+			checkPassFail(index.validate(false), true)
+			checkPassFail(ridOrderCount(index.openScan(&one, GTE, &one, LTE)), 1667 * 7)
+			checkPassFail(cursorCount(index.openScan(&zero, GTE, &one, LTE)), 1667 * 8)
+			checkPassFail((index.shape().postingPages > spilledPages), true)
+
+			// deletes take the smallest record id first; a list down to one short page
+			// goes back into its leaf, and the key goes with its last record id
+			RecordId first, next;
+			index.startScan(&zero, GTE, &zero, LTE);
+			index.scanNext(first);
+			index.endScan();
+			checkPassFail(index.deleteEntry(&zero), true)
+			index.startScan(&zero, GTE, &zero, LTE);
+			index.scanNext(next);
+			index.endScan();
+			checkPassFail((PostingList::code(first) < PostingList::code(next)), true)
+			bool deleted = true;
+			for (int i = 0; i < 1667 * 7 - 100; i++)
+				deleted = index.deleteEntry(&one) && deleted;
+			checkPassFail(deleted, true)
+			checkPassFail(index.validate(false), true)
+			checkPassFail((index.shape().postingPages < spilledPages), true)
+			checkPassFail(ridOrderCount(index.openScan(&one, GTE, &one, LTE)), 100)
+			for (int i = 0; i < 100; i++)
+				deleted = index.deleteEntry(&one) && deleted;
+			checkPassFail(deleted, true)
+			checkPassFail(index.deleteEntry(&one), false)
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.shape().entries, (size_t)distinctKeys - 1)
+			checkPassFail(intScan(&index,0,GTE,2,LTE), 3332)
+		}
+		File::remove(indexName);
+	}
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,d), DOUBLE, true);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.shape().entries, (size_t)distinctKeys)
+			checkPassFail(doubleScan(&index,1,GTE,2,LTE), 3333)
+		}
+		File::remove(indexName);
+	}
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), STRING, true);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.shape().entries, (size_t)distinctKeys)
+			checkPassFail(stringScan(&index,0,GT,2,LTE), 3333)
+			char key[STRINGSIZE + 1];
+			sprintf(key, "%05d string record", 2);
+			checkPassFail(ridOrderCount(index.openScan(key, GTE, key, LTE)), 1666)
+		}
+		File::remove(indexName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void lookupTests()
+{
+	std::cout << "Lookup tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// 1000 keys of five records each; keys from 1000 up are not in the relation
+	const int distinctKeys = 1000;
+	createRelationDuplicates(distinctKeys);
+	for (int bloom = 0; bloom < 2; bloom++)
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, bloom == 1 ? 10 : 0);
+			checkPassFail(index.validate(false), true)
+
+			// a lookup finds what a scan of one key does, in the same order
+			std::vector<RecordId> rids, scanned(5);
+			int found = 0;
+			for (int key = 0; key < distinctKeys; key += 7)
+			{
+				rids.clear();
+				index.startScan(&key, GTE, &key, LTE);
+				index.scanNextBatch(scanned.data(), scanned.size());
+				index.endScan();
+				found += index.lookup(&key, rids) == 5 && std::equal(rids.begin(), rids.end(), scanned.begin());
+			}
+			checkPassFail(found, (distinctKeys + 6) / 7)
+
+			// lookup appends, and leaves the vector alone for a missing key
+			int key = 3;
+			checkPassFail(index.lookup(&key, rids), 5u)
+			checkPassFail(rids.size(), 10u)
+			key = -1;
+			checkPassFail(index.lookup(&key, rids), 0u)
+			checkPassFail(rids.size(), 10u)
+			const RecordId rid = rids[0];
+			rids.clear();
+
+			// a key inserted after the filter was built is found, and one deleted is gone
+			key = distinctKeys + 5;
+			checkPassFail(index.lookup(&key, rids), 0u)
+			index.insertEntry(&key, rid);
+			checkPassFail(index.lookup(&key, rids), 1u)
+			checkPassFail(index.deleteEntry(&key), true)
+			checkPassFail(index.lookup(&key, rids), 0u)
+		}
+		{
+			// reopened, the index keeps its filter: absent keys read almost no pages
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			std::vector<RecordId> rids;
+			bufMgr->clearBufStats();
+			for (int key = distinctKeys + 10; key < 2 * distinctKeys + 10; key++)
+				index.lookup(&key, rids);
+			checkPassFail(rids.size(), 0u)
+			const int accesses = bufMgr->getBufStats().accesses;
+			checkPassFail((bloom == 1 ? accesses < distinctKeys / 10 : accesses >= distinctKeys), true)
+			int key = distinctKeys + 5;
+			checkPassFail(index.lookup(&key, rids), 0u)
+			key = distinctKeys - 1;
+			checkPassFail(index.lookup(&key, rids), 5u)
+		}
+		File::remove(indexName);
+	}
+
+	// doubles within DOUBLEEPSILON of a key, and strings, pass the filter
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,d), DOUBLE, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 10);
+			std::vector<RecordId> rids;
+			int found = 0;
+			for (int key = 0; key < distinctKeys; key++)
+			{
+				const double below = key - DOUBLEEPSILON / 2, above = key + DOUBLEEPSILON / 2;
+				found += index.lookup(&below, rids) == 5;
+				found += index.lookup(&above, rids) == 5;
+			}
+			checkPassFail(found, 2 * distinctKeys)
+			const double missing = 0.5;
+			checkPassFail(index.lookup(&missing, rids), 0u)
+		}
+		File::remove(indexName);
+	}
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), STRING, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 10);
+			std::vector<RecordId> rids;
+			char key[STRINGSIZE + 1];
+			int found = 0;
+			for (int i = 0; i < distinctKeys; i++)
+			{
+				sprintf(key, "%05d string record", i);
+				found += index.lookup(key, rids) == 5;
+			}
+			checkPassFail(found, distinctKeys)
+			sprintf(key, "%05d string record", distinctKeys);
+			checkPassFail(index.lookup(key, rids), 0u)
+		}
+		File::remove(indexName);
+	}
+
+	// a list in overflow pages comes back whole
+	deleteRelation();
+	createRelationDuplicates(2);
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			std::vector<RecordId> rids;
+			int key = 1;
+			checkPassFail(index.lookup(&key, rids), (size_t)relationSize / 2)
+			checkPassFail(ridOrderCount(index.openScan(&key, GTE, &key, LTE)), relationSize / 2)
+		}
+		File::remove(indexName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void sequentialInsertTests()
+{
+	std::cout << "Sequential insert tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// inserted in key order, either way, leaves split 90/10 and stay nearly full;
+	// in random order they split in half
+	double fill[3][3];
+	for (int order = 0; order < 3; order++)
+	{
+		if (order == 0)
+			createRelationForward();
+		else if (order == 1)
+			createRelationBackward();
+		else
+			createRelationRandom();
+		for (int type = 0; type < 3; type++)
+		{
+			const int offsets[] = {offsetof(tuple,i), offsetof(tuple,d), offsetof(tuple,s)};
+			std::string indexName;
+			{
+				BTreeIndex index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, false);
+				checkPassFail(index.validate(false), true)
+				const IndexShape shape = index.shape();
+				checkPassFail(shape.entries, (size_t)relationSize)
+				fill[type][order] = shape.leafFill;
+				if (type == INTEGER)
+				{
+					checkPassFail(intScan(&index,25,GT,40,LT), 14)
+					checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+				}
+			}
+			File::remove(indexName);
+		}
+		deleteRelation();
+	}
+	for (int type = 0; type < 3; type++)
+		checkPassFail((fill[type][0] > 0.8 && fill[type][1] > 0.8), true)
+	checkPassFail((fill[STRING][2] < 0.7), true)
+
+	// appends past the last leaf skip the walk down; keys that go elsewhere, and keys
+	// after deletes have merged leaves, still find their own leaves
+	createRelationForward();
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, false);
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = 1;
+			for (int key = relationSize; key < 4 * relationSize; key++)
+				index.insertEntry(&key, rid);
+			for (int key = -1; key > -relationSize; key--)
+				index.insertEntry(&key, rid);
+			for (int key = 0; key < relationSize; key += 2)
+				index.insertEntry(&key, rid);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(intScan(&index,relationSize - 10,GTE,relationSize + 10,LT), 20 + 5)
+			checkPassFail(intScan(&index,-10,GT,10,LT), 9 + 10 + 5)
+			bool deleted = true;
+			for (int key = 3 * relationSize; key < 4 * relationSize; key++)
+				deleted = index.deleteEntry(&key) && deleted;
+			checkPassFail(deleted, true)
+			for (int key = 3 * relationSize - 1; key >= 2 * relationSize; key--)
+				deleted = index.deleteEntry(&key) && deleted;
+			checkPassFail(deleted, true)
+			for (int key = 2 * relationSize; key < 3 * relationSize; key++)
+				index.insertEntry(&key, rid);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(intScan(&index,-relationSize,GT,4 * relationSize,LT), 4 * relationSize - 1 + relationSize / 2)
+			std::vector<RecordId> rids;
+			int key = 3 * relationSize - 1;
+			checkPassFail(index.lookup(&key, rids), 1u)
+			key = 3 * relationSize;
+			checkPassFail(index.lookup(&key, rids), 0u)
+		}
+		File::remove(indexName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void freePageTests()
+{
+	std::cout << "Free page tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// a deleted blob page is handed out again, the last deleted first
+	const std::string blobName = "freepages";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		PageId pageNos[3];
+		for (int i = 0; i < 3; i++)
+			blob.allocatePage(pageNos[i]);
+		blob.deletePage(pageNos[1]);
+		blob.deletePage(pageNos[0]);
+		checkPassFail(blob.freePageCount(), 2u)
+		// a page already on the free list is not deleted again
+		bool refused = false;
+		try
+		{
+			blob.deletePage(pageNos[1]);
+		}
+		catch(InvalidPageException e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+		checkPassFail(blob.freePageCount(), 2u)
+	}
+	{
+		BlobFile blob = BlobFile::open(blobName);
+		PageId pageNo;
+		blob.allocatePage(pageNo);
+		checkPassFail(pageNo, 1u)
+		blob.allocatePage(pageNo);
+		checkPassFail(pageNo, 2u)
+		blob.allocatePage(pageNo);
+		checkPassFail(pageNo, 4u)
+		checkPassFail(blob.pageCount(), 4u)
+		checkPassFail(blob.freePageCount(), 0u)
+	}
+	File::remove(blobName);
+
+	// pages the deletes free are reused, so churn does not grow the index file
+	createRelationForward();
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, false);
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = 1;
+			std::size_t filePages[3];
+			bool deleted = true;
+			for (int round = 0; round < 3; round++)
+			{
+				for (int key = relationSize; key < 3 * relationSize; key++)
+					index.insertEntry(&key, rid);
+				for (int key = 3 * relationSize - 1; key >= relationSize; key--)
+					deleted = index.deleteEntry(&key) && deleted;
+				const IndexShape shape = index.shape();
+				filePages[round] = shape.filePages;
+				checkPassFail((shape.freePages > 0), true)
+			}
+			checkPassFail(deleted, true)
+			checkPassFail(filePages[1], filePages[0])
+			checkPassFail(filePages[2], filePages[0])
+			checkPassFail(index.validate(false), true)
+			checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+
+			// the index is open
+			bool thrown = false;
+			try
+			{
+				BTreeIndex::compact(indexName, bufMgr);
+			}
+			catch(FileOpenException e)
+			{
+				thrown = true;
+			}
+			checkPassFail(thrown, true)
+		}
+
+		// compacted, the file holds just the pages in use
+		checkPassFail((BTreeIndex::compact(indexName, bufMgr) > 0), true)
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			checkPassFail(index.validate(false), true)
+			const IndexShape shape = index.shape();
+			checkPassFail(shape.freePages, 0u)
+			checkPassFail(shape.filePages, 1 + shape.nonLeaves + shape.leaves)
+			checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+			checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		}
+		File::remove(indexName);
+	}
+	deleteRelation();
+
+	// every key type, with the pages of three keys in four freed
+	createRelationRandom();
+	for (int type = 0; type < 3; type++)
+	{
+		const int offsets[] = {offsetof(tuple,i), offsetof(tuple,d), offsetof(tuple,s)};
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, false);
+			bool deleted = true;
+			for (int i = 0; i < relationSize; i++)
+			{
+				if (i % 4 == 0)
+					continue;
+				int intKey = i;
+				double doubleKey = i;
+				char stringKey[STRINGSIZE + 1];
+				sprintf(stringKey, "%05d string record", i);
+				const void* keys[] = {&intKey, &doubleKey, stringKey};
+				deleted = index.deleteEntry(keys[type]) && deleted;
+			}
+			checkPassFail(deleted, true)
+			checkPassFail((index.shape().freePages > 0), true)
+		}
+		checkPassFail((BTreeIndex::compact(indexName, bufMgr) > 0), true)
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, true);
+			checkPassFail(index.validate(false), true)
+			const IndexShape shape = index.shape();
+			checkPassFail(shape.entries, (size_t)relationSize / 4)
+			checkPassFail(shape.freePages, 0u)
+			checkPassFail(shape.filePages, 1 + shape.nonLeaves + shape.leaves)
+			if (type == INTEGER)
+				checkPassFail(intScan(&index,25,GT,40,LT), 3)
+		}
+		File::remove(indexName);
+	}
+	deleteRelation();
+
+	// overflow posting pages and the Bloom filter move with the tree
+	createRelationDuplicates(2);
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 10);
+			int key = 0;
+			for (int i = 0; i < relationSize / 4; i++)
+				index.deleteEntry(&key);
+		}
+		BTreeIndex::compact(indexName, bufMgr);
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			checkPassFail(index.validate(false), true)
+			const IndexShape shape = index.shape();
+			checkPassFail(shape.freePages, 0u)
+			checkPassFail((shape.filePages > 1 + shape.nonLeaves + shape.leaves + shape.postingPages), true)
+			std::vector<RecordId> rids;
+			int key = 1;
+			checkPassFail(index.lookup(&key, rids), (size_t)relationSize / 2)
+			key = 0;
+			checkPassFail(index.lookup(&key, rids), (size_t)relationSize / 4)
+			bufMgr->clearBufStats();
+			for (key = 2; key < 1002; key++)
+				index.lookup(&key, rids);
+			checkPassFail((bufMgr->getBufStats().accesses < 100), true)
+		}
+		File::remove(indexName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void orderStatisticTests()
+{
+	std::cout << "Order statistic tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// with and without subtree counts, bulk loaded and inserted, every key type gives
+	// the same counts, ranks and record ids
+	createRelationRandom();
+	for (int counted = 0; counted < 2; counted++)
+	{
+		for (int bulk = 0; bulk < 2; bulk++)
+		{
+			for (int type = 0; type < 3; type++)
+			{
+				const int offsets[] = {offsetof(tuple,i), offsetof(tuple,d), offsetof(tuple,s)};
+				int intKeys[2];
+				double doubleKeys[2];
+				char stringKeys[2][STRINGSIZE + 1];
+				// points keys[0] and keys[1] at low and high of the type
+				auto setKeys = [&](int low, int high) {
+					intKeys[0] = low;
+					intKeys[1] = high;
+					doubleKeys[0] = low;
+					doubleKeys[1] = high;
+					sprintf(stringKeys[0], "%05d string record", low);
+					sprintf(stringKeys[1], "%05d string record", high);
+				};
+				const void* lowKeys[] = {&intKeys[0], &doubleKeys[0], stringKeys[0]};
+				const void* highKeys[] = {&intKeys[1], &doubleKeys[1], stringKeys[1]};
+				// true if select left key i in keys[0]
+				auto selected = [&](int i) {
+					char stringKey[STRINGSIZE + 1];
+					sprintf(stringKey, "%05d string record", i);
+					return type == INTEGER ? intKeys[0] == i
+						: type == DOUBLE ? doubleKeys[0] == i
+						: strncmp(stringKeys[0], stringKey, STRINGSIZE) == 0;
+				};
+
+				std::string indexName;
+				{
+					BTreeIndex index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, bulk == 1,
+						BTreeIndex::DEFAULT_FILL_FACTOR, 0, counted == 1);
+					checkPassFail(index.validate(false), true)
+
+					int right = 0;
+					for (int low = 0; low < relationSize; low += 397)
+					{
+						const int high = std::min(relationSize - 1, low + 1234);
+						setKeys(low, high);
+						right += index.countRange(lowKeys[type], GTE, highKeys[type], LTE) == (size_t)(high - low + 1);
+						right += index.countRange(lowKeys[type], GT, highKeys[type], LT) == (size_t)(high - low - 1);
+						right += index.rank(lowKeys[type]) == (size_t)low;
+
+						RecordId rid;
+						setKeys(-1, -1);
+						right += index.select(low, (void*)lowKeys[type], rid) && selected(low);
+					}
+					checkPassFail(right, 4 * ((relationSize + 396) / 397))
+					setKeys(0, 0);
+					RecordId rid;
+					checkPassFail(index.select(relationSize, (void*)lowKeys[type], rid), false)
+					setKeys(3, 3);
+					checkPassFail(index.countRange(lowKeys[type], GT, highKeys[type], LT), 0u)
+
+					// three keys in four deleted, merging leaves and non-leaves
+					bool deleted = true;
+					for (int i = 0; i < relationSize; i++)
+					{
+						if (i % 4 == 0)
+							continue;
+						setKeys(i, i);
+						deleted = index.deleteEntry(lowKeys[type]) && deleted;
+					}
+					checkPassFail(deleted, true)
+					checkPassFail(index.validate(false), true)
+					setKeys(0, relationSize);
+					checkPassFail(index.countRange(lowKeys[type], GTE, highKeys[type], LT), (size_t)relationSize / 4)
+					right = 0;
+					for (int i = 0; i < relationSize; i += 101)
+					{
+						setKeys(i, i);
+						right += index.rank(lowKeys[type]) == (size_t)(i + 3) / 4;
+						setKeys(-1, -1);
+						right += index.select(i / 4, (void*)lowKeys[type], rid) && selected(i / 4 * 4);
+					}
+					checkPassFail(right, 2 * ((relationSize + 100) / 101))
+				}
+				File::remove(indexName);
+			}
+		}
+	}
+	deleteRelation();
+
+	// the k-th record id and its key come from walking down the counts
+	createRelationForward();
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 0, true);
+			int right = 0;
+			for (int k = 0; k < relationSize; k += 13)
+			{
+				int key = -1;
+				RecordId rid;
+				std::vector<RecordId> rids;
+				right += index.select(k, &key, rid) && key == k && index.lookup(&key, rids) == 1 && rids[0] == rid;
+			}
+			checkPassFail(right, (relationSize + 12) / 13)
+
+			// a count reads a path down the tree for each bound, not the leaves between
+			const IndexShape shape = index.shape();
+			int low = 0, high = relationSize - 1;
+			bufMgr->clearBufStats();
+			checkPassFail(index.countRange(&low, GTE, &high, LTE), (size_t)relationSize)
+			checkPassFail((bufMgr->getBufStats().accesses <= 2 * (shape.height + 1)), true)
+			checkPassFail((shape.leaves > (size_t)(2 * (shape.height + 1))), true)
+
+			// inserts keep the counts, splitting up to a new root
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = 1;
+			for (int key = relationSize; key < 4 * relationSize; key++)
+				index.insertEntry(&key, rid);
+			checkPassFail(index.validate(false), true)
+			high = 4 * relationSize;
+			checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(4 * relationSize))
+			int key = 2 * relationSize;
+			checkPassFail(index.rank(&key), (size_t)(2 * relationSize))
+		}
+		{
+			// reopened, the index keeps its counts
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			int key = 3;
+			checkPassFail(index.deleteEntry(&key), true)
+			checkPassFail(index.validate(false), true)
+			key = 10;
+			checkPassFail(index.rank(&key), 9u)
+			int low = 0;
+			bufMgr->clearBufStats();
+			checkPassFail(index.countRange(&low, GTE, &key, LTE), 10u)
+			checkPassFail((bufMgr->getBufStats().accesses < 10), true)
+		}
+		File::remove(indexName);
+	}
+	deleteRelation();
+
+	// duplicates are counted by their posting lists, in overflow pages too
+	createRelationDuplicates(2);
+	for (int counted = 0; counted < 2; counted++)
+	{
+		std::string indexName;
+		{
+			BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, counted == 1,
+				BTreeIndex::DEFAULT_FILL_FACTOR, 0, counted == 1);
+			int zero = 0, one = 1;
+			checkPassFail(index.countRange(&zero, GTE, &zero, LTE), (size_t)relationSize / 2)
+			checkPassFail(index.countRange(&zero, GT, &one, LTE), (size_t)relationSize / 2)
+			checkPassFail(index.rank(&one), (size_t)relationSize / 2)
+			std::vector<RecordId> rids;
+			index.lookup(&one, rids);
+			int right = 0;
+			for (int k = 0; k < relationSize / 2; k += 97)
+			{
+				int key = -1;
+				RecordId rid;
+				right += index.select(relationSize / 2 + k, &key, rid) && key == 1 && rid == rids[k];
+			}
+			checkPassFail(right, (relationSize / 2 + 96) / 97)
+			for (int i = 0; i < relationSize / 4; i++)
+				index.deleteEntry(&zero);
+			checkPassFail(index.validate(false), true)
+			checkPassFail(index.rank(&one), (size_t)relationSize / 4)
+		}
+		File::remove(indexName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void bEpsilonTests()
+{
+	std::cout << "B-epsilon tree tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// every key type scans the same record ids as a B+ Tree, with messages still buffered,
+	// after deletes, each found through the buffers above its leaf, and after reopening
+	indexEngineTests<BEpsilonIndex>(
+		[](BEpsilonIndex& index, BTreeIndex& btree, int type) {
+			checkPassFail((index.bufferedMessages() > 0), true)
+			scanOperatorTests(index, btree, type);
+		},
+		[](BEpsilonIndex&, int) {
+		});
+
+	// many record ids of one key span leaves, and deletes take the first of them
+	createRelationDuplicates(2);
+	{
+		std::string btreeName, indexName;
+		{
+			BTreeIndex btree(relationName, btreeName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			BEpsilonIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER);
+			int zero = 0, one = 1;
+			checkPassFail(scanRids(index, &one, GTE, &one, LTE).size(), (size_t)relationSize / 2)
+			checkPassFail((scanRids(index, &zero, GTE, &one, LTE) == scanRids(btree, &zero, GTE, &one, LTE)), true)
+			for (int i = 0; i < relationSize / 4; i++)
+			{
+				index.deleteEntry(&one);
+				btree.deleteEntry(&one);
+			}
+			checkPassFail(index.validate(false), true)
+			checkPassFail((scanRids(index, &zero, GTE, &one, LTE) == scanRids(btree, &zero, GTE, &one, LTE)), true)
+			scanErrorTests(index);
+		}
+		File::remove(indexName);
+		File::remove(btreeName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void lsmTreeTests()
+{
+	std::cout << "LSM tree tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// every key type scans and looks up the same record ids as a B+ Tree, with runs on
+	// three levels, after deletes and after reopening, where the memtable was written
+	// out as a run
+	indexEngineTests<LSMIndex>(
+		[](LSMIndex& index, BTreeIndex& btree, int type) {
+			index.waitForCompaction();
+			const std::vector<std::size_t> runs = index.levelRuns();
+			checkPassFail((runs[0] < 4 && runs.size() > 2), true)
+			scanOperatorTests(index, btree, type);
+
+			std::vector<RecordId> rids;
+			const RelationKey seven(7), last(relationSize);
+			checkPassFail(index.lookup(seven.of(type), rids), 1u)
+			checkPassFail((rids == scanRids(btree, seven.of(type), GTE, seven.of(type), LTE)), true)
+			checkPassFail(index.lookup(last.of(type), rids), 0u)
+		},
+		// each delete a tombstone hiding an entry of an older run
+		[](LSMIndex& index, int type) {
+			std::vector<RecordId> rids;
+			const RelationKey one(1);
+			checkPassFail(index.lookup(one.of(type), rids), 0u)
+			index.flushMemtable();
+			index.waitForCompaction();
+		},
+		(std::size_t)300);
+
+	// many record ids of one key across runs; a scan reads the index as it was when it
+	// started, while inserts write runs and merge them away under it
+	createRelationDuplicates(2);
+	{
+		std::string btreeName, indexName;
+		{
+			BTreeIndex btree(relationName, btreeName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			LSMIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER, 300);
+			int zero = 0, one = 1;
+			checkPassFail(scanRids(index, &one, GTE, &one, LTE).size(), (size_t)relationSize / 2)
+			checkPassFail((scanRids(index, &zero, GTE, &one, LTE) == scanRids(btree, &zero, GTE, &one, LTE)), true)
+			for (int i = 0; i < relationSize / 4; i++)
+			{
+				index.deleteEntry(&one);
+				btree.deleteEntry(&one);
+			}
+			checkPassFail((scanRids(index, &zero, GTE, &one, LTE) == scanRids(btree, &zero, GTE, &one, LTE)), true)
+
+			std::vector<RecordId> before;
+			index.startScan(&zero, GTE, &one, LTE);
+			for (int i = 0; i < relationSize; i++)
+			{
+				RecordId rid;
+				rid.page_number = 1000 + i / 100;
+				rid.slot_number = i % 100 + 1;
+				index.insertEntry(&zero, rid);
+			}
+			index.waitForCompaction();
+			try
+			{
+				while (1)
+				{
+					RecordId rid;
+					index.scanNext(rid);
+					before.push_back(rid);
+				}
+			}
+			catch(IndexScanCompletedException e)
+			{
+			}
+			index.endScan();
+			checkPassFail((before == scanRids(btree, &zero, GTE, &one, LTE)), true)
+			std::vector<RecordId> rids;
+			checkPassFail(index.lookup(&zero, rids), (size_t)relationSize / 2 + relationSize)
+			checkPassFail(index.validate(false), true)
+			scanErrorTests(index);
+		}
+		LSMIndex::remove(indexName, bufMgr);
+		File::remove(btreeName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+void hashIndexTests()
+{
+	std::cout << "Extendible hash index tests" << std::endl;
+	std::cout << "-------------------------------" << std::endl;
+
+	// every key type looks up the same record ids as a B+ Tree, after splits, after
+	// deletes and after reopening, with the directory of the meta page
+	indexEngineTests<HashIndex>(
+		[](HashIndex& index, BTreeIndex& btree, int type) {
+			checkPassFail((index.globalDepth() > 0), true)
+
+			std::vector<RecordId> rids, btreeRids;
+			const RelationKey seven(7), last(relationSize);
+			checkPassFail(index.lookup(seven.of(type), rids), 1u)
+			btree.lookup(seven.of(type), btreeRids);
+			checkPassFail((rids == btreeRids), true)
+			checkPassFail(index.lookup(last.of(type), rids), 0u)
+		},
+		[](HashIndex& index, int type) {
+			std::vector<RecordId> rids;
+			const RelationKey one(1);
+			checkPassFail(index.lookup(one.of(type), rids), 0u)
+		});
+
+	// many record ids of one key, on a chain of overflow pages no split can shorten
+	createRelationDuplicates(2);
+	{
+		std::string btreeName, indexName;
+		{
+			BTreeIndex btree(relationName, btreeName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			HashIndex index(relationName, indexName, bufMgr, offsetof(tuple,i), INTEGER);
+			checkPassFail((indexName == btreeName + ".hash"), true)
+			int zero = 0, one = 1;
+			std::vector<RecordId> hashRids, btreeRids;
+			checkPassFail(index.lookup(&one, hashRids), (size_t)relationSize / 2)
+			checkPassFail(index.validate(false), true)
+			for (int i = 0; i < relationSize / 4; i++)
+			{
+				index.deleteEntry(&one);
+				btree.deleteEntry(&one);
+			}
+			hashRids.clear();
+			index.lookup(&zero, hashRids);
+			index.lookup(&one, hashRids);
+			btree.lookup(&zero, btreeRids);
+			btree.lookup(&one, btreeRids);
+			checkPassFail((hashRids == btreeRids), true)
+
+			// inserts fill the room deletes left on the chain
+			for (int i = 0; i < relationSize / 4; i++)
+			{
+				RecordId rid;
+				rid.page_number = 1000 + i / 100;
+				rid.slot_number = i % 100 + 1;
+				index.insertEntry(&one, rid);
+			}
+			hashRids.clear();
+			checkPassFail(index.lookup(&one, hashRids), (size_t)relationSize / 2)
+			checkPassFail((hashRids.back().page_number >= 1000), true)
+			checkPassFail(index.validate(false), true)
+		}
+		File::remove(indexName);
+		File::remove(btreeName);
+	}
+	checkPassFail(bufMgr->pinnedCnt(), 0)
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// scanRids: record ids of a scan of a BTreeIndex, BEpsilonIndex or LSMIndex, in order
+// -----------------------------------------------------------------------------
+
+template <class Index>
+std::vector<RecordId> scanRids(Index& index, const void* lowVal, Operator lowOp, const void* highVal, Operator highOp)
+{
+	std::vector<RecordId> rids;
+	try
+	{
+		index.startScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return rids;
+	}
+	try
+	{
+		while (1)
+		{
+			RecordId rid;
+			index.scanNext(rid);
+			rids.push_back(rid);
+		}
+	}
+	catch(IndexScanCompletedException e)
+	{
+	}
+	index.endScan();
+	return rids;
+}
+
+// -----------------------------------------------------------------------------
+// indexEngineTests: an index engine against a B+ Tree on every key type
+// -----------------------------------------------------------------------------
+
+RelationKey::RelationKey(int key)
+{
+	i = key;
+	d = key;
+	sprintf(s, "%05d string record", key);
+}
+
+const void* RelationKey::of(int type) const
+{
+	const void* keys[] = {&i, &d, s};
+	return keys[type];
+}
+
+template <class Index>
+std::vector<RecordId> rangeRids(Index& index, int type, int low, int high)
+{
+	const RelationKey lowKey(low), highKey(high);
+	return scanRids(index, lowKey.of(type), GTE, highKey.of(type), LT);
+}
+
+std::vector<RecordId> rangeRids(HashIndex& index, int type, int low, int high)
+{
+	std::vector<RecordId> rids;
+	for (int i = low; i < high; i++)
+	{
+		const RelationKey key(i);
+		index.lookup(key.of(type), rids);
+	}
+	return rids;
+}
+
+template <class Index>
+void removeIndex(const std::string& indexName)
+{
+	File::remove(indexName);
+}
+
+template <>
+void removeIndex<LSMIndex>(const std::string& indexName)
+{
+	LSMIndex::remove(indexName, bufMgr);
+}
+
+template <class Index, class Built, class Deleted, class... Args>
+void indexEngineTests(Built built, Deleted deleted, Args... args)
+{
+	createRelationRandom();
+	for (int type = 0; type < 3; type++)
+	{
+		const int offsets[] = {offsetof(tuple,i), offsetof(tuple,d), offsetof(tuple,s)};
+		std::string btreeName, indexName;
+		{
+			BTreeIndex btree(relationName, btreeName, bufMgr, offsets[type], (Datatype)type, true);
+			{
+				Index index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, args...);
+				built(index, btree, type);
+				checkPassFail(index.validate(false), true)
+				checkPassFail(rangeRids(index, type, 26, 40).size(), 14u)
+				checkPassFail((rangeRids(index, type, 0, relationSize) == rangeRids(btree, type, 0, relationSize)), true)
+
+				// three keys in four deleted
+				bool allDeleted = true;
+				for (int i = 0; i < relationSize; i++)
+				{
+					if (i % 4 == 0)
+						continue;
+					const RelationKey key(i);
+					allDeleted = index.deleteEntry(key.of(type)) && allDeleted;
+					btree.deleteEntry(key.of(type));
+				}
+				checkPassFail(allDeleted, true)
+				const RelationKey one(1);
+				checkPassFail(index.deleteEntry(one.of(type)), false)
+				deleted(index, type);
+				checkPassFail(index.validate(false), true)
+				checkPassFail(rangeRids(index, type, 0, relationSize).size(), (size_t)relationSize / 4)
+				checkPassFail((rangeRids(index, type, 0, relationSize) == rangeRids(btree, type, 0, relationSize)), true)
+			}
+			{
+				Index index(relationName, indexName, bufMgr, offsets[type], (Datatype)type, args...);
+				checkPassFail(index.validate(false), true)
+				checkPassFail((rangeRids(index, type, 0, relationSize) == rangeRids(btree, type, 0, relationSize)), true)
+			}
+		}
+		removeIndex<Index>(indexName);
+		File::remove(btreeName);
+		checkPassFail(File::exists(indexName), false)
+	}
+	deleteRelation();
+}
+
+template <class Index>
+void scanOperatorTests(Index& index, BTreeIndex& btree, int type)
+{
+	const RelationKey low(25), high(40);
+	checkPassFail(scanRids(index, low.of(type), GT, high.of(type), LT).size(), 14u)
+	checkPassFail((scanRids(index, low.of(type), GTE, high.of(type), LTE)
+		== scanRids(btree, low.of(type), GTE, high.of(type), LTE)), true)
+}
+
+template <class Index>
+void scanErrorTests(Index& index)
+{
+	int zero = 0, one = 1;
+	bool thrown = false;
+	try
+	{
+		index.startScan(&zero, LT, &one, LTE);
+	}
+	catch(BadOpcodesException e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+	thrown = false;
+	try
+	{
+		index.startScan(&one, GTE, &zero, LTE);
+	}
+	catch(BadScanrangeException e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+	thrown = false;
+	try
+	{
+		index.startScan(&zero, GT, &one, LT);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+	thrown = false;
+	try
+	{
+		index.endScan();
+	}
+	catch(ScanNotInitializedException e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+}
+
+// -----------------------------------------------------------------------------
+// createRelationDuplicates: key i % distinctKeys for record i, in order
+// -----------------------------------------------------------------------------
+
+void createRelationDuplicates(int distinctKeys)
+{
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	file1 = new PageFile(relationName, true);
+	memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+	Page new_page = file1->allocatePage(new_page_number);
+	for (int i = 0; i < relationSize; i++)
+	{
+		record1.i = i % distinctKeys;
+		record1.d = record1.i;
+		sprintf(record1.s, "%05d string record", record1.i);
+		std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
+		try
+		{
+			new_page.insertRecord(new_data);
+		}
+		catch(InsufficientSpaceException e)
+		{
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+			new_page.insertRecord(new_data);
+		}
+	}
+	file1->writePage(new_page_number, new_page);
+}
+
+// Number of record ids of a scan over one key, -1 if they are not in (page, slot) order
+int ridOrderCount(ScanCursor* cursor)
+{
+	int count = 0;
+	bool ordered = true;
+	std::uint64_t previous = 0;
+	RecordId rid;
+	try
+	{
+		while (1)
+		{
+			cursor->scanNext(rid);
+			ordered = ordered && PostingList::code(rid) >= previous;
+			previous = PostingList::code(rid);
+			count++;
+		}
+	}
+	catch (IndexScanCompletedException e)
+	{
+	}
+	delete cursor;
+	return ordered ? count : -1;
+}
+
+template <class Entry, class Key>
+int nodeSearchMismatches(const Entry* entries, int usage, Key key)
+{
+	const int upper = LinearNodeSearch::upperBound(entries, usage, key);
+	const int lower = LinearNodeSearch::lowerBound(entries, usage, key);
+	return (BinaryNodeSearch::upperBound(entries, usage, key) != upper)
+		+ (BinaryNodeSearch::lowerBound(entries, usage, key) != lower)
+		+ (SimdNodeSearch::upperBound(entries, usage, key) != upper)
+		+ (SimdNodeSearch::lowerBound(entries, usage, key) != lower);
+}
+
+template <class Node>
+int stringNodeMismatches(const Node* node, const char* probe)
+{
+	StringKeyValue key;
+	int lower = 0, upper = 0;
+	for (int i = 0; i < node->usage; i++)
+	{
+		const int cmp = strncmp(node->key(i, key), probe, STRINGSIZE);
+		lower += (cmp < 0);
+		upper += (cmp <= 0);
+	}
+	return (node->lowerBound(probe) != lower) + (node->upperBound(probe) != upper);
+}
+
+int countUsedPages(PageFile& file, bool& ordered)
+{
+	int used = 0;
+	PageId last = Page::INVALID_NUMBER;
+	ordered = true;
+	for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+	{
+		ordered = ordered && iter.page_number() > last;
+		last = iter.page_number();
+		used++;
+	}
+	return used;
+}
+
 void deleteRelation()
 {
 	if(file1)
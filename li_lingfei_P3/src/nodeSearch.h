@@ -0,0 +1,252 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <climits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "btree.h"
+
+/**
+ * Intra-node search kernels. The B+-tree searches its nodes through NodeSearch,
+ * which is picked at compile time with -DNODE_SEARCH=<kernel>:
+ *     NODE_SEARCH_LINEAR   the original scan from the left
+ *     NODE_SEARCH_BINARY   branchless binary search, for every key type
+ *     NODE_SEARCH_SIMD     binary search down to a small window, which is then
+ *                          compared all at once: AVX2 gathers with -mavx2,
+ *                          SSE2 for doubles otherwise.
+ * String nodes keep their keys in a key heap and binary search it themselves
+ * (btreeNode.h).
+ */
+#define NODE_SEARCH_LINEAR 0
+#define NODE_SEARCH_BINARY 1
+#define NODE_SEARCH_SIMD 2
+
+#ifndef NODE_SEARCH
+#define NODE_SEARCH NODE_SEARCH_SIMD
+#endif
+
+namespace badgerdb
+{
+
+/**
+ * @brief Original kernel: walks the node from the left.
+ */
+struct LinearNodeSearch {
+    /**
+     * Number of leading entries whose key is not greater than key, i.e. the
+     * position of the first entry with a greater key
+     */
+    template<class Entry, class Key>
+    static int upperBound(const Entry* entries, int usage, Key key) {
+        int i = 0;
+        while(i < usage && !keyLess(key, entries[i].key)) {
+            i ++;
+        }
+        return i;
+    }
+
+    /**
+     * Number of leading entries whose key is smaller than key, i.e. the
+     * position of the first entry with an equal or greater key
+     */
+    template<class Entry, class Key>
+    static int lowerBound(const Entry* entries, int usage, Key key) {
+        int i = 0;
+        while(i < usage && keyLess(entries[i].key, key)) {
+            i ++;
+        }
+        return i;
+    }
+};
+
+/**
+ * @brief Binary search whose loop has no data dependent branch: each step
+ * halves the window with a conditional move.
+ */
+struct BinaryNodeSearch {
+    template<class Entry, class Key>
+    static int upperBound(const Entry* entries, int usage, Key key) {
+        int base = 0;
+        int len = usage;
+        narrowUpper(entries, base, len, key, 1);
+        return base + (len == 1 && !keyLess(key, entries[base].key));
+    }
+
+    template<class Entry, class Key>
+    static int lowerBound(const Entry* entries, int usage, Key key) {
+        int base = 0;
+        int len = usage;
+        narrowLower(entries, base, len, key, 1);
+        return base + (len == 1 && keyLess(entries[base].key, key));
+    }
+
+protected:
+    /**
+     * Shrinks [base, base + len) around the answer until at most window
+     * entries are left. The answer stays within [base, base + len].
+     */
+    template<class Entry, class Key>
+    static void narrowUpper(const Entry* entries, int& base, int& len, Key key, const int window) {
+        while(len > window) {
+            const int half = len / 2;
+            base = !keyLess(key, entries[base + half - 1].key) ? base + half : base;
+            len -= half;
+        }
+    }
+
+    template<class Entry, class Key>
+    static void narrowLower(const Entry* entries, int& base, int& len, Key key, const int window) {
+        while(len > window) {
+            const int half = len / 2;
+            base = keyLess(entries[base + half - 1].key, key) ? base + half : base;
+            len -= half;
+        }
+    }
+};
+
+/**
+ * @brief Binary search down to WINDOW entries, then one vector comparison of
+ * the window counts the entries in front of the answer. Int and double keys
+ * only; other keys fall through to BinaryNodeSearch.
+ */
+struct SimdNodeSearch : public BinaryNodeSearch {
+    using BinaryNodeSearch::upperBound;
+    using BinaryNodeSearch::lowerBound;
+
+    static const int WINDOW = 16;
+
+    template<class Entry>
+    static int upperBound(const Entry* entries, int usage, int key) {
+        return intWindow(entries, usage, key, true);
+    }
+    template<class Entry>
+    static int lowerBound(const Entry* entries, int usage, int key) {
+        return intWindow(entries, usage, key, false);
+    }
+    template<class Entry>
+    static int upperBound(const Entry* entries, int usage, double key) {
+        return doubleWindow(entries, usage, key, true);
+    }
+    template<class Entry>
+    static int lowerBound(const Entry* entries, int usage, double key) {
+        return doubleWindow(entries, usage, key, false);
+    }
+
+private:
+    template<class Entry>
+    static int intWindow(const Entry* entries, int usage, int key, const bool upper) {
+        int base = 0;
+        int len = usage;
+        if(upper) {
+            narrowUpper(entries, base, len, key, WINDOW);
+        } else {
+            narrowLower(entries, base, len, key, WINDOW);
+        }
+        //upper counts entries <= key, lower counts entries < key, or <= key - 1
+        if(!upper && key == INT_MIN) {
+            return base;
+        }
+        const int bound = upper ? key : key - 1;
+        const Entry* window = entries + base;
+        int count = 0;
+        int i = 0;
+        //a compare sets a lane to -1, so adding the masks counts the keys above bound, negated.
+        //Without AVX2 gathers, packing the strided keys costs more than the plain loop below
+#if defined(__AVX2__)
+        const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                _mm256_set1_epi32(sizeof(Entry)));
+        const __m256i bounds = _mm256_set1_epi32(bound);
+        __m256i greater = _mm256_setzero_si256();
+        for(; i + 8 <= len; i += 8) {
+            const __m256i keys = _mm256_i32gather_epi32((const int*)&window[i].key, offsets, 1);
+            greater = _mm256_add_epi32(greater, _mm256_cmpgt_epi32(keys, bounds));
+        }
+        count = i + sumLanes(_mm_add_epi32(_mm256_castsi256_si128(greater), _mm256_extracti128_si256(greater, 1)));
+#endif
+        for(; i < len; i ++) {
+            count += window[i].key <= bound;
+        }
+        return base + count;
+    }
+
+    template<class Entry>
+    static int doubleWindow(const Entry* entries, int usage, double key, const bool upper) {
+        int base = 0;
+        int len = usage;
+        if(upper) {
+            narrowUpper(entries, base, len, key, WINDOW);
+        } else {
+            narrowLower(entries, base, len, key, WINDOW);
+        }
+        const Entry* window = entries + base;
+        int count = 0;
+        int i = 0;
+        //hits are key < value (upper) or value < key (lower) and not within DOUBLEEPSILON;
+        //64 bit masks of -1 are added up as for ints
+#if defined(__AVX2__)
+        const __m128i offsets = _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(sizeof(Entry)));
+        const __m256d keys = _mm256_set1_pd(key);
+        const __m256d epsilon = _mm256_set1_pd(DOUBLEEPSILON);
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        __m256i hits = _mm256_setzero_si256();
+        for(; i + 4 <= len; i += 4) {
+            const __m256d values = _mm256_i32gather_pd((const double*)&window[i].key, offsets, 1);
+            const __m256d equal = _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(values, keys)), epsilon, _CMP_LT_OQ);
+            const __m256d less = upper ? _mm256_cmp_pd(keys, values, _CMP_LT_OQ) : _mm256_cmp_pd(values, keys, _CMP_LT_OQ);
+            hits = _mm256_add_epi64(hits, _mm256_castpd_si256(_mm256_andnot_pd(equal, less)));
+        }
+        const int found = -sumLanes64(_mm_add_epi64(_mm256_castsi256_si128(hits), _mm256_extracti128_si256(hits, 1)));
+        count = upper ? i - found : found;
+#elif defined(__SSE2__)
+        const __m128d keys = _mm_set1_pd(key);
+        const __m128d epsilon = _mm_set1_pd(DOUBLEEPSILON);
+        const __m128d sign = _mm_set1_pd(-0.0);
+        __m128i hits = _mm_setzero_si128();
+        for(; i + 2 <= len; i += 2) {
+            const __m128d values = _mm_setr_pd(window[i].key, window[i+1].key);
+            const __m128d equal = _mm_cmplt_pd(_mm_andnot_pd(sign, _mm_sub_pd(values, keys)), epsilon);
+            const __m128d less = upper ? _mm_cmplt_pd(keys, values) : _mm_cmplt_pd(values, keys);
+            hits = _mm_add_epi64(hits, _mm_castpd_si128(_mm_andnot_pd(equal, less)));
+        }
+        const int found = -sumLanes64(hits);
+        count = upper ? i - found : found;
+#endif
+        for(; i < len; i ++) {
+            count += upper ? !keyLess(key, window[i].key) : keyLess(window[i].key, key);
+        }
+        return base + count;
+    }
+
+#if defined(__SSE2__)
+    static int sumLanes(const __m128i lanes) {
+        const __m128i pairs = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtsi128_si32(_mm_add_epi32(pairs, _mm_shuffle_epi32(pairs, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+
+    static int sumLanes64(const __m128i lanes) {
+        return _mm_cvtsi128_si32(_mm_add_epi64(lanes, _mm_unpackhi_epi64(lanes, lanes)));
+    }
+#endif
+};
+
+#if NODE_SEARCH == NODE_SEARCH_LINEAR
+typedef LinearNodeSearch NodeSearch;
+#elif NODE_SEARCH == NODE_SEARCH_BINARY
+typedef BinaryNodeSearch NodeSearch;
+#else
+typedef SimdNodeSearch NodeSearch;
+#endif
+
+}
@@ -44,11 +44,14 @@ RecordId Page::insertRecord(const std::string& record_data) {
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  return getRecordView(record_id).toString();
+}
+
+RecordView Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-	return retStr;
+  const RecordView view = {&data_[slot.item_offset], slot.item_length};
+  return view;
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -99,10 +102,9 @@ void Page::deleteRecord(const RecordId& record_id,
   }
   // If we have data to move, shift it to the right.
   if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+    // Regions may overlap, so memmove rather than memcpy.
+    memmove(&data_[move_offset + slot->item_length], &data_[move_offset],
+            move_bytes);
 
     //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
   }
@@ -93,6 +93,33 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Read-only handle to the bytes of a record stored on a page.
+ *
+ * A RecordView points directly into the data area of the page it was taken
+ * from, so no bytes are copied.  It is only valid while that page stays in
+ * memory (for buffer pool pages: while the page is pinned) and while the record
+ * is not updated or deleted.
+ */
+struct RecordView {
+  /**
+   * First byte of the record.
+   */
+  const char* data;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::uint16_t length;
+
+  /**
+   * Returns a copy of the record bytes.
+   *
+   * @return  The record.
+   */
+  std::string toString() const { return std::string(data, length); }
+};
+
 class PageIterator;
 
 /**
@@ -143,14 +170,25 @@ class Page {
 
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
-   * stored on the page; use updateRecord to change it.
+   * stored on the page; use updateRecord to change it.  Convenience wrapper
+   * around getRecordView.
    *
    * @see updateRecord
+   * @see getRecordView
    * @param record_id  ID of the record to return.
    * @return  The record.
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns a view of the record with the given ID without copying it.  The
+   * view points into this page and is invalidated by any change to the page.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record bytes.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -0,0 +1,250 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+
+/**
+ * Posting lists: the record ids of one key, in (page, slot) order. A leaf entry of the
+ * B+-tree is a key and the value bytes of its posting list, which are either
+ *     inline     varint(count << 1), then the record ids, each as a varint of its
+ *                difference from the one before (the first from 0)
+ *     overflow   the byte 1, then count, head and tail as raw 32 bit words: the
+ *                record ids are in a chain of PostingPages from head to tail
+ * A record id is coded as page_number << 16 | slot_number, so the differences of
+ * records on one page take a byte and the step to the next page three.
+ */
+
+namespace badgerdb
+{
+
+/**
+ * @brief Coding of posting lists and of the values of leaf entries.
+ */
+struct PostingList {
+    /**
+     * Most bytes of an inline list. A list that would grow past this spills to
+     * overflow pages, so that any two leaf entries fit in half a page.
+     */
+    static const int MAX_INLINE = 1024;
+
+    /**
+     * An overflow list that shrinks to one page of at most this many bytes is taken
+     * back into its leaf
+     */
+    static const int UNSPILL_BYTES = MAX_INLINE / 2;
+
+    /**
+     * Bytes of the value of an overflow list
+     */
+    static const int OVERFLOW_BYTES = 1 + 3 * sizeof(std::uint32_t);
+
+    /**
+     * @brief Where an overflow list lies.
+     */
+    struct Overflow {
+        std::uint32_t count;
+        PageId headPageNo;
+        PageId tailPageNo;
+    };
+
+    static std::uint64_t code(const RecordId& rid) {
+        return ((std::uint64_t)rid.page_number << 16) | rid.slot_number;
+    }
+
+    static RecordId rid(const std::uint64_t code) {
+        RecordId rid;
+        rid.page_number = (PageId)(code >> 16);
+        rid.slot_number = (SlotId)(code & 0xffff);
+        return rid;
+    }
+
+    static int varintLength(std::uint64_t v) {
+        int n = 1;
+        while(v >= 0x80) {
+            v >>= 7;
+            n ++;
+        }
+        return n;
+    }
+
+    static int putVarint(char* dst, std::uint64_t v) {
+        int n = 0;
+        while(v >= 0x80) {
+            dst[n ++] = (char)(v | 0x80);
+            v >>= 7;
+        }
+        dst[n ++] = (char)v;
+        return n;
+    }
+
+    static std::uint64_t getVarint(const char*& src) {
+        std::uint64_t v = 0;
+        int shift = 0;
+        while(*src & 0x80) {
+            v |= (std::uint64_t)(*src ++ & 0x7f) << shift;
+            shift += 7;
+        }
+        v |= (std::uint64_t)(std::uint8_t)(*src ++) << shift;
+        return v;
+    }
+
+    static bool isOverflow(const char* value) {
+        return value[0] == 1;
+    }
+
+    static Overflow overflow(const char* value) {
+        Overflow o;
+        memcpy(&o, value + 1, sizeof(o));
+        return o;
+    }
+
+    static int putOverflow(char* dst, const Overflow& o) {
+        dst[0] = 1;
+        memcpy(dst + 1, &o, sizeof(o));
+        return OVERFLOW_BYTES;
+    }
+
+    /**
+     * Number of record ids of a list
+     */
+    static std::uint32_t count(const char* value) {
+        if(isOverflow(value)) {
+            return overflow(value).count;
+        }
+        return (std::uint32_t)(getVarint(value) >> 1);
+    }
+
+    /**
+     * Bytes of the inline list of codes
+     */
+    static int inlineLength(const std::uint64_t* codes, const int n) {
+        int length = varintLength((std::uint64_t)n << 1);
+        std::uint64_t previous = 0;
+        for(int i = 0; i < n; i ++) {
+            length += varintLength(codes[i] - previous);
+            previous = codes[i];
+        }
+        return length;
+    }
+
+    /**
+     * Writes the inline list of codes, which are in order, to dst. Returns its length
+     */
+    static int putInline(char* dst, const std::uint64_t* codes, const int n) {
+        int length = putVarint(dst, (std::uint64_t)n << 1);
+        std::uint64_t previous = 0;
+        for(int i = 0; i < n; i ++) {
+            length += putVarint(dst + length, codes[i] - previous);
+            previous = codes[i];
+        }
+        return length;
+    }
+
+    /**
+     * Appends the codes of an inline list to codes
+     */
+    static void getInline(const char* value, std::vector<std::uint64_t>& codes) {
+        const int n = (int)(getVarint(value) >> 1);
+        std::uint64_t previous = 0;
+        for(int i = 0; i < n; i ++) {
+            previous += getVarint(value);
+            codes.push_back(previous);
+        }
+    }
+};
+
+/**
+ * @brief Overflow page of a posting list: count record ids, coded as in an inline list
+ * but without the count. The codes of the first and last one are kept in the clear, so
+ * that a page can be skipped or appended to without decoding it.
+ */
+struct PostingPage {
+    static const int DATA_SIZE = Page::SIZE - 4 * sizeof(std::uint32_t) - 2 * sizeof(std::uint64_t);
+
+    /**
+     * Bytes of data in use
+     */
+    std::uint32_t bytes;
+
+    std::uint32_t count;
+
+    /**
+     * Next page of the list, 0 on its tail
+     */
+    PageId nextPageNo;
+
+    std::uint32_t unused;
+
+    std::uint64_t first;
+    std::uint64_t last;
+
+    char data[DATA_SIZE];
+
+    void init() {
+        bytes = count = 0;
+        nextPageNo = 0;
+        unused = 0;
+        first = last = 0;
+    }
+
+    /**
+     * Appends code, which is not less than the last one. Returns false, changing
+     * nothing, if the page is full
+     */
+    bool append(const std::uint64_t code) {
+        const std::uint64_t delta = code - (count == 0 ? 0 : last);
+        if((int)bytes + PostingList::varintLength(delta) > DATA_SIZE) {
+            return false;
+        }
+        bytes += PostingList::putVarint(data + bytes, delta);
+        if(count ++ == 0) {
+            first = code;
+        }
+        last = code;
+        return true;
+    }
+
+    /**
+     * Appends the codes of the page to codes
+     */
+    void get(std::vector<std::uint64_t>& codes) const {
+        const char* src = data;
+        std::uint64_t previous = 0;
+        for(std::uint32_t i = 0; i < count; i ++) {
+            previous += PostingList::getVarint(src);
+            codes.push_back(previous);
+        }
+    }
+
+    /**
+     * Bytes the codes take on a page
+     */
+    static int length(const std::uint64_t* codes, const int n) {
+        return PostingList::inlineLength(codes, n) - PostingList::varintLength((std::uint64_t)n << 1);
+    }
+
+    /**
+     * Refills the page with codes, which must fit
+     */
+    void put(const std::uint64_t* codes, const int n) {
+        bytes = count = 0;
+        for(int i = 0; i < n; i ++) {
+            append(codes[i]);
+        }
+    }
+};
+
+static_assert(sizeof(PostingPage) == Page::SIZE, "a posting page fills a page");
+
+}